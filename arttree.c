@@ -0,0 +1,902 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "arttree.h"
+#include "keyidx.h"
+
+#define ART_IS_LEAF(x)		(((uintptr_t)(x) & 1))
+#define ART_SET_LEAF(x)		((ArtNode *)((uintptr_t)(x) | 1))
+#define ART_LEAF_RAW(x)		((ArtLeaf *)((uintptr_t)(x) & ~(uintptr_t)1))
+
+#define ART_MIN(a, b)		(((a) < (b)) ? (a) : (b))
+
+/*
+ * Function _artIntKey is private to this file.
+ * Turns an integer key into the tree's byte key, most significant byte
+ * first so the tree is in numeric order.  All keys are 8 bytes, none is
+ * a prefix of another.
+ */
+static int _artIntKey(uint64_t key, unsigned char *buf) {
+	int i;
+
+	for (i = 7; i >= 0; i--) {
+		buf[i] = key & 0xff;
+		key >>= 8;
+	}
+
+	return 8;
+}
+
+/*
+ * Function _artPackKey is private to this file.
+ * _artKey() of a tree that packs stride digits into each byte, two hex
+ * digits fill one.  The key starts with its length in 2 bytes instead of
+ * ending in a 0 byte, every byte value is a digit run, so keys with the
+ * same start have the same length and none is a prefix of another.  The
+ * last byte of a key whose length is not a multiple of the stride holds
+ * the digits that are left.
+ */
+static int _artPackKey(ArtTree *trie, const unsigned char *map, char *key, int len, unsigned char *buf) {
+	int radix = (trie->dbType == HEX_DB) ? 16 : 8;
+	int i, j, n = 2;
+	int b;
+
+	buf[0] = len >> 8;
+	buf[1] = len & 0xff;
+
+	for (i = 0; i < len; n++) {
+		for (b = 0, j = 0; j < trie->stride && i < len; j++, i++)
+			b = b * radix + map[(unsigned char)key[i]];
+		buf[n] = b;
+	}
+
+	return n;
+}
+
+/*
+ * Function _artKey is private to this file.
+ * Turns key into the tree's byte key.  Each character becomes its child
+ * index + 1 for the database type and a 0 byte ends the key, so no key
+ * is a prefix of another.  A tree of integer keys takes the number the
+ * digits hold.  Returns the key length or -1 on a bad key.
+ */
+static int _artKey(ArtTree *trie, char *key, unsigned char *buf) {
+	const unsigned char *map = keyIdxMap[trie->dbType];
+	uint64_t val;
+	int len, i;
+
+	if (trie->intKeys)
+		return (keyToInt(key, &val) == 0) ? _artIntKey(val, buf) : -1;
+
+	len = keyCheck(trie->dbType, key);
+	if (len < 0 || len >= ART_MAX_KEY)
+		return -1;
+
+	if (trie->stride > 1)
+		return _artPackKey(trie, map, key, len, buf);
+
+	for (i = 0; i < len; i++)
+		buf[i] = map[(unsigned char)key[i]] + 1;
+
+	buf[i++] = 0;
+
+	return i;
+}
+
+static size_t _artNodeSize(int type) {
+
+	switch (type) {
+		case ART_NODE4:
+			return sizeof(ArtNode4);
+		case ART_NODE16:
+			return sizeof(ArtNode16);
+		case ART_NODE48:
+			return sizeof(ArtNode48);
+		default:
+			return sizeof(ArtNode256);
+	}
+}
+
+static ArtNode *_artNewNode(ArtTree *trie, int type) {
+	ArtNode *n = (ArtNode *)mpAlloc(trie->pool, _artNodeSize(type));
+
+	if (n != NULL)
+		n->type = type;
+
+	return n;
+}
+
+static void _artFreeNode(ArtTree *trie, ArtNode *n) {
+
+	mpFree(trie->pool, n, _artNodeSize(n->type));
+}
+
+/*
+ * Function _artCopyHeader is private to this file.
+ * Used when a node is replaced by a node of another size.
+ */
+static void _artCopyHeader(ArtNode *dst, ArtNode *src) {
+
+	dst->numChild = src->numChild;
+	dst->prefixLen = src->prefixLen;
+	memcpy(dst->prefix, src->prefix, ART_MIN(src->prefixLen, ART_MAX_PREFIX));
+}
+
+static ArtLeaf *_artNewLeaf(ArtTree *trie, unsigned char *key, int keyLen) {
+	ArtLeaf *l = (ArtLeaf *)mpAlloc(trie->pool, sizeof(ArtLeaf) + keyLen);
+
+	if (l == NULL)
+		return NULL;
+
+	l->keyLen = keyLen;
+	memcpy(l->key, key, keyLen);
+
+	return l;
+}
+
+static void _artFreeLeaf(ArtTree *trie, ArtLeaf *l) {
+
+	mpFree(trie->pool, l, sizeof(ArtLeaf) + l->keyLen);
+}
+
+static inline int _artLeafMatches(ArtLeaf *l, unsigned char *key, int keyLen) {
+
+	if (l->keyLen != (unsigned int)keyLen)
+		return 0;
+
+	return memcmp(l->key, key, keyLen) == 0;
+}
+
+/*
+ * Function _artFindChild is private to this file.
+ * Returns the address of the child slot for byte c or NULL.
+ */
+static ArtNode **_artFindChild(ArtNode *n, unsigned char c) {
+	int i;
+
+	switch (n->type) {
+		case ART_NODE4: {
+			ArtNode4 *p = (ArtNode4 *)n;
+
+			for (i = 0; i < n->numChild; i++) {
+				if (p->keys[i] == c)
+					return &p->child[i];
+			}
+			break;
+		}
+		case ART_NODE16: {
+			ArtNode16 *p = (ArtNode16 *)n;
+			int bits;
+#ifdef __SSE2__
+			// Compare all 16 keys at once.
+			__m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)c),
+					_mm_loadu_si128((__m128i *)p->keys));
+
+			bits = _mm_movemask_epi8(cmp) & ((1 << n->numChild) - 1);
+#else
+			bits = 0;
+			for (i = 0; i < n->numChild; i++) {
+				if (p->keys[i] == c)
+					bits |= 1 << i;
+			}
+#endif
+			if (bits)
+				return &p->child[__builtin_ctz(bits)];
+			break;
+		}
+		case ART_NODE48: {
+			ArtNode48 *p = (ArtNode48 *)n;
+
+			i = p->keys[c];
+			if (i)
+				return &p->child[i - 1];
+			break;
+		}
+		case ART_NODE256: {
+			ArtNode256 *p = (ArtNode256 *)n;
+
+			if (p->child[c] != NULL)
+				return &p->child[c];
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Function _artMinimum is private to this file.
+ * Returns the left most leaf under n.
+ */
+static ArtLeaf *_artMinimum(ArtNode *n) {
+	int i;
+
+	while (n != NULL && !ART_IS_LEAF(n)) {
+		switch (n->type) {
+			case ART_NODE4:
+				n = ((ArtNode4 *)n)->child[0];
+				break;
+			case ART_NODE16:
+				n = ((ArtNode16 *)n)->child[0];
+				break;
+			case ART_NODE48:
+				for (i = 0; ((ArtNode48 *)n)->keys[i] == 0; i++)
+					;
+				n = ((ArtNode48 *)n)->child[((ArtNode48 *)n)->keys[i] - 1];
+				break;
+			default:
+				for (i = 0; ((ArtNode256 *)n)->child[i] == NULL; i++)
+					;
+				n = ((ArtNode256 *)n)->child[i];
+				break;
+		}
+	}
+
+	return (n == NULL) ? NULL : ART_LEAF_RAW(n);
+}
+
+/*
+ * Function _artCheckPrefix is private to this file.
+ * Returns the number of prefix bytes stored in n that match key.
+ */
+static int _artCheckPrefix(ArtNode *n, unsigned char *key, int keyLen, int depth) {
+	int max = ART_MIN(ART_MIN((int)n->prefixLen, ART_MAX_PREFIX), keyLen - depth);
+	int i;
+
+	for (i = 0; i < max; i++) {
+		if (n->prefix[i] != key[depth + i])
+			return i;
+	}
+
+	return i;
+}
+
+/*
+ * Function _artPrefixMismatch is private to this file.
+ * Like _artCheckPrefix but looks at a leaf when the prefix is longer
+ * than what the node keeps.
+ */
+static int _artPrefixMismatch(ArtNode *n, unsigned char *key, int keyLen, int depth) {
+	int max = ART_MIN(ART_MIN((int)n->prefixLen, ART_MAX_PREFIX), keyLen - depth);
+	int i;
+
+	for (i = 0; i < max; i++) {
+		if (n->prefix[i] != key[depth + i])
+			return i;
+	}
+
+	if (n->prefixLen > ART_MAX_PREFIX) {
+		ArtLeaf *l = _artMinimum(n);
+
+		max = ART_MIN((int)l->keyLen, keyLen) - depth;
+		for (; i < max; i++) {
+			if (l->key[depth + i] != key[depth + i])
+				return i;
+		}
+	}
+
+	return i;
+}
+
+/*
+ * Functions _artAddChildN are private to this file.
+ * ref is the slot holding n, it is updated when n grows into a bigger node.
+ */
+static int _artAddChild256(ArtNode256 *n, unsigned char c, ArtNode *child) {
+
+	n->n.numChild++;
+	n->child[c] = child;
+
+	return 0;
+}
+
+static int _artAddChild48(ArtTree *trie, ArtNode48 *n, ArtNode **ref, unsigned char c, ArtNode *child) {
+	int i;
+
+	if (n->n.numChild < 48) {
+		for (i = 0; n->child[i] != NULL; i++)
+			;
+		n->child[i] = child;
+		n->keys[c] = i + 1;
+		n->n.numChild++;
+		return 0;
+	}
+
+	ArtNode256 *nn = (ArtNode256 *)_artNewNode(trie, ART_NODE256);
+	if (nn == NULL)
+		return -1;
+
+	for (i = 0; i < 256; i++) {
+		if (n->keys[i])
+			nn->child[i] = n->child[n->keys[i] - 1];
+	}
+	_artCopyHeader(&nn->n, &n->n);
+	*ref = &nn->n;
+	_artFreeNode(trie, &n->n);
+
+	return _artAddChild256(nn, c, child);
+}
+
+static int _artAddChild16(ArtTree *trie, ArtNode16 *n, ArtNode **ref, unsigned char c, ArtNode *child) {
+	int i;
+
+	if (n->n.numChild < 16) {
+		for (i = n->n.numChild; i > 0 && n->keys[i - 1] > c; i--) {
+			n->keys[i] = n->keys[i - 1];
+			n->child[i] = n->child[i - 1];
+		}
+		n->keys[i] = c;
+		n->child[i] = child;
+		n->n.numChild++;
+		return 0;
+	}
+
+	ArtNode48 *nn = (ArtNode48 *)_artNewNode(trie, ART_NODE48);
+	if (nn == NULL)
+		return -1;
+
+	memcpy(nn->child, n->child, n->n.numChild * sizeof(ArtNode *));
+	for (i = 0; i < n->n.numChild; i++)
+		nn->keys[n->keys[i]] = i + 1;
+	_artCopyHeader(&nn->n, &n->n);
+	*ref = &nn->n;
+	_artFreeNode(trie, &n->n);
+
+	return _artAddChild48(trie, nn, ref, c, child);
+}
+
+static int _artAddChild4(ArtTree *trie, ArtNode4 *n, ArtNode **ref, unsigned char c, ArtNode *child) {
+	int i;
+
+	if (n->n.numChild < 4) {
+		for (i = n->n.numChild; i > 0 && n->keys[i - 1] > c; i--) {
+			n->keys[i] = n->keys[i - 1];
+			n->child[i] = n->child[i - 1];
+		}
+		n->keys[i] = c;
+		n->child[i] = child;
+		n->n.numChild++;
+		return 0;
+	}
+
+	ArtNode16 *nn = (ArtNode16 *)_artNewNode(trie, ART_NODE16);
+	if (nn == NULL)
+		return -1;
+
+	memcpy(nn->child, n->child, n->n.numChild * sizeof(ArtNode *));
+	memcpy(nn->keys, n->keys, n->n.numChild);
+	_artCopyHeader(&nn->n, &n->n);
+	*ref = &nn->n;
+	_artFreeNode(trie, &n->n);
+
+	return _artAddChild16(trie, nn, ref, c, child);
+}
+
+static int _artAddChild(ArtTree *trie, ArtNode *n, ArtNode **ref, unsigned char c, ArtNode *child) {
+
+	switch (n->type) {
+		case ART_NODE4:
+			return _artAddChild4(trie, (ArtNode4 *)n, ref, c, child);
+		case ART_NODE16:
+			return _artAddChild16(trie, (ArtNode16 *)n, ref, c, child);
+		case ART_NODE48:
+			return _artAddChild48(trie, (ArtNode48 *)n, ref, c, child);
+		default:
+			return _artAddChild256((ArtNode256 *)n, c, child);
+	}
+}
+
+/*
+ * Functions _artRemoveChildN are private to this file.
+ * Nodes shrink to the next smaller type when they get sparse, the
+ * thresholds are below the grow points so a node does not flip back and
+ * forth on one key.
+ */
+static void _artRemoveChild256(ArtTree *trie, ArtNode256 *n, ArtNode **ref, unsigned char c) {
+	int i, pos = 0;
+
+	n->child[c] = NULL;
+	n->n.numChild--;
+
+	if (n->n.numChild != 37)
+		return;
+
+	ArtNode48 *nn = (ArtNode48 *)_artNewNode(trie, ART_NODE48);
+	if (nn == NULL)
+		return;			// Stay a big node, it is still correct.
+
+	_artCopyHeader(&nn->n, &n->n);
+	for (i = 0; i < 256; i++) {
+		if (n->child[i] != NULL) {
+			nn->child[pos] = n->child[i];
+			nn->keys[i] = pos + 1;
+			pos++;
+		}
+	}
+	*ref = &nn->n;
+	_artFreeNode(trie, &n->n);
+}
+
+static void _artRemoveChild48(ArtTree *trie, ArtNode48 *n, ArtNode **ref, unsigned char c) {
+	int i, pos = n->keys[c];
+
+	n->keys[c] = 0;
+	n->child[pos - 1] = NULL;
+	n->n.numChild--;
+
+	if (n->n.numChild != 12)
+		return;
+
+	ArtNode16 *nn = (ArtNode16 *)_artNewNode(trie, ART_NODE16);
+	if (nn == NULL)
+		return;
+
+	_artCopyHeader(&nn->n, &n->n);
+	pos = 0;
+	for (i = 0; i < 256; i++) {
+		if (n->keys[i]) {
+			nn->keys[pos] = i;
+			nn->child[pos] = n->child[n->keys[i] - 1];
+			pos++;
+		}
+	}
+	*ref = &nn->n;
+	_artFreeNode(trie, &n->n);
+}
+
+static void _artRemoveChild16(ArtTree *trie, ArtNode16 *n, ArtNode **ref, ArtNode **slot) {
+	int pos = slot - n->child;
+	int cnt = n->n.numChild - 1 - pos;
+
+	memmove(&n->keys[pos], &n->keys[pos + 1], cnt);
+	memmove(&n->child[pos], &n->child[pos + 1], cnt * sizeof(ArtNode *));
+	n->n.numChild--;
+
+	if (n->n.numChild != 3)
+		return;
+
+	ArtNode4 *nn = (ArtNode4 *)_artNewNode(trie, ART_NODE4);
+	if (nn == NULL)
+		return;
+
+	_artCopyHeader(&nn->n, &n->n);
+	memcpy(nn->keys, n->keys, 3);
+	memcpy(nn->child, n->child, 3 * sizeof(ArtNode *));
+	*ref = &nn->n;
+	_artFreeNode(trie, &n->n);
+}
+
+static void _artRemoveChild4(ArtTree *trie, ArtNode4 *n, ArtNode **ref, ArtNode **slot) {
+	int pos = slot - n->child;
+	int cnt = n->n.numChild - 1 - pos;
+
+	memmove(&n->keys[pos], &n->keys[pos + 1], cnt);
+	memmove(&n->child[pos], &n->child[pos + 1], cnt * sizeof(ArtNode *));
+	n->n.numChild--;
+
+	if (n->n.numChild != 1)
+		return;
+
+	// A single child is pulled up in place of this node.
+	ArtNode *child = n->child[0];
+
+	if (!ART_IS_LEAF(child)) {
+		int prefix = n->n.prefixLen;
+
+		// Path becomes this prefix, the child's key byte and the child's prefix.
+		if (prefix < ART_MAX_PREFIX) {
+			n->n.prefix[prefix] = n->keys[0];
+			prefix++;
+		}
+		if (prefix < ART_MAX_PREFIX) {
+			int sub = ART_MIN((int)child->prefixLen, ART_MAX_PREFIX - prefix);
+
+			memcpy(n->n.prefix + prefix, child->prefix, sub);
+			prefix += sub;
+		}
+		memcpy(child->prefix, n->n.prefix, ART_MIN(prefix, ART_MAX_PREFIX));
+		child->prefixLen += n->n.prefixLen + 1;
+	}
+
+	*ref = child;
+	_artFreeNode(trie, &n->n);
+}
+
+static void _artRemoveChild(ArtTree *trie, ArtNode *n, ArtNode **ref, unsigned char c, ArtNode **slot) {
+
+	switch (n->type) {
+		case ART_NODE4:
+			_artRemoveChild4(trie, (ArtNode4 *)n, ref, slot);
+			break;
+		case ART_NODE16:
+			_artRemoveChild16(trie, (ArtNode16 *)n, ref, slot);
+			break;
+		case ART_NODE48:
+			_artRemoveChild48(trie, (ArtNode48 *)n, ref, c);
+			break;
+		default:
+			_artRemoveChild256(trie, (ArtNode256 *)n, ref, c);
+			break;
+	}
+}
+
+/*
+ * Function _artInsert is private to this file.
+ * Returns the leaf for key, adding it if needed.  isNew is set when the
+ * leaf was added.
+ */
+static ArtLeaf *_artInsert(ArtTree *trie, ArtNode *n, ArtNode **ref,
+		unsigned char *key, int keyLen, int depth, int *isNew) {
+	ArtLeaf *l;
+	ArtNode4 *nn;
+	int i;
+
+	for (;;) {
+		if (n == NULL) {
+			l = _artNewLeaf(trie, key, keyLen);
+			if (l == NULL)
+				return NULL;
+			*ref = ART_SET_LEAF(l);
+			*isNew = 1;
+			return l;
+		}
+
+		if (ART_IS_LEAF(n)) {
+			ArtLeaf *old = ART_LEAF_RAW(n);
+
+			if (_artLeafMatches(old, key, keyLen))
+				return old;
+
+			// Two leaves, put a Node4 over them holding their common path.
+			nn = (ArtNode4 *)_artNewNode(trie, ART_NODE4);
+			if (nn == NULL)
+				return NULL;
+			l = _artNewLeaf(trie, key, keyLen);
+			if (l == NULL) {
+				_artFreeNode(trie, &nn->n);
+				return NULL;
+			}
+
+			for (i = depth; i < keyLen && old->key[i] == key[i]; i++)
+				;
+			i -= depth;
+			nn->n.prefixLen = i;
+			memcpy(nn->n.prefix, key + depth, ART_MIN(i, ART_MAX_PREFIX));
+
+			_artAddChild4(trie, nn, ref, old->key[depth + i], n);
+			_artAddChild4(trie, nn, ref, key[depth + i], ART_SET_LEAF(l));
+			*ref = &nn->n;
+			*isNew = 1;
+			return l;
+		}
+
+		if (n->prefixLen) {
+			int diff = _artPrefixMismatch(n, key, keyLen, depth);
+
+			if (diff < (int)n->prefixLen) {
+				// Key leaves the compressed path, split it with a Node4.
+				nn = (ArtNode4 *)_artNewNode(trie, ART_NODE4);
+				if (nn == NULL)
+					return NULL;
+				l = _artNewLeaf(trie, key, keyLen);
+				if (l == NULL) {
+					_artFreeNode(trie, &nn->n);
+					return NULL;
+				}
+
+				nn->n.prefixLen = diff;
+				memcpy(nn->n.prefix, n->prefix, ART_MIN(diff, ART_MAX_PREFIX));
+
+				if (n->prefixLen <= ART_MAX_PREFIX) {
+					_artAddChild4(trie, nn, ref, n->prefix[diff], n);
+					n->prefixLen -= diff + 1;
+					memmove(n->prefix, n->prefix + diff + 1, ART_MIN((int)n->prefixLen, ART_MAX_PREFIX));
+				} else {
+					ArtLeaf *min = _artMinimum(n);
+
+					n->prefixLen -= diff + 1;
+					_artAddChild4(trie, nn, ref, min->key[depth + diff], n);
+					memcpy(n->prefix, min->key + depth + diff + 1, ART_MIN((int)n->prefixLen, ART_MAX_PREFIX));
+				}
+
+				_artAddChild4(trie, nn, ref, key[depth + diff], ART_SET_LEAF(l));
+				*ref = &nn->n;
+				*isNew = 1;
+				return l;
+			}
+
+			depth += n->prefixLen;
+		}
+
+		ArtNode **child = _artFindChild(n, key[depth]);
+
+		if (child == NULL) {
+			l = _artNewLeaf(trie, key, keyLen);
+			if (l == NULL)
+				return NULL;
+			if (_artAddChild(trie, n, ref, key[depth], ART_SET_LEAF(l)) != 0) {
+				_artFreeLeaf(trie, l);
+				return NULL;
+			}
+			*isNew = 1;
+			return l;
+		}
+
+		ref = child;
+		n = *child;
+		depth++;
+	}
+}
+
+/*
+ * Function _artSearch is private to this file.
+ */
+static ArtLeaf *_artSearch(ArtTree *trie, unsigned char *key, int keyLen) {
+	ArtNode *n = trie->root;
+	ArtNode **child;
+	int depth = 0;
+
+	while (n != NULL) {
+		if (ART_IS_LEAF(n)) {
+			ArtLeaf *l = ART_LEAF_RAW(n);
+
+			// Paths are only checked optimistically, compare the whole key.
+			return _artLeafMatches(l, key, keyLen) ? l : NULL;
+		}
+
+		if (n->prefixLen) {
+			if (_artCheckPrefix(n, key, keyLen, depth) != ART_MIN((int)n->prefixLen, ART_MAX_PREFIX))
+				return NULL;
+			depth += n->prefixLen;
+		}
+
+		if (depth >= keyLen)
+			return NULL;
+
+		child = _artFindChild(n, key[depth]);
+		n = (child != NULL) ? *child : NULL;
+		depth++;
+	}
+
+	return NULL;
+}
+
+/*
+ * Function _artDelete is private to this file.
+ * Unlinks the leaf for key and returns it, or NULL if not found.
+ */
+static ArtLeaf *_artDelete(ArtTree *trie, ArtNode *n, ArtNode **ref,
+		unsigned char *key, int keyLen, int depth) {
+	ArtNode **child;
+	ArtLeaf *l;
+
+	for (;;) {
+		if (n == NULL)
+			return NULL;
+
+		if (ART_IS_LEAF(n)) {
+			// Only the root can be a lone leaf.
+			l = ART_LEAF_RAW(n);
+			if (!_artLeafMatches(l, key, keyLen))
+				return NULL;
+			*ref = NULL;
+			return l;
+		}
+
+		if (n->prefixLen) {
+			if (_artCheckPrefix(n, key, keyLen, depth) != ART_MIN((int)n->prefixLen, ART_MAX_PREFIX))
+				return NULL;
+			depth += n->prefixLen;
+		}
+
+		if (depth >= keyLen)
+			return NULL;
+
+		child = _artFindChild(n, key[depth]);
+		if (child == NULL)
+			return NULL;
+
+		if (ART_IS_LEAF(*child)) {
+			l = ART_LEAF_RAW(*child);
+			if (!_artLeafMatches(l, key, keyLen))
+				return NULL;
+			_artRemoveChild(trie, n, ref, key[depth], child);
+			return l;
+		}
+
+		ref = child;
+		n = *child;
+		depth++;
+	}
+}
+
+ArtTree *artInit(MemPool_t *pool, DbTypes_t dbType) {
+
+	ArtTree *artRoot = (ArtTree *) calloc(1, sizeof(ArtTree));
+	if (artRoot == NULL)
+		return NULL;
+	artRoot->root = NULL;
+	artRoot->dbType = dbType;
+	artRoot->pool = pool;
+
+	// Each node type gets its own size class in the pool.
+	mpAddClass(pool, sizeof(ArtNode4));
+	mpAddClass(pool, sizeof(ArtNode16));
+	mpAddClass(pool, sizeof(ArtNode48));
+	mpAddClass(pool, sizeof(ArtNode256));
+
+	return artRoot;
+}
+
+/*
+ * Function _artPut is private to this file.
+ * artInsert() once the key is in the tree's byte form.
+ */
+static int _artPut(ArtTree *trie, unsigned char *buf, int keyLen, void *value, int valueLen, void ***dataRef) {
+	void *data, *old;
+	int isNew = 0;
+	int ret = 0;
+	ArtLeaf *l;
+
+	/* Cannot insert NULL values */
+
+	if (value == TRIE_NULL) {
+		return ret;
+	}
+
+	l = _artInsert(trie, trie->root, &trie->root, buf, keyLen, 0, &isNew);
+	if (l == NULL)
+		return ret;
+
+	if (valueLen == MP_VAL_OWNED)
+		data = value;		// already in the pool, taken as is.
+	else
+		data = mpValInline(&l->val, value, valueLen);
+	if (data == NULL) {
+		data = mpValAlloc(trie->pool, valueLen);
+		if (data == NULL) {
+			if (isNew) {
+				_artDelete(trie, trie->root, &trie->root, buf, keyLen, 0);
+				_artFreeLeaf(trie, l);
+			}
+			return 0;
+		}
+		memcpy((char *)data, (char *)value, valueLen);
+	}
+
+	// Swap the value in whole, readers holding only the index locks see
+	// the old or the new value, never NULL for a key that stays.
+	old = AtomicFetchSet(&l->data, data);
+	if (old != NULL) {
+		mpValRetire(trie->pool, old);
+		ret = 2;
+	} else {
+		ret = 1;
+	}
+	if (dataRef != NULL)
+		*dataRef = &l->data;
+
+	return ret;
+}
+
+/*
+ * Function _artRemove is private to this file.
+ * artDelete() once the key is in the tree's byte form.
+ */
+static int _artRemove(ArtTree *trie, unsigned char *buf, int keyLen) {
+	ArtLeaf *l;
+
+	l = _artDelete(trie, trie->root, &trie->root, buf, keyLen, 0);
+	if (l == NULL)
+		return -1;		// record not found.
+
+	// Readers may still hold the value, and a short one is in the leaf.
+	if (!mpValIsInline(l->data))
+		mpValRetire(trie->pool, l->data);
+	mpRetire(trie->pool, l, sizeof(ArtLeaf) + l->keyLen);
+
+	return 0;
+}
+
+/*
+ * Function artInsert is used to insert data into the tree.
+ * dataRef - if not NULL, set to the address of the leaf's data pointer.
+ * Returns 1 if the key is new, 2 if it was updated and 0 on error.
+ */
+int artInsert(ArtTree *trie, char *key, void *value, int valueLen, void ***dataRef) {
+	unsigned char buf[ART_MAX_KEY];
+	int keyLen;
+
+	keyLen = _artKey(trie, key, buf);
+	if (keyLen < 0) {
+		pErr("ERROR: Bad key character or key too long.\n");
+		return 0;
+	}
+
+	return _artPut(trie, buf, keyLen, value, valueLen, dataRef);
+}
+
+int artDelete(ArtTree *trie, char *key) {
+	unsigned char buf[ART_MAX_KEY];
+	int keyLen;
+
+	keyLen = _artKey(trie, key, buf);
+	if (keyLen < 0)
+		return -1;
+
+	return _artRemove(trie, buf, keyLen);
+}
+
+void *artLookup(ArtTree *trie, char *key) {
+	unsigned char buf[ART_MAX_KEY];
+	int keyLen;
+	ArtLeaf *l;
+
+	keyLen = _artKey(trie, key, buf);
+	if (keyLen < 0)
+		return TRIE_NULL;
+
+	l = _artSearch(trie, buf, keyLen);
+
+	return (l != NULL) ? l->data : TRIE_NULL;
+}
+
+/*
+ * Function artInsertInt is artInsert() for a tree of integer keys, the
+ * key is used as is without going through a string.
+ */
+int artInsertInt(ArtTree *trie, uint64_t key, void *value, int valueLen, void ***dataRef) {
+	unsigned char buf[8];
+
+	return _artPut(trie, buf, _artIntKey(key, buf), value, valueLen, dataRef);
+}
+
+int artDeleteInt(ArtTree *trie, uint64_t key) {
+	unsigned char buf[8];
+
+	return _artRemove(trie, buf, _artIntKey(key, buf));
+}
+
+/*
+ * Function artLookupInt is artLookup() for a tree of integer keys.  A
+ * key is at most 8 nodes down, one per byte.
+ */
+void *artLookupInt(ArtTree *trie, uint64_t key) {
+	unsigned char buf[8];
+	ArtLeaf *l;
+
+	l = _artSearch(trie, buf, _artIntKey(key, buf));
+
+	return (l != NULL) ? l->data : TRIE_NULL;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#ifndef _ARTTREE_H_
+#define _ARTTREE_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+#include "memdbc.h"
+#include "mempool.h"
+
+#ifndef TRIE_NULL
+#define TRIE_NULL ((void *) 0)
+#endif
+
+// Adaptive Radix Tree.  Inner nodes change type as children are added
+// and removed so a node only costs what its fan out needs:
+//   ART_NODE4   - up to 4 children, sorted keys.
+//   ART_NODE16  - up to 16 children, sorted keys searched with SSE2.
+//   ART_NODE48  - 256 byte index into 48 child slots.
+//   ART_NODE256 - child pointer per byte value.
+#define ART_NODE4		1
+#define ART_NODE16		2
+#define ART_NODE48		3
+#define ART_NODE256		4
+
+// Bytes of a compressed path kept in the node, longer paths are
+// checked against a leaf.
+#define ART_MAX_PREFIX	8
+
+// Longest key the tree will take.
+#define ART_MAX_KEY		1024
+
+// Most HEX_DB or OCTAL_DB key digits packed into a key byte.
+#define ART_MAX_STRIDE	2
+
+typedef struct _artNode {
+	unsigned char type;
+	unsigned char pad;
+	unsigned short numChild;
+	unsigned int prefixLen;
+	unsigned char prefix[ART_MAX_PREFIX];
+} ArtNode;
+
+typedef struct _artNode4 {
+	ArtNode n;
+	unsigned char keys[4];
+	ArtNode *child[4];
+} ArtNode4;
+
+typedef struct _artNode16 {
+	ArtNode n;
+	unsigned char keys[16];
+	ArtNode *child[16];
+} ArtNode16;
+
+typedef struct _artNode48 {
+	ArtNode n;
+	unsigned char keys[256];		// slot + 1 of the child, 0 is empty.
+	ArtNode *child[48];
+} ArtNode48;
+
+typedef struct _artNode256 {
+	ArtNode n;
+	ArtNode *child[256];
+} ArtNode256;
+
+// Leaves hold the whole key so paths can be expanded lazily.  Pointers
+// to leaves are tagged with the low bit set.
+typedef struct _artLeaf {
+	void *data;
+	MpValSlot_t val;				// short values are kept here.
+	unsigned int keyLen;
+	unsigned char key[];
+} ArtLeaf;
+
+typedef struct _artTree {
+	ArtNode *root;
+	DbTypes_t dbType;				// key characters are checked against this.
+	int intKeys;					// keys are uint64_t, kept as 8 big endian bytes.
+	int stride;						// key digits packed into a byte, 0 or 1 for one.
+	MemPool_t *pool;				// nodes, leaves and values are allocated from here.
+} ArtTree;
+
+ArtTree *artInit(MemPool_t *pool, DbTypes_t dbType);
+int artInsert(ArtTree *trie, char *key, void *value, int valueLen, void ***dataRef);
+int artDelete(ArtTree *trie, char *key);
+void *artLookup(ArtTree *trie, char *key);
+int artInsertInt(ArtTree *trie, uint64_t key, void *value, int valueLen, void ***dataRef);
+int artDeleteInt(ArtTree *trie, uint64_t key);
+void *artLookupInt(ArtTree *trie, uint64_t key);
+
+#endif /* _ARTTREE_H_ */
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#include "bgsave.h"
+
+/*
+ * Function _bgThread is private to this file.
+ * Passes the child's progress to the callback and reaps it.
+ */
+static void *_bgThread(void *arg) {
+	BgSave_t *bg = (BgSave_t *)arg;
+	unsigned long done = 0, n;
+	ssize_t r;
+	int status;
+
+	for (;;) {
+		r = read(bg->fd, &n, sizeof(n));
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r != sizeof(n))
+			break;		// the child is gone.
+		done = n;
+		if (bg->callback != NULL)
+			bg->callback(bg->arg, SAVE_RUNNING, done, bg->total);
+	}
+	close(bg->fd);
+
+	while (waitpid(bg->pid, &status, 0) < 0 && errno == EINTR)
+		;
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		bg->state = SAVE_DONE;
+	else
+		bg->state = SAVE_FAILED;
+
+	if (bg->callback != NULL)
+		bg->callback(bg->arg, bg->state, done, bg->total);
+
+	AtomicSet(&bg->finished, 1);
+
+	return NULL;
+}
+
+/*
+ * Function bgSaveStart forks and runs fn in the child.  The caller must
+ * hold whatever locks make memory consistent, the child gets it as it
+ * is at the fork and the locks can be dropped as soon as this returns.
+ */
+BgSave_t *bgSaveStart(BgSaveFn_t fn, void *ctx, unsigned long total, MemDbcSaveFn_t callback, void *arg) {
+	BgSave_t *bg = (BgSave_t *)calloc(1, sizeof(BgSave_t));
+	int fds[2];
+
+	if (bg == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+	bg->total = total;
+	bg->callback = callback;
+	bg->arg = arg;
+	bg->state = SAVE_RUNNING;
+
+	if (pipe(fds) != 0) {
+		memDbcErrorNum = FILE_ERR;
+		free(bg);
+		return NULL;
+	}
+
+	bg->pid = fork();
+	if (bg->pid < 0) {
+		memDbcErrorNum = MALLOC_ERR;
+		close(fds[0]);
+		close(fds[1]);
+		free(bg);
+		return NULL;
+	}
+
+	if (bg->pid == 0) {
+		// Only this thread exists in the child, nothing else can change memory.
+		close(fds[0]);
+		_exit(fn(ctx, fds[1]) == 0 ? 0 : 1);
+	}
+
+	close(fds[1]);
+	bg->fd = fds[0];
+
+	if (pthread_create(&bg->thread, NULL, _bgThread, bg) != 0) {
+		// Nobody to report to, still wait for the child.
+		close(bg->fd);
+		waitpid(bg->pid, NULL, 0);
+		free(bg);
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+
+	return bg;
+}
+
+/*
+ * Function bgSaveProgress is called by the child to report the number
+ * of records written so far.
+ */
+void bgSaveProgress(int fd, unsigned long done) {
+	ssize_t r;
+
+	do {
+		r = write(fd, &done, sizeof(done));
+	} while (r < 0 && errno == EINTR);
+}
+
+/*
+ * Function bgSaveFinished returns 1 once the save has ended and its
+ * callback has been told.
+ */
+int bgSaveFinished(BgSave_t *bg) {
+
+	return AtomicGet(&bg->finished);
+}
+
+/*
+ * Function bgSaveWait waits for the save to end and frees it.
+ * Returns 0 if the file was saved or -1.
+ */
+int bgSaveWait(BgSave_t *bg) {
+	int r;
+
+	pthread_join(bg->thread, NULL);
+
+	r = (bg->state == SAVE_DONE) ? 0 : -1;
+	if (r != 0)
+		memDbcErrorNum = FILE_ERR;
+
+	free(bg);
+
+	return r;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+
+#ifndef _BGSAVE_H_
+#define _BGSAVE_H_
+
+#include <sys/types.h>
+#include <pthread.h>
+#include "memdbc.h"
+
+// Background saves.  The process is forked, the child gets a copy on
+// write view of memory as it was at the fork and saves it while the
+// parent carries on.  The child reports how many records it has written
+// down a pipe, a thread in the parent reads them and calls the user's
+// callback.
+
+// Records the child writes between progress reports.
+#define BG_PROGRESS		65536
+
+// Runs in the child, returns 0 or -1.
+typedef int (*BgSaveFn_t)(void *ctx, int progressFd);
+
+typedef struct _bgSave {
+	pid_t pid;
+	int fd;						// read end of the progress pipe.
+	pthread_t thread;
+	unsigned long total;
+	MemDbcSaveFn_t callback;
+	void *arg;
+	int finished;
+	MemDbcSaveState_t state;
+} BgSave_t;
+
+BgSave_t *bgSaveStart(BgSaveFn_t fn, void *ctx, unsigned long total, MemDbcSaveFn_t callback, void *arg);
+void bgSaveProgress(int fd, unsigned long done);
+int bgSaveFinished(BgSave_t *bg);
+int bgSaveWait(BgSave_t *bg);
+
+#endif /* _BGSAVE_H_ */
@@ -0,0 +1,898 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memdbc.h"
+#include "bptree.h"
+
+/*
+ * Function _bptPrefix is private to this file.
+ * Packs the first 8 bytes of key big endian so integer order matches strcmp().
+ */
+static inline unsigned long long _bptPrefix(const char *key) {
+	unsigned long long pfx = 0;
+	int i;
+
+	for (i = 0; i < 8 && key[i] != '\0'; i++)
+		pfx |= (unsigned long long)(unsigned char)key[i] << (56 - (i * 8));
+
+	return pfx;
+}
+
+/*
+ * Function _bptCmp is private to this file.
+ * Compares key against entry i of node, same return as strcmp().
+ */
+static inline int _bptCmp(const char *key, unsigned long long pfx, BptNode_t *node, int i) {
+
+	if (pfx < node->pfx[i])
+		return -1;
+	if (pfx > node->pfx[i])
+		return 1;
+
+	// Prefix is equal, if the key ended inside the prefix both keys are equal.
+	if ((pfx & 0xff) == 0)
+		return 0;
+
+	return strcmp(key + 8, node->keys[i] + 8);
+}
+
+/*
+ * Function _bptLowerBound is private to this file.
+ * Returns index of first entry >= key, found is set if the entry is equal.
+ */
+static int _bptLowerBound(BptNode_t *node, const char *key, unsigned long long pfx, int *found) {
+	int lo = 0;
+	int hi = node->count;
+
+	*found = 0;
+
+	while (lo < hi) {
+		int mid = (lo + hi) >> 1;
+		int c = _bptCmp(key, pfx, node, mid);
+
+		if (c > 0) {
+			lo = mid + 1;
+		} else {
+			if (c == 0)
+				*found = 1;
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/*
+ * Function _bptChildIdx is private to this file.
+ * Returns the child of an inner node to follow for key.
+ */
+static inline int _bptChildIdx(BptNode_t *node, const char *key, unsigned long long pfx) {
+	int found;
+	int i = _bptLowerBound(node, key, pfx, &found);
+
+	// Separator keys are the first key of the right child.
+	return (found) ? i + 1 : i;
+}
+
+static BptNode_t *_bptNewNode(BpTree_t *tree, int isLeaf) {
+	size_t size = (isLeaf) ? sizeof(BptLeaf_t) : sizeof(BptInner_t);
+	BptNode_t *node = (BptNode_t *)calloc(1, size);
+
+	if (node != NULL) {
+		node->isLeaf = isLeaf;
+		AtomicAdd(&tree->bytes, size);
+	}
+
+	return node;
+}
+
+/*
+ * Function _bptDropNode is private to this file.
+ * Frees a node made by _bptNewNode(), not its keys.
+ */
+static void _bptDropNode(BpTree_t *tree, BptNode_t *node) {
+
+	AtomicSub(&tree->bytes, (node->isLeaf) ? sizeof(BptLeaf_t) : sizeof(BptInner_t));
+	free(node);
+}
+
+/*
+ * Function _bptDupKey is private to this file.
+ * Returns a copy of key owned by the tree or NULL.
+ */
+static char *_bptDupKey(BpTree_t *tree, const char *key) {
+	size_t len = strlen(key) + 1;
+	char *k = (char *)malloc(len);
+
+	if (k != NULL) {
+		memcpy(k, key, len);
+		AtomicAdd(&tree->bytes, len);
+	}
+
+	return k;
+}
+
+/*
+ * Function _bptDropKey is private to this file.
+ */
+static void _bptDropKey(BpTree_t *tree, char *key) {
+
+	if (key != NULL) {
+		AtomicSub(&tree->bytes, strlen(key) + 1);
+		free(key);
+	}
+}
+
+BpTree_t *bptInit() {
+
+	BpTree_t *tree = (BpTree_t *)calloc(1, sizeof(BpTree_t));
+
+	return tree;
+}
+
+/*
+ * Function bptInsert is used to add a key to the tree.
+ * Returns 1 if key was added, 0 if key existed and data was replaced,
+ * -1 if out of memory.  The tree is not changed on error.
+ */
+int bptInsert(BpTree_t *tree, char *key, void **data) {
+	BptInner_t *path[BPT_MAX_HEIGHT];
+	int pathIdx[BPT_MAX_HEIGHT];
+	BptNode_t *spare[BPT_MAX_HEIGHT + 1];
+	int numSpare = 0;
+	int depth = 0;
+	int found, i, n;
+	unsigned long long pfx = _bptPrefix(key);
+	BptNode_t *node;
+	BptLeaf_t *leaf;
+	char *k;
+	char *sep = NULL;
+
+	if (tree->root == NULL) {
+		leaf = (BptLeaf_t *)_bptNewNode(tree, 1);
+		if (leaf == NULL)
+			return -1;
+		tree->root = &leaf->hdr;
+		tree->first = leaf;
+		tree->last = leaf;
+	}
+
+	node = tree->root;
+
+	while (node->isLeaf == 0) {
+		i = _bptChildIdx(node, key, pfx);
+		path[depth] = (BptInner_t *)node;
+		pathIdx[depth] = i;
+		depth++;
+		node = ((BptInner_t *)node)->child[i];
+	}
+
+	leaf = (BptLeaf_t *)node;
+
+	i = _bptLowerBound(node, key, pfx, &found);
+
+	if (found) {
+		leaf->data[i] = data;
+		return 0;
+	}
+
+	// Allocate everything a split could need before the tree is changed,
+	// a full leaf needs a new leaf and its separator, each full parent
+	// above it needs a new inner node and a full root needs a new root.
+	if (node->count == BPT_ORDER) {
+		int mid = (BPT_ORDER + 1) / 2;
+
+		spare[numSpare] = _bptNewNode(tree, 1);
+		if (spare[numSpare++] == NULL)
+			goto nomem;
+
+		// The separator is the entry that lands at mid after the insert.
+		if (mid < i)
+			sep = _bptDupKey(tree, node->keys[mid]);
+		else if (mid == i)
+			sep = _bptDupKey(tree, key);
+		else
+			sep = _bptDupKey(tree, node->keys[mid - 1]);
+		if (sep == NULL)
+			goto nomem;
+
+		for (n = depth - 1; n >= 0 && path[n]->hdr.count == BPT_ORDER; n--) {
+			spare[numSpare] = _bptNewNode(tree, 0);
+			if (spare[numSpare++] == NULL)
+				goto nomem;
+		}
+		if (n < 0) {
+			spare[numSpare] = _bptNewNode(tree, 0);
+			if (spare[numSpare++] == NULL)
+				goto nomem;
+		}
+	}
+
+	k = _bptDupKey(tree, key);
+	if (k == NULL)
+		goto nomem;
+
+	n = node->count;
+	memmove(&node->keys[i + 1], &node->keys[i], (n - i) * sizeof(char *));
+	memmove(&node->pfx[i + 1], &node->pfx[i], (n - i) * sizeof(unsigned long long));
+	memmove(&leaf->data[i + 1], &leaf->data[i], (n - i) * sizeof(void **));
+	node->keys[i] = k;
+	node->pfx[i] = pfx;
+	leaf->data[i] = data;
+	node->count++;
+	tree->count++;
+
+	if (node->count <= BPT_ORDER)
+		return 1;
+
+	// Split the leaf, right half goes to the new leaf.
+	numSpare = 0;
+
+	BptLeaf_t *right = (BptLeaf_t *)spare[numSpare++];
+	int mid = node->count / 2;
+
+	n = node->count - mid;
+	memcpy(right->hdr.keys, &node->keys[mid], n * sizeof(char *));
+	memcpy(right->hdr.pfx, &node->pfx[mid], n * sizeof(unsigned long long));
+	memcpy(right->data, &leaf->data[mid], n * sizeof(void **));
+	right->hdr.count = n;
+	node->count = mid;
+
+	right->next = leaf->next;
+	right->prev = leaf;
+	if (leaf->next != NULL)
+		leaf->next->prev = right;
+	else
+		tree->last = right;
+	leaf->next = right;
+
+	// Push the separator up, splitting full parents as we go.
+	BptNode_t *child = &right->hdr;
+	unsigned long long sepPfx = _bptPrefix(sep);
+
+	for (depth--; depth >= 0; depth--) {
+		BptInner_t *p = path[depth];
+
+		i = pathIdx[depth];
+		n = p->hdr.count;
+		memmove(&p->hdr.keys[i + 1], &p->hdr.keys[i], (n - i) * sizeof(char *));
+		memmove(&p->hdr.pfx[i + 1], &p->hdr.pfx[i], (n - i) * sizeof(unsigned long long));
+		memmove(&p->child[i + 2], &p->child[i + 1], (n - i) * sizeof(BptNode_t *));
+		p->hdr.keys[i] = sep;
+		p->hdr.pfx[i] = sepPfx;
+		p->child[i + 1] = child;
+		p->hdr.count++;
+
+		if (p->hdr.count <= BPT_ORDER)
+			return 1;
+
+		// Split inner node, the middle key moves up to the parent.
+		BptInner_t *r = (BptInner_t *)spare[numSpare++];
+
+		mid = p->hdr.count / 2;
+		n = p->hdr.count - mid - 1;
+		memcpy(r->hdr.keys, &p->hdr.keys[mid + 1], n * sizeof(char *));
+		memcpy(r->hdr.pfx, &p->hdr.pfx[mid + 1], n * sizeof(unsigned long long));
+		memcpy(r->child, &p->child[mid + 1], (n + 1) * sizeof(BptNode_t *));
+		r->hdr.count = n;
+		sep = p->hdr.keys[mid];
+		sepPfx = p->hdr.pfx[mid];
+		p->hdr.count = mid;
+		child = &r->hdr;
+	}
+
+	// Root was split, grow the tree by one level.
+	BptInner_t *root = (BptInner_t *)spare[numSpare++];
+
+	root->hdr.keys[0] = sep;
+	root->hdr.pfx[0] = sepPfx;
+	root->child[0] = tree->root;
+	root->child[1] = child;
+	root->hdr.count = 1;
+	tree->root = &root->hdr;
+
+	return 1;
+
+nomem:
+	for (n = 0; n < numSpare; n++)
+		_bptDropNode(tree, spare[n]);
+	_bptDropKey(tree, sep);
+	memDbcErrorNum = MALLOC_ERR;
+	return -1;
+}
+
+/*
+ * Function bptAppend adds a key that sorts after every key in the tree.
+ * Used by loaders reading sorted input.  A full right most node is not
+ * split in half, a new node is started beside it, so the tree is built
+ * with packed nodes and no search.  Falls back to bptInsert() if key
+ * does not sort after the last key.
+ * Returns 1 if key was added, 0 if key existed and -1 if out of memory.
+ */
+int bptAppend(BpTree_t *tree, char *key, void **data) {
+	BptInner_t *path[BPT_MAX_HEIGHT];
+	BptNode_t *spare[BPT_MAX_HEIGHT + 1];
+	int numSpare = 0;
+	int depth = 0;
+	int n;
+	unsigned long long pfx = _bptPrefix(key);
+	BptLeaf_t *leaf = tree->last;
+	BptNode_t *node;
+	char *k = NULL;
+	char *sep = NULL;
+
+	if (leaf == NULL || leaf->hdr.count == 0 ||
+			strcmp(key, leaf->hdr.keys[leaf->hdr.count - 1]) <= 0)
+		return bptInsert(tree, key, data);
+
+	node = tree->root;
+	while (node->isLeaf == 0) {
+		path[depth++] = (BptInner_t *)node;
+		node = ((BptInner_t *)node)->child[node->count];
+	}
+
+	k = _bptDupKey(tree, key);
+	if (k == NULL)
+		goto nomem;
+
+	if (leaf->hdr.count < BPT_ORDER) {
+		n = leaf->hdr.count++;
+		leaf->hdr.keys[n] = k;
+		leaf->hdr.pfx[n] = pfx;
+		leaf->data[n] = data;
+		tree->count++;
+		return 1;
+	}
+
+	// Allocate the new leaf, a node for each full parent and maybe a new root.
+	spare[numSpare] = _bptNewNode(tree, 1);
+	if (spare[numSpare++] == NULL)
+		goto nomem;
+	sep = _bptDupKey(tree, key);
+	if (sep == NULL)
+		goto nomem;
+	for (n = depth - 1; n >= 0 && path[n]->hdr.count == BPT_ORDER; n--) {
+		spare[numSpare] = _bptNewNode(tree, 0);
+		if (spare[numSpare++] == NULL)
+			goto nomem;
+	}
+	if (n < 0) {
+		spare[numSpare] = _bptNewNode(tree, 0);
+		if (spare[numSpare++] == NULL)
+			goto nomem;
+	}
+
+	numSpare = 0;
+
+	BptLeaf_t *right = (BptLeaf_t *)spare[numSpare++];
+
+	right->hdr.keys[0] = k;
+	right->hdr.pfx[0] = pfx;
+	right->data[0] = data;
+	right->hdr.count = 1;
+	right->prev = leaf;
+	leaf->next = right;
+	tree->last = right;
+	tree->count++;
+
+	// Hang the new node off the right most parent with room, full
+	// parents get a new right most sibling holding just the child.
+	BptNode_t *child = &right->hdr;
+
+	for (depth--; depth >= 0; depth--) {
+		BptInner_t *p = path[depth];
+
+		if (p->hdr.count < BPT_ORDER) {
+			n = p->hdr.count++;
+			p->hdr.keys[n] = sep;
+			p->hdr.pfx[n] = pfx;
+			p->child[n + 1] = child;
+			return 1;
+		}
+
+		BptInner_t *r = (BptInner_t *)spare[numSpare++];
+
+		r->child[0] = child;
+		child = &r->hdr;
+	}
+
+	BptInner_t *root = (BptInner_t *)spare[numSpare++];
+
+	root->hdr.keys[0] = sep;
+	root->hdr.pfx[0] = pfx;
+	root->child[0] = tree->root;
+	root->child[1] = child;
+	root->hdr.count = 1;
+	tree->root = &root->hdr;
+
+	return 1;
+
+nomem:
+	for (n = 0; n < numSpare; n++)
+		_bptDropNode(tree, spare[n]);
+	_bptDropKey(tree, sep);
+	_bptDropKey(tree, k);
+	memDbcErrorNum = MALLOC_ERR;
+	return -1;
+}
+
+/*
+ * Function bptDelete is used to remove a key from the tree.
+ * Nodes are released when they become empty instead of being merged
+ * with a neighbour, this keeps delete simple and the height is still
+ * bounded by the largest size the tree has had.
+ * Returns 0 on success, -1 if key not found.
+ */
+int bptDelete(BpTree_t *tree, char *key) {
+	BptInner_t *path[BPT_MAX_HEIGHT];
+	int pathIdx[BPT_MAX_HEIGHT];
+	int depth = 0;
+	int found, i, n;
+	unsigned long long pfx = _bptPrefix(key);
+	BptNode_t *node = tree->root;
+	BptLeaf_t *leaf;
+
+	if (node == NULL)
+		return -1;
+
+	while (node->isLeaf == 0) {
+		i = _bptChildIdx(node, key, pfx);
+		path[depth] = (BptInner_t *)node;
+		pathIdx[depth] = i;
+		depth++;
+		node = ((BptInner_t *)node)->child[i];
+	}
+
+	leaf = (BptLeaf_t *)node;
+
+	i = _bptLowerBound(node, key, pfx, &found);
+	if (found == 0)
+		return -1;
+
+	_bptDropKey(tree, node->keys[i]);
+	n = node->count - i - 1;
+	memmove(&node->keys[i], &node->keys[i + 1], n * sizeof(char *));
+	memmove(&node->pfx[i], &node->pfx[i + 1], n * sizeof(unsigned long long));
+	memmove(&leaf->data[i], &leaf->data[i + 1], n * sizeof(void **));
+	node->count--;
+	tree->count--;
+
+	if (node->count > 0 || depth == 0)
+		return 0;
+
+	// Leaf is empty, unlink it from the leaf chain.
+	if (leaf->prev != NULL)
+		leaf->prev->next = leaf->next;
+	else
+		tree->first = leaf->next;
+	if (leaf->next != NULL)
+		leaf->next->prev = leaf->prev;
+	else
+		tree->last = leaf->prev;
+	_bptDropNode(tree, &leaf->hdr);
+
+	// Remove the child from its parent, parents left with no children
+	// are removed as well.
+	for (depth--; depth >= 0; depth--) {
+		BptInner_t *p = path[depth];
+
+		i = pathIdx[depth];
+
+		if (p->hdr.count == 0) {
+			_bptDropNode(tree, &p->hdr);
+			if (depth == 0) {
+				tree->root = NULL;
+				tree->first = NULL;
+				tree->last = NULL;
+				return 0;
+			}
+			continue;
+		}
+
+		// Drop the separator that bounds the removed child.
+		int k = (i > 0) ? i - 1 : 0;
+
+		_bptDropKey(tree, p->hdr.keys[k]);
+		n = p->hdr.count - k - 1;
+		memmove(&p->hdr.keys[k], &p->hdr.keys[k + 1], n * sizeof(char *));
+		memmove(&p->hdr.pfx[k], &p->hdr.pfx[k + 1], n * sizeof(unsigned long long));
+		n = p->hdr.count - i;
+		memmove(&p->child[i], &p->child[i + 1], n * sizeof(BptNode_t *));
+		p->hdr.count--;
+		break;
+	}
+
+	// Shrink the tree while the root has a single child.
+	while (tree->root->isLeaf == 0 && tree->root->count == 0) {
+		BptNode_t *old = tree->root;
+
+		tree->root = ((BptInner_t *)old)->child[0];
+		_bptDropNode(tree, old);
+	}
+
+	return 0;
+}
+
+/*
+ * Function bptFind returns the data reference stored for key or NULL.
+ */
+void **bptFind(BpTree_t *tree, char *key) {
+	unsigned long long pfx = _bptPrefix(key);
+	BptNode_t *node = tree->root;
+	int found, i;
+
+	if (node == NULL)
+		return NULL;
+
+	while (node->isLeaf == 0)
+		node = ((BptInner_t *)node)->child[_bptChildIdx(node, key, pfx)];
+
+	i = _bptLowerBound(node, key, pfx, &found);
+	if (found == 0)
+		return NULL;
+
+	return ((BptLeaf_t *)node)->data[i];
+}
+
+/*
+ * Function bptSeek returns the leaf holding the first key >= key and sets
+ * pos to its place in the leaf, or returns NULL if every key is less.
+ */
+BptLeaf_t *bptSeek(BpTree_t *tree, char *key, int *pos) {
+	unsigned long long pfx = _bptPrefix(key);
+	BptNode_t *node = tree->root;
+	BptLeaf_t *leaf;
+	int found;
+
+	if (node == NULL)
+		return NULL;
+
+	while (node->isLeaf == 0)
+		node = ((BptInner_t *)node)->child[_bptChildIdx(node, key, pfx)];
+
+	leaf = (BptLeaf_t *)node;
+	*pos = _bptLowerBound(node, key, pfx, &found);
+
+	// Past the end of the leaf it is the first key of the next one.
+	while (leaf != NULL && *pos >= leaf->hdr.count) {
+		leaf = leaf->next;
+		*pos = 0;
+	}
+
+	return leaf;
+}
+
+/*
+ * Function bptSample returns a key picked at random and sets data to
+ * its data reference, or returns NULL if the tree is empty.  Each level
+ * takes a random child, so keys in nodes with fewer keys come up more.
+ * seed - state of the random numbers, kept by the caller.
+ */
+char *bptSample(BpTree_t *tree, unsigned int *seed, void ***data) {
+	BptNode_t *node = tree->root;
+	int i;
+
+	if (node == NULL || tree->count == 0)
+		return NULL;
+
+	while (node->isLeaf == 0)
+		node = ((BptInner_t *)node)->child[rand_r(seed) % (node->count + 1)];
+
+	// Only an empty root leaf has no keys.
+	if (node->count == 0)
+		return NULL;
+
+	i = rand_r(seed) % node->count;
+	*data = ((BptLeaf_t *)node)->data[i];
+
+	return node->keys[i];
+}
+
+/*
+ * Function bptUpdate replaces the data reference old stored for key
+ * with data.  Returns 1 if it was replaced, else 0.
+ */
+int bptUpdate(BpTree_t *tree, char *key, void **old, void **data) {
+	unsigned long long pfx = _bptPrefix(key);
+	BptNode_t *node = tree->root;
+	int found, i;
+
+	if (node == NULL)
+		return 0;
+
+	while (node->isLeaf == 0)
+		node = ((BptInner_t *)node)->child[_bptChildIdx(node, key, pfx)];
+
+	i = _bptLowerBound(node, key, pfx, &found);
+	if (found == 1 && ((BptLeaf_t *)node)->data[i] == old) {
+		((BptLeaf_t *)node)->data[i] = data;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Function _bptFreeNode is private to this file.
+ * leafKeys - 0 to leave the keys of the leaves, they have been moved.
+ */
+static void _bptFreeNode(BpTree_t *tree, BptNode_t *node, int leafKeys) {
+	int i;
+
+	if (node->isLeaf == 0 || leafKeys) {
+		for (i = 0; i < node->count; i++)
+			_bptDropKey(tree, node->keys[i]);
+	}
+
+	if (node->isLeaf == 0) {
+		for (i = 0; i <= node->count; i++)
+			_bptFreeNode(tree, ((BptInner_t *)node)->child[i], leafKeys);
+	}
+
+	_bptDropNode(tree, node);
+}
+
+/*
+ * Function _bptBuild is private to this file.
+ * Builds an empty tree bottom up from n sorted unique keys.  Leaves are
+ * filled in order and packed, then each level of inner nodes is made
+ * over the one below it, so there is no search and no split.  The tree
+ * takes the key strings, separators are copies.
+ * Returns 0 or -1 if out of memory, the tree is left empty on error.
+ */
+static int _bptBuild(BpTree_t *tree, char **keys, void ***data, size_t n) {
+	size_t numLeaves = (n + BPT_ORDER - 1) / BPT_ORDER;
+	BptNode_t **level;
+	char **first;				// smallest key under each node of level.
+	BptLeaf_t *prev = NULL;
+	size_t bytes = tree->bytes;
+	size_t count = 0;
+	size_t next = 0;
+	size_t i = 0;
+	size_t j, k;
+
+	if (n == 0)
+		return 0;
+
+	level = (BptNode_t **)malloc(numLeaves * sizeof(BptNode_t *));
+	first = (char **)malloc(numLeaves * sizeof(char *));
+	if (level == NULL || first == NULL)
+		goto nomem;
+
+	for (i = 0; i < n; i += k) {
+		BptLeaf_t *leaf = (BptLeaf_t *)_bptNewNode(tree, 1);
+
+		if (leaf == NULL) {
+			next = count;
+			i = count;
+			goto nomem;
+		}
+		k = (n - i < BPT_ORDER) ? n - i : BPT_ORDER;
+		for (j = 0; j < k; j++) {
+			leaf->hdr.keys[j] = keys[i + j];
+			leaf->hdr.pfx[j] = _bptPrefix(keys[i + j]);
+			leaf->data[j] = data[i + j];
+			AtomicAdd(&tree->bytes, strlen(keys[i + j]) + 1);
+		}
+		leaf->hdr.count = k;
+		leaf->prev = prev;
+		if (prev != NULL)
+			prev->next = leaf;
+		else
+			tree->first = leaf;
+		prev = leaf;
+		first[count] = keys[i];
+		level[count++] = &leaf->hdr;
+	}
+	tree->last = prev;
+
+	// Parents are written over the front of level, a parent is never
+	// stored past the first child it has not taken yet.
+	while (count > 1) {
+		next = 0;
+		for (i = 0; i < count; i += k) {
+			BptInner_t *p = (BptInner_t *)_bptNewNode(tree, 0);
+
+			if (p == NULL)
+				goto nomem;
+			k = (count - i < BPT_ORDER + 1) ? count - i : BPT_ORDER + 1;
+			p->child[0] = level[i];
+			for (j = 1; j < k; j++) {
+				char *sep = _bptDupKey(tree, first[i + j]);
+
+				if (sep == NULL) {
+					level[next++] = &p->hdr;
+					i += j;
+					goto nomem;
+				}
+				p->hdr.keys[j - 1] = sep;
+				p->hdr.pfx[j - 1] = _bptPrefix(sep);
+				p->child[j] = level[i + j];
+				p->hdr.count = j;
+			}
+			first[next] = first[i];
+			level[next++] = &p->hdr;
+		}
+		count = next;
+	}
+
+	tree->root = level[0];
+	tree->count = n;
+
+	free(level);
+	free(first);
+
+	return 0;
+
+nomem:
+	// Free what was built, level holds next parents then the children
+	// from i on that no parent has taken.
+	if (level != NULL) {
+		for (j = 0; j < next; j++)
+			_bptFreeNode(tree, level[j], 0);
+		for (j = i; j < count; j++)
+			_bptFreeNode(tree, level[j], 0);
+	}
+	free(level);
+	free(first);
+	AtomicSet(&tree->bytes, bytes);
+	tree->root = NULL;
+	tree->first = NULL;
+	tree->last = NULL;
+	memDbcErrorNum = MALLOC_ERR;
+	return -1;
+}
+
+/*
+ * Function bptBuild fills an empty tree from n keys sorted by strcmp()
+ * with no duplicates.  The tree is built bottom up with full leaves and
+ * takes the key strings, they must come from malloc().
+ * Returns 0 or -1 on error.
+ */
+int bptBuild(BpTree_t *tree, char **keys, void ***data, size_t n) {
+
+	if (tree->root != NULL) {
+		memDbcErrorNum = OPTION_ERR;
+		return -1;
+	}
+
+	return _bptBuild(tree, keys, data, n);
+}
+
+/*
+ * Function bptMerge adds n keys sorted by strcmp() with no duplicates.
+ * Keys already in the tree get the new data.  A batch that is large
+ * next to the tree is merged with the leaves in one pass and the tree
+ * is rebuilt bottom up, a small one is inserted a key at a time.
+ * Returns the number of keys added or -1 if out of memory, the tree is
+ * not changed on error.
+ */
+int bptMerge(BpTree_t *tree, char **keys, void ***data, int n) {
+	BpTree_t built;
+	BptLeaf_t *leaf = tree->first;
+	char **mKeys = NULL;
+	void ***mData = NULL;
+	char **newKeys = NULL;
+	size_t m = 0;
+	int added = 0;
+	int li = 0;
+	int i = 0;
+	int c, r;
+
+	if (n <= 0)
+		return 0;
+
+	if (tree->count / BPT_MERGE_RATIO > (unsigned long)n) {
+		for (i = 0; i < n; i++) {
+			r = bptInsert(tree, keys[i], data[i]);
+			if (r < 0)
+				return -1;
+			added += r;
+		}
+		return added;
+	}
+
+	mKeys = (char **)malloc((tree->count + n) * sizeof(char *));
+	mData = (void ***)malloc((tree->count + n) * sizeof(void **));
+	newKeys = (char **)calloc(n, sizeof(char *));
+	if (mKeys == NULL || mData == NULL || newKeys == NULL)
+		goto nomem;
+
+	while (i < n || leaf != NULL) {
+		if (leaf != NULL && li == leaf->hdr.count) {
+			leaf = leaf->next;
+			li = 0;
+			continue;
+		}
+
+		if (leaf == NULL)
+			c = 1;
+		else if (i == n)
+			c = -1;
+		else
+			c = strcmp(leaf->hdr.keys[li], keys[i]);
+
+		if (c < 0) {
+			mKeys[m] = leaf->hdr.keys[li];
+			mData[m++] = leaf->data[li++];
+		} else if (c == 0) {
+			mKeys[m] = leaf->hdr.keys[li++];
+			mData[m++] = data[i++];
+		} else {
+			newKeys[i] = strdup(keys[i]);
+			if (newKeys[i] == NULL)
+				goto nomem;
+			mKeys[m] = newKeys[i];
+			mData[m++] = data[i++];
+			added++;
+		}
+	}
+
+	memset(&built, 0, sizeof(BpTree_t));
+	if (_bptBuild(&built, mKeys, mData, m) != 0)
+		goto nomem;
+
+	// The old nodes go, their keys live on in the new leaves and are
+	// counted in built.
+	if (tree->root != NULL)
+		_bptFreeNode(tree, tree->root, 0);
+	tree->root = built.root;
+	tree->first = built.first;
+	tree->last = built.last;
+	tree->count = built.count;
+	AtomicSet(&tree->bytes, built.bytes);
+
+	free(mKeys);
+	free(mData);
+	free(newKeys);
+
+	return added;
+
+nomem:
+	if (newKeys != NULL) {
+		for (i = 0; i < n; i++)
+			free(newKeys[i]);
+	}
+	free(mKeys);
+	free(mData);
+	free(newKeys);
+	memDbcErrorNum = MALLOC_ERR;
+	return -1;
+}
+
+void bptFree(BpTree_t *tree) {
+
+	if (tree == NULL)
+		return;
+
+	if (tree->root != NULL)
+		_bptFreeNode(tree, tree->root, 1);
+
+	free(tree);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#ifndef _BPTREE_H_
+#define _BPTREE_H_
+
+#include <stddef.h>
+
+// Number of entries a node can hold.  Leaves are wide so a walk
+// touches few nodes and the prefix arrays stay in a few cache lines.
+#define BPT_ORDER		64
+
+// Max height of the tree, 64-way fan out makes this more than enough.
+#define BPT_MAX_HEIGHT	16
+
+// bptMerge() inserts a key at a time when the tree has more than this
+// many keys for each key in the batch, else it rebuilds the tree.
+#define BPT_MERGE_RATIO	8
+
+// Every node starts with this header.  The pfx array holds the first
+// 8 bytes of each key in big endian order so most compares are done
+// on integers without touching the key string.
+typedef struct _bptNode {
+	unsigned short isLeaf;
+	unsigned short count;			// number of keys in node.
+	unsigned long long pfx[BPT_ORDER + 1];
+	char *keys[BPT_ORDER + 1];
+} BptNode_t;
+
+typedef struct _bptInner {
+	BptNode_t hdr;
+	BptNode_t *child[BPT_ORDER + 2];
+} BptInner_t;
+
+// Each leaf entry holds the key and a pointer to the trie node's
+// data pointer, so a walk never has to search the trie.
+typedef struct _bptLeaf {
+	BptNode_t hdr;
+	void **data[BPT_ORDER + 1];
+	struct _bptLeaf *next;
+	struct _bptLeaf *prev;
+} BptLeaf_t;
+
+typedef struct _bpTree {
+	BptNode_t *root;
+	BptLeaf_t *first;				// left most leaf.
+	BptLeaf_t *last;				// right most leaf.
+	unsigned long count;			// number of keys in tree.
+	size_t bytes;					// nodes and key copies allocated.
+} BpTree_t;
+
+BpTree_t *bptInit();
+int bptInsert(BpTree_t *tree, char *key, void **data);
+int bptAppend(BpTree_t *tree, char *key, void **data);
+int bptBuild(BpTree_t *tree, char **keys, void ***data, size_t n);
+int bptMerge(BpTree_t *tree, char **keys, void ***data, int n);
+int bptDelete(BpTree_t *tree, char *key);
+void **bptFind(BpTree_t *tree, char *key);
+BptLeaf_t *bptSeek(BpTree_t *tree, char *key, int *pos);
+int bptUpdate(BpTree_t *tree, char *key, void **old, void **data);
+char *bptSample(BpTree_t *tree, unsigned int *seed, void ***data);
+void bptFree(BpTree_t *tree);
+
+#endif /* _BPTREE_H_ */
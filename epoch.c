@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memdbc.h"
+#include "epoch.h"
+
+static unsigned long _epGlobal = 0;
+static EpThread_t *_epThreads = NULL;	// every record ever made, never shrinks.
+
+static pthread_once_t _epOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t _epKey;
+static __thread EpThread_t *_epSelf = NULL;
+
+/*
+ * Function _epThreadExit is private to this file.
+ * Called when a thread ends, its record and anything still in limbo is
+ * picked up by the next thread that needs a record.
+ */
+static void _epThreadExit(void *arg) {
+	EpThread_t *rec = (EpThread_t *)arg;
+
+	AtomicSet(&rec->state, 0);
+	rec->nest = 0;
+	AtomicSet(&rec->owned, 0);
+}
+
+static void _epKeyInit() {
+
+	pthread_key_create(&_epKey, _epThreadExit);
+}
+
+/*
+ * Function _epGetSelf is private to this file.
+ * Returns the calling thread's record, making or reusing one the first time.
+ */
+static EpThread_t *_epGetSelf() {
+	EpThread_t *rec = _epSelf;
+	int zero;
+
+	if (rec != NULL)
+		return rec;
+
+	pthread_once(&_epOnce, _epKeyInit);
+
+	for (rec = AtomicGet(&_epThreads); rec != NULL; rec = rec->next) {
+		zero = 0;
+		if (AtomicGet(&rec->owned) == 0 && AtomicExchange(&rec->owned, &zero, &(int){1}) == 1)
+			break;
+	}
+
+	if (rec == NULL) {
+		rec = (EpThread_t *)calloc(1, sizeof(EpThread_t));
+		if (rec == NULL) {
+			pErr("Unable to allocate epoch record.\n");
+			abort();
+		}
+		rec->owned = 1;
+		pthread_spin_init(&rec->lock, PTHREAD_PROCESS_PRIVATE);
+
+		EpThread_t *head = AtomicGet(&_epThreads);
+		do {
+			rec->next = head;
+		} while (AtomicExchange(&_epThreads, &head, &rec) == 0);
+	}
+
+	pthread_setspecific(_epKey, rec);
+	_epSelf = rec;
+
+	return rec;
+}
+
+/*
+ * Function _epTryAdvance is private to this file.
+ * Moves the global epoch on if every thread in a read section has seen
+ * the current one.  Returns the global epoch.
+ */
+static unsigned long _epTryAdvance() {
+	unsigned long e = AtomicGet(&_epGlobal);
+	unsigned long s;
+	EpThread_t *rec;
+
+	for (rec = AtomicGet(&_epThreads); rec != NULL; rec = rec->next) {
+		s = AtomicGet(&rec->state);
+		if ((s & 1) && (s >> 1) != e)
+			return e;		// a reader is still in an older epoch.
+	}
+
+	if (AtomicExchange(&_epGlobal, &e, &(unsigned long){e + 1}) == 1)
+		return e + 1;
+
+	return e;			// another thread moved it, e holds the new value.
+}
+
+/*
+ * Function _epReclaim is private to this file.
+ * Frees everything in rec's limbo retired two or more epochs ago.
+ */
+static void _epReclaim(EpThread_t *rec, unsigned long e) {
+	EpItem_t *item, **prev, *next;
+
+	// The lock is held while freeing so epForget() can not let the
+	// pool go away under us.
+	pthread_spin_lock(&rec->lock);
+
+	// Newest first, find the first item old enough and cut the list there.
+	for (prev = &rec->limbo; *prev != NULL; prev = &(*prev)->next) {
+		if ((*prev)->epoch + 2 <= e)
+			break;
+	}
+	item = *prev;
+	*prev = NULL;
+
+	for (; item != NULL; item = next) {
+		next = item->next;
+		item->fn(item->ctx, item->p, item->size);
+		item->next = rec->freeItems;
+		rec->freeItems = item;
+	}
+
+	pthread_spin_unlock(&rec->lock);
+}
+
+/*
+ * Function epEnter starts a read section, calls may be nested.
+ */
+void epEnter() {
+	EpThread_t *rec = _epGetSelf();
+
+	if (rec->nest++ == 0) {
+		AtomicSet(&rec->state, (AtomicGet(&_epGlobal) << 1) | 1);
+	}
+}
+
+/*
+ * Function epExit ends a read section.
+ */
+void epExit() {
+	EpThread_t *rec = _epSelf;
+
+	if (rec == NULL || rec->nest == 0)
+		return;
+
+	if (--rec->nest == 0)
+		__atomic_store_n(&rec->state, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Function epRetire hands memory that is no longer reachable to the
+ * reclaimer, fn(ctx, p, size) is called once no reader can still see it.
+ */
+void epRetire(EpFreeFn_t fn, void *ctx, void *p, size_t size) {
+	EpThread_t *rec = _epGetSelf();
+	EpItem_t *item;
+
+	pthread_spin_lock(&rec->lock);
+	item = rec->freeItems;
+	if (item != NULL)
+		rec->freeItems = item->next;
+	pthread_spin_unlock(&rec->lock);
+
+	if (item == NULL) {
+		item = (EpItem_t *)malloc(sizeof(EpItem_t));
+		if (item == NULL) {
+			// Nothing to track it with, leak it rather than free it early.
+			memDbcErrorNum = MALLOC_ERR;
+			return;
+		}
+	}
+
+	item->epoch = AtomicGet(&_epGlobal);
+	item->fn = fn;
+	item->ctx = ctx;
+	item->p = p;
+	item->size = size;
+
+	pthread_spin_lock(&rec->lock);
+	item->next = rec->limbo;
+	rec->limbo = item;
+	pthread_spin_unlock(&rec->lock);
+
+	if (++rec->sinceScan >= EP_SCAN) {
+		rec->sinceScan = 0;
+		_epReclaim(rec, _epTryAdvance());
+	}
+}
+
+/*
+ * Function epForget drops everything retired with ctx without freeing
+ * it.  Used when the pool the memory came from is being destroyed.
+ */
+void epForget(void *ctx) {
+
+	epForgetIf(ctx, NULL);
+}
+
+/*
+ * Function epForgetIf is epForget() for only the memory match(ctx, p)
+ * returns 1 for, or all of it when match is NULL.  Used when part of a
+ * pool is given back to the system.
+ */
+void epForgetIf(void *ctx, EpMatchFn_t match) {
+	EpItem_t *item, **prev;
+	EpThread_t *rec;
+
+	for (rec = AtomicGet(&_epThreads); rec != NULL; rec = rec->next) {
+		pthread_spin_lock(&rec->lock);
+		prev = &rec->limbo;
+		while ((item = *prev) != NULL) {
+			if (item->ctx == ctx && (match == NULL || match(ctx, item->p) == 1)) {
+				*prev = item->next;
+				item->next = rec->freeItems;
+				rec->freeItems = item;
+			} else {
+				prev = &item->next;
+			}
+		}
+		pthread_spin_unlock(&rec->lock);
+	}
+}
+
+/*
+ * Function epNow returns the global epoch, memory unlinked now is safe
+ * to reuse once epPassed() says so for it.
+ */
+unsigned long epNow() {
+
+	return AtomicGet(&_epGlobal);
+}
+
+/*
+ * Function epPassed returns 1 if no reader can still see memory that
+ * was unlinked in epoch e.
+ */
+int epPassed(unsigned long e) {
+
+	return AtomicGet(&_epGlobal) >= e + 2;
+}
+
+/*
+ * Function epTryPass is epPassed() for a thread that waits on readers
+ * without retiring anything, it tries to move the epoch on first.
+ * The caller must not be in a read section.
+ */
+int epTryPass(unsigned long e) {
+
+	_epTryAdvance();
+
+	return epPassed(e);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+#include <sys/types.h>
+#include <pthread.h>
+
+// Epoch based reclamation.  Readers call epEnter()/epExit() around any
+// use of tree memory.  Memory unlinked by a writer is handed to
+// epRetire() and only freed once every thread that was inside a read
+// section when it was retired has left it.
+//
+// There is one global epoch.  Memory retired in epoch e is freed once
+// the global epoch reaches e + 2, and the global epoch only moves on
+// when every thread inside a read section has seen the current one.
+
+// Retires between attempts to move the epoch on and free memory.
+#define EP_SCAN		64
+
+typedef void (*EpFreeFn_t)(void *ctx, void *p, size_t size);
+typedef int (*EpMatchFn_t)(void *ctx, void *p);
+
+typedef struct _epItem {
+	struct _epItem *next;
+	unsigned long epoch;			// global epoch when it was retired.
+	EpFreeFn_t fn;
+	void *ctx;
+	void *p;
+	size_t size;
+} EpItem_t;
+
+// One per thread, records are kept for the life of the process and
+// reused by new threads.
+typedef struct _epThread {
+	struct _epThread *next;
+	unsigned long state;			// (epoch << 1) | 1 while in a read section.
+	int nest;						// epEnter() calls not yet matched by epExit().
+	int owned;						// in use by a live thread.
+	unsigned int sinceScan;
+	pthread_spinlock_t lock;		// guards limbo and freeItems.
+	EpItem_t *limbo;				// retired memory, newest first.
+	EpItem_t *freeItems;
+} EpThread_t;
+
+void epEnter();
+void epExit();
+void epRetire(EpFreeFn_t fn, void *ctx, void *p, size_t size);
+void epForget(void *ctx);
+void epForgetIf(void *ctx, EpMatchFn_t match);
+unsigned long epNow();
+int epPassed(unsigned long e);
+int epTryPass(unsigned long e);
+
+#endif /* _EPOCH_H_ */
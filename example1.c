@@ -126,7 +126,8 @@ void testAscii() {
 	memDbcWalk(memDbc, walkCallback);
 
 	// Delete a record.
-	memDbcDelete(memDbc, "wiles");
+	if (memDbcDelete(memDbc, "wiles") == 0)
+		printf("Deleted key %s\n", "wiles");
 
 	memDbcWalk(memDbc, walkCallback);
 
@@ -184,7 +185,8 @@ void testDigital() {
 	memDbcWalk(memDbc, walkCallback);
 
 	// Delete a record.
-	memDbcDelete(memDbc, "123");
+	if (memDbcDelete(memDbc, "123") == 0)
+		printf("Deleted key %s\n", "123");
 
 	memDbcWalk(memDbc, walkCallback);
 
@@ -244,10 +246,21 @@ void testHex() {
 	memDbcWalk(memDbc, walkCallback);
 
 	// Delete a record.
-	memDbcDelete(memDbc, "E678");
+	if (memDbcDelete(memDbc, "E678") == 0)
+		printf("Deleted key %s\n", "E678");
 
 	memDbcWalk(memDbc, walkCallback);
 
+	// Hex keys are the same in either case.
+	memDbcAdd(memDbc, "BEEF", v2, strlen(v2));
+	if (memDbcDelete(memDbc, "beef") == 0)
+		printf("Deleted key %s added as %s\n", "beef", "BEEF");
+
+	if (memDbcFind(memDbc, "BEEF") == NULL)
+		printf("Record NOT Found: Key=%s\n", "BEEF");
+
+	printf("Record Count: %lu\n", memDbcNumEntries(memDbc));
+
 	// update record.
 	printf("Update record '123B'\n");
 	memDbcAdd(memDbc, "123B", "was updated.", 12);
@@ -302,7 +315,8 @@ void testOctal() {
 	memDbcWalk(memDbc, walkCallback);
 
 	// Delete a record.
-	memDbcDelete(memDbc, "067");
+	if (memDbcDelete(memDbc, "067") == 0)
+		printf("Deleted key %s\n", "067");
 
 	memDbcWalk(memDbc, walkCallback);
 
@@ -61,7 +61,13 @@ int main(int argc, char *argv[]) {
 	memDbcAdd(memDbc, data[0].name, &data[0], sizeof(Data_t));
 	memDbcAdd(memDbc, data[1].name, &data[1], sizeof(Data_t));
 	memDbcAdd(memDbc, data[2].name, &data[2], sizeof(Data_t));
-	memDbcAdd(memDbc, data[3].name, &data[3], sizeof(Data_t));
+
+	// A record built in the database's own memory is added without a copy.
+	Data_t *d = (Data_t *)memDbcValueAlloc(memDbc, data[3].name, sizeof(Data_t));
+	if (d != NULL) {
+		*d = data[3];
+		memDbcAddOwned(memDbc, data[3].name, d);
+	}
 
 	// Search for a single record.
 	Data_t *p = (Data_t *)memDbcFind(memDbc, "John Doe");
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+// Multi-threaded stress test of the trie engine.
+//
+// For 1, 2, 4 ... up to the thread count given on the command line it:
+//   - has each writer insert its own keys, then update them again,
+//   - has every writer insert the same keys at the same time, only one
+//     writer of each key may see it as new,
+// and then checks every record and the record count.  The inserts and
+// updates per second, and each as a multiple of the one thread rate, are
+// printed for each thread count so the scaling can be seen.
+//
+// Only correctness is tested, the Result column and exit status say
+// whether every record and count came out right.  The rates are printed
+// and not checked, they depend on the machine.
+//
+// Writers of one shard share its key index lock, so the default is
+// DEFAULT_SHARDS shards to let the inserts scale too.
+//
+//   ./example3 [maxThreads] [keysPerThread] [shards]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "memdbc.h"
+
+#define DEFAULT_SHARDS	16
+
+typedef struct _worker_ {
+	pthread_t tid;
+	MemDbc_t *memDbc;
+	int id;
+	int numKeys;
+	int shared;				// all workers use the same keys.
+	int round;				// value written is key * 10 + round.
+	unsigned long newKeys;	// number of times memDbcAdd() returned 1.
+	unsigned long errors;
+} Worker_t;
+
+pthread_barrier_t barrier;
+
+static void makeKey(char *buf, int worker, int n) {
+
+	// Digital keys, the worker id is last so writers spread over the trie.
+	sprintf(buf, "%d%06d%02d", n % 10, n, worker);
+}
+
+static double now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void *worker(void *arg) {
+	Worker_t *w = (Worker_t *)arg;
+	char key[32];
+	char val[32];
+	int i, r;
+
+	pthread_barrier_wait(&barrier);
+
+	for (i = 0; i < w->numKeys; i++) {
+		makeKey(key, w->shared ? 0 : w->id, i);
+		sprintf(val, "%d", i * 10 + w->round);
+
+		r = memDbcAdd(w->memDbc, key, val, strlen(val) + 1);
+		if (r == 1)
+			w->newKeys++;
+		else if (r != 2)
+			w->errors++;
+
+		// Read back what was just written, another writer of a shared
+		// key may have replaced it but it must be a whole value.
+		char *p = (char *)memDbcFind(w->memDbc, key);
+		if (p == NULL || (!w->shared && atoi(p) != i * 10 + w->round))
+			w->errors++;
+	}
+
+	return NULL;
+}
+
+// Runs numThreads workers and returns the seconds it took.
+static double runWorkers(MemDbc_t *memDbc, Worker_t *w, int numThreads, int numKeys, int shared, int round) {
+	double start;
+	int i;
+
+	pthread_barrier_init(&barrier, NULL, numThreads + 1);
+
+	for (i = 0; i < numThreads; i++) {
+		memset(&w[i], 0, sizeof(Worker_t));
+		w[i].memDbc = memDbc;
+		w[i].id = i;
+		w[i].numKeys = numKeys;
+		w[i].shared = shared;
+		w[i].round = round;
+		pthread_create(&w[i].tid, NULL, worker, &w[i]);
+	}
+
+	pthread_barrier_wait(&barrier);
+	start = now();
+
+	for (i = 0; i < numThreads; i++)
+		pthread_join(w[i].tid, NULL);
+
+	pthread_barrier_destroy(&barrier);
+
+	return now() - start;
+}
+
+static unsigned long sumNew(Worker_t *w, int numThreads, unsigned long *errors) {
+	unsigned long n = 0;
+	int i;
+
+	for (i = 0; i < numThreads; i++) {
+		n += w[i].newKeys;
+		*errors += w[i].errors;
+	}
+
+	return n;
+}
+
+// Checks every key written by the private workers holds the last value.
+static unsigned long verify(MemDbc_t *memDbc, int numThreads, int numKeys, int round) {
+	unsigned long errors = 0;
+	char key[32];
+	int t, i;
+
+	for (t = 0; t < numThreads; t++) {
+		for (i = 0; i < numKeys; i++) {
+			makeKey(key, t, i);
+			char *p = (char *)memDbcFind(memDbc, key);
+			if (p == NULL || atoi(p) != i * 10 + round)
+				errors++;
+		}
+	}
+
+	return errors;
+}
+
+int main(int argc, char *argv[]) {
+	int maxThreads = 8;
+	int numKeys = 100000;
+	int shards = DEFAULT_SHARDS;
+	double baseIns = 0.0;
+	double baseUpd = 0.0;
+	int failed = 0;
+	int n;
+
+	if (argc > 1)
+		maxThreads = atoi(argv[1]);
+	if (argc > 2)
+		numKeys = atoi(argv[2]);
+	if (argc > 3)
+		shards = atoi(argv[3]);
+
+	Worker_t *w = (Worker_t *)calloc(maxThreads, sizeof(Worker_t));
+
+	printf("%d shards, %d keys per thread\n", shards, numKeys);
+	printf("%7s %14s %8s %14s %8s %s\n", "Threads", "Inserts/sec", "Scaling", "Updates/sec", "Scaling", "Result");
+
+	for (n = 1; n <= maxThreads; n *= 2) {
+		unsigned long errors = 0;
+		unsigned long total = (unsigned long)n * numKeys;
+		double ins, upd;
+
+		MemDbcOpts_t opts = { .reserveKeys = total, .shards = shards };
+		MemDbc_t *memDbc = memDbcInitOpts(DIGITAL_DB, &opts);
+		if (memDbc == NULL) {
+			printf("memDbcInitOpts failed %d\n", memDbcError());
+			return 1;
+		}
+
+		// Private keys, every insert is new.
+		ins = runWorkers(memDbc, w, n, numKeys, 0, 1);
+		if (sumNew(w, n, &errors) != total)
+			errors++;
+
+		// Same keys again, every insert is an update.
+		upd = runWorkers(memDbc, w, n, numKeys, 0, 2);
+		if (sumNew(w, n, &errors) != 0)
+			errors++;
+
+		errors += verify(memDbc, n, numKeys, 2);
+		if (memDbcNumEntries(memDbc) != total)
+			errors++;
+
+		memDbcFree(memDbc);
+
+		// Every writer adds the same keys, each key is new exactly once.
+		memDbc = memDbcInitOpts(DIGITAL_DB, &opts);
+		runWorkers(memDbc, w, n, numKeys, 1, 0);
+		if (sumNew(w, n, &errors) != (unsigned long)numKeys)
+			errors++;
+		if (memDbcNumEntries(memDbc) != (unsigned long)numKeys)
+			errors++;
+		memDbcFree(memDbc);
+
+		if (n == 1) {
+			baseIns = total / ins;
+			baseUpd = total / upd;
+		}
+
+		printf("%7d %14.0f %7.2fx %14.0f %7.2fx %s\n", n, total / ins, (total / ins) / baseIns,
+				total / upd, (total / upd) / baseUpd, errors == 0 ? "OK" : "FAILED");
+
+		if (errors != 0)
+			failed = 1;
+	}
+
+	free(w);
+
+	return failed;
+}
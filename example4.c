@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+
+// Benchmark of memDbcFindMany() against a loop of memDbcFind().
+//
+// Fills a database with random digital keys, then looks all of them up
+// in a random order, batch keys at a time, first with memDbcFind() and
+// then with memDbcFindMany().  Both must find the same records.  The
+// lookups per second of each are printed.
+//
+//   ./example4 [numKeys] [batch] [shards]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "memdbc.h"
+
+#define KEY_SIZE	16
+
+static double now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+	int numKeys = 1000000;
+	int batch = 100;
+	int shards = 1;
+	unsigned long errors = 0;
+	double single, many;
+	int i, j, n;
+
+	if (argc > 1)
+		numKeys = atoi(argv[1]);
+	if (argc > 2)
+		batch = atoi(argv[2]);
+	if (argc > 3)
+		shards = atoi(argv[3]);
+
+	char *keys = (char *)malloc((size_t)numKeys * KEY_SIZE);
+	char **order = (char **)malloc(numKeys * sizeof(char *));
+	void **out1 = (void **)malloc(batch * sizeof(void *));
+	void **out2 = (void **)malloc(batch * sizeof(void *));
+
+	MemDbcOpts_t opts = { .reserveKeys = numKeys, .shards = shards };
+	MemDbc_t *memDbc = memDbcInitOpts(DIGITAL_DB, &opts);
+	if (memDbc == NULL) {
+		printf("memDbcInitOpts failed %d\n", memDbcError());
+		return 1;
+	}
+
+	srand(1);
+	for (i = 0; i < numKeys; i++) {
+		char *key = keys + (size_t)i * KEY_SIZE;
+
+		sprintf(key, "%05d%05d", rand() % 100000, i % 100000);
+		memDbcAdd(memDbc, key, key, strlen(key) + 1);
+		order[i] = key;
+	}
+
+	// Look the keys up in a different order than they were added.
+	for (i = numKeys - 1; i > 0; i--) {
+		char *t;
+
+		j = rand() % (i + 1);
+		t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+
+	memDbcReadBegin(memDbc);
+
+	double start = now();
+	for (i = 0; i < numKeys; i += batch) {
+		n = (numKeys - i < batch) ? numKeys - i : batch;
+		for (j = 0; j < n; j++)
+			out1[j] = memDbcFind(memDbc, order[i + j]);
+	}
+	single = now() - start;
+
+	start = now();
+	for (i = 0; i < numKeys; i += batch) {
+		n = (numKeys - i < batch) ? numKeys - i : batch;
+		memDbcFindMany(memDbc, order + i, n, out2);
+	}
+	many = now() - start;
+
+	// Check the two agree, a key added twice holds its last value.
+	for (i = 0; i < numKeys; i += batch) {
+		n = (numKeys - i < batch) ? numKeys - i : batch;
+		memDbcFindMany(memDbc, order + i, n, out2);
+		for (j = 0; j < n; j++) {
+			out1[j] = memDbcFind(memDbc, order[i + j]);
+			if (out1[j] == NULL || out1[j] != out2[j])
+				errors++;
+		}
+	}
+
+	memDbcReadEnd(memDbc);
+
+	printf("%14s %14s %8s %s\n", "Find/sec", "FindMany/sec", "Speedup", "Result");
+	printf("%14.0f %14.0f %7.2fx %s\n", numKeys / single, numKeys / many, single / many,
+			errors == 0 ? "OK" : "FAILED");
+
+	memDbcFree(memDbc);
+	free(keys);
+	free(order);
+	free(out1);
+	free(out2);
+
+	return errors != 0;
+}
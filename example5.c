@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+
+// Churn benchmark, session ids that come and go.
+//
+// Fills a HEX_DB database with numKeys random 32 digit session ids, then
+// for each round deletes every id and adds a new one in its place, so
+// the number of records stays the same while the keys never repeat.
+// After each round the record count, the resident memory and the adds
+// and deletes per second are printed.  With the trie nodes of deleted
+// keys freed the memory stays flat from round to round, the record
+// count must stay numKeys.
+//
+// Then three of every four ids are deleted, which leaves the nodes of
+// the rest spread thin over the pool, and the rest are looked up before
+// and after memDbcCompact() packs them.  The compaction runs in steps of
+// at most COMPACT_NODES nodes, the longest step and the memory given
+// back are printed.
+//
+//   ./example5 [numKeys] [rounds] [shards]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "memdbc.h"
+
+#define KEY_SIZE	33
+
+// Nodes memDbcCompact() moves per call.
+#define COMPACT_NODES	4096
+
+static double now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Resident memory of the process in MB.
+static double rssMb() {
+	long pages = 0;
+	FILE *fp = fopen("/proc/self/statm", "r");
+
+	if (fp != NULL) {
+		if (fscanf(fp, "%*s %ld", &pages) != 1)
+			pages = 0;
+		fclose(fp);
+	}
+
+	return (double)pages * sysconf(_SC_PAGESIZE) / (1024 * 1024);
+}
+
+// Looks up every fourth key, the ones left, returns lookups per second.
+static double lookups(MemDbc_t *memDbc, char *keys, int numKeys, unsigned long *errors) {
+	double start = now();
+	int i;
+
+	for (i = 0; i < numKeys; i += 4) {
+		if (memDbcFind(memDbc, keys + (size_t)i * KEY_SIZE) == NULL)
+			(*errors)++;
+	}
+
+	return (numKeys / 4) / (now() - start);
+}
+
+static void makeKey(char *buf) {
+	static const char hex[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < KEY_SIZE - 1; i++)
+		buf[i] = hex[rand() & 15];
+	buf[i] = '\0';
+}
+
+int main(int argc, char *argv[]) {
+	int numKeys = 200000;
+	int rounds = 10;
+	int shards = 1;
+	unsigned long errors = 0;
+	int i, round;
+
+	if (argc > 1)
+		numKeys = atoi(argv[1]);
+	if (argc > 2)
+		rounds = atoi(argv[2]);
+	if (argc > 3)
+		shards = atoi(argv[3]);
+
+	char *keys = (char *)malloc((size_t)numKeys * KEY_SIZE);
+
+	MemDbcOpts_t opts = { .reserveKeys = numKeys, .shards = shards };
+	MemDbc_t *memDbc = memDbcInitOpts(HEX_DB, &opts);
+	if (memDbc == NULL) {
+		printf("memDbcInitOpts failed %d\n", memDbcError());
+		return 1;
+	}
+
+	srand(1);
+	for (i = 0; i < numKeys; i++) {
+		char *key = keys + (size_t)i * KEY_SIZE;
+
+		makeKey(key);
+		if (memDbcAdd(memDbc, key, key, 8) != 1)
+			errors++;
+	}
+
+	printf("%6s %10s %10s %14s %s\n", "Round", "Records", "RSS MB", "Ops/sec", "Result");
+	printf("%6d %10lu %10.1f %14s %s\n", 0, memDbcNumEntries(memDbc), rssMb(), "-",
+			(memDbcNumEntries(memDbc) == (unsigned long)numKeys) ? "OK" : "FAILED");
+
+	for (round = 1; round <= rounds; round++) {
+		unsigned long roundErrors = 0;
+		double start = now();
+
+		for (i = 0; i < numKeys; i++) {
+			char *key = keys + (size_t)i * KEY_SIZE;
+
+			if (memDbcDelete(memDbc, key) != 0)
+				roundErrors++;
+			makeKey(key);
+			if (memDbcAdd(memDbc, key, key, 8) != 1)
+				roundErrors++;
+		}
+
+		double secs = now() - start;
+
+		if (memDbcNumEntries(memDbc) != (unsigned long)numKeys)
+			roundErrors++;
+		errors += roundErrors;
+
+		printf("%6d %10lu %10.1f %14.0f %s\n", round, memDbcNumEntries(memDbc), rssMb(),
+				2.0 * numKeys / secs, roundErrors == 0 ? "OK" : "FAILED");
+	}
+
+	for (i = 0; i < numKeys; i++) {
+		if (i % 4 != 0 && memDbcDelete(memDbc, keys + (size_t)i * KEY_SIZE) != 0)
+			errors++;
+	}
+
+	unsigned long before = errors;
+	double rss = rssMb();
+	double rate = lookups(memDbc, keys, numKeys, &errors);
+	double longest = 0;
+	size_t reclaimed = 0, bytes;
+	int steps = 0, r;
+
+	do {
+		double start = now();
+
+		r = memDbcCompact(memDbc, COMPACT_NODES, 0, &bytes);
+		if (now() - start > longest)
+			longest = now() - start;
+		reclaimed += bytes;
+		steps++;
+	} while (r == 1);
+
+	if (r != 0)
+		errors++;
+
+	printf("\n%10s %10s %14s %s\n", "Compact", "RSS MB", "Lookups/sec", "Result");
+	printf("%10s %10.1f %14.0f %s\n", "before", rss, rate, "-");
+	rate = lookups(memDbc, keys, numKeys, &errors);
+	printf("%10s %10.1f %14.0f %s\n", "after", rssMb(), rate, (errors == before) ? "OK" : "FAILED");
+	printf("%d steps, longest %.3f ms, %.1f MB reclaimed\n", steps, longest * 1000, reclaimed / (1024.0 * 1024.0));
+
+	memDbcFree(memDbc);
+	free(keys);
+
+	return errors != 0;
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_X86		1
+#endif
+
+#include "keyidx.h"
+
+// Character ranges of each DbType, as lo,hi pairs.  The string form is
+// what pcmpistri takes as its set of ranges.
+typedef struct _keyRanges {
+	int num;
+	unsigned char lo[3];
+	unsigned char hi[3];
+	char str[16];
+} KeyRanges_t;
+
+static const KeyRanges_t _keyRanges[OCTAL_DB + 1] = {
+	[ASCII_DB] = { 1, { ' ' }, { '~' }, " ~" },
+	[DIGITAL_DB] = { 1, { '0' }, { '9' }, "09" },
+	[HEX_DB] = { 3, { '0', 'A', 'a' }, { '9', 'F', 'f' }, "09AFaf" },
+	[OCTAL_DB] = { 1, { '0' }, { '7' }, "07" }
+};
+
+unsigned char keyIdxMap[OCTAL_DB + 1][256];
+
+// 1 for the characters of each DbType.
+static unsigned char _keyValid[OCTAL_DB + 1][256];
+
+static int (*_keyCheck)(DbTypes_t dbType, const char *key);
+
+/*
+ * Function _keyCheckScalar is private to this file.
+ * Returns the length of key or -1 if it has a character not in the
+ * DbType's alphabet.
+ */
+static int _keyCheckScalar(DbTypes_t dbType, const char *key) {
+	const unsigned char *valid = _keyValid[dbType];
+	const unsigned char *p = (const unsigned char *)key;
+
+	for (; *p != '\0'; p++) {
+		if (valid[*p] == 0)
+			return -1;
+	}
+
+	return (const char *)p - key;
+}
+
+#ifdef KEY_X86
+
+/*
+ * Function _keyCheckSse42 is private to this file.
+ * _keyCheckScalar() 16 bytes at a time.  pcmpistri finds the first byte
+ * before the NUL that is outside the ranges.  Loads are aligned so they
+ * never cross into a page the key is not in, bytes past the NUL are read
+ * but not used.
+ */
+__attribute__((target("sse4.2"), no_sanitize_address))
+static int _keyCheckSse42(DbTypes_t dbType, const char *key) {
+	const int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_MASKED_NEGATIVE_POLARITY;
+	const unsigned char *valid = _keyValid[dbType];
+	const char *p = key;
+	__m128i ranges, d;
+
+	for (; ((uintptr_t)p & 15) != 0; p++) {
+		if (*p == '\0')
+			return p - key;
+		if (valid[(unsigned char)*p] == 0)
+			return -1;
+	}
+
+	ranges = _mm_loadu_si128((const __m128i *)_keyRanges[dbType].str);
+
+	for (;; p += 16) {
+		d = _mm_load_si128((const __m128i *)p);
+		if (_mm_cmpistri(ranges, d, mode) < 16)
+			return -1;
+		if (_mm_cmpistrz(ranges, d, mode))
+			return p - key + __builtin_ctz(_mm_movemask_epi8(_mm_cmpeq_epi8(d, _mm_setzero_si128())));
+	}
+}
+
+/*
+ * Function _keyCheckAvx2 is private to this file.
+ * _keyCheckScalar() 32 bytes at a time, each byte is tested against the
+ * ranges with unsigned min and max.
+ */
+__attribute__((target("avx2"), no_sanitize_address))
+static int _keyCheckAvx2(DbTypes_t dbType, const char *key) {
+	const KeyRanges_t *r = &_keyRanges[dbType];
+	const unsigned char *valid = _keyValid[dbType];
+	const char *p = key;
+	__m256i lo[3], hi[3];
+	__m256i d, ok;
+	unsigned int nul, bad;
+	int i;
+
+	for (; ((uintptr_t)p & 31) != 0; p++) {
+		if (*p == '\0')
+			return p - key;
+		if (valid[(unsigned char)*p] == 0)
+			return -1;
+	}
+
+	for (i = 0; i < r->num; i++) {
+		lo[i] = _mm256_set1_epi8((char)r->lo[i]);
+		hi[i] = _mm256_set1_epi8((char)r->hi[i]);
+	}
+
+	for (;; p += 32) {
+		d = _mm256_load_si256((const __m256i *)p);
+		ok = _mm256_cmpeq_epi8(d, _mm256_setzero_si256());
+		nul = (unsigned int)_mm256_movemask_epi8(ok);
+		for (i = 0; i < r->num; i++) {
+			// lo <= d <= hi
+			__m256i in = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(d, lo[i]), d),
+					_mm256_cmpeq_epi8(_mm256_min_epu8(d, hi[i]), d));
+			ok = _mm256_or_si256(ok, in);
+		}
+		bad = ~(unsigned int)_mm256_movemask_epi8(ok);
+
+		if (nul != 0) {
+			// Only the bytes before the NUL count.
+			i = __builtin_ctz(nul);
+			return (bad & ((1u << i) - 1)) ? -1 : (int)(p - key) + i;
+		}
+		if (bad != 0)
+			return -1;
+	}
+}
+
+#endif
+
+/*
+ * Function _keyInit is private to this file.
+ * Fills the tables and picks the widest check the CPU can run.
+ */
+__attribute__((constructor))
+static void _keyInit(void) {
+	int t, i, c;
+
+	for (t = ASCII_DB; t <= OCTAL_DB; t++) {
+		const KeyRanges_t *r = &_keyRanges[t];
+		int idx = 0;
+
+		for (i = 0; i < r->num; i++) {
+			for (c = r->lo[i]; c <= r->hi[i]; c++) {
+				_keyValid[t][c] = 1;
+				keyIdxMap[t][c] = idx++;
+			}
+		}
+	}
+
+	// Hex keys ignore case, a-f take the same children as A-F.
+	for (c = 'a'; c <= 'f'; c++)
+		keyIdxMap[HEX_DB][c] = keyIdxMap[HEX_DB][c - 'a' + 'A'];
+
+	_keyCheck = _keyCheckScalar;
+#ifdef KEY_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		_keyCheck = _keyCheckAvx2;
+	else if (__builtin_cpu_supports("sse4.2"))
+		_keyCheck = _keyCheckSse42;
+#endif
+}
+
+/*
+ * Function keyCheck returns the length of key, or -1 with memDbcError()
+ * set to KEY_ERR if it has a character that is not in the DbType's
+ * alphabet.
+ */
+int keyCheck(DbTypes_t dbType, const char *key) {
+	int len;
+
+	if (dbType < ASCII_DB || dbType > OCTAL_DB) {
+		memDbcErrorNum = UNKNOWN_TYPE;
+		return -1;
+	}
+
+	len = _keyCheck(dbType, key);
+	if (len < 0)
+		memDbcErrorNum = KEY_ERR;
+
+	return len;
+}
+
+/*
+ * Function keyToInt sets val to the number a DIGITAL_DB key holds.
+ * Returns 0, or -1 with memDbcError() set to KEY_ERR if the key is
+ * empty, has a character other than 0-9 or does not fit a uint64_t.
+ */
+int keyToInt(const char *key, uint64_t *val) {
+	const char *p;
+	uint64_t v = 0;
+	unsigned int d;
+
+	for (p = key; *p >= '0' && *p <= '9'; p++) {
+		d = *p - '0';
+		if (v > (UINT64_MAX - d) / 10)
+			break;
+		v = v * 10 + d;
+	}
+
+	if (p == key || *p != '\0') {
+		memDbcErrorNum = KEY_ERR;
+		return -1;
+	}
+
+	*val = v;
+
+	return 0;
+}
+
+/*
+ * Function keyFromInt writes val into buf as a DIGITAL_DB key, zero
+ * padded to width digits, or as few as it needs when width is 0.  buf
+ * must hold MEMDBC_INT_WIDTH + 1 bytes.  Returns the key length, or -1
+ * with memDbcError() set to KEY_ERR if val needs more than width digits.
+ */
+int keyFromInt(uint64_t val, int width, char *buf) {
+	char tmp[MEMDBC_INT_WIDTH];
+	int i, n = 0;
+
+	do {
+		tmp[n++] = '0' + val % 10;
+		val /= 10;
+	} while (val != 0);
+
+	if (width > 0) {
+		if (n > width) {
+			memDbcErrorNum = KEY_ERR;
+			return -1;
+		}
+		while (n < width)
+			tmp[n++] = '0';
+	}
+
+	for (i = 0; i < n; i++)
+		buf[i] = tmp[n - 1 - i];
+	buf[n] = '\0';
+
+	return n;
+}
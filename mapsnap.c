@@ -0,0 +1,658 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapsnap.h"
+
+static const char _mapZeros[8] = { 0 };
+
+/*
+ * Function _mapWriteAll is private to this file.
+ * Writes len bytes, retrying short writes.
+ */
+static int _mapWriteAll(int fd, const char *p, size_t len) {
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			memDbcErrorNum = FILE_ERR;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Function _mapSyncDir is private to this file.
+ * Syncs the directory fileName is in, so a rename into it survives a crash.
+ */
+static int _mapSyncDir(const char *fileName) {
+	const char *slash = strrchr(fileName, '/');
+	char *dir;
+	int fd, r;
+
+	if (slash == NULL)
+		dir = strdup(".");
+	else if (slash == fileName)
+		dir = strdup("/");
+	else
+		dir = strndup(fileName, slash - fileName);
+	if (dir == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+	free(dir);
+	if (fd < 0) {
+		memDbcErrorNum = FILE_ERR;
+		return -1;
+	}
+
+	r = fsync(fd);
+	close(fd);
+	if (r != 0) {
+		memDbcErrorNum = FILE_ERR;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Function _mapFlush is private to this file.
+ */
+static int _mapFlush(MapFile_t *map) {
+
+	if (_mapWriteAll(map->fd, map->buf, map->used) != 0)
+		return -1;
+	map->off += map->used;
+	map->used = 0;
+
+	return 0;
+}
+
+/*
+ * Function _mapPut is private to this file.
+ */
+static int _mapPut(MapFile_t *map, const void *p, size_t len) {
+
+	if (map->used + len > MAP_BUF_SIZE) {
+		if (_mapFlush(map) != 0)
+			return -1;
+		if (len > MAP_BUF_SIZE) {
+			if (_mapWriteAll(map->fd, p, len) != 0)
+				return -1;
+			map->off += len;
+			return 0;
+		}
+	}
+
+	memcpy(map->buf + map->used, p, len);
+	map->used += len;
+
+	return 0;
+}
+
+/*
+ * Function _mapRelease is private to this file.
+ */
+static void _mapRelease(MapFile_t *map) {
+	size_t i;
+
+	if (map->fd >= 0)
+		close(map->fd);
+	if (map->base != NULL)
+		munmap(map->base, map->size);
+	if (map->keys != NULL) {
+		for (i = 0; i < map->hdr.recCount; i++)
+			free(map->keys[i].key);
+		free(map->keys);
+	}
+	free(map->fileName);
+	free(map->tmpName);
+	free(map->buf);
+	free(map->trie);
+	free(map);
+}
+
+/*
+ * Function mapCreate starts a new mapped snapshot of dbType records.
+ */
+MapFile_t *mapCreate(char *fileName, DbTypes_t dbType) {
+	MapFile_t *map = (MapFile_t *)calloc(1, sizeof(MapFile_t));
+
+	if (map == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+	map->fd = -1;
+	map->dbType = dbType;
+
+	map->fileName = strdup(fileName);
+	map->tmpName = (char *)malloc(strlen(fileName) + 5);
+	map->buf = (char *)malloc(MAP_BUF_SIZE);
+	if (map->fileName == NULL || map->tmpName == NULL || map->buf == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		_mapRelease(map);
+		return NULL;
+	}
+	sprintf(map->tmpName, "%s.tmp", fileName);
+
+	map->fd = open(map->tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (map->fd < 0) {
+		memDbcErrorNum = FILE_ERR;
+		_mapRelease(map);
+		return NULL;
+	}
+
+	memcpy(map->hdr.magic, MAP_MAGIC, sizeof(map->hdr.magic));
+	map->hdr.version = MAP_VERSION;
+	map->hdr.dbType = dbType;
+	map->hdr.recStart = MAP_ALIGN(sizeof(MapHdr_t));
+
+	// The header is rewritten by mapClose().
+	if (_mapPut(map, &map->hdr, sizeof(MapHdr_t)) != 0 ||
+			_mapPut(map, _mapZeros, map->hdr.recStart - sizeof(MapHdr_t)) != 0) {
+		mapAbort(map);
+		return NULL;
+	}
+
+	return map;
+}
+
+/*
+ * Function mapWrite adds a record, records must be added in key order.
+ */
+int mapWrite(MapFile_t *map, char *key, void *data, int len) {
+	MapRec_t rec;
+	char *k;
+	size_t i;
+
+	if (map->hdr.recCount == map->maxKeys) {
+		size_t n = (map->maxKeys == 0) ? 1024 : map->maxKeys * 2;
+		MapKey_t *p = (MapKey_t *)realloc(map->keys, n * sizeof(MapKey_t));
+
+		if (p == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			return -1;
+		}
+		map->keys = p;
+		map->maxKeys = n;
+	}
+
+	k = strdup(key);
+	if (k == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+	if (map->dbType == HEX_DB) {
+		for (i = 0; k[i] != '\0'; i++)
+			k[i] = tolower((unsigned char)k[i]);
+	}
+
+	memset(&rec, 0, sizeof(MapRec_t));
+	rec.keyLen = strlen(key);
+	rec.val.len = len;
+
+	map->keys[map->hdr.recCount].key = k;
+	map->keys[map->hdr.recCount].rec = map->off + map->used;
+	map->hdr.recCount++;
+
+	if (_mapPut(map, &rec, sizeof(MapRec_t)) != 0 ||
+			_mapPut(map, data, len) != 0 ||
+			_mapPut(map, _mapZeros, MAP_ALIGN(len + 1) - len) != 0 ||
+			_mapPut(map, key, rec.keyLen) != 0 ||
+			_mapPut(map, _mapZeros, MAP_ALIGN(rec.keyLen + 1) - rec.keyLen) != 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Function _mapReserve is private to this file.
+ * Returns the offset in the trie buffer of size zeroed bytes or -1.
+ */
+static long _mapReserve(MapFile_t *map, size_t size) {
+	long pos = map->trieUsed;
+
+	if (map->trieUsed + size > map->trieSize) {
+		size_t n = (map->trieSize == 0) ? MAP_BUF_SIZE : map->trieSize * 2;
+		char *p;
+
+		while (n < map->trieUsed + size)
+			n *= 2;
+		p = (char *)realloc(map->trie, n);
+		if (p == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			return -1;
+		}
+		map->trie = p;
+		map->trieSize = n;
+	}
+
+	memset(map->trie + pos, 0, size);
+	map->trieUsed += size;
+
+	return pos;
+}
+
+/*
+ * Function _mapBuild is private to this file.
+ * Builds the trie node for keys lo to hi - 1, which are sorted and
+ * share their first depth bytes.  Returns its file offset or 0.
+ */
+static uint64_t _mapBuild(MapFile_t *map, size_t lo, size_t hi, size_t depth) {
+	MapKey_t *keys = map->keys;
+	char *first = keys[lo].key + depth;
+	char *last = keys[hi - 1].key + depth;
+	size_t lcp = 0, end, i, j, n, head;
+	uint64_t rec = 0, child;
+	MapNode_t *node;
+	long pos;
+	int c;
+
+	// Sorted keys share whatever the first and last one share.
+	while (first[lcp] != '\0' && first[lcp] == last[lcp])
+		lcp++;
+	end = depth + lcp;
+
+	// Only the first of keys that differ just in case is found.
+	i = lo;
+	if (keys[i].key[end] == '\0')
+		rec = keys[i].rec;
+	while (i < hi && keys[i].key[end] == '\0')
+		i++;
+
+	for (n = 0, j = i; j < hi; n++) {
+		c = keys[j].key[end];
+		while (j < hi && keys[j].key[end] == c)
+			j++;
+	}
+
+	head = MAP_ALIGN(sizeof(MapNode_t) + lcp + n);
+	pos = _mapReserve(map, head + n * sizeof(uint64_t));
+	if (pos < 0)
+		return 0;
+
+	node = (MapNode_t *)(map->trie + pos);
+	node->rec = rec;
+	node->numChildren = n;
+	node->prefixLen = lcp;
+	memcpy(node->bytes, first, lcp);
+
+	for (n = 0; i < hi; n++) {
+		c = keys[i].key[end];
+		for (j = i; j < hi && keys[j].key[end] == c; j++)
+			;
+
+		child = _mapBuild(map, i, j, end + 1);
+		if (child == 0)
+			return 0;
+
+		// The buffer may have moved while the child was built.
+		node = (MapNode_t *)(map->trie + pos);
+		node->bytes[lcp + n] = c;
+		((uint64_t *)(map->trie + pos + head))[n] = child;
+
+		i = j;
+	}
+
+	return map->hdr.trieStart + pos;
+}
+
+/*
+ * Function _mapCmp is private to this file.
+ */
+static int _mapCmp(const void *a, const void *b) {
+
+	return strcmp(((MapKey_t *)a)->key, ((MapKey_t *)b)->key);
+}
+
+/*
+ * Function mapClose builds the trie, finishes the file and moves it to
+ * its real name.
+ */
+int mapClose(MapFile_t *map) {
+	size_t i;
+	int r;
+
+	if (_mapFlush(map) != 0)
+		goto err;
+
+	map->hdr.recEnd = map->off;
+	map->hdr.recIndex = map->off;
+
+	// The keys are still in record order here.
+	for (i = 0; i < map->hdr.recCount; i++) {
+		if (_mapPut(map, &map->keys[i].rec, sizeof(uint64_t)) != 0)
+			goto err;
+	}
+	if (_mapFlush(map) != 0)
+		goto err;
+
+	map->hdr.trieStart = map->off;
+
+	if (map->hdr.recCount > 0) {
+		// Lower casing HEX_DB keys can change their order.
+		if (map->dbType == HEX_DB)
+			qsort(map->keys, map->hdr.recCount, sizeof(MapKey_t), _mapCmp);
+
+		map->hdr.root = _mapBuild(map, 0, map->hdr.recCount, 0);
+		if (map->hdr.root == 0)
+			goto err;
+	}
+
+	map->hdr.fileSize = map->hdr.trieStart + map->trieUsed;
+
+	if (_mapWriteAll(map->fd, map->trie, map->trieUsed) != 0)
+		goto err;
+
+	if (pwrite(map->fd, &map->hdr, sizeof(MapHdr_t), 0) != sizeof(MapHdr_t) ||
+			fsync(map->fd) != 0) {
+		memDbcErrorNum = FILE_ERR;
+		goto err;
+	}
+
+	close(map->fd);
+	map->fd = -1;
+
+	if (rename(map->tmpName, map->fileName) != 0) {
+		memDbcErrorNum = FILE_ERR;
+		goto err;
+	}
+
+	r = _mapSyncDir(map->fileName);
+	_mapRelease(map);
+
+	return r;
+
+err:
+	mapAbort(map);
+	return -1;
+}
+
+/*
+ * Function mapAbort throws away a mapped snapshot that is being written.
+ */
+void mapAbort(MapFile_t *map) {
+
+	if (map->fd >= 0) {
+		close(map->fd);
+		map->fd = -1;
+	}
+	unlink(map->tmpName);
+	_mapRelease(map);
+}
+
+/*
+ * Function _mapRecAt is private to this file.
+ * Returns the record at file offset pos, or NULL with FORMAT_ERR if it
+ * does not lie inside the records or its key and value are not ended.
+ */
+static MapRec_t *_mapRecAt(MapFile_t *map, uint64_t pos) {
+	MapRec_t *rec;
+	uint64_t val, key;
+
+	if (pos < map->hdr.recStart || pos >= map->hdr.recEnd || (pos & 7) != 0 ||
+			map->hdr.recEnd - pos < sizeof(MapRec_t))
+		goto bad;
+
+	rec = (MapRec_t *)(map->base + pos);
+	val = pos + sizeof(MapRec_t);
+	key = val + MAP_ALIGN((uint64_t)rec->val.len + 1);
+	if (key + MAP_ALIGN((uint64_t)rec->keyLen + 1) > map->hdr.recEnd ||
+			map->base[val + rec->val.len] != '\0' || map->base[key + rec->keyLen] != '\0')
+		goto bad;
+
+	return rec;
+
+bad:
+	memDbcErrorNum = FORMAT_ERR;
+	return NULL;
+}
+
+/*
+ * Function _mapNodeAt is private to this file.
+ * Returns the trie node at file offset pos, or NULL with FORMAT_ERR if it
+ * or its children's offsets do not lie inside the trie.
+ */
+static MapNode_t *_mapNodeAt(MapFile_t *map, uint64_t pos) {
+	MapNode_t *node;
+
+	if (pos < map->hdr.trieStart || pos >= map->hdr.fileSize || (pos & 7) != 0 ||
+			map->hdr.fileSize - pos < sizeof(MapNode_t))
+		goto bad;
+
+	node = (MapNode_t *)(map->base + pos);
+	if (node->numChildren > 256 || map->hdr.fileSize - pos <
+			MAP_ALIGN(sizeof(MapNode_t) + (uint64_t)node->prefixLen + node->numChildren) +
+			node->numChildren * sizeof(uint64_t))
+		goto bad;
+
+	return node;
+
+bad:
+	memDbcErrorNum = FORMAT_ERR;
+	return NULL;
+}
+
+/*
+ * Function mapOpen maps a snapshot written by mapClose() read only.
+ * Only the header is checked here, every record and trie node is checked
+ * against it as it is reached, so a damaged file is never read past its end.
+ */
+MapFile_t *mapOpen(char *fileName) {
+	MapFile_t *map = (MapFile_t *)calloc(1, sizeof(MapFile_t));
+	MapHdr_t *hdr;
+	struct stat st;
+
+	if (map == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+
+	map->fd = open(fileName, O_RDONLY);
+	if (map->fd < 0 || fstat(map->fd, &st) != 0) {
+		memDbcErrorNum = FILE_ERR;
+		_mapRelease(map);
+		return NULL;
+	}
+
+	if ((size_t)st.st_size < sizeof(MapHdr_t)) {
+		memDbcErrorNum = FORMAT_ERR;
+		_mapRelease(map);
+		return NULL;
+	}
+
+	map->size = st.st_size;
+	map->base = (char *)mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0);
+	if (map->base == MAP_FAILED) {
+		map->base = NULL;
+		memDbcErrorNum = FILE_ERR;
+		_mapRelease(map);
+		return NULL;
+	}
+
+	// The mapping stays good after the file is closed.
+	close(map->fd);
+	map->fd = -1;
+
+	hdr = (MapHdr_t *)map->base;
+	if (memcmp(hdr->magic, MAP_MAGIC, sizeof(hdr->magic)) != 0 ||
+			hdr->version != MAP_VERSION || hdr->fileSize != map->size ||
+			hdr->recStart < sizeof(MapHdr_t) || (hdr->recStart & 7) != 0 ||
+			hdr->recStart > hdr->recEnd || hdr->recEnd > hdr->fileSize ||
+			hdr->recIndex != hdr->recEnd ||
+			hdr->recCount > (hdr->fileSize - hdr->recIndex) / sizeof(uint64_t) ||
+			hdr->trieStart != hdr->recIndex + hdr->recCount * sizeof(uint64_t) ||
+			hdr->trieStart > hdr->fileSize || hdr->root >= hdr->fileSize ||
+			(hdr->root != 0 && hdr->root < hdr->trieStart)) {
+		memDbcErrorNum = FORMAT_ERR;
+		_mapRelease(map);
+		return NULL;
+	}
+
+	map->hdr = *hdr;
+	map->dbType = hdr->dbType;
+
+	return map;
+}
+
+/*
+ * Function mapFind returns the value stored for key or NULL.
+ * The value points into the mapping and is read only.  A damaged file
+ * returns NULL with FORMAT_ERR.
+ */
+void *mapFind(MapFile_t *map, char *key) {
+	unsigned char *p = (unsigned char *)key;
+	MapNode_t *node;
+	unsigned char *b;
+	uint32_t i;
+	int c;
+
+	if (map->hdr.root == 0)
+		return NULL;
+
+	node = _mapNodeAt(map, map->hdr.root);
+
+	// Each step down takes a byte of key, so even a damaged trie ends.
+	for (;;) {
+		if (node == NULL)
+			return NULL;
+
+		for (i = 0; i < node->prefixLen; i++, p++) {
+			c = (map->dbType == HEX_DB) ? tolower(*p) : *p;
+			if (c != node->bytes[i])
+				return NULL;
+		}
+
+		if (*p == '\0') {
+			if (node->rec == 0 || _mapRecAt(map, node->rec) == NULL)
+				return NULL;
+			return map->base + node->rec + sizeof(MapRec_t);
+		}
+
+		c = (map->dbType == HEX_DB) ? tolower(*p) : *p;
+		p++;
+
+		b = (unsigned char *)memchr(node->bytes + node->prefixLen, c, node->numChildren);
+		if (b == NULL)
+			return NULL;
+
+		i = b - (node->bytes + node->prefixLen);
+		node = _mapNodeAt(map, ((uint64_t *)((char *)node +
+				MAP_ALIGN(sizeof(MapNode_t) + node->prefixLen + node->numChildren)))[i]);
+	}
+}
+
+/*
+ * Function mapNext returns the key of the record at *pos and moves pos to
+ * the next one, or NULL after the last record.  Set *pos to 0 to start.
+ * A damaged record returns NULL with FORMAT_ERR.
+ */
+char *mapNext(MapFile_t *map, uint64_t *pos, void **data) {
+	MapRec_t *rec;
+	char *key;
+
+	if (*pos == 0)
+		*pos = map->hdr.recStart;
+	if (*pos >= map->hdr.recEnd)
+		return NULL;
+
+	rec = _mapRecAt(map, *pos);
+	if (rec == NULL)
+		return NULL;
+	*data = (char *)rec + sizeof(MapRec_t);
+	key = (char *)*data + MAP_ALIGN(rec->val.len + 1);
+
+	*pos = (key - map->base) + MAP_ALIGN(rec->keyLen + 1);
+
+	return key;
+}
+
+/*
+ * Function mapRec returns the key of record n, counting from 0 in key
+ * order, or NULL if there are not that many.
+ */
+char *mapRec(MapFile_t *map, uint64_t n, void **data) {
+	uint64_t pos;
+
+	if (n >= map->hdr.recCount)
+		return NULL;
+
+	pos = ((uint64_t *)(map->base + map->hdr.recIndex))[n];
+
+	return mapNext(map, &pos, data);
+}
+
+/*
+ * Function mapSeek returns the number of records whose key is before key,
+ * the record number of key or of the first key after it.  A damaged
+ * record returns recCount with FORMAT_ERR.
+ */
+uint64_t mapSeek(MapFile_t *map, char *key) {
+	uint64_t lo = 0, hi = map->hdr.recCount, mid;
+	void *data;
+	char *k;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		k = mapRec(map, mid, &data);
+		if (k == NULL)
+			return map->hdr.recCount;
+		if (strcmp(k, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * Function mapFree unmaps a snapshot opened by mapOpen().
+ */
+void mapFree(MapFile_t *map) {
+
+	if (map != NULL)
+		_mapRelease(map);
+}
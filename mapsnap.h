@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#ifndef _MAPSNAP_H_
+#define _MAPSNAP_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+#include "memdbc.h"
+#include "mempool.h"
+
+// Snapshot that is used in place through mmap().  Nothing in the file is
+// a pointer, every reference is a byte offset from the start of the file,
+// so the mapping can be at any address and shared by many processes.
+// Numbers are in host byte order.
+//
+//   MapHdr_t
+//   records in key order, each 8 byte aligned:
+//       MapRec_t, value bytes, NUL, pad to 8, key bytes, NUL, pad to 8
+//   uint64_t offset of each record, in key order
+//   trie nodes, each 8 byte aligned:
+//       MapNode_t, prefix bytes, child bytes, pad to 8, uint64_t child[]
+//
+// The trie is path compressed, a node holds the key bytes shared by
+// everything under it and one child per next byte.  HEX_DB keys are
+// put in the trie in lower case as the trees ignore case.  The offset
+// table lets a cursor seek by binary search and step back a record.
+#define MAP_MAGIC		"MEMDBCM1"
+#define MAP_VERSION		2
+
+// Size of the write buffer.
+#define MAP_BUF_SIZE	(1024 * 1024)
+
+#define MAP_ALIGN(n)	(((n) + 7) & ~(uint64_t)7)
+
+typedef struct _mapHdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t dbType;
+	uint64_t recCount;
+	uint64_t recStart;		// first record.
+	uint64_t recEnd;		// first byte after the records.
+	uint64_t recIndex;		// offset table, recCount entries.
+	uint64_t trieStart;		// first trie node.
+	uint64_t root;			// root trie node or 0 if empty.
+	uint64_t fileSize;
+} MapHdr_t;
+
+// The value header matches the pool's so mpValLen() works on mapped values.
+typedef struct _mapRec {
+	uint32_t keyLen;
+	uint32_t unused;
+	MpValHdr_t val;
+} MapRec_t;
+
+typedef struct _mapNode {
+	uint64_t rec;			// record of the key ending here or 0.
+	uint32_t numChildren;
+	uint32_t prefixLen;
+	unsigned char bytes[];	// prefix then the first byte of each child.
+} MapNode_t;
+
+// Key and record of one record, kept by the writer to build the trie.
+typedef struct _mapKey {
+	char *key;
+	uint64_t rec;
+} MapKey_t;
+
+typedef struct _mapFile {
+	int fd;
+	DbTypes_t dbType;
+	MapHdr_t hdr;
+	// Writers only.
+	char *fileName;
+	char *tmpName;
+	char *buf;
+	size_t used;
+	uint64_t off;			// file offset of buf[0].
+	MapKey_t *keys;
+	size_t maxKeys;
+	char *trie;				// trie is built here before it is written.
+	size_t trieSize;
+	size_t trieUsed;
+	// Readers only.
+	char *base;
+	size_t size;
+} MapFile_t;
+
+MapFile_t *mapCreate(char *fileName, DbTypes_t dbType);
+int mapWrite(MapFile_t *map, char *key, void *data, int len);
+int mapClose(MapFile_t *map);
+void mapAbort(MapFile_t *map);
+
+MapFile_t *mapOpen(char *fileName);
+void *mapFind(MapFile_t *map, char *key);
+char *mapNext(MapFile_t *map, uint64_t *pos, void **data);
+char *mapRec(MapFile_t *map, uint64_t n, void **data);
+uint64_t mapSeek(MapFile_t *map, char *key);
+void mapFree(MapFile_t *map);
+
+#endif /* _MAPSNAP_H_ */
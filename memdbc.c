@@ -23,335 +23,804 @@
  *      Author: Kelly Wiles
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE		// pthread_rwlockattr_setkind_np()
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <string.h>
 #include <regex.h>
+#include <ctype.h>
+#include <limits.h>
+#include <time.h>
 
 #include "memdbc.h"
 #include "trietree.h"
-
+#include "bptree.h"
+#include "mempool.h"
+#include "radixtree.h"
+#include "arttree.h"
+#include "epoch.h"
+#include "snapshot.h"
+#include "mapsnap.h"
+#include "wal.h"
+#include "bgsave.h"
+#include "keyidx.h"
+#include "ttl.h"
 // Local variables and functions.
-MemDbcError_t memDbcErrorNum = 0;
-
-/* keyListinsert() - Insert record key into sorted linked list.
- * memDbc - returned by memDbcInit()
- * key - Key sting to insert.
- */
-void keyListInsert(MemDbc_t *memDbc, char *key) {
-	Key_t *temp, *prev, *next;
-    temp = (Key_t*)malloc(sizeof(Key_t));
-    temp->key = strdup(key);
-    temp->ptr = NULL;
-
-    if (memDbc->head == NULL) {		// If linked list is emptt.
-		// printf("Head: %s\n", key);
-        memDbc->head = temp;
-    } else {
-        prev = NULL;
-        next = memDbc->head;
-		// look for matching key or key in list larger than key.
-        while(next != NULL && strcmp(next->key, key) < 0){
-            prev = next;
-            next = next->ptr;
-        }
-        if (next == NULL) {			// add key to end of list.
-            prev->ptr = temp;
-        } else {
-            if (prev != NULL) {		// add key to middle of list.
-                temp->ptr = prev->ptr;
-                prev-> ptr = temp;
-            } else {				// add key to start of linked list.
-                temp->ptr = memDbc->head;
-                memDbc->head = temp;
-            }
-        }
-    }
-}
-
-/* keyListDelete() - delete key from sorted linked list.
- * memDbc - returned by memDbcInit()
- * key - to remove.
- */
-void keyListDelete(MemDbc_t *memDbc, char *key) {
-
-	Key_t *next = memDbc->head;
-	Key_t *prev = NULL;
-
-	while(next != NULL) {
-		if (strcmp(key, next->key) == 0) {
-			if (prev == NULL) {
-				// Deleting first item in list.
-				memDbc->head = next->ptr;
-				free(next->key);
-				free(next);
-			} else {
-				prev->ptr = next->ptr;
-				free(next->key);
-				free(next);
-			}
-			printf("Deleted key %s\n", key);
-			break;
+__thread MemDbcError_t memDbcErrorNum = 0;
+
+// Random numbers of the eviction samples and LFU counts, see evictRand().
+static __thread unsigned int evictSeed;
+
+// Cursor over the leaves of one shard's key index.
+typedef struct _keyCursor {
+	BptLeaf_t *leaf;
+	int pos;
+} KeyCursor_t;
+
+// Merges the shard key indexes into one sorted stream.  heap holds the
+// shards that still have keys, ordered by their cursor's current key.
+// A mapped snapshot is already one sorted stream and is read in place.
+typedef struct _keyMerge {
+	int dir;				// 1 for ascending, -1 descending.
+	int num;
+	int *heap;
+	KeyCursor_t *cur;
+	MapFile_t *map;
+	uint64_t mapPos;
+	void *mapData;
+} KeyMerge_t;
+
+// Bulk load state of one shard.  The shard's keys come in sorted order,
+// the trie walk of a key starts from the path of the key before it and
+// the keys are put in the index in one go when the build is closed.
+typedef struct _shardBuild {
+	void **path;			// trie nodes of the last key, TRIE_ENGINE only.
+	size_t pathSize;
+	char *last;				// last key added or NULL.
+	size_t lastSize;
+	char **keys;
+	void ***refs;
+	size_t numKeys;
+	size_t maxKeys;
+} ShardBuild_t;
+
+// A record of memDbcLoad() with a time to live, set once the load is done.
+typedef struct _loadTtl {
+	char *key;
+	uint64_t expires;
+} LoadTtl_t;
+
+struct _memDbcBuild {
+	MemDbc_t *memDbc;
+	ShardBuild_t *shards;
+};
+
+// Pull style walk, see memDbcCursorOpen().  The cursor holds a window of
+// up to MEMDBC_CURSOR_BATCH records read in direction dir, keys[0] first.
+// No locks are held between calls.
+struct _memDbcCursor {
+	MemDbc_t *memDbc;
+	KeyMerge_t km;
+	int dir;				// 1 if the window was read forward, -1 back.
+	int num;				// records in the window.
+	int pos;				// current record or -1 if none.
+	int atEnd;				// no records past the window in dir.
+	char *keys[MEMDBC_CURSOR_BATCH];
+	void *data[MEMDBC_CURSOR_BATCH];
+	uint64_t mapPos[MEMDBC_CURSOR_BATCH];	// mapped snapshot record number + 1 of each key.
+	char *buf;				// key bytes of the window.
+	size_t bufSize;
+	char *last;				// copy of the key the next window starts from.
+	size_t lastSize;
+};
+
+// A record of a memDbcAddBatch() batch, sorted by shard and key.
+typedef struct _batchRec {
+	char *key;
+	int idx;				// place in the caller's arrays.
+	int shard;
+} BatchRec_t;
+
+// Steps of compacting one shard, see memDbcCompact().
+typedef enum {
+	COMPACT_START,		// writers are told to take the tree lock.
+	COMPACT_GATE,		// waiting for the writers that did not see that.
+	COMPACT_MOVE,		// copying the trie out of the old chunks.
+	COMPACT_DRAIN,		// waiting for memDbcValueAlloc() records from them.
+	COMPACT_FREE,		// waiting for readers to leave the old chunks.
+	COMPACT_RELEASE		// giving the old chunks back to the system.
+} CompactPhase_t;
+
+// A memDbcCompact() run, kept between calls.  Shards are done one at a time.
+typedef struct _compact {
+	int shard;
+	CompactPhase_t phase;
+	unsigned long epoch;	// epoch the phase waits to pass.
+	TrieCursor_t tc;
+} Compact_t;
+
+/* intHash() - Returns the hash of an INT_ENGINE key.
+ */
+static inline unsigned int intHash(uint64_t key) {
+
+	// Fibonacci hashing, the high bits depend on all of the key.
+	return (unsigned int)((key * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+/* keyHash() - Returns the hash of key.
+ * memDbc - returned by memDbcInit()
+ */
+static inline unsigned int keyHash(MemDbc_t *memDbc, char *key) {
+	unsigned int h = 2166136261u;
+	unsigned char *p;
+	uint64_t val = 0;
+
+	// Integer keys hash the same from memDbcAdd() and memDbcAddInt().
+	if (memDbc->engine == INT_ENGINE) {
+		keyToInt(key, &val);
+		return intHash(val);
+	}
+
+	// FNV-1a, hex keys are folded to lower case as the trees ignore case.
+	for (p = (unsigned char *)key; *p != '\0'; p++) {
+		h ^= (memDbc->dbType == HEX_DB) ? (unsigned int)tolower(*p) : *p;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/* keyShard() - Returns the shard that holds key.
+ * memDbc - returned by memDbcInit()
+ */
+static inline MemDbcShard_t *keyShard(MemDbc_t *memDbc, char *key) {
+
+	if (memDbc->numShards == 1)
+		return memDbc->shards;
+
+	return &memDbc->shards[keyHash(memDbc, key) % memDbc->numShards];
+}
+
+/* intShard() - Returns the shard that holds an INT_ENGINE key.
+ * memDbc - returned by memDbcInit()
+ */
+static inline MemDbcShard_t *intShard(MemDbc_t *memDbc, uint64_t key) {
+
+	if (memDbc->numShards == 1)
+		return memDbc->shards;
+
+	return &memDbc->shards[intHash(key) % memDbc->numShards];
+}
+
+/* keyFold() - Returns key with the letters of a HEX_DB key in lower case.
+ * The trees ignore the case of hex digits, the key index, log, TTL table
+ * and snapshots are given the same spelling so a key is one entry in each.
+ * Returns key if there is nothing to fold, else buf or a malloc()ed copy
+ * if it does not fit, keyFoldEnd() frees it.  NULL if out of memory.
+ * memDbc - returned by memDbcInit()
+ * buf - MEMDBC_KEY_FOLD bytes or NULL to always copy to the heap.
+ */
+static char *keyFold(MemDbc_t *memDbc, char *key, char *buf) {
+	size_t len, i;
+	char *f;
+
+	if (memDbc->dbType != HEX_DB || key == NULL)
+		return key;
+
+	for (i = 0; key[i] != '\0' && !isupper((unsigned char)key[i]); i++)
+		;
+	if (key[i] == '\0')
+		return key;
+
+	len = strlen(key) + 1;
+	f = (buf != NULL && len <= MEMDBC_KEY_FOLD) ? buf : (char *)malloc(len);
+	if (f == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+	for (i = 0; i < len; i++)
+		f[i] = tolower((unsigned char)key[i]);
+
+	return f;
+}
+
+/* keyFoldEnd() - Frees what keyFold() returned for key.
+ */
+static inline void keyFoldEnd(char *folded, char *key, char *buf) {
+
+	if (folded != key && folded != buf)
+		free(folded);
+}
+
+/* dbKeyCheck() - keyCheck() for the database, INT_ENGINE keys must also be
+ * keyWidth digits and fit a uint64_t.  Returns the key length or -1.
+ * memDbc - returned by memDbcInit()
+ */
+static inline int dbKeyCheck(MemDbc_t *memDbc, char *key) {
+	uint64_t val;
+	int len = keyCheck(memDbc->dbType, key);
+
+	if (len < 0 || memDbc->engine != INT_ENGINE)
+		return len;
+
+	if (len != memDbc->keyWidth || keyToInt(key, &val) != 0) {
+		memDbcErrorNum = KEY_ERR;
+		return -1;
+	}
+
+	return len;
+}
+
+/* lockIndexes() - Locks the key index of every shard, in shard order.
+ * memDbc - returned by memDbcInit()
+ */
+static void lockIndexes(MemDbc_t *memDbc) {
+	int i;
+
+	for (i = 0; i < memDbc->numShards; i++)
+		pthread_mutex_lock(&memDbc->shards[i].indexLock);
+}
+
+static void unlockIndexes(MemDbc_t *memDbc) {
+	int i;
+
+	for (i = memDbc->numShards - 1; i >= 0; i--)
+		pthread_mutex_unlock(&memDbc->shards[i].indexLock);
+}
+
+/* keyCursorKey() - Returns the key under a cursor.
+ */
+static inline char *keyCursorKey(KeyCursor_t *c) {
+	return c->leaf->hdr.keys[c->pos];
+}
+
+/* keyCursorStep() - Moves a cursor to the next key in direction dir,
+ * over empty leaves.  Returns 0 past the end.
+ */
+static int keyCursorStep(KeyCursor_t *c, int dir) {
+
+	if (dir > 0) {
+		if (++c->pos < c->leaf->hdr.count)
+			return 1;
+		do {
+			c->leaf = c->leaf->next;
+		} while (c->leaf != NULL && c->leaf->hdr.count == 0);
+		c->pos = 0;
+	} else {
+		if (--c->pos >= 0)
+			return 1;
+		do {
+			c->leaf = c->leaf->prev;
+		} while (c->leaf != NULL && c->leaf->hdr.count == 0);
+		c->pos = (c->leaf != NULL) ? c->leaf->hdr.count - 1 : 0;
+	}
+
+	return c->leaf != NULL;
+}
+
+/* keyCursorSeek() - Puts a cursor on the first key past bound in direction
+ * dir, or on bound itself if incl.  bound NULL is the first or last key.
+ * Returns 0 if there is none.
+ */
+static int keyCursorSeek(KeyCursor_t *c, BpTree_t *tree, char *bound, int dir, int incl) {
+	int pos;
+
+	if (bound != NULL) {
+		c->leaf = bptSeek(tree, bound, &pos);
+		if (c->leaf != NULL) {
+			c->pos = pos;
+			if (dir > 0 && (incl || strcmp(keyCursorKey(c), bound) != 0))
+				return 1;
+			if (dir < 0 && incl && strcmp(keyCursorKey(c), bound) == 0)
+				return 1;
+			return keyCursorStep(c, dir);
 		}
-		prev = next;
-		next = next->ptr;
+		// Every key is before bound.
+		if (dir > 0)
+			return 0;
+	}
+
+	// Start just outside the end and step onto it.
+	c->leaf = (dir > 0) ? tree->first : tree->last;
+	if (c->leaf == NULL)
+		return 0;
+	c->pos = (dir > 0) ? -1 : c->leaf->hdr.count;
+
+	return keyCursorStep(c, dir);
+}
+
+/* keyMergeDown() - Moves heap entry i down to its place.
+ */
+static void keyMergeDown(KeyMerge_t *km, int i) {
+	int c, t;
+
+	for (;;) {
+		c = i * 2 + 1;
+		if (c >= km->num)
+			break;
+		if (c + 1 < km->num && km->dir *
+				strcmp(keyCursorKey(&km->cur[km->heap[c + 1]]), keyCursorKey(&km->cur[km->heap[c]])) < 0)
+			c++;
+		if (km->dir * strcmp(keyCursorKey(&km->cur[km->heap[c]]), keyCursorKey(&km->cur[km->heap[i]])) >= 0)
+			break;
+		t = km->heap[i];
+		km->heap[i] = km->heap[c];
+		km->heap[c] = t;
+		i = c;
+	}
+}
+
+/* keyMergeInit() - Starts a sorted merge of all shard key indexes.
+ * The caller must hold the index locks.  Returns -1 if out of memory.
+ * memDbc - returned by memDbcInit()
+ */
+int keyMergeInit(MemDbc_t *memDbc, KeyMerge_t *km) {
+	BptLeaf_t *leaf;
+	int i;
+
+	km->dir = 1;
+	km->num = 0;
+	km->map = (MapFile_t *)memDbc->map;
+	km->mapPos = 0;
+	if (km->map != NULL) {
+		km->heap = NULL;
+		km->cur = NULL;
+		return 0;
+	}
+
+	km->heap = (int *)malloc(memDbc->numShards * sizeof(int));
+	km->cur = (KeyCursor_t *)malloc(memDbc->numShards * sizeof(KeyCursor_t));
+	if (km->heap == NULL || km->cur == NULL) {
+		free(km->heap);
+		free(km->cur);
+		memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+
+	for (i = 0; i < memDbc->numShards; i++) {
+		leaf = ((BpTree_t *)memDbc->shards[i].index)->first;
+		while (leaf != NULL && leaf->hdr.count == 0)
+			leaf = leaf->next;
+		if (leaf == NULL)
+			continue;
+		km->cur[i].leaf = leaf;
+		km->cur[i].pos = 0;
+		km->heap[km->num++] = i;
+	}
+
+	for (i = km->num / 2 - 1; i >= 0; i--)
+		keyMergeDown(km, i);
+
+	return 0;
+}
+
+/* keyMergeNext() - Returns the next key in sorted order and the address
+ * of its data pointer, or NULL at the end.  A mapped snapshot is only
+ * read forward.
+ */
+char *keyMergeNext(KeyMerge_t *km, void ***ref) {
+	KeyCursor_t *c;
+	char *key;
+
+	if (km->map != NULL) {
+		*ref = &km->mapData;
+		return mapNext(km->map, &km->mapPos, &km->mapData);
 	}
+
+	if (km->num == 0)
+		return NULL;
+
+	c = &km->cur[km->heap[0]];
+	key = keyCursorKey(c);
+	*ref = c->leaf->data[c->pos];
+
+	if (keyCursorStep(c, km->dir) == 0)
+		km->heap[0] = km->heap[--km->num];		// shard is done.
+
+	keyMergeDown(km, 0);
+
+	return key;
 }
 
-/* keyListWalk() - Walks the sorted linked list and call the callback function.
+static void keyMergeEnd(KeyMerge_t *km) {
+
+	free(km->heap);
+	free(km->cur);
+}
+
+/* keyIndexWalk() - Walks the key index leaves in sorted order and call the callback function.
  * memDbc - returned by memDbcInit()
  * callback - the user supplied callback fucntion.
  */
-void keyListWalk(MemDbc_t *memDbc, char *(*callback)(char *key, void *data)) {
+void keyIndexWalk(MemDbc_t *memDbc, char *(*callback)(char *key, void *data)) {
 
-	Key_t *next = memDbc->head;
+	KeyMerge_t km;
+	void **ref = NULL;
 	void *data = NULL;
+	char *key;
+
+	if (keyMergeInit(memDbc, &km) != 0)
+		return;
 
 	printf("Walking sorted list:\n");
-	while(next != NULL) {
-		switch (memDbc->dbType) {
-			case ASCII_DB:
-				data = attLookup(memDbc->tree, next->key);
-				break;
-			case DIGITAL_DB:
-				data = dttLookup(memDbc->tree, next->key);
-				break;
-			case HEX_DB:
-				data = httLookup(memDbc->tree, next->key);
-				break;
-			case OCTAL_DB:
-				data = ottLookup(memDbc->tree, next->key);
-				break;
-			default:
-				memDbcErrorNum = UNKNOWN_TYPE;
-				break;
-		}
+	while ((key = keyMergeNext(&km, &ref)) != NULL) {
+		data = AtomicGet(ref);
+		if (data == NULL)
+			continue;		// deleted by a writer that has not reached the index yet.
 
 		if (callback == NULL)
-			printf("  Key=%s, Value=%s\n", next->key, (char *)data);
+			printf("  Key=%s, Value=%s\n", key, (char *)data);
 		else {
-			char *s = callback(next->key, data);
+			char *s = callback(key, data);
 			if ( s != NULL) {
 				printf("  %s\n", s);
 				free(s);
 			}
 		}
-		next = next->ptr;
 	}
+
+	keyMergeEnd(&km);
 }
 
-/* keyListSave() - Walks the sorted linked list and calls the callback function.
+/* keyIndexSave() - Walks the key index leaves in sorted order and calls the callback function.
  * memDbc - returned by memDbcInit()
  * fileName - file name to save data to or NULL if user is saving the records.
  * callback - the user supplied callback fucntion.
  */
-void keyListSave(MemDbc_t *memDbc, char *fileName, char *(*callback)(char *key, void *data)) {
+void keyIndexSave(MemDbc_t *memDbc, char *fileName, char *(*callback)(char *key, void *data)) {
 
-	Key_t *next = memDbc->head;
+	KeyMerge_t km;
+	void **ref = NULL;
 	void *data = NULL;
 	FILE *out = NULL;
+	char *key;
 
-	if (fileName != NULL)
-		out = fopen(fileName, "w");
+	if (keyMergeInit(memDbc, &km) != 0)
+		return;
 
-	while(next != NULL) {
-		switch (memDbc->dbType) {
-			case ASCII_DB:
-				data = attLookup(memDbc->tree, next->key);
-				break;
-			case DIGITAL_DB:
-				data = dttLookup(memDbc->tree, next->key);
-				break;
-			case HEX_DB:
-				data = httLookup(memDbc->tree, next->key);
-				break;
-			case OCTAL_DB:
-				data = ottLookup(memDbc->tree, next->key);
-				break;
-			default:
-				memDbcErrorNum = UNKNOWN_TYPE;
-				break;
+	if (fileName != NULL) {
+		out = fopen(fileName, "w");
+		if (out == NULL) {
+			memDbcErrorNum = FILE_ERR;
+			keyMergeEnd(&km);
+			return;
 		}
+	} else if (callback == NULL) {
+		memDbcErrorNum = CALLBACK_NULL;
+		keyMergeEnd(&km);
+		return;
+	}
+
+	while ((key = keyMergeNext(&km, &ref)) != NULL) {
+		data = AtomicGet(ref);
+		if (data == NULL)
+			continue;		// deleted by a writer that has not reached the index yet.
 
 		if (callback == NULL) {
-			// Save a record per line.
-			fprintf(out, "%s,%s\n", next->key, (char *)data);
+			// Save a record per line, the stored length is used so the
+			// value is not scanned for its end.
+			int len = mpValLen(data);
+
+			if (len > 0 && ((char *)data)[len - 1] == '\0')
+				len--;		// added with its terminator.
+			fprintf(out, "%s,", key);
+			fwrite(data, 1, len, out);
+			fputc('\n', out);
 		} else {
 			if (fileName != NULL) {
-				char *s = callback(next->key, data);
+				char *s = callback(key, data);
 				if (s != NULL) {
 					fprintf(out, "%s\n", s);
 					free(s);		// free memory allocated by callback.
 				}
 			} else {
 				// Caller is saving the data.
-				callback(next->key, data);
+				callback(key, data);
 			}
 		}
-		next = next->ptr;
 	}
 	if (fileName != NULL)
 		fclose(out);
+
+	keyMergeEnd(&km);
 }
 
-/* allocateRoot() - Allocates the root node of the given type.
+/* treeNodeSize() - Returns the size of a trie node of the given type.
  * memDbc - returned by memDbcInit()
  */
-void *allocateRoot(MemDbc_t *memDbc) {
-	void *p = NULL;
+size_t treeNodeSize(MemDbc_t *memDbc) {
+	size_t n = 0;
+
+	if (memDbc->engine == RADIX_ENGINE)
+		return sizeof(RadixTreeNode);
+	if (memDbc->engine == ART_ENGINE)
+		return sizeof(ArtNode4) + sizeof(ArtLeaf);
+	if (memDbc->engine == INT_ENGINE)
+		return sizeof(ArtNode4) + sizeof(ArtLeaf) + sizeof(uint64_t);
+	if (memDbc->stride > 1)
+		return wttNodeSize(memDbc->dbType, memDbc->stride);
 
 	switch (memDbc->dbType) {
 		case ASCII_DB:
-			p = (void *)calloc(1, sizeof(AsciiTrieTree));
+			n = sizeof(AsciiTrieTreeNode);
 			break;
 		case DIGITAL_DB:
-			p = (void *)calloc(1, sizeof(DigitalTrieTree));
+			n = sizeof(DigitalTrieTreeNode);
 			break;
 		case HEX_DB:
-			p = (void *)calloc(1, sizeof(HexTrieTree));
+			n = sizeof(HexTrieTreeNode);
 			break;
 		case OCTAL_DB:
-			p = (void *)calloc(1, sizeof(OctalTrieTree));
+			n = sizeof(OctalTrieTreeNode);
 			break;
 		default:
 			memDbcErrorNum = UNKNOWN_TYPE;
 			break;
 	}
 
-	return p;
+	return n;
+}
+
+/* strideOk() - Returns 1 if the tree can take memDbc->stride digits a level.
+ * memDbc - returned by memDbcInit()
+ */
+static int strideOk(MemDbc_t *memDbc) {
+
+	if (memDbc->engine == TRIE_ENGINE)
+		return wttNodeSize(memDbc->dbType, memDbc->stride) != 0;
+
+	if (memDbc->engine == ART_ENGINE)
+		return (memDbc->dbType == HEX_DB || memDbc->dbType == OCTAL_DB) && memDbc->stride <= ART_MAX_STRIDE;
+
+	return 0;
 }
 
 /* initTree() - initalize the given type of tree.
  * memDbc - returned by memDbcInit()
+ * shard - the shard the tree is for.
  */
-void *initTree(MemDbc_t *memDbc) {
+void *initTree(MemDbc_t *memDbc, MemDbcShard_t *shard) {
 	void *p = NULL;
 
-	switch (memDbc->dbType) {
-		case ASCII_DB:
-			p = (void *)attInit();
-			break;
-		case DIGITAL_DB:
-			p = (void *)dttInit();
-			break;
-		case HEX_DB:
-			p = (void *)httInit();
-			break;
-		case OCTAL_DB:
-			p = (void *)ottInit();
-			break;
-		default:
-			memDbcErrorNum = UNKNOWN_TYPE;
-			break;
+	if (memDbc->engine == RADIX_ENGINE) {
+		// The radix tree only handles ASCII keys.
+		if (memDbc->dbType == ASCII_DB)
+			p = (void *)rttInit(shard->pool);
+		else
+			memDbcErrorNum = OPTION_ERR;
+	} else if (memDbc->engine == ART_ENGINE) {
+		p = (void *)artInit(shard->pool, memDbc->dbType);
+		if (p != NULL)
+			((ArtTree *)p)->stride = memDbc->stride;
+	} else if (memDbc->engine == INT_ENGINE) {
+		// Integer keys are numbers, only DIGITAL_DB keys are.
+		if (memDbc->dbType == DIGITAL_DB)
+			p = (void *)artInit(shard->pool, memDbc->dbType);
+		else
+			memDbcErrorNum = OPTION_ERR;
+		if (p != NULL)
+			((ArtTree *)p)->intKeys = 1;
+	} else if (memDbc->stride > 1) {
+		p = (void *)wttInit(shard->pool, memDbc->dbType, memDbc->stride);
+	} else {
+		switch (memDbc->dbType) {
+			case ASCII_DB:
+				p = (void *)attInit(shard->pool);
+				break;
+			case DIGITAL_DB:
+				p = (void *)dttInit(shard->pool);
+				break;
+			case HEX_DB:
+				p = (void *)httInit(shard->pool);
+				break;
+			case OCTAL_DB:
+				p = (void *)ottInit(shard->pool);
+				break;
+			default:
+				memDbcErrorNum = UNKNOWN_TYPE;
+				break;
+		}
 	}
 
+	if (p == NULL && memDbcErrorNum == MEMDBC_OK)
+		memDbcErrorNum = MALLOC_ERR;
+
 	return p;
 }
 
-// Exported functions.
+/* evictRand() - Returns the thread's evictSeed, seeded from the thread and
+ * the clock the first time so threads do not all sample the same records.
+ */
+static inline unsigned int *evictRand(void) {
+	struct timespec ts;
 
-/* memDbInit() - Initalize the MemDbc_t struture.
- * dbType - The type of database user wants.
+	if (evictSeed == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		evictSeed = (unsigned int)((uintptr_t)pthread_self() * 2654435761u) ^ (unsigned int)ts.tv_nsec;
+		if (evictSeed == 0)
+			evictSeed = 1;
+	}
+
+	return &evictSeed;
+}
+
+/* evictClock() - Returns the milliseconds since the database was made.
+ * memDbc - returned by memDbcInit()
  */
-MemDbc_t *memDbcInit(DbTypes_t dbType) {
+static inline uint64_t evictClock(MemDbc_t *memDbc) {
+	struct timespec ts;
 
-	memDbcErrorNum = MEMDBC_OK;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
 
-	MemDbc_t *memDbc = (MemDbc_t *)calloc(sizeof(MemDbc_t), 1);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - memDbc->evictStart;
+}
 
-	if (memDbc == NULL) {
-		memDbcErrorNum = MALLOC_ERR;
-		return NULL;
+/* evictStamp() - Returns the access stamp of a record used now, never 0.
+ * For EVICT_LRU it is the tick of MEMDBC_LRU_MS, for EVICT_LFU the minute
+ * above the low byte and the count of uses in it.
+ * memDbc - returned by memDbcInit()
+ * old - the record's stamp, 0 if it has none.
+ */
+static unsigned int evictStamp(MemDbc_t *memDbc, unsigned int old) {
+	uint64_t clock = evictClock(memDbc);
+	unsigned int minute;
+	int count, idle;
+
+	if (memDbc->evict == EVICT_LRU)
+		return (clock / MEMDBC_LRU_MS) % MP_VAL_STAMP_MAX + 1;
+
+	minute = clock / 60000 + 1;
+	count = MEMDBC_LFU_INIT;
+	if (old != 0) {
+		idle = (minute - (old >> 8)) & (MP_VAL_STAMP_MAX >> 8);
+		count = (idle < (int)(old & 0xff)) ? (int)(old & 0xff) - idle : 0;
 	}
+	if (count < 255 && rand_r(evictRand()) % ((count > MEMDBC_LFU_INIT ? count - MEMDBC_LFU_INIT : 0) * MEMDBC_LFU_FACTOR + 1) == 0)
+		count++;
 
-	memDbc->dbType = dbType;
-	memDbc->tree = allocateRoot(memDbc);
+	return ((minute & (MP_VAL_STAMP_MAX >> 8)) << 8) | count;
+}
 
-	if (memDbcErrorNum != MEMDBC_OK) {
-		if (memDbc != NULL && memDbc->tree != NULL)
-			free(memDbc->tree);
-		if (memDbc != NULL)
-			free(memDbc);
-		memDbc = NULL;
+/* evictTouch() - Stamps a record a reader found, inside its epoch.  The
+ * stamp is only written when it changes, so readers of a busy record do
+ * not all write to it.
+ * memDbc - returned by memDbcInit()
+ */
+static inline void evictTouch(MemDbc_t *memDbc, void *data) {
+	unsigned int old = mpValStamp(data);
+	unsigned int now = evictStamp(memDbc, old);
+
+	// A reader that loses to another one leaves its stamp.
+	if (now != old)
+		mpValSetStamp(data, old, now);
+}
+
+/* evictNew() - Stamps a record just stored, under the writer's locks.
+ * memDbc - returned by memDbcInit()
+ * ref - address of the data pointer in the tree.
+ */
+static inline void evictNew(MemDbc_t *memDbc, void **ref) {
+	void *data = AtomicGet(ref);
+
+	if (data != NULL)
+		mpValSetStamp(data, mpValStamp(data), evictStamp(memDbc, 0));
+}
+
+/* evictScore() - Returns how much a record should be evicted, the higher
+ * the sooner.  A record stored before there was a stamp is stamped as
+ * used now.
+ * memDbc - returned by memDbcInit()
+ */
+static unsigned int evictScore(MemDbc_t *memDbc, void *data) {
+	unsigned int old = mpValStamp(data);
+	uint64_t clock;
+	unsigned int minute, idle, count;
+
+	if (old == 0) {
+		mpValSetStamp(data, 0, evictStamp(memDbc, 0));
+		return 0;
 	}
 
-	initTree(memDbc);
+	clock = evictClock(memDbc);
 
-	return memDbc;
+	// Ticks since it was used.
+	if (memDbc->evict == EVICT_LRU)
+		return ((clock / MEMDBC_LRU_MS) % MP_VAL_STAMP_MAX + 1 - old + MP_VAL_STAMP_MAX) % MP_VAL_STAMP_MAX;
+
+	// Uses it is short of 255, after taking off the minutes unused, and
+	// of records as often used the one unused longest first.
+	minute = clock / 60000 + 1;
+	idle = (minute - (old >> 8)) & (MP_VAL_STAMP_MAX >> 8);
+	count = (idle < (old & 0xff)) ? (old & 0xff) - idle : 0;
+
+	return ((255 - count) << 22) | idle;
 }
 
-/* memDbcAdd() - Add a record to the database.
+/* shardUsed() - Returns the bytes a shard counts against its part of
+ * maxMemory, its pool and key index and a part of the expiry times.
  * memDbc - returned by memDbcInit()
- * key - the key to store data under.
- * data - the data to store.
- * len - Length of the data.
+ * shard - the shard to look at.
  */
-int memDbcAdd(MemDbc_t *memDbc, char *key, void *data, int len) {
+static size_t shardUsed(MemDbc_t *memDbc, MemDbcShard_t *shard) {
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	size_t n = mpUsed(shard->pool) + AtomicGet(&((BpTree_t *)shard->index)->bytes);
 
-	int r = 0;
+	if (ttl != NULL)
+		n += ttlBytes(ttl) / memDbc->numShards;
 
-	switch (memDbc->dbType) {
+	return n;
+}
+
+/* treeInsert() - Insert or update a key in the tree.
+ * memDbc - returned by memDbcInit()
+ * shard - the shard holding key.
+ * ref - set to the address of the data pointer in the tree.
+ */
+int treeInsert(MemDbc_t *memDbc, MemDbcShard_t *shard, char *key, void *data, int len, void ***ref) {
+	int r = -1;
+
+	if (memDbc->engine == RADIX_ENGINE)
+		r = rttInsert(shard->tree, key, data, len, ref);
+	else if (memDbc->engine == ART_ENGINE || memDbc->engine == INT_ENGINE)
+		r = artInsert(shard->tree, key, data, len, ref);
+	else if (memDbc->stride > 1)
+		r = wttInsert(shard->tree, key, data, len, ref);
+	else switch (memDbc->dbType) {
 		case ASCII_DB:
-			r = attInsert(memDbc->tree, key, data, len);
-			if (r == 1) {
-				// key already exists in trie tree then do NOT add to sorted link list.
-				keyListInsert(memDbc, key);
-				memDbc->recCount++;
-			}
+			r = attInsert(shard->tree, key, data, len, ref);
 			break;
 		case DIGITAL_DB:
-			r = dttInsert(memDbc->tree, key, data, len);
-			if (r == 1) {
-				// key already exists in trie tree then do NOT add to sorted link list.
-				keyListInsert(memDbc, key);
-				memDbc->recCount++;
-			}
+			r = dttInsert(shard->tree, key, data, len, ref);
 			break;
 		case HEX_DB:
-			r = httInsert(memDbc->tree, key, data, len);
-			if (r == 1) {
-				// key already exists in trie tree then do NOT add to sorted link list.
-				keyListInsert(memDbc, key);
-				memDbc->recCount++;
-			}
+			r = httInsert(shard->tree, key, data, len, ref);
 			break;
 		case OCTAL_DB:
-			r = ottInsert(memDbc->tree, key, data, len);
-			if (r == 1) {
-				// key already exists in trie tree then do NOT add to sorted link list.
-				keyListInsert(memDbc, key);
-				memDbc->recCount++;
-			}
+			r = ottInsert(shard->tree, key, data, len, ref);
 			break;
 		default:
 			memDbcErrorNum = UNKNOWN_TYPE;
-			return -1;
+			break;
 	}
 
+	// A new record counts as just used.
+	if ((r == 1 || r == 2) && memDbc->evict != EVICT_NONE)
+		evictNew(memDbc, *ref);
+
 	return r;
 }
 
-/* memDbcFind() - Find a single rcord in database.
+/* treeLookup() - Returns the data stored for key or NULL.
  * memDbc - returned by memDbcInit()
- * key - to look for.
+ * shard - the shard holding key.
  */
-void *memDbcFind(MemDbc_t * memDbc, char *key) {
+void *treeLookup(MemDbc_t *memDbc, MemDbcShard_t *shard, char *key) {
 	void *rec = NULL;
 
+	if (memDbc->engine == RADIX_ENGINE)
+		return rttLookup(shard->tree, key);
+	if (memDbc->engine == ART_ENGINE || memDbc->engine == INT_ENGINE)
+		return artLookup(shard->tree, key);
+	if (memDbc->stride > 1)
+		return wttLookup(shard->tree, key);
+
 	switch (memDbc->dbType) {
 		case ASCII_DB:
-			rec = attLookup(memDbc->tree, key);
+			rec = attLookup(shard->tree, key);
 			break;
 		case DIGITAL_DB:
-			rec = dttLookup(memDbc->tree, key);
+			rec = dttLookup(shard->tree, key);
 			break;
 		case HEX_DB:
-			rec = httLookup(memDbc->tree, key);
+			rec = httLookup(shard->tree, key);
 			break;
 		case OCTAL_DB:
-			rec = ottLookup(memDbc->tree, key);
+			rec = ottLookup(shard->tree, key);
 			break;
 		default:
 			memDbcErrorNum = UNKNOWN_TYPE;
@@ -361,110 +830,2859 @@ void *memDbcFind(MemDbc_t * memDbc, char *key) {
 	return rec;
 }
 
-/* memDbcDelete() - Marks a record as deleted.
+/* treeDelete() - Removes key from the tree, returns 0 or -1 if not found.
+ * memDbc - returned by memDbcInit()
+ * shard - the shard holding key.
  */
-int memDbcDelete(MemDbc_t * memDbc, char *key) {
+int treeDelete(MemDbc_t *memDbc, MemDbcShard_t *shard, char *key) {
 	int r = -1;
 
+	if (memDbc->engine == RADIX_ENGINE)
+		return rttDelete(shard->tree, key);
+	if (memDbc->engine == ART_ENGINE || memDbc->engine == INT_ENGINE)
+		return artDelete(shard->tree, key);
+	if (memDbc->stride > 1)
+		return wttDelete(shard->tree, key);
+
 	switch (memDbc->dbType) {
 		case ASCII_DB:
-			r = attDelete(memDbc->tree, key);
+			r = attDelete(shard->tree, key);
 			break;
 		case DIGITAL_DB:
-			r = dttDelete(memDbc->tree, key);
+			r = dttDelete(shard->tree, key);
 			break;
 		case HEX_DB:
-			r = httDelete(memDbc->tree, key);
+			r = httDelete(shard->tree, key);
 			break;
 		case OCTAL_DB:
-			r = ottDelete(memDbc->tree, key);
+			r = ottDelete(shard->tree, key);
 			break;
 		default:
 			memDbcErrorNum = UNKNOWN_TYPE;
 			break;
 	}
 
-	if (r == 0) {
-		keyListDelete(memDbc, key);
+	return r;
+}
+
+/* treeRef() - Returns the address of the data pointer of key in a trie,
+ * or NULL if key is not in it.  A trie node is retired once no key is
+ * left under it, the key index is set from this under the index lock
+ * rather than from the ref an insert returned.
+ * memDbc - returned by memDbcInit()
+ * shard - the shard holding key.
+ */
+static void **treeRef(MemDbc_t *memDbc, MemDbcShard_t *shard, char *key) {
+	void **ref = NULL;
+
+	if (memDbc->stride > 1) {
+		WideTrieTreeLeaf *leaf = wttFindEnd(shard->tree, key);
+
+		if (leaf != NULL)
+			ref = &leaf->data;
+	} else {
+		switch (memDbc->dbType) {
+			case ASCII_DB: {
+				AsciiTrieTreeNode *node = attFindEnd(shard->tree, key);
+				if (node != NULL)
+					ref = &node->data;
+				break;
+			}
+			case DIGITAL_DB: {
+				DigitalTrieTreeNode *node = dttFindEnd(shard->tree, key);
+				if (node != NULL)
+					ref = &node->data;
+				break;
+			}
+			case HEX_DB: {
+				HexTrieTreeNode *node = httFindEnd(shard->tree, key);
+				if (node != NULL)
+					ref = &node->data;
+				break;
+			}
+			case OCTAL_DB: {
+				OctalTrieTreeNode *node = ottFindEnd(shard->tree, key);
+				if (node != NULL)
+					ref = &node->data;
+				break;
+			}
+			default:
+				memDbcErrorNum = UNKNOWN_TYPE;
+				break;
+		}
 	}
 
-	return r;
+	if (ref == NULL || AtomicGet(ref) == NULL)
+		return NULL;
+
+	return ref;
 }
 
-/* memDbcFindAll() - Find all regex matching records.
+/* treeIndex() - Sets the key index entry of a trie key to what the tree
+ * holds now, called with the index lock held after a trie writer.  Each
+ * writer that adds or takes out a key does this before it leaves its
+ * epoch, so the index never points at a node that has been freed.  key
+ * must be folded by keyFold(), the index compares keys as they are and
+ * a HEX_DB key in another case would leave the old entry behind.
  * memDbc - returned by memDbcInit()
- * regexStr - regex pattern to match to.
- * callback - user supplied callback function.
+ * shard - the shard holding key.
  */
-void memDbcFindAll(MemDbc_t *memDbc, char *regexStr, void (*callback)(char *key, void *data)) {
-	Key_t *next = memDbc->head;
-	void *data = NULL;
+static void treeIndex(MemDbc_t *memDbc, MemDbcShard_t *shard, char *key) {
+	void **ref = treeRef(memDbc, shard, key);
 
-	if (callback == NULL) {
-		memDbcErrorNum = CALLBACK_NULL;
-		return;
+	if (ref != NULL)
+		bptInsert(shard->index, key, ref);
+	else
+		bptDelete(shard->index, key);
+}
+
+/* trieGate() - Trie writers do not lock, but while memDbcCompact() moves
+ * a shard's nodes they share its tree lock so a step can keep them out.
+ * Called inside the writer's epoch, memDbcCompact() waits for it to pass
+ * after setting compacting.  Returns 1 if the lock was taken.
+ * shard - the shard written to.
+ */
+static inline int trieGate(MemDbcShard_t *shard) {
+
+	if (AtomicGet(&shard->compacting) == 0)
+		return 0;
+
+	pthread_rwlock_rdlock(&shard->treeLock);
+
+	return 1;
+}
+
+/* evictShard() - Deletes records of a shard while it is over its share of
+ * maxMemory, at most max so an add does a bounded amount of work.  Each
+ * one is the worst of MEMDBC_EVICT_SAMPLES keys picked at random from the
+ * key index, no walk is needed.
+ * memDbc - returned by memDbcInit()
+ * shard - the shard just added to.
+ * max - most records to delete.
+ */
+static void evictShard(MemDbc_t *memDbc, MemDbcShard_t *shard, int max) {
+	unsigned int score, best = 0;
+	char *key, *victim;
+	void **ref;
+	void *data;
+	int i, n;
+
+	for (n = 0; n < max && shardUsed(memDbc, shard) > memDbc->shardMemory; n++) {
+		victim = NULL;
+
+		// The records sampled may be updated or deleted as they are looked at.
+		epEnter();
+		pthread_mutex_lock(&shard->indexLock);
+		for (i = 0; i < MEMDBC_EVICT_SAMPLES; i++) {
+			key = bptSample(shard->index, evictRand(), &ref);
+			if (key == NULL)
+				break;
+			data = AtomicGet(ref);
+			if (data == NULL)
+				continue;
+			score = evictScore(memDbc, data);
+			if (victim == NULL || score > best) {
+				victim = key;
+				best = score;
+			}
+		}
+		// The index key goes with the record.
+		if (victim != NULL)
+			victim = strdup(victim);
+		pthread_mutex_unlock(&shard->indexLock);
+		epExit();
+
+		if (victim == NULL)
+			break;
+
+		memDbcDelete(memDbc, victim);
+		free(victim);
 	}
+}
 
-	regex_t regex;
+// Exported functions.
 
-	int r = regcomp(&regex, regexStr, 0);
-	if (r != 0) {
-		memDbcErrorNum = REGEX_ERR;
+/* memDbInit() - Initalize the MemDbc_t struture.
+ * dbType - The type of database user wants.
+ */
+MemDbc_t *memDbcInit(DbTypes_t dbType) {
+
+	return memDbcInitOpts(dbType, NULL);
+}
+
+/* memDbInitOpts() - Initalize the MemDbc_t struture with options.
+ * dbType - The type of database user wants.
+ * opts - Tuning options or NULL for the defaults.
+ */
+MemDbc_t *memDbcInitOpts(DbTypes_t dbType, MemDbcOpts_t *opts) {
+	MemDbcShard_t *shard;
+	pthread_rwlockattr_t attr;
+	size_t reserve = 0;
+	int flags = 0;
+	int i;
+
+	memDbcErrorNum = MEMDBC_OK;
+
+	MemDbc_t *memDbc = (MemDbc_t *)calloc(sizeof(MemDbc_t), 1);
+
+	if (memDbc == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+
+	memDbc->dbType = dbType;
+	memDbc->numShards = 1;
+	memDbc->keyWidth = MEMDBC_INT_WIDTH;
+
+	if (opts != NULL) {
+		memDbc->engine = opts->engine;
+		if (opts->shards > 1)
+			memDbc->numShards = opts->shards;
+		if (opts->shards < 0 || opts->shards > MEMDBC_MAX_SHARDS)
+			memDbcErrorNum = OPTION_ERR;
+		if (opts->keyWidth > 0)
+			memDbc->keyWidth = opts->keyWidth;
+		if (opts->keyWidth < 0 || opts->keyWidth > MEMDBC_INT_WIDTH)
+			memDbcErrorNum = OPTION_ERR;
+		// Only HEX_DB and OCTAL_DB keys take more than a digit per level.
+		if (opts->stride > 1)
+			memDbc->stride = opts->stride;
+		if (opts->stride > 1 && !strideOk(memDbc))
+			memDbcErrorNum = OPTION_ERR;
+		// Each new key costs at least one node and one value.
+		reserve = opts->reserveKeys * (treeNodeSize(memDbc) + MEMDBC_AVG_VALUE);
+		reserve /= memDbc->numShards;
+		if (opts->hugePages)
+			flags |= MP_HUGE_PAGES;
+		// Each shard keeps to its part of the budget.
+		if (opts->maxMemory > 0) {
+			memDbc->shardMemory = opts->maxMemory / memDbc->numShards;
+			memDbc->evict = opts->evict;
+			memDbc->evictStart = evictClock(memDbc);
+		}
+		if (opts->evict < EVICT_NONE || opts->evict > EVICT_LFU)
+			memDbcErrorNum = OPTION_ERR;
+	}
+
+	if (memDbcErrorNum != MEMDBC_OK) {
+		free(memDbc);
+		return NULL;
+	}
+
+	// Shards are cache line aligned so their locks and counts do not share lines.
+	if (posix_memalign((void **)&memDbc->shards, 64, memDbc->numShards * sizeof(MemDbcShard_t)) != 0) {
+		free(memDbc);
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+	memset(memDbc->shards, 0, memDbc->numShards * sizeof(MemDbcShard_t));
+
+	// A steady stream of readers of the tree lock must not keep a writer,
+	// or memDbcCompact(), out.  Nothing takes it twice in one thread.
+	pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+
+	for (i = 0; i < memDbc->numShards; i++) {
+		shard = &memDbc->shards[i];
+		pthread_mutex_init(&shard->indexLock, NULL);
+		pthread_rwlock_init(&shard->treeLock, &attr);
+
+		if (memDbcErrorNum == MEMDBC_OK)
+			shard->pool = mpInit(reserve, flags);
+		if (shard->pool != NULL)
+			shard->tree = initTree(memDbc, shard);
+		if (shard->tree != NULL)
+			shard->index = bptInit();
+
+		if (shard->index == NULL && memDbcErrorNum == MEMDBC_OK)
+			memDbcErrorNum = MALLOC_ERR;
+	}
+	pthread_rwlockattr_destroy(&attr);
+
+	if (memDbcErrorNum != MEMDBC_OK) {
+		memDbcFree(memDbc);
+		return NULL;
+	}
+
+	return memDbc;
+}
+
+/* memDbcFree() - Releases the database and all of its records.
+ * memDbc - returned by memDbcInit()
+ */
+void memDbcFree(MemDbc_t *memDbc) {
+	MemDbcShard_t *shard;
+	int i;
+
+	if (memDbc == NULL)
 		return;
+
+	// The sweep thread deletes records and logs them.
+	if (memDbc->ttl != NULL)
+		ttlStop(memDbc->ttl);
+	if (memDbc->bgSave != NULL)
+		bgSaveWait(memDbc->bgSave);
+	if (memDbc->wal != NULL)
+		walClose(memDbc->wal);
+	if (memDbc->map != NULL)
+		mapFree(memDbc->map);
+	if (memDbc->compact != NULL) {
+		trieCursorFree(&((Compact_t *)memDbc->compact)->tc);
+		free(memDbc->compact);
 	}
+	ttlFree(memDbc->ttl);
 
-	while(next != NULL) {
-		if (regexec(&regex, next->key, 0, NULL, 0) == 0) {
-			switch (memDbc->dbType) {
-				case ASCII_DB:
-					data = attLookup(memDbc->tree, next->key);
-					break;
-				case DIGITAL_DB:
-					data = dttLookup(memDbc->tree, next->key);
-					break;
-				case HEX_DB:
-					data = httLookup(memDbc->tree, next->key);
-					break;
-				case OCTAL_DB:
-					data = ottLookup(memDbc->tree, next->key);
-					break;
-				default:
-					memDbcErrorNum = UNKNOWN_TYPE;
-					break;
-			}
+	for (i = 0; i < memDbc->numShards; i++) {
+		shard = &memDbc->shards[i];
+		if (shard->index != NULL)
+			bptFree(shard->index);
+		if (shard->tree != NULL)
+			free(shard->tree);
+		// Trie nodes and values all live in the pool.
+		mpDestroy(shard->pool);
+		pthread_mutex_destroy(&shard->indexLock);
+		pthread_rwlock_destroy(&shard->treeLock);
+	}
+	free(memDbc->shards);
+	free(memDbc);
+}
 
-			if (callback != NULL) {
-				callback(next->key, data);
-			}
+/* dbAddInt() - dbAdd() of an INT_ENGINE key.
+ * memDbc - returned by memDbcInit()
+ * key - the key as a number, used by the tree.
+ * str - the key as a string of keyWidth digits, used by the key index.
+ */
+static int dbAddInt(MemDbc_t *memDbc, uint64_t key, char *str, void *data, int len) {
+
+	MemDbcShard_t *shard = intShard(memDbc, key);
+	int r = 0;
+	void **ref = NULL;
+
+	epEnter();
+
+	pthread_rwlock_wrlock(&shard->treeLock);
+	r = artInsertInt(shard->tree, key, data, len, &ref);
+	if ((r == 1 || r == 2) && memDbc->evict != EVICT_NONE)
+		evictNew(memDbc, ref);
+	if (r == 1) {
+		pthread_mutex_lock(&shard->indexLock);
+		bptInsert(shard->index, str, ref);
+		pthread_mutex_unlock(&shard->indexLock);
+	}
+	pthread_rwlock_unlock(&shard->treeLock);
+
+	epExit();
+
+	if (r == 1)
+		AtomicAdd(&shard->recCount, 1);
+
+	if (r != 1 && r != 2 && len == MP_VAL_OWNED)
+		mpValFree(shard->pool, data);
+
+	return r;
+}
+
+/* dbAdd() - Adds a record to the trees, memDbcAdd() without the log.
+ * The key is folded by the caller.
+ * memDbc - returned by memDbcInit()
+ */
+static int dbAdd(MemDbc_t *memDbc, char *key, void *data, int len) {
+
+	MemDbcShard_t *shard = keyShard(memDbc, key);
+	int r = 0;
+	void **ref = NULL;
+	uint64_t val;
+
+	// A bad character would send the key down the wrong child.
+	if (dbKeyCheck(memDbc, key) < 0) {
+		if (len == MP_VAL_OWNED)
+			mpValFree(shard->pool, data);
+		return -1;
+	}
+
+	if (memDbc->engine == INT_ENGINE) {
+		keyToInt(key, &val);
+		return dbAddInt(memDbc, val, key, data, len);
+	}
+
+	epEnter();
+
+	if (memDbc->engine == TRIE_ENGINE) {
+		// Trie writers do not lock, only the key index is serialized.
+		int gate = trieGate(shard);
+		void *owned = data;
+
+		// An owned record may be in the memory being compacted away.
+		if (gate && len == MP_VAL_OWNED)
+			owned = mpValMove(shard->pool, data);
+
+		// The tree takes the copy, data goes with the old chunks.
+		if (owned != NULL)
+			r = treeInsert(memDbc, shard, key, owned, len, &ref);
+		if (owned != data && r != 1 && r != 2)
+			mpValFree(shard->pool, owned);
+
+		if (r == 1) {
+			// key already exists in trie tree then do NOT add to the key index.
+			// A delete may have got in after the insert and freed the node,
+			// index what the tree holds now.
+			pthread_mutex_lock(&shard->indexLock);
+			treeIndex(memDbc, shard, key);
+			pthread_mutex_unlock(&shard->indexLock);
+		}
+
+		if (gate)
+			pthread_rwlock_unlock(&shard->treeLock);
+	} else {
+		// Radix and ART nodes move on insert, writers take the tree lock.
+		pthread_rwlock_wrlock(&shard->treeLock);
+		r = treeInsert(memDbc, shard, key, data, len, &ref);
+		if (r == 1) {
+			pthread_mutex_lock(&shard->indexLock);
+			bptInsert(shard->index, key, ref);
+			pthread_mutex_unlock(&shard->indexLock);
 		}
-		next = next->ptr;
+		pthread_rwlock_unlock(&shard->treeLock);
 	}
+
+	epExit();
+
+	if (r == 1)
+		AtomicAdd(&shard->recCount, 1);
+
+	// An owned value the tree did not take is freed here.
+	if (r != 1 && r != 2 && len == MP_VAL_OWNED)
+		mpValFree(shard->pool, data);
+
+	return r;
 }
 
-/* memDbcNumEntries() - returns the record count.
+/* addLogged() - dbAdd() and the write ahead log.
  * memDbc - returned by memDbcInit()
+ * intKey - the key as a number from memDbcAddInt() or NULL.
+ * len - Length of the data or MP_VAL_OWNED.
+ * expires - ttlWallNow() time the record is kept to, logged with it, or 0.
  */
-unsigned long memDbcNumEntries(MemDbc_t *memDbc) {
-	return memDbc->recCount;
+static int addLogged(MemDbc_t *memDbc, char *key, uint64_t *intKey, void *data, int len, uint64_t expires) {
+	Wal_t *wal = (Wal_t *)memDbc->wal;
+	pthread_mutex_t *stripe;
+	uint64_t lsn = 0;
+	int r;
+
+	if (wal == NULL)
+		return (intKey != NULL) ? dbAddInt(memDbc, *intKey, key, data, len) : dbAdd(memDbc, key, data, len);
+
+	// Writes of the same key must reach the log in the order they are made.
+	// An owned value can not be retired while the stripe is held, every
+	// writer of the key takes it.
+	stripe = &wal->stripes[((intKey != NULL) ? intHash(*intKey) : keyHash(memDbc, key)) % WAL_STRIPES];
+	pthread_mutex_lock(stripe);
+	r = (intKey != NULL) ? dbAddInt(memDbc, *intKey, key, data, len) : dbAdd(memDbc, key, data, len);
+	if (r == 1 || r == 2)
+		lsn = walLog(wal, WAL_ADD, key, data, (len == MP_VAL_OWNED) ? mpValLen(data) : len, expires);
+	pthread_mutex_unlock(stripe);
+
+	// Wait outside the stripe so other writers can join the same sync.
+	if ((r == 1 || r == 2) && (lsn == 0 || walWait(wal, lsn) != 0))
+		r = -1;
+
+	return r;
 }
 
-/* memDbcWalk() - Walks the database calling the callback
+/* addRecord() - addLogged() that also sets or clears the key's time to live.
  * memDbc - returned by memDbcInit()
- * callback - user supplied callback function.
+ * intKey - the key as a number from memDbcAddInt() or NULL.
+ * len - Length of the data or MP_VAL_OWNED.
+ * ttlMs - milliseconds the record is kept, 0 for no limit.
  */
-void memDbcWalk(MemDbc_t *memDbc, char *(*callback)(char *key, void *data)) {
+static int addRecord(MemDbc_t *memDbc, char *key, uint64_t *intKey, void *data, int len, unsigned long ttlMs) {
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	MemDbcShard_t *shard = (intKey != NULL) ? intShard(memDbc, *intKey) : keyShard(memDbc, key);
+	TtlStripe_t *stripe;
+	uint64_t tick = 0;
+	unsigned int h;
+	int r;
+
+	// Over its share of maxMemory with nothing to evict.
+	if (memDbc->shardMemory != 0 && memDbc->evict == EVICT_NONE && shardUsed(memDbc, shard) > memDbc->shardMemory) {
+		if (len == MP_VAL_OWNED)
+			mpValFree(shard->pool, data);
+		memDbcErrorNum = MEMORY_ERR;
+		return -1;
+	}
+
+	if (ttl == NULL) {
+		r = addLogged(memDbc, key, intKey, data, len, 0);
+	} else {
+		// The stripe is held over the add so the old expiry time can not
+		// remove the new record, and the log gets the key's changes of
+		// expiry time in the order they are made.
+		h = keyHash(memDbc, key);
+		stripe = ttlStripe(ttl, h);
+		pthread_mutex_lock(&stripe->lock);
+		if (ttlMs != 0)
+			tick = ttlNow(ttl) + ttlMs;
+		r = addLogged(memDbc, key, intKey, data, len, (tick != 0) ? ttlToWall(ttl, tick) : 0);
+		if (r == 1 || r == 2) {
+			if (ttlMs == 0)
+				ttlClear(ttl, key, h);
+			else if (ttlSet(ttl, key, h, tick) < 0)
+				r = -1;
+		}
+		pthread_mutex_unlock(&stripe->lock);
+	}
+
+	// No locks are held, the evicted records are deleted as by memDbcDelete().
+	if (memDbc->evict != EVICT_NONE && (r == 1 || r == 2))
+		evictShard(memDbc, shard, MEMDBC_EVICT_MAX);
 
-	keyListWalk(memDbc, callback);
+	return r;
 }
 
-/* memDbcSave() - Saves all records to a file.
+/* memDbcAdd() - Add a record to the database.
  * memDbc - returned by memDbcInit()
- * fileName - File name to save data to or NULL is user's callback is saving the data.
- * callback - user supplied callback function.
+ * key - the key to store data under.
+ * data - the data to store.
+ * len - Length of the data.
  */
-void memDbcSave(MemDbc_t *memDbc, char *fileName, char *(*callback)(char *key, void *data)) {
+int memDbcAdd(MemDbc_t *memDbc, char *key, void *data, int len) {
+	char buf[MEMDBC_KEY_FOLD];
+	char *k;
+	int r;
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return -1;
+	}
+	if ((k = keyFold(memDbc, key, buf)) == NULL)
+		return -1;
+
+	r = addRecord(memDbc, k, NULL, data, len, 0);
+	keyFoldEnd(k, key, buf);
+
+	return r;
+}
+
+/* memDbcValueAlloc() - Allocates a record from the database's memory.
+ * The caller fills it in and hands it to memDbcAddOwned(), so the record
+ * is not copied.  len bytes plus a NUL are allocated.
+ * memDbc - returned by memDbcInit()
+ * key - the key the record will be added under, it picks the shard.
+ * len - Length of the data.
+ */
+void *memDbcValueAlloc(MemDbc_t *memDbc, char *key, int len) {
+	MemDbcShard_t *shard;
+	void *data;
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return NULL;
+	}
+
+	// Counted before it is allocated, memDbcCompact() can not give back
+	// the memory it is in while the count is not 0.
+	shard = keyShard(memDbc, key);
+	AtomicAdd(&shard->owned, 1);
+
+	data = mpValAlloc(shard->pool, len);
+	if (data == NULL) {
+		AtomicSub(&shard->owned, 1);
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+	((char *)data)[len] = '\0';
+
+	return data;
+}
+
+/* memDbcValueFree() - Frees a record from memDbcValueAlloc() that was not added.
+ * memDbc - returned by memDbcInit()
+ * key - the key given to memDbcValueAlloc().
+ * data - the record.
+ */
+void memDbcValueFree(MemDbc_t *memDbc, char *key, void *data) {
+	MemDbcShard_t *shard;
+
+	// memDbcValueAlloc() gives out nothing on a mapping.
+	if (memDbc->map != NULL)
+		return;
+
+	shard = keyShard(memDbc, key);
+	if (data != NULL) {
+		mpValFree(shard->pool, data);
+		AtomicSub(&shard->owned, 1);
+	}
+}
+
+/* memDbcAddOwned() - Add a record without copying it.
+ * The database owns data from this call on, even if it fails, and frees
+ * it when the record is updated or deleted.
+ * memDbc - returned by memDbcInit()
+ * key - the key given to memDbcValueAlloc().
+ * data - returned by memDbcValueAlloc(), its length is the one allocated.
+ */
+int memDbcAddOwned(MemDbc_t *memDbc, char *key, void *data) {
+	char buf[MEMDBC_KEY_FOLD];
+	char *k;
+	int r;
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return -1;
+	}
+	if (data == NULL) {
+		memDbcErrorNum = CALLBACK_NULL;
+		return -1;
+	}
+
+	k = keyFold(memDbc, key, buf);
+	if (k == NULL) {
+		memDbcValueFree(memDbc, key, data);
+		return -1;
+	}
+
+	r = addRecord(memDbc, k, NULL, data, MP_VAL_OWNED, 0);
+
+	// The log is written from data, it is only let go after that.
+	AtomicSub(&keyShard(memDbc, k)->owned, 1);
+	keyFoldEnd(k, key, buf);
+
+	return r;
+}
+
+/* batchCmp() - qsort() compare of batch records, by shard, key and then
+ * place in the batch so later records of a key are stored last.
+ */
+static int batchCmp(const void *a, const void *b) {
+	const BatchRec_t *x = (const BatchRec_t *)a;
+	const BatchRec_t *y = (const BatchRec_t *)b;
+	int c;
+
+	if (x->shard != y->shard)
+		return (x->shard < y->shard) ? -1 : 1;
+	c = strcmp(x->key, y->key);
+	if (c != 0)
+		return c;
+
+	return (x->idx < y->idx) ? -1 : (x->idx > y->idx);
+}
+
+/* batchShard() - Stores the sorted records of one shard and merges the new
+ * keys into its index at once.  Returns the log position of the last
+ * record logged.
+ * memDbc - returned by memDbcInit()
+ * recs - records of the shard sorted by key.
+ * newKeys, newRefs - room for n keys.
+ */
+static uint64_t batchShard(MemDbc_t *memDbc, MemDbcShard_t *shard, BatchRec_t *recs, int n,
+		void **values, int *lens, MemDbcAction_t *status, char **newKeys, void ***newRefs) {
+	Wal_t *wal = (Wal_t *)memDbc->wal;
+	uint64_t lsn = 0;
+	void **ref = NULL;
+	int numNew = 0;
+	int gate = 0;
+	int full = (memDbc->shardMemory != 0 && memDbc->evict == EVICT_NONE);
+	int i, m, r;
+
+	epEnter();
+
+	// Radix and ART nodes move on insert, writers take the tree lock.
+	if (memDbc->engine != TRIE_ENGINE)
+		pthread_rwlock_wrlock(&shard->treeLock);
+	else
+		gate = trieGate(shard);
+
+	// In key order the nodes of a shared prefix are made by the first key
+	// and are still in cache for the ones after it.
+	for (i = 0; i < n; i++) {
+		int idx = recs[i].idx;
+
+		// Over its share of maxMemory with nothing to evict.
+		if (full && shardUsed(memDbc, shard) > memDbc->shardMemory) {
+			status[idx] = ACTION_ERR;
+			memDbcErrorNum = MEMORY_ERR;
+			continue;
+		}
+
+		r = treeInsert(memDbc, shard, recs[i].key, values[idx], lens[idx], &ref);
+		status[idx] = (r == 1) ? ACTION_INSERT : (r == 2) ? ACTION_UPDATED : ACTION_ERR;
+
+		if (r == 1) {
+			newKeys[numNew] = recs[i].key;
+			newRefs[numNew++] = ref;
+		}
+
+		if (wal != NULL && (r == 1 || r == 2)) {
+			uint64_t l = walLog(wal, WAL_ADD, recs[i].key, values[idx], lens[idx], 0);
+
+			if (l == 0)
+				status[idx] = ACTION_ERR;
+			else
+				lsn = l;
+		}
+	}
+
+	pthread_mutex_lock(&shard->indexLock);
+	// A trie delete may have got in after an insert and freed the node,
+	// only index the keys still in the tree, where they are now.
+	for (i = 0, m = 0; i < numNew; i++) {
+		if (memDbc->engine == TRIE_ENGINE)
+			newRefs[i] = treeRef(memDbc, shard, newKeys[i]);
+		if (newRefs[i] != NULL) {
+			newKeys[m] = newKeys[i];
+			newRefs[m++] = newRefs[i];
+		}
+	}
+	bptMerge(shard->index, newKeys, newRefs, m);
+	pthread_mutex_unlock(&shard->indexLock);
+
+	if (memDbc->engine != TRIE_ENGINE || gate)
+		pthread_rwlock_unlock(&shard->treeLock);
+
+	epExit();
+
+	AtomicAdd(&shard->recCount, numNew);
+
+	return lsn;
+}
+
+/* memDbcAddBatch() - Add many records at once.
+ * The batch is sorted once, each shard's records are stored in key order
+ * and their new keys merged into the key index in one pass instead of a
+ * search per key.  If a key is in the batch more than once the last one
+ * is kept.  Returns the number of records stored or -1.
+ * memDbc - returned by memDbcInit()
+ * keys, values, lens - the n records, as given to memDbcAdd().
+ * status - if not NULL set to ACTION_INSERT, ACTION_UPDATED or ACTION_ERR
+ *          for each record.
+ */
+int memDbcAddBatch(MemDbc_t *memDbc, char **keys, void **values, int *lens, int n, MemDbcAction_t *status) {
+	Wal_t *wal = (Wal_t *)memDbc->wal;
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	MemDbcAction_t *st = status;
+	BatchRec_t *recs;
+	char **newKeys;
+	void ***newRefs;
+	char **folded = NULL;
+	uint64_t lsn = 0;
+	int stored = 0;
+	int i, j, m;
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return -1;
+	}
+	if (n <= 0)
+		return 0;
+
+	recs = (BatchRec_t *)malloc(n * sizeof(BatchRec_t));
+	newKeys = (char **)malloc(n * sizeof(char *));
+	newRefs = (void ***)malloc(n * sizeof(void **));
+	if (memDbc->dbType == HEX_DB)
+		folded = (char **)calloc(n, sizeof(char *));
+	if (st == NULL)
+		st = (MemDbcAction_t *)malloc(n * sizeof(MemDbcAction_t));
+	if (recs == NULL || newKeys == NULL || newRefs == NULL || st == NULL ||
+			(memDbc->dbType == HEX_DB && folded == NULL)) {
+		memDbcErrorNum = MALLOC_ERR;
+		stored = -1;
+		goto done;
+	}
+
+	// Records with bad keys are left out of the batch.
+	for (i = 0, m = 0; i < n; i++) {
+		char *k = keys[i];
+
+		if (folded != NULL) {
+			k = keyFold(memDbc, keys[i], NULL);
+			if (k == NULL) {
+				stored = -1;
+				goto done;
+			}
+			if (k != keys[i])
+				folded[i] = k;
+		}
+		if (dbKeyCheck(memDbc, k) < 0) {
+			st[i] = ACTION_ERR;
+			continue;
+		}
+		recs[m].key = k;
+		recs[m].idx = i;
+		recs[m++].shard = (memDbc->numShards > 1) ? keyHash(memDbc, k) % memDbc->numShards : 0;
+	}
+	qsort(recs, m, sizeof(BatchRec_t), batchCmp);
+
+	// The records stored have no time to live, expiries of the keys wait.
+	if (ttl != NULL) {
+		for (i = 0; i < TTL_STRIPES; i++)
+			pthread_mutex_lock(&ttl->stripes[i].lock);
+	}
+
+	// Hold every log stripe so no single key writer gets between a batch
+	// record and its log record.
+	if (wal != NULL) {
+		for (i = 0; i < WAL_STRIPES; i++)
+			pthread_mutex_lock(&wal->stripes[i]);
+	}
+
+	for (i = 0; i < m; i = j) {
+		uint64_t l;
+
+		for (j = i + 1; j < m && recs[j].shard == recs[i].shard; j++)
+			;
+		l = batchShard(memDbc, &memDbc->shards[recs[i].shard], recs + i, j - i,
+				values, lens, st, newKeys + i, newRefs + i);
+		if (l > lsn)
+			lsn = l;
+	}
+
+	if (wal != NULL) {
+		for (i = WAL_STRIPES - 1; i >= 0; i--)
+			pthread_mutex_unlock(&wal->stripes[i]);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (st[i] != ACTION_ERR)
+			stored++;
+		if (st[i] != ACTION_ERR && ttl != NULL) {
+			char *k = (folded != NULL && folded[i] != NULL) ? folded[i] : keys[i];
+
+			ttlClear(ttl, k, keyHash(memDbc, k));
+		}
+	}
+
+	if (ttl != NULL) {
+		for (i = TTL_STRIPES - 1; i >= 0; i--)
+			pthread_mutex_unlock(&ttl->stripes[i].lock);
+	}
+
+	for (i = 0; i < m && memDbc->evict != EVICT_NONE; i = j) {
+		for (j = i + 1; j < m && recs[j].shard == recs[i].shard; j++)
+			;
+		evictShard(memDbc, &memDbc->shards[recs[i].shard], (j - i) * MEMDBC_EVICT_MAX);
+	}
+
+	// Wait outside the stripes so other writers can join the same sync.
+	if (lsn != 0 && walWait(wal, lsn) != 0)
+		stored = -1;
+
+done:
+	for (i = 0; folded != NULL && i < n; i++)
+		free(folded[i]);
+	free(folded);
+	free(recs);
+	free(newKeys);
+	free(newRefs);
+	if (st != status)
+		free(st);
+
+	return stored;
+}
+
+/* ttlOf() - Sets expires to the tick the time to live of key runs out.
+ * Returns 1 if it has one, else 0.
+ * memDbc - returned by memDbcInit()
+ * ttl - memDbc->ttl, not NULL.
+ */
+static int ttlOf(MemDbc_t *memDbc, Ttl_t *ttl, char *key, uint64_t *expires) {
+	char buf[MEMDBC_KEY_FOLD];
+	char *k = keyFold(memDbc, key, buf);
+	int r;
+
+	if (k == NULL)
+		return 0;
+
+	r = ttlGet(ttl, k, keyHash(memDbc, k), expires);
+	keyFoldEnd(k, key, buf);
+
+	return r;
+}
+
+/* ttlDue() - Returns 1 if the time to live of key has run out.  The
+ * record is left for memDbcExpireTick() to remove, readers change nothing.
+ * memDbc - returned by memDbcInit()
+ * ttl - memDbc->ttl, not NULL.
+ */
+static int ttlDue(MemDbc_t *memDbc, Ttl_t *ttl, char *key) {
+	uint64_t expires;
+
+	return ttlOf(memDbc, ttl, key, &expires) && expires <= ttlNow(ttl);
+}
+
+/* dbFind() - Looks up a record in the trees, memDbcFind() without expiry.
+ * memDbc - returned by memDbcInit()
+ * key - to look for, already checked.
+ */
+static void *dbFind(MemDbc_t *memDbc, char *key) {
+	MemDbcShard_t *shard = keyShard(memDbc, key);
+	void *rec;
+
+	epEnter();
+
+	if (memDbc->engine == TRIE_ENGINE) {
+		rec = treeLookup(memDbc, shard, key);
+	} else {
+		pthread_rwlock_rdlock(&shard->treeLock);
+		rec = treeLookup(memDbc, shard, key);
+		pthread_rwlock_unlock(&shard->treeLock);
+	}
+
+	if (rec != NULL && memDbc->evict != EVICT_NONE)
+		evictTouch(memDbc, rec);
+
+	epExit();
+
+	return rec;
+}
+
+/* memDbcFind() - Find a single rcord in database.
+ * A record whose time to live has run out is not found.
+ * memDbc - returned by memDbcInit()
+ * key - to look for.
+ */
+void *memDbcFind(MemDbc_t * memDbc, char *key) {
+	Ttl_t *ttl;
+
+	if (dbKeyCheck(memDbc, key) < 0)
+		return NULL;
+
+	// Nothing in a mapping changes, there is nothing to lock or reclaim.
+	if (memDbc->map != NULL)
+		return mapFind(memDbc->map, key);
+
+	ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	if (ttl != NULL && ttlDue(memDbc, ttl, key))
+		return NULL;
+
+	return dbFind(memDbc, key);
+}
+
+/* memDbcFindView() - Find a single record and its length.
+ * Returns a view with data NULL if the key is not found.  The length is
+ * the one given to memDbcAdd(), the data is good for as long as a record
+ * returned by memDbcFind() is.
+ * memDbc - returned by memDbcInit()
+ * key - to look for.
+ */
+MemDbcView_t memDbcFindView(MemDbc_t *memDbc, char *key) {
+	MemDbcView_t view = { NULL, 0 };
+
+	// The length must be read before the value can be reclaimed.
+	epEnter();
+
+	view.data = memDbcFind(memDbc, key);
+	if (view.data != NULL)
+		view.len = mpValLen(view.data);
+
+	epExit();
+
+	return view;
+}
+
+/* memDbcValueLen() - Returns the length of a record returned by memDbcFind()
+ * or passed to a walk or save callback.
+ * data - the record.
+ */
+int memDbcValueLen(void *data) {
+
+	return mpValLen(data);
+}
+
+/* treeLookupMany() - Looks up n keys of one shard's trie together.
+ * Returns the number found or -1 if the engine can not do it.
+ * memDbc - returned by memDbcInit()
+ * shard - the shard holding the keys.
+ */
+static int treeLookupMany(MemDbc_t *memDbc, MemDbcShard_t *shard, char **keys, int n, void **out) {
+	int r = -1;
+
+	if (memDbc->engine != TRIE_ENGINE)
+		return -1;
+	if (memDbc->stride > 1)
+		return wttLookupMany(shard->tree, keys, n, out);
+
+	switch (memDbc->dbType) {
+		case ASCII_DB:
+			r = attLookupMany(shard->tree, keys, n, out);
+			break;
+		case DIGITAL_DB:
+			r = dttLookupMany(shard->tree, keys, n, out);
+			break;
+		case HEX_DB:
+			r = httLookupMany(shard->tree, keys, n, out);
+			break;
+		case OCTAL_DB:
+			r = ottLookupMany(shard->tree, keys, n, out);
+			break;
+		default:
+			memDbcErrorNum = UNKNOWN_TYPE;
+			break;
+	}
+
+	return r;
+}
+
+/* findManySharded() - memDbcFindMany() of a sharded trie database.
+ * The keys are grouped by shard so each shard's lookups run together.
+ * Returns the number found or -1 if out of memory.
+ * memDbc - returned by memDbcInit()
+ */
+static int findManySharded(MemDbc_t *memDbc, char **keys, int n, void **out) {
+	int numShards = memDbc->numShards;
+	int *start = (int *)calloc(numShards + 1, sizeof(int));
+	int *idx = (int *)malloc(n * sizeof(int));
+	int *shardOf = (int *)malloc(n * sizeof(int));
+	char **sKeys = (char **)malloc(n * sizeof(char *));
+	void **sOut = (void **)malloc(n * sizeof(void *));
+	int found = 0;
+	int i, s;
+
+	if (start == NULL || idx == NULL || shardOf == NULL || sKeys == NULL || sOut == NULL) {
+		found = -1;
+		goto done;
+	}
+
+	// Counting sort of the keys by shard.
+	for (i = 0; i < n; i++) {
+		shardOf[i] = keyHash(memDbc, keys[i]) % numShards;
+		start[shardOf[i] + 1]++;
+	}
+	for (s = 0; s < numShards; s++)
+		start[s + 1] += start[s];
+	for (i = 0; i < n; i++) {
+		int j = start[shardOf[i]]++;
+
+		idx[j] = i;
+		sKeys[j] = keys[i];
+	}
+
+	// start[s] is now the end of shard s.
+	for (s = 0, i = 0; s < numShards; i = start[s++]) {
+		if (start[s] > i)
+			found += treeLookupMany(memDbc, &memDbc->shards[s], sKeys + i, start[s] - i, sOut + i);
+	}
+
+	for (i = 0; i < n; i++)
+		out[idx[i]] = sOut[i];
+
+done:
+	free(start);
+	free(idx);
+	free(shardOf);
+	free(sKeys);
+	free(sOut);
+
+	return found;
+}
+
+/* memDbcFindMany() - Find many records at once.
+ * out[i] is set to the record of keys[i] or NULL.  With the trie engine
+ * the lookups walk down the trie together and prefetch the nodes they
+ * need next, so their cache misses overlap.  The records are good for
+ * as long as ones returned by memDbcFind() are.  Returns the number of
+ * keys found.
+ * memDbc - returned by memDbcInit()
+ * keys - the n keys to look for.
+ * out - set to the n records.
+ */
+int memDbcFindMany(MemDbc_t *memDbc, char **keys, int n, void **out) {
+	int found = -1;
+	int i;
+
+	if (n <= 0)
+		return 0;
+
+	epEnter();
+
+	// A bad key would be looked up in the wrong place, a batch with one
+	// is looked up a key at a time.
+	for (i = 0; i < n && memDbc->map == NULL && memDbc->engine == TRIE_ENGINE; i++) {
+		if (dbKeyCheck(memDbc, keys[i]) < 0)
+			break;
+	}
+
+	if (i == n) {
+		Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+
+		if (memDbc->numShards == 1)
+			found = treeLookupMany(memDbc, memDbc->shards, keys, n, out);
+		else
+			found = findManySharded(memDbc, keys, n, out);
+
+		// Same as memDbcFind(), records past their time are not found.
+		for (i = 0; i < n && found > 0 && ttl != NULL; i++) {
+			if (out[i] != NULL && ttlDue(memDbc, ttl, keys[i])) {
+				out[i] = NULL;
+				found--;
+			}
+		}
+		for (i = 0; i < n && memDbc->evict != EVICT_NONE; i++) {
+			if (out[i] != NULL)
+				evictTouch(memDbc, out[i]);
+		}
+	}
+
+	// Other engines, or no memory to group the keys, look up a key at a time.
+	if (found < 0) {
+		found = 0;
+		for (i = 0; i < n; i++) {
+			out[i] = memDbcFind(memDbc, keys[i]);
+			if (out[i] != NULL)
+				found++;
+		}
+	}
+
+	epExit();
+
+	return found;
+}
+
+/* memDbcReadBegin() - Starts a read section.
+ * Records returned by memDbcFind() are not freed before memDbcReadEnd()
+ * is called, even if another thread updates or deletes them.  Calls
+ * may be nested.
+ * memDbc - returned by memDbcInit()
+ */
+void memDbcReadBegin(MemDbc_t *memDbc) {
+
+	epEnter();
+}
+
+/* memDbcReadEnd() - Ends a read section started by memDbcReadBegin().
+ * memDbc - returned by memDbcInit()
+ */
+void memDbcReadEnd(MemDbc_t *memDbc) {
+
+	epExit();
+}
+
+/* dbDelete() - Removes a record from the trees, memDbcDelete() without the log.
+ * The key is folded by the caller.
+ * memDbc - returned by memDbcInit()
+ */
+static int dbDelete(MemDbc_t * memDbc, char *key) {
+	MemDbcShard_t *shard = keyShard(memDbc, key);
+	int r = -1;
+
+	if (dbKeyCheck(memDbc, key) < 0)
+		return -1;
+
+	epEnter();
+
+	if (memDbc->engine == TRIE_ENGINE) {
+		int gate = trieGate(shard);
+
+		r = treeDelete(memDbc, shard, key);
+
+		if (r == 0) {
+			// Same as memDbcAdd(), an insert may have put the key back
+			// in a new node.
+			pthread_mutex_lock(&shard->indexLock);
+			treeIndex(memDbc, shard, key);
+			pthread_mutex_unlock(&shard->indexLock);
+		}
+
+		if (gate)
+			pthread_rwlock_unlock(&shard->treeLock);
+	} else {
+		// The node holding the data is freed, walks must not be on it.
+		pthread_rwlock_wrlock(&shard->treeLock);
+		pthread_mutex_lock(&shard->indexLock);
+		r = treeDelete(memDbc, shard, key);
+		if (r == 0)
+			bptDelete(shard->index, key);
+		pthread_mutex_unlock(&shard->indexLock);
+		pthread_rwlock_unlock(&shard->treeLock);
+	}
+
+	epExit();
+
+	if (r == 0)
+		AtomicSub(&shard->recCount, 1);
+
+	return r;
+}
+
+/* deleteLogged() - dbDelete() and the write ahead log.
+ * memDbc - returned by memDbcInit()
+ */
+static int deleteLogged(MemDbc_t *memDbc, char *key) {
+	Wal_t *wal = (Wal_t *)memDbc->wal;
+	pthread_mutex_t *stripe;
+	uint64_t lsn = 0;
+	int r;
+
+	if (wal == NULL) {
+		r = dbDelete(memDbc, key);
+	} else {
+		stripe = &wal->stripes[keyHash(memDbc, key) % WAL_STRIPES];
+		pthread_mutex_lock(stripe);
+		r = dbDelete(memDbc, key);
+		if (r == 0)
+			lsn = walLog(wal, WAL_DELETE, key, NULL, 0, 0);
+		pthread_mutex_unlock(stripe);
+
+		if (r == 0 && (lsn == 0 || walWait(wal, lsn) != 0))
+			r = -1;
+	}
+
+	return r;
+}
+
+/* memDbcDelete() - Marks a record as deleted.
+ */
+int memDbcDelete(MemDbc_t * memDbc, char *key) {
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	TtlStripe_t *stripe;
+	char buf[MEMDBC_KEY_FOLD];
+	char *k;
+	unsigned int h;
+	int r;
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return -1;
+	}
+	if ((k = keyFold(memDbc, key, buf)) == NULL)
+		return -1;
+
+	if (ttl == NULL) {
+		r = deleteLogged(memDbc, k);
+	} else {
+		h = keyHash(memDbc, k);
+		stripe = ttlStripe(ttl, h);
+		pthread_mutex_lock(&stripe->lock);
+		r = deleteLogged(memDbc, k);
+		ttlClear(ttl, k, h);
+		pthread_mutex_unlock(&stripe->lock);
+	}
+	keyFoldEnd(k, key, buf);
+
+	return r;
+}
+
+/* compactMoved() - Points the key index at a record memDbcCompact() moved.
+ */
+static void compactMoved(void *ctx, char *key, void **old, void **ref) {
+
+	bptUpdate(((MemDbcShard_t *)ctx)->index, key, old, ref);
+}
+
+/* treeCompact() - Moves up to budget nodes of a shard's trie out of the
+ * chunks its pool is evacuating.  Returns 1 if there are more, 0 when
+ * the trie is done or -1 on error.
+ * memDbc - returned by memDbcInit()
+ * tc - where the last call stopped.
+ */
+static int treeCompact(MemDbc_t *memDbc, MemDbcShard_t *shard, TrieCursor_t *tc, int budget) {
+
+	if (memDbc->stride > 1)
+		return wttCompact(shard->tree, tc, budget, compactMoved, shard);
+
+	switch (memDbc->dbType) {
+		case ASCII_DB:
+			return attCompact(shard->tree, tc, budget, compactMoved, shard);
+		case DIGITAL_DB:
+			return dttCompact(shard->tree, tc, budget, compactMoved, shard);
+		case HEX_DB:
+			return httCompact(shard->tree, tc, budget, compactMoved, shard);
+		case OCTAL_DB:
+			return ottCompact(shard->tree, tc, budget, compactMoved, shard);
+		default:
+			memDbcErrorNum = UNKNOWN_TYPE;
+			return -1;
+	}
+}
+
+/* compactLate() - Returns 1 if maxMicros have gone by since start.
+ * start - when memDbcCompact() was called.
+ * maxMicros - most microseconds to spend, 0 for no limit.
+ */
+static int compactLate(struct timespec *start, int maxMicros) {
+	struct timespec now;
+
+	if (maxMicros <= 0)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000 >= maxMicros;
+}
+
+/* memDbcCompact() - Compacts the trie a step at a time while the database
+ * is in use.  After many deletes the nodes still in use are spread over
+ * chunks of freed ones and each level of a lookup is on another page.
+ * A compaction copies the nodes in depth first order into new chunks
+ * and gives the old ones back to the system, so the trie is packed in
+ * the order lookups and walks go through it.  Shards are done one at a
+ * time, writers to a shard being done wait for at most
+ * MEMDBC_COMPACT_SLICE nodes at once and readers do not wait.
+ * Call it again while it returns 1, from one thread and not inside
+ * memDbcReadBegin().  Only TRIE_ENGINE databases are compacted, others
+ * return 0.  Returns 1 if there is more to do, 0 when done or -1.
+ * memDbc - returned by memDbcInit()
+ * maxNodes - most nodes to move in this call, 0 for no limit.  Giving
+ *            back a chunk counts as MEMDBC_COMPACT_SLICE nodes.
+ * maxMicros - most microseconds to spend in this call, 0 for no limit.
+ * reclaimed - if not NULL, set to the bytes given back by this call.
+ */
+int memDbcCompact(MemDbc_t *memDbc, int maxNodes, int maxMicros, size_t *reclaimed) {
+	Compact_t *c = (Compact_t *)memDbc->compact;
+	MemDbcShard_t *shard;
+	struct timespec start;
+	int budget = (maxNodes > 0) ? maxNodes : INT_MAX;
+	int slice, r;
+	size_t n;
+
+	if (reclaimed != NULL)
+		*reclaimed = 0;
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return -1;
+	}
+	if (memDbc->engine != TRIE_ENGINE)
+		return 0;
+
+	if (c == NULL) {
+		c = (Compact_t *)calloc(1, sizeof(Compact_t));
+		if (c == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			return -1;
+		}
+		memDbc->compact = c;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (c->shard < memDbc->numShards) {
+		shard = &memDbc->shards[c->shard];
+
+		switch (c->phase) {
+			case COMPACT_START:
+				AtomicSet(&shard->compacting, 1);
+				c->epoch = epNow();
+				c->phase = COMPACT_GATE;
+				// fall through
+			case COMPACT_GATE:
+				// Writers that saw compacting as 0 do not hold the lock.
+				if (epTryPass(c->epoch) == 0)
+					return 1;
+				pthread_rwlock_wrlock(&shard->treeLock);
+				r = mpEvacuate(shard->pool);
+				pthread_rwlock_unlock(&shard->treeLock);
+				if (r != 0)
+					return -1;
+				c->phase = COMPACT_MOVE;
+				break;
+			case COMPACT_MOVE:
+				if (budget <= 0 || compactLate(&start, maxMicros))
+					return 1;
+				slice = (budget < MEMDBC_COMPACT_SLICE) ? budget : MEMDBC_COMPACT_SLICE;
+				budget -= slice;
+
+				// The key index is fixed up as the nodes move.
+				pthread_rwlock_wrlock(&shard->treeLock);
+				pthread_mutex_lock(&shard->indexLock);
+				r = treeCompact(memDbc, shard, &c->tc, slice);
+				pthread_mutex_unlock(&shard->indexLock);
+				pthread_rwlock_unlock(&shard->treeLock);
+
+				if (r < 0)
+					return -1;
+				if (r == 0)
+					c->phase = COMPACT_DRAIN;
+				break;
+			case COMPACT_DRAIN:
+				// A memDbcValueAlloc() record may be in the old chunks
+				// until it is added or freed.
+				if (AtomicGet(&shard->owned) != 0)
+					return 1;
+				c->epoch = epNow();
+				c->phase = COMPACT_FREE;
+				// fall through
+			case COMPACT_FREE:
+				// Readers may still be in the old nodes.
+				if (epTryPass(c->epoch) == 0)
+					return 1;
+				// Writers look at the old chunks under the pool lock and
+				// stop once the first call is made, they need not wait.
+				r = mpEvacuateEnd(shard->pool, 1, &n);
+				AtomicSet(&shard->compacting, 0);
+				c->phase = COMPACT_RELEASE;
+				budget -= MEMDBC_COMPACT_SLICE;
+				if (reclaimed != NULL)
+					*reclaimed += n;
+				if (r != 0)
+					break;
+				c->phase = COMPACT_START;
+				c->shard++;
+				break;
+			case COMPACT_RELEASE:
+				// A chunk is given back for each slice of nodes allowed.
+				if (budget <= 0 || compactLate(&start, maxMicros))
+					return 1;
+				r = mpEvacuateEnd(shard->pool, 1, &n);
+				budget -= MEMDBC_COMPACT_SLICE;
+				if (reclaimed != NULL)
+					*reclaimed += n;
+				if (r != 0)
+					break;
+				c->phase = COMPACT_START;
+				c->shard++;
+				break;
+		}
+	}
+
+	trieCursorFree(&c->tc);
+	free(c);
+	memDbc->compact = NULL;
+
+	return 0;
+}
+
+/* memDbcAddInt() - Add a record with an integer key.
+ * On an INT_ENGINE database the number goes to the tree as is, the
+ * string of keyWidth digits is only made for the key index and the log.
+ * Other databases store it under the decimal string of key.
+ * memDbc - returned by memDbcInit()
+ * key - the key to store data under.
+ * data - the data to store.
+ * len - Length of the data.
+ */
+int memDbcAddInt(MemDbc_t *memDbc, uint64_t key, void *data, int len) {
+	char buf[MEMDBC_INT_WIDTH + 1];
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return -1;
+	}
+
+	if (memDbc->engine != INT_ENGINE) {
+		keyFromInt(key, 0, buf);
+		return addRecord(memDbc, buf, NULL, data, len, 0);
+	}
+
+	// Too many digits for keyWidth.
+	if (keyFromInt(key, memDbc->keyWidth, buf) < 0)
+		return -1;
+
+	return addRecord(memDbc, buf, &key, data, len, 0);
+}
+
+/* memDbcFindInt() - Find a record by an integer key.
+ * On an INT_ENGINE database the number is looked up without a string,
+ * one tree node per byte of the key at most.  Other databases look up
+ * the decimal string of key.
+ * memDbc - returned by memDbcInit()
+ * key - to look for.
+ */
+void *memDbcFindInt(MemDbc_t *memDbc, uint64_t key) {
+	char buf[MEMDBC_INT_WIDTH + 1];
+	MemDbcShard_t *shard;
+	Ttl_t *ttl;
+	void *rec;
+
+	if (memDbc->engine != INT_ENGINE) {
+		keyFromInt(key, 0, buf);
+		return memDbcFind(memDbc, buf);
+	}
+
+	ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	if (ttl != NULL && keyFromInt(key, memDbc->keyWidth, buf) > 0 && ttlDue(memDbc, ttl, buf))
+		return NULL;
+
+	shard = intShard(memDbc, key);
+
+	epEnter();
+	pthread_rwlock_rdlock(&shard->treeLock);
+	rec = artLookupInt(shard->tree, key);
+	pthread_rwlock_unlock(&shard->treeLock);
+	if (rec != NULL && memDbc->evict != EVICT_NONE)
+		evictTouch(memDbc, rec);
+	epExit();
+
+	return rec;
+}
+
+/* memDbcDeleteInt() - memDbcDelete() of an integer key.
+ * memDbc - returned by memDbcInit()
+ * key - the key to delete.
+ */
+int memDbcDeleteInt(MemDbc_t *memDbc, uint64_t key) {
+	char buf[MEMDBC_INT_WIDTH + 1];
+
+	if (keyFromInt(key, (memDbc->engine == INT_ENGINE) ? memDbc->keyWidth : 0, buf) < 0)
+		return -1;
+
+	return memDbcDelete(memDbc, buf);
+}
+
+/* dbTtl() - Returns the expiry times of the database, made on first use.
+ * memDbc - returned by memDbcInit()
+ */
+static Ttl_t *dbTtl(MemDbc_t *memDbc) {
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	void *none = NULL;
+
+	if (ttl != NULL)
+		return ttl;
+
+	ttl = ttlInit(memDbc->dbType);
+	if (ttl == NULL)
+		return NULL;
+
+	// Another thread may have made it first.
+	if (AtomicExchange(&memDbc->ttl, &none, (void **)&ttl) == 0) {
+		ttlFree(ttl);
+		ttl = (Ttl_t *)none;
+	}
+
+	return ttl;
+}
+
+/* expireRecord() - Removes a record whose time to live has run out, the
+ * key's expiry stripe is held.
+ */
+static void expireRecord(void *ctx, char *key) {
+
+	deleteLogged((MemDbc_t *)ctx, key);
+}
+
+/* ttlRestore() - Sets the expiry time of a key read back from the log or
+ * a snapshot.  Returns 0 or -1 if out of memory.
+ * memDbc - returned by memDbcInit()
+ * key - already folded.
+ * expires - ttlWallNow() time the record is kept to, or 0 to clear it.
+ */
+static int ttlRestore(MemDbc_t *memDbc, char *key, uint64_t expires) {
+	Ttl_t *ttl = (expires != 0) ? dbTtl(memDbc) : (Ttl_t *)AtomicGet(&memDbc->ttl);
+	TtlStripe_t *stripe;
+	unsigned int h;
+	int r = 0;
+
+	if (ttl == NULL)
+		return (expires != 0) ? -1 : 0;
+
+	h = keyHash(memDbc, key);
+	stripe = ttlStripe(ttl, h);
+	pthread_mutex_lock(&stripe->lock);
+	if (expires == 0)
+		ttlClear(ttl, key, h);
+	else
+		r = ttlSet(ttl, key, h, ttlFromWall(ttl, expires));
+	pthread_mutex_unlock(&stripe->lock);
+
+	return r;
+}
+
+/* memDbcAddTTL() - Add a record that is removed after ttlMs milliseconds.
+ * From then on memDbcFind() does not find it, memDbcExpireTick() or the
+ * thread of memDbcExpireStart() deletes it.  Adding the key again with
+ * memDbcAdd() keeps it for good.
+ * memDbc - returned by memDbcInit()
+ * key - the key to store data under.
+ * data - the data to store.
+ * len - Length of the data.
+ * ttlMs - milliseconds to keep the record, 0 for no limit.
+ */
+int memDbcAddTTL(MemDbc_t *memDbc, char *key, void *data, int len, unsigned long ttlMs) {
+	char buf[MEMDBC_KEY_FOLD];
+	char *k;
+	int r;
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return -1;
+	}
+	if (ttlMs != 0 && dbTtl(memDbc) == NULL)
+		return -1;
+	if ((k = keyFold(memDbc, key, buf)) == NULL)
+		return -1;
+
+	r = addRecord(memDbc, k, NULL, data, len, ttlMs);
+	keyFoldEnd(k, key, buf);
+
+	return r;
+}
+
+/* dbExpire() - memDbcExpire() of a key already folded.
+ * memDbc - returned by memDbcInit()
+ */
+static int dbExpire(MemDbc_t *memDbc, char *key, unsigned long ttlMs) {
+	Wal_t *wal = (Wal_t *)memDbc->wal;
+	Ttl_t *ttl;
+	TtlStripe_t *stripe;
+	uint64_t tick = 0, lsn = 0;
+	unsigned int h;
+	int r = -1;
+
+	if (dbKeyCheck(memDbc, key) < 0)
+		return -1;
+
+	ttl = (ttlMs != 0) ? dbTtl(memDbc) : (Ttl_t *)AtomicGet(&memDbc->ttl);
+	if (ttl == NULL)
+		return (ttlMs == 0 && dbFind(memDbc, key) != NULL) ? 0 : -1;
+
+	// A record past its time is gone even if not yet deleted.
+	h = keyHash(memDbc, key);
+	stripe = ttlStripe(ttl, h);
+	pthread_mutex_lock(&stripe->lock);
+	if (ttlDue(memDbc, ttl, key) == 0 && dbFind(memDbc, key) != NULL) {
+		r = 0;
+		if (ttlMs != 0)
+			tick = ttlNow(ttl) + ttlMs;
+		if (ttlMs == 0)
+			ttlClear(ttl, key, h);
+		else if (ttlSet(ttl, key, h, tick) < 0)
+			r = -1;
+		// Adds of the key hold the same stripe, so they and this reach
+		// the log in order.
+		if (r == 0 && wal != NULL) {
+			lsn = walLog(wal, WAL_EXPIRE, key, NULL, 0, (tick != 0) ? ttlToWall(ttl, tick) : 0);
+			if (lsn == 0)
+				r = -1;
+		}
+	}
+	pthread_mutex_unlock(&stripe->lock);
+
+	if (lsn != 0 && walWait(wal, lsn) != 0)
+		r = -1;
+
+	return r;
+}
+
+/* memDbcExpire() - Sets the time to live of a record already there.
+ * Returns 0 or -1 if the key is not found.
+ * memDbc - returned by memDbcInit()
+ * key - the record's key.
+ * ttlMs - milliseconds from now to keep the record, 0 to keep it for good.
+ */
+int memDbcExpire(MemDbc_t *memDbc, char *key, unsigned long ttlMs) {
+	char buf[MEMDBC_KEY_FOLD];
+	char *k;
+	int r;
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return -1;
+	}
+	if ((k = keyFold(memDbc, key, buf)) == NULL)
+		return -1;
+
+	r = dbExpire(memDbc, k, ttlMs);
+	keyFoldEnd(k, key, buf);
+
+	return r;
+}
+
+/* memDbcExpireTick() - Deletes the records whose time to live has run out.
+ * The expiry times are kept in a timing wheel, only the records that are
+ * due are looked at.  Returns the number deleted.
+ * memDbc - returned by memDbcInit()
+ * maxKeys - most records to delete, 0 for all that are due.
+ */
+int memDbcExpireTick(MemDbc_t *memDbc, int maxKeys) {
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+
+	if (ttl == NULL)
+		return 0;
+
+	return ttlAdvance(ttl, maxKeys, expireRecord, memDbc);
+}
+
+/* memDbcExpireStart() - Starts a thread that calls memDbcExpireTick()
+ * every TTL_SWEEP_MS milliseconds until memDbcExpireStop() or memDbcFree().
+ * memDbc - returned by memDbcInit()
+ */
+int memDbcExpireStart(MemDbc_t *memDbc) {
+	Ttl_t *ttl;
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return -1;
+	}
+
+	ttl = dbTtl(memDbc);
+	if (ttl == NULL)
+		return -1;
+
+	return ttlStart(ttl, expireRecord, memDbc);
+}
+
+/* memDbcExpireStop() - Stops the thread of memDbcExpireStart().
+ * memDbc - returned by memDbcInit()
+ */
+void memDbcExpireStop(MemDbc_t *memDbc) {
+
+	if (memDbc->ttl != NULL)
+		ttlStop(memDbc->ttl);
+}
+
+/* memDbcFindAll() - Find all regex matching records.
+ * memDbc - returned by memDbcInit()
+ * regexStr - regex pattern to match to.
+ * callback - user supplied callback function.
+ */
+void memDbcFindAll(MemDbc_t *memDbc, char *regexStr, void (*callback)(char *key, void *data)) {
+	KeyMerge_t km;
+	void **ref;
+	char *key;
+
+	if (callback == NULL) {
+		memDbcErrorNum = CALLBACK_NULL;
+		return;
+	}
+
+	regex_t regex;
+
+	int r = regcomp(&regex, regexStr, 0);
+	if (r != 0) {
+		memDbcErrorNum = REGEX_ERR;
+		return;
+	}
+
+	epEnter();
+	lockIndexes(memDbc);
+
+	if (keyMergeInit(memDbc, &km) == 0) {
+		while ((key = keyMergeNext(&km, &ref)) != NULL) {
+			void *data = AtomicGet(ref);
+
+			if (data != NULL && regexec(&regex, key, 0, NULL, 0) == 0)
+				callback(key, data);
+		}
+		keyMergeEnd(&km);
+	}
+
+	unlockIndexes(memDbc);
+	epExit();
+
+	regfree(&regex);
+}
+
+/* memDbcNumEntries() - returns the record count.
+ * memDbc - returned by memDbcInit()
+ */
+unsigned long memDbcNumEntries(MemDbc_t *memDbc) {
+	unsigned long n = 0;
+	int i;
+
+	if (memDbc->map != NULL)
+		return ((MapFile_t *)memDbc->map)->hdr.recCount;
+
+	for (i = 0; i < memDbc->numShards; i++)
+		n += AtomicGet(&memDbc->shards[i].recCount);
+
+	return n;
+}
+
+/* memDbcMemoryUsed() - returns the bytes of records, tree nodes, the key
+ * index and expiry times counted against maxMemory.
+ * memDbc - returned by memDbcInit()
+ */
+size_t memDbcMemoryUsed(MemDbc_t *memDbc) {
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	size_t n = 0;
+	int i;
+
+	if (memDbc->map != NULL)
+		return 0;
+
+	for (i = 0; i < memDbc->numShards; i++)
+		n += mpUsed(memDbc->shards[i].pool) + AtomicGet(&((BpTree_t *)memDbc->shards[i].index)->bytes);
+	if (ttl != NULL)
+		n += ttlBytes(ttl);
+
+	return n;
+}
+
+/* memDbcWalk() - Walks the database calling the callback
+ * memDbc - returned by memDbcInit()
+ * callback - user supplied callback function.
+ */
+void memDbcWalk(MemDbc_t *memDbc, char *(*callback)(char *key, void *data)) {
+
+	epEnter();
+	lockIndexes(memDbc);
+	keyIndexWalk(memDbc, callback);
+	unlockIndexes(memDbc);
+	epExit();
+}
+
+/* memDbcSave() - Saves all records to a file.
+ * memDbc - returned by memDbcInit()
+ * fileName - File name to save data to or NULL is user's callback is saving the data.
+ * callback - user supplied callback function.
+ */
+void memDbcSave(MemDbc_t *memDbc, char *fileName, char *(*callback)(char *key, void *data)) {
+
+	epEnter();
+	lockIndexes(memDbc);
+	keyIndexSave(memDbc, fileName, callback);
+	unlockIndexes(memDbc);
+	epExit();
+}
+
+/* saveRecords() - Writes every record to a new binary snapshot.
+ * The caller must hold the index locks.  Returns the snapshot ready for
+ * snapClose() or NULL.
+ * memDbc - returned by memDbcInit()
+ * fileName - File name to save data to.
+ * progressFd - pipe to report progress on or -1.
+ */
+static SnapFile_t *saveRecords(MemDbc_t *memDbc, char *fileName, int progressFd) {
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	uint64_t now = (ttl != NULL) ? ttlNow(ttl) : 0;
+	uint64_t tick, expires;
+	SnapFile_t *snap;
+	KeyMerge_t km;
+	void **ref;
+	void *data;
+	char *key;
+	unsigned long n = 0;
+
+	snap = snapCreate(fileName, memDbc->dbType, memDbc->engine,
+			(memDbc->engine == INT_ENGINE) ? memDbc->keyWidth : 0);
+	if (snap == NULL)
+		return NULL;
+
+	if (keyMergeInit(memDbc, &km) != 0) {
+		snapAbort(snap);
+		return NULL;
+	}
+
+	while ((key = keyMergeNext(&km, &ref)) != NULL) {
+		// Every engine swaps an updated value in whole, NULL is a delete
+		// by a writer that has not reached the index yet.
+		data = AtomicGet(ref);
+		if (data == NULL)
+			continue;
+
+		// Same as cursorFill(), records past their time are not saved,
+		// the others keep theirs.
+		expires = 0;
+		if (ttl != NULL && ttlOf(memDbc, ttl, key, &tick)) {
+			if (tick <= now)
+				continue;
+			expires = ttlToWall(ttl, tick);
+		}
+
+		if (snapWrite(snap, key, data, mpValLen(data), expires) != 0) {
+			keyMergeEnd(&km);
+			snapAbort(snap);
+			return NULL;
+		}
+
+		if (progressFd >= 0 && ++n % BG_PROGRESS == 0)
+			bgSaveProgress(progressFd, n);
+	}
+	keyMergeEnd(&km);
+
+	if (progressFd >= 0)
+		bgSaveProgress(progressFd, n);
+
+	return snap;
+}
+
+/* memDbcSaveBinary() - Saves all records to a binary snapshot file.
+ * The keys and raw value bytes are written in key order so memDbcLoad()
+ * can rebuild the database without searching.  Returns 0 or -1 and
+ * memDbcError() is set.
+ * memDbc - returned by memDbcInit()
+ * fileName - File name to save data to.
+ */
+int memDbcSaveBinary(MemDbc_t *memDbc, char *fileName) {
+	SnapFile_t *snap;
+
+	epEnter();
+	lockIndexes(memDbc);
+	snap = saveRecords(memDbc, fileName, -1);
+	unlockIndexes(memDbc);
+	epExit();
+
+	if (snap == NULL)
+		return -1;
+
+	return snapClose(snap);
+}
+
+// What the child of memDbcSaveBackground() saves.
+typedef struct _bgSaveCtx {
+	MemDbc_t *memDbc;
+	char *fileName;
+	Ttl_t *ttl;				// expiry times held over the fork or NULL.
+} BgSaveCtx_t;
+
+/* bgSaveChild() - Runs in the child of memDbcSaveBackground().
+ */
+static int bgSaveChild(void *ctx, int progressFd) {
+	BgSaveCtx_t *c = (BgSaveCtx_t *)ctx;
+	SnapFile_t *snap;
+
+	// The locks were held by the parent at the fork and no thread in
+	// the child can change anything, so they are not taken here.  The
+	// expiry tables are looked up through their locks, the child lets
+	// go of its copies.
+	if (c->ttl != NULL)
+		ttlRelease(c->ttl);
+	snap = saveRecords(c->memDbc, c->fileName, progressFd);
+	if (snap == NULL)
+		return -1;
+
+	return snapClose(snap);
+}
+
+/* bgSaveFork() - Starts the child of a background save with the indexes
+ * and expiry tables held, so it sees them whole.  Returns the save or NULL.
+ * memDbc - returned by memDbcInit()
+ * ctx - fileName to save to, the rest is filled in.
+ */
+static BgSave_t *bgSaveFork(MemDbc_t *memDbc, BgSaveCtx_t *ctx, MemDbcSaveFn_t callback, void *arg) {
+	unsigned long total = memDbcNumEntries(memDbc);
+	BgSave_t *bg;
+
+	ctx->memDbc = memDbc;
+	ctx->ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+
+	epEnter();
+	lockIndexes(memDbc);
+	if (ctx->ttl != NULL)
+		ttlHold(ctx->ttl);
+	bg = bgSaveStart(bgSaveChild, ctx, total, callback, arg);
+	if (ctx->ttl != NULL)
+		ttlRelease(ctx->ttl);
+	unlockIndexes(memDbc);
+	epExit();
+
+	return bg;
+}
+
+/* memDbcSaveBackground() - Saves a binary snapshot without holding up writers.
+ * The process is forked and the child saves the records as they were at
+ * the fork from its copy on write view of memory, while adds and deletes
+ * go on in the parent.  callback, if not NULL, is called from another
+ * thread with SAVE_RUNNING as records are written and then once with
+ * SAVE_DONE or SAVE_FAILED.  Only one save runs at a time, returns -1
+ * with memDbcError() set to BUSY_ERR while one is running.
+ * memDbc - returned by memDbcInit()
+ * fileName - File name to save data to.
+ * callback - user supplied callback function or NULL.
+ * arg - passed to callback.
+ */
+int memDbcSaveBackground(MemDbc_t *memDbc, char *fileName, MemDbcSaveFn_t callback, void *arg) {
+	BgSaveCtx_t ctx = { memDbc, fileName, NULL };
+
+	if (memDbc->bgSave != NULL) {
+		if (bgSaveFinished(memDbc->bgSave) == 0) {
+			memDbcErrorNum = BUSY_ERR;
+			return -1;
+		}
+		bgSaveWait(memDbc->bgSave);
+		memDbc->bgSave = NULL;
+	}
+
+	// The indexes are only locked for the fork itself.
+	memDbc->bgSave = bgSaveFork(memDbc, &ctx, callback, arg);
+
+	return (memDbc->bgSave == NULL) ? -1 : 0;
+}
+
+/* memDbcSaveWait() - Waits for memDbcSaveBackground() to finish.
+ * Returns 0 if the file was saved, or there was no save, else -1.
+ * memDbc - returned by memDbcInit()
+ */
+int memDbcSaveWait(MemDbc_t *memDbc) {
+	int r;
+
+	if (memDbc->bgSave == NULL)
+		return 0;
+
+	r = bgSaveWait(memDbc->bgSave);
+	memDbc->bgSave = NULL;
+
+	return r;
+}
+
+/* buildInsert() - Puts a key of a bulk load in the tree.
+ * The trie engine starts from the path of the shard's last key, the
+ * others insert from the root.
+ * memDbc - returned by memDbcInit()
+ * depth - bytes key shares with the last key or -1.
+ * ref - set to the address of the data pointer in the tree.
+ */
+static int buildInsert(MemDbc_t *memDbc, MemDbcShard_t *shard, ShardBuild_t *sb, int depth,
+		char *key, void *data, int len, void ***ref) {
+	int r = -1;
+
+	if (memDbc->engine != TRIE_ENGINE)
+		return treeInsert(memDbc, shard, key, data, len, ref);
+	if (memDbc->stride > 1)
+		return wttAppend(shard->tree, (WideTrieTreeNode **)sb->path, depth, key, data, len, ref);
+
+	switch (memDbc->dbType) {
+		case ASCII_DB:
+			r = attAppend(shard->tree, (AsciiTrieTreeNode **)sb->path, depth, key, data, len, ref);
+			break;
+		case DIGITAL_DB:
+			r = dttAppend(shard->tree, (DigitalTrieTreeNode **)sb->path, depth, key, data, len, ref);
+			break;
+		case HEX_DB:
+			r = httAppend(shard->tree, (HexTrieTreeNode **)sb->path, depth, key, data, len, ref);
+			break;
+		case OCTAL_DB:
+			r = ottAppend(shard->tree, (OctalTrieTreeNode **)sb->path, depth, key, data, len, ref);
+			break;
+		default:
+			memDbcErrorNum = UNKNOWN_TYPE;
+			break;
+	}
+
+	return r;
+}
+
+/* buildGrow() - Makes sure *p has room for n elements of size bytes.
+ * Returns 0 or -1 if out of memory.
+ */
+static int buildGrow(void **p, size_t *max, size_t n, size_t size) {
+	size_t m = (*max == 0) ? 1024 : *max;
+	void *np;
+
+	if (n <= *max)
+		return 0;
+
+	while (m < n)
+		m *= 2;
+
+	np = realloc(*p, m * size);
+	if (np == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+	*p = np;
+	*max = m;
+
+	return 0;
+}
+
+/* buildGrowKeys() - Doubles the room for the new keys of a shard.
+ * Returns 0 or -1 if out of memory.
+ */
+static int buildGrowKeys(ShardBuild_t *sb) {
+	size_t m = (sb->maxKeys == 0) ? 1024 : sb->maxKeys * 2;
+	char **keys;
+	void ***refs;
+
+	keys = (char **)realloc(sb->keys, m * sizeof(char *));
+	if (keys == NULL)
+		goto nomem;
+	sb->keys = keys;
+
+	refs = (void ***)realloc(sb->refs, m * sizeof(void **));
+	if (refs == NULL)
+		goto nomem;
+	sb->refs = refs;
+
+	sb->maxKeys = m;
+
+	return 0;
+
+nomem:
+	memDbcErrorNum = MALLOC_ERR;
+	return -1;
+}
+
+/* memDbcBuildOpen() - Starts a bulk load of records in sorted order.
+ * Add the records with memDbcBuildAdd() and get the database from
+ * memDbcBuildClose().  Returns NULL on error and memDbcError() is set.
+ * dbType - type of keys.
+ * opts - Tuning options or NULL for the defaults.
+ */
+MemDbcBuild_t *memDbcBuildOpen(DbTypes_t dbType, MemDbcOpts_t *opts) {
+	MemDbcBuild_t *build = (MemDbcBuild_t *)calloc(1, sizeof(MemDbcBuild_t));
+
+	if (build == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+
+	build->memDbc = memDbcInitOpts(dbType, opts);
+	if (build->memDbc == NULL) {
+		free(build);
+		return NULL;
+	}
+
+	build->shards = (ShardBuild_t *)calloc(build->memDbc->numShards, sizeof(ShardBuild_t));
+	if (build->shards == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		memDbcFree(build->memDbc);
+		free(build);
+		return NULL;
+	}
+
+	return build;
+}
+
+/* buildAdd() - memDbcBuildAdd() of a key already folded.
+ */
+static int buildAdd(MemDbcBuild_t *build, char *key, void *data, int len) {
+	MemDbc_t *memDbc = build->memDbc;
+	MemDbcShard_t *shard = keyShard(memDbc, key);
+	ShardBuild_t *sb = &build->shards[shard - memDbc->shards];
+	size_t keyLen = strlen(key);
+	void **ref = NULL;
+	int depth = -1;
+	int r;
+
+	if (dbKeyCheck(memDbc, key) < 0)
+		return -1;
+
+	if (sb->last != NULL) {
+		// Bytes shared with the last key, they are in its trie path.
+		for (depth = 0; key[depth] != '\0' && key[depth] == sb->last[depth]; depth++)
+			;
+		if ((unsigned char)key[depth] < (unsigned char)sb->last[depth]) {
+			memDbcErrorNum = FORMAT_ERR;
+			return -1;
+		}
+	}
+
+	if (buildGrow((void **)&sb->path, &sb->pathSize, keyLen + 1, sizeof(void *)) != 0 ||
+			buildGrow((void **)&sb->last, &sb->lastSize, keyLen + 1, 1) != 0)
+		return -1;
+	if (sb->numKeys == sb->maxKeys && buildGrowKeys(sb) != 0)
+		return -1;
+
+	epEnter();
+	r = buildInsert(memDbc, shard, sb, depth, key, data, len, &ref);
+	epExit();
+
+	if (r != 1 && r != 2) {
+		if (memDbcErrorNum == MEMDBC_OK)
+			memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+
+	memcpy(sb->last, key, keyLen + 1);
+
+	if (r == 1) {
+		sb->keys[sb->numKeys] = strdup(key);
+		if (sb->keys[sb->numKeys] == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			return -1;
+		}
+		sb->refs[sb->numKeys++] = ref;
+		shard->recCount++;
+	}
+
+	return r;
+}
+
+/* memDbcBuildAdd() - Adds the next record of a bulk load.
+ * Keys must come in strcmp() order, HEX_DB keys compared in lower case.
+ * Nodes are made in the order the keys arrive, so each subtree ends up
+ * packed together in memory, and the key index is built bottom up by
+ * memDbcBuildClose() with no search.
+ * Returns 1 if the key is new, 2 if it was the same as the last key and
+ * replaced it, or -1 with memDbcError() set to FORMAT_ERR if the key
+ * is out of order.
+ * build - returned by memDbcBuildOpen()
+ * key - the key to store data under.
+ * data - the data to store.
+ * len - Length of the data.
+ */
+int memDbcBuildAdd(MemDbcBuild_t *build, char *key, void *data, int len) {
+	char buf[MEMDBC_KEY_FOLD];
+	char *k;
+	int r;
+
+	if ((k = keyFold(build->memDbc, key, buf)) == NULL)
+		return -1;
+
+	r = buildAdd(build, k, data, len);
+	keyFoldEnd(k, key, buf);
+
+	return r;
+}
+
+/* memDbcBuildClose() - Ends a bulk load and returns the database.
+ * Returns NULL on error and memDbcError() is set, the database is freed.
+ * build - returned by memDbcBuildOpen(), it is freed.
+ */
+MemDbc_t *memDbcBuildClose(MemDbcBuild_t *build) {
+	MemDbc_t *memDbc = build->memDbc;
+	int numShards = memDbc->numShards;
+	size_t i;
+	int s;
+
+	for (s = 0; s < numShards; s++) {
+		ShardBuild_t *sb = &build->shards[s];
+
+		if (memDbc != NULL && bptBuild(memDbc->shards[s].index, sb->keys, sb->refs, sb->numKeys) != 0) {
+			memDbcFree(memDbc);
+			memDbc = NULL;
+		}
+		if (memDbc == NULL) {
+			// Keys not taken by an index are freed here.
+			for (i = 0; i < sb->numKeys; i++)
+				free(sb->keys[i]);
+		}
+		free(sb->path);
+		free(sb->last);
+		free(sb->keys);
+		free(sb->refs);
+	}
+
+	free(build->shards);
+	free(build);
+
+	return memDbc;
+}
+
+/* memDbcLoadText() - Builds a new database from a text file of sorted records.
+ * Each line is a key, a comma and the value, as memDbcSave() writes them
+ * with a NULL callback.  Values are stored without the newline.
+ * Returns NULL on error and memDbcError() is set.
+ * fileName - File name to load.
+ * dbType - type of keys.
+ * opts - Tuning options or NULL for the defaults.
+ */
+MemDbc_t *memDbcLoadText(char *fileName, DbTypes_t dbType, MemDbcOpts_t *opts) {
+	MemDbcBuild_t *build;
+	MemDbc_t *memDbc;
+	FILE *in;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t n;
+	int failed = 0;
+
+	in = fopen(fileName, "r");
+	if (in == NULL) {
+		memDbcErrorNum = FILE_ERR;
+		return NULL;
+	}
+
+	build = memDbcBuildOpen(dbType, opts);
+	if (build == NULL) {
+		fclose(in);
+		return NULL;
+	}
+
+	while ((n = getline(&line, &size, in)) > 0) {
+		char *comma;
+
+		if (line[n - 1] == '\n')
+			line[--n] = '\0';
+
+		comma = strchr(line, ',');
+		if (comma == NULL) {
+			memDbcErrorNum = FORMAT_ERR;
+			failed = 1;
+			break;
+		}
+		*comma++ = '\0';
+
+		if (memDbcBuildAdd(build, line, comma, n - (comma - line)) < 0) {
+			failed = 1;
+			break;
+		}
+	}
+	free(line);
+	fclose(in);
+
+	memDbc = memDbcBuildClose(build);
+	if (failed && memDbc != NULL) {
+		memDbcFree(memDbc);
+		memDbc = NULL;
+	}
+
+	return memDbc;
+}
+
+/* memDbcLoad() - Builds a new database from a file saved by memDbcSaveBinary().
+ * The records arrive in key order so they are bulk loaded with
+ * memDbcBuildAdd().  Returns NULL on error and memDbcError() is set.
+ * fileName - File name to load.
+ * opts - Tuning options or NULL for the defaults, the pool is sized
+ *        for the records in the file if reserveKeys is 0.  engine and
+ *        keyWidth default to the saved database's, other values are a
+ *        FORMAT_ERR.
+ */
+MemDbc_t *memDbcLoad(char *fileName, MemDbcOpts_t *opts) {
+	MemDbcOpts_t o = { 0 };
+	MemDbcBuild_t *build;
+	MemDbc_t *memDbc;
+	SnapFile_t *snap;
+	LoadTtl_t *ttls = NULL;
+	size_t numTtls = 0, maxTtls = 0, i;
+	uint64_t expires, now;
+	void *data;
+	char *key;
+	int len, r;
+
+	snap = snapOpen(fileName);
+	if (snap == NULL)
+		return NULL;
+
+	if (opts != NULL)
+		o = *opts;
+	if (o.reserveKeys == 0)
+		o.reserveKeys = snap->hdr.recCount;
+
+	// An INT_ENGINE file read into another tree, or with other key
+	// widths, would find none of its keys.
+	if ((o.engine != TRIE_ENGINE && o.engine != snap->hdr.engine) ||
+			(o.keyWidth != 0 && snap->hdr.keyWidth != 0 && o.keyWidth != snap->hdr.keyWidth)) {
+		memDbcErrorNum = FORMAT_ERR;
+		snapFree(snap);
+		return NULL;
+	}
+	o.engine = snap->hdr.engine;
+	if (snap->hdr.keyWidth != 0)
+		o.keyWidth = snap->hdr.keyWidth;
+
+	build = memDbcBuildOpen(snap->hdr.dbType, &o);
+	if (build == NULL) {
+		snapFree(snap);
+		return NULL;
+	}
+
+	// Nobody else can see the database yet so no locks are taken.
+	now = ttlWallNow();
+	while ((r = snapRead(snap, &key, &data, &len, &expires)) == 1) {
+		// Records whose time ran out since the save are left out.
+		if (expires != 0 && expires <= now)
+			continue;
+
+		if (memDbcBuildAdd(build, key, data, len) < 0) {
+			r = -1;
+			break;
+		}
+
+		if (expires != 0) {
+			if (buildGrow((void **)&ttls, &maxTtls, numTtls + 1, sizeof(LoadTtl_t)) != 0) {
+				r = -1;
+				break;
+			}
+			ttls[numTtls].key = strdup(key);
+			if (ttls[numTtls].key == NULL) {
+				memDbcErrorNum = MALLOC_ERR;
+				r = -1;
+				break;
+			}
+			ttls[numTtls++].expires = expires;
+		}
+	}
+
+	snapFree(snap);
+
+	memDbc = memDbcBuildClose(build);
+
+	// The expiry times go on once the records are in the trees.
+	for (i = 0; i < numTtls; i++) {
+		if (r == 0 && memDbc != NULL && ttlRestore(memDbc, ttls[i].key, ttls[i].expires) < 0)
+			r = -1;
+		free(ttls[i].key);
+	}
+	free(ttls);
+
+	if (r != 0 && memDbc != NULL) {
+		memDbcFree(memDbc);
+		memDbc = NULL;
+	}
+
+	return memDbc;
+}
+
+/* memDbcSaveMapped() - Saves all records to a file memDbcOpenMapped() can use in place.
+ * Returns 0 or -1 and memDbcError() is set.
+ * memDbc - returned by memDbcInit()
+ * fileName - File name to save data to.
+ */
+int memDbcSaveMapped(MemDbc_t *memDbc, char *fileName) {
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	MapFile_t *map;
+	KeyMerge_t km;
+	void **ref;
+	void *data;
+	char *key;
+	int r = 0;
+
+	map = mapCreate(fileName, memDbc->dbType);
+	if (map == NULL)
+		return -1;
+
+	epEnter();
+	lockIndexes(memDbc);
+
+	if (keyMergeInit(memDbc, &km) == 0) {
+		while ((key = keyMergeNext(&km, &ref)) != NULL) {
+			data = AtomicGet(ref);
+			if (data == NULL)
+				continue;		// deleted by a writer that has not reached the index yet.
+			if (ttl != NULL && ttlDue(memDbc, ttl, key))
+				continue;
+
+			if (mapWrite(map, key, data, mpValLen(data)) != 0) {
+				r = -1;
+				break;
+			}
+		}
+		keyMergeEnd(&km);
+	} else {
+		r = -1;
+	}
+
+	unlockIndexes(memDbc);
+	epExit();
+
+	if (r != 0) {
+		mapAbort(map);
+		return -1;
+	}
+
+	// The trie is built from the saved keys once the indexes are unlocked.
+	return mapClose(map);
+}
+
+/* memDbcOpenMapped() - Opens a file saved by memDbcSaveMapped() read only.
+ * The file is mapped and used in place, nothing is copied, so the open is
+ * quick and the pages are shared with every other process mapping it.
+ * memDbcAdd() and memDbcDelete() fail with READONLY_ERR and the records
+ * returned by memDbcFind() must not be written to.
+ * fileName - File name to open.
+ */
+MemDbc_t *memDbcOpenMapped(char *fileName) {
+	MemDbc_t *memDbc;
+
+	memDbcErrorNum = MEMDBC_OK;
+
+	memDbc = (MemDbc_t *)calloc(sizeof(MemDbc_t), 1);
+	if (memDbc == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+
+	memDbc->map = mapOpen(fileName);
+	if (memDbc->map == NULL) {
+		free(memDbc);
+		return NULL;
+	}
+	memDbc->dbType = ((MapFile_t *)memDbc->map)->dbType;
+
+	return memDbc;
+}
+
+/* walApply() - Applies a record found in the log by memDbcWalOpen().
+ * Keys are folded here too, a log written before HEX_DB keys were folded
+ * may hold them in upper case.
+ */
+static int walApply(void *ctx, int op, char *key, void *data, int len, uint64_t expires) {
+	MemDbc_t *memDbc = (MemDbc_t *)ctx;
+	char buf[MEMDBC_KEY_FOLD];
+	char *k;
+	int r = 0;
+
+	if ((k = keyFold(memDbc, key, buf)) == NULL)
+		return -1;
+
+	// A time to live that ran out while the log was closed is a delete.
+	if (expires != 0 && expires <= ttlWallNow())
+		op = WAL_DELETE;
+
+	if (op == WAL_DELETE) {
+		dbDelete(memDbc, k);
+		r = ttlRestore(memDbc, k, 0);
+	} else if (op == WAL_ADD) {
+		if (dbAdd(memDbc, k, data, len) < 0 || ttlRestore(memDbc, k, expires) < 0)
+			r = -1;
+	} else if (dbFind(memDbc, k) != NULL) {
+		r = ttlRestore(memDbc, k, expires);
+	}
+
+	keyFoldEnd(k, key, buf);
+
+	return r;
+}
+
+/* memDbcWalOpen() - Attaches a write ahead log to the database.
+ * Records already in the log are applied to the database first, so
+ * opening the log of a crashed process brings back its changes.  From
+ * then on every add and delete is logged.  Returns 0 or -1 and
+ * memDbcError() is set.
+ * memDbc - returned by memDbcInit() or memDbcLoad()
+ * fileName - the log file, created if missing.
+ * durability - how long memDbcAdd() and memDbcDelete() wait for the log.
+ */
+int memDbcWalOpen(MemDbc_t *memDbc, char *fileName, MemDbcDurability_t durability) {
+
+	if (memDbc->map != NULL) {
+		memDbcErrorNum = READONLY_ERR;
+		return -1;
+	}
+	if (memDbc->wal != NULL || durability < WAL_NO_SYNC || durability > WAL_SYNC) {
+		memDbcErrorNum = OPTION_ERR;
+		return -1;
+	}
+
+	memDbc->wal = walOpen(fileName, memDbc->dbType, durability, walApply, memDbc);
+
+	return (memDbc->wal == NULL) ? -1 : 0;
+}
+
+/* memDbcWalSync() - Waits until every change logged so far is on disk.
+ * memDbc - returned by memDbcInit()
+ */
+int memDbcWalSync(MemDbc_t *memDbc) {
+
+	if (memDbc->wal == NULL)
+		return 0;
+
+	return walSync(memDbc->wal);
+}
+
+/* memDbcCheckpoint() - Saves a binary snapshot and drops what it holds
+ * from the log.  As with memDbcSaveBackground() the snapshot is written
+ * by a forked child, writers are only held off for the fork so the
+ * snapshot holds the log up to that point.  Once the snapshot and its
+ * directory are synced the log is cut there, the records logged since
+ * are kept.  Returns when it is done.  Restart with memDbcLoad() then
+ * memDbcWalOpen().
+ * memDbc - returned by memDbcInit()
+ * fileName - File name to save data to.
+ */
+int memDbcCheckpoint(MemDbc_t *memDbc, char *fileName) {
+	Wal_t *wal = (Wal_t *)memDbc->wal;
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	BgSaveCtx_t ctx = { memDbc, fileName, NULL };
+	uint64_t lsn;
+	BgSave_t *bg;
+	int i;
+
+	if (wal == NULL)
+		return memDbcSaveBinary(memDbc, fileName);
+
+	// An add sets its expiry time after it is logged, the expiry stripes
+	// keep that from falling between the log position and the fork.
+	if (ttl != NULL) {
+		for (i = 0; i < TTL_STRIPES; i++)
+			pthread_mutex_lock(&ttl->stripes[i].lock);
+	}
+	for (i = 0; i < WAL_STRIPES; i++)
+		pthread_mutex_lock(&wal->stripes[i]);
+
+	lsn = walLsn(wal);
+	bg = bgSaveFork(memDbc, &ctx, NULL, NULL);
+
+	for (i = WAL_STRIPES - 1; i >= 0; i--)
+		pthread_mutex_unlock(&wal->stripes[i]);
+	if (ttl != NULL) {
+		for (i = TTL_STRIPES - 1; i >= 0; i--)
+			pthread_mutex_unlock(&ttl->stripes[i].lock);
+	}
+
+	if (bg == NULL || bgSaveWait(bg) != 0)
+		return -1;
+
+	return walTruncate(wal, lsn);
+}
+
+/* memDbcWalClose() - Syncs and detaches the write ahead log.
+ * memDbcFree() does this if it is not called.
+ * memDbc - returned by memDbcInit()
+ */
+int memDbcWalClose(MemDbc_t *memDbc) {
+	int r;
+
+	if (memDbc->wal == NULL)
+		return 0;
+
+	r = walClose(memDbc->wal);
+	memDbc->wal = NULL;
+
+	return r;
+}
+
+/* cursorFillMap() - cursorFill() of a mapped snapshot.  The records are
+ * used in place and found by record number, a seek is a binary search of
+ * the file's offset table.  A damaged record ends the cursor with -1.
+ * mapAt - record number + 1 of bound when it came from the cursor, else 0.
+ */
+static int cursorFillMap(MemDbcCursor_t *cur, char *bound, uint64_t mapAt, int dir, int incl) {
+	MapFile_t *map = (MapFile_t *)cur->memDbc->map;
+	uint64_t at;
+	void *data;
+	char *key;
+	int n = 0;
+
+	// at is the first record past bound in dir, counting back from at - 1.
+	if (mapAt != 0) {
+		at = (dir > 0) ? mapAt : mapAt - 1;
+	} else if (bound == NULL) {
+		at = (dir > 0) ? 0 : map->hdr.recCount;
+	} else {
+		// Step over bound going forward without it, or back with it.
+		at = mapSeek(map, bound);
+		key = mapRec(map, at, &data);
+		if (key != NULL && strcmp(key, bound) == 0 && (dir > 0) != (incl != 0))
+			at++;
+	}
+
+	if (dir > 0) {
+		for (; n < MEMDBC_CURSOR_BATCH && at < map->hdr.recCount; n++, at++) {
+			cur->keys[n] = mapRec(map, at, &cur->data[n]);
+			if (cur->keys[n] == NULL)
+				goto bad;
+			cur->mapPos[n] = at + 1;
+		}
+		cur->atEnd = (at >= map->hdr.recCount);
+	} else {
+		for (; n < MEMDBC_CURSOR_BATCH && at > 0; n++, at--) {
+			cur->keys[n] = mapRec(map, at - 1, &cur->data[n]);
+			if (cur->keys[n] == NULL)
+				goto bad;
+			cur->mapPos[n] = at;
+		}
+		cur->atEnd = (at == 0);
+	}
+
+	cur->dir = dir;
+	cur->num = n;
+	cur->pos = (n > 0) ? 0 : -1;
+
+	return n;
+
+bad:
+	cur->num = 0;
+	cur->pos = -1;
+	cur->atEnd = 1;
+	return -1;
+}
+
+/* cursorFill() - Reads the next window of a cursor, the records past bound
+ * in direction dir and bound itself if incl.  bound NULL starts at the
+ * first or last key.  The index locks are held while at most
+ * MEMDBC_CURSOR_BATCH records are copied.  Returns the records read or -1.
+ * bound - must not point into the window.
+ * mapAt - see cursorFillMap().
+ */
+static int cursorFill(MemDbcCursor_t *cur, char *bound, uint64_t mapAt, int dir, int incl) {
+	MemDbc_t *memDbc = cur->memDbc;
+	Ttl_t *ttl = (Ttl_t *)AtomicGet(&memDbc->ttl);
+	KeyMerge_t *km = &cur->km;
+	size_t off[MEMDBC_CURSOR_BATCH];
+	size_t used = 0, len;
+	void **ref;
+	void *data;
+	char *key;
+	int i, n = 0;
+
+	if (memDbc->map != NULL)
+		return cursorFillMap(cur, bound, mapAt, dir, incl);
+
+	epEnter();
+	lockIndexes(memDbc);
+
+	km->dir = dir;
+	km->num = 0;
+	for (i = 0; i < memDbc->numShards; i++) {
+		if (keyCursorSeek(&km->cur[i], memDbc->shards[i].index, bound, dir, incl))
+			km->heap[km->num++] = i;
+	}
+	for (i = km->num / 2 - 1; i >= 0; i--)
+		keyMergeDown(km, i);
+
+	while (n < MEMDBC_CURSOR_BATCH && (key = keyMergeNext(km, &ref)) != NULL) {
+		// As in saveRecords(), NULL is only ever a delete, updates swap
+		// the value in whole on every engine.
+		data = AtomicGet(ref);
+		if (data == NULL)
+			continue;
+		// Same as memDbcFind(), records past their time are not seen.
+		if (ttl != NULL && ttlDue(memDbc, ttl, key))
+			continue;
+
+		len = strlen(key) + 1;
+		if (buildGrow((void **)&cur->buf, &cur->bufSize, used + len, 1) != 0) {
+			n = -1;
+			break;
+		}
+		memcpy(cur->buf + used, key, len);
+		off[n] = used;
+		cur->data[n++] = data;
+		used += len;
+	}
+	cur->atEnd = (km->num == 0);
+
+	unlockIndexes(memDbc);
+	epExit();
+
+	// The buffer may have moved as it grew.
+	for (i = 0; i < n; i++)
+		cur->keys[i] = cur->buf + off[i];
+
+	cur->dir = dir;
+	cur->num = (n > 0) ? n : 0;
+	cur->pos = (n > 0) ? 0 : -1;
+
+	return n;
+}
+
+/* cursorStep() - Moves a cursor to the next record in direction dir.
+ * Returns 0 or -1 if there is none.
+ */
+static int cursorStep(MemDbcCursor_t *cur, int dir) {
+	size_t len;
+
+	if (cur->pos < 0)
+		return -1;
+
+	if (dir == cur->dir) {
+		if (cur->pos + 1 < cur->num) {
+			cur->pos++;
+			return 0;
+		}
+		if (cur->atEnd) {
+			cur->pos = -1;
+			return -1;
+		}
+	} else if (cur->pos > 0) {
+		// Back over the window already read.
+		cur->pos--;
+		return 0;
+	}
+
+	// Read on from the current key, the window is overwritten.
+	len = strlen(cur->keys[cur->pos]) + 1;
+	if (buildGrow((void **)&cur->last, &cur->lastSize, len, 1) != 0) {
+		cur->pos = -1;
+		return -1;
+	}
+	memcpy(cur->last, cur->keys[cur->pos], len);
+
+	return (cursorFill(cur, cur->last, cur->mapPos[cur->pos], dir, 0) > 0) ? 0 : -1;
+}
+
+/* memDbcCursorOpen() - Opens a cursor that walks the records in key order.
+ * It is not on a record until one of the seeks is called.  Nothing is
+ * allocated per record and no locks are held between calls, so a walk
+ * can stop at any time.  Returns NULL if out of memory.
+ * memDbc - returned by memDbcInit()
+ */
+MemDbcCursor_t *memDbcCursorOpen(MemDbc_t *memDbc) {
+	MemDbcCursor_t *cur = (MemDbcCursor_t *)calloc(1, sizeof(MemDbcCursor_t));
+
+	if (cur == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+
+	cur->memDbc = memDbc;
+	cur->dir = 1;
+	cur->pos = -1;
+	cur->km.map = (MapFile_t *)memDbc->map;
+
+	if (memDbc->map == NULL) {
+		cur->km.heap = (int *)malloc(memDbc->numShards * sizeof(int));
+		cur->km.cur = (KeyCursor_t *)malloc(memDbc->numShards * sizeof(KeyCursor_t));
+		if (cur->km.heap == NULL || cur->km.cur == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			memDbcCursorClose(cur);
+			return NULL;
+		}
+	}
+
+	return cur;
+}
+
+/* memDbcCursorSeek() - Moves to the first record whose key is key or after
+ * it.  Returns 0 or -1 if there is none.
+ * cur - returned by memDbcCursorOpen()
+ */
+int memDbcCursorSeek(MemDbcCursor_t *cur, char *key) {
+	char buf[MEMDBC_KEY_FOLD];
+	char *k = keyFold(cur->memDbc, key, buf);
+	int r;
+
+	if (k == NULL)
+		return -1;
+
+	r = (cursorFill(cur, k, 0, 1, 1) > 0) ? 0 : -1;
+	keyFoldEnd(k, key, buf);
+
+	return r;
+}
+
+/* memDbcCursorSeekFirst() - Moves to the first record.
+ * Returns 0 or -1 if there are none.
+ * cur - returned by memDbcCursorOpen()
+ */
+int memDbcCursorSeekFirst(MemDbcCursor_t *cur) {
+
+	return (cursorFill(cur, NULL, 0, 1, 1) > 0) ? 0 : -1;
+}
+
+/* memDbcCursorSeekLast() - Moves to the last record.
+ * Returns 0 or -1 if there are none.
+ * cur - returned by memDbcCursorOpen()
+ */
+int memDbcCursorSeekLast(MemDbcCursor_t *cur) {
+
+	return (cursorFill(cur, NULL, 0, -1, 1) > 0) ? 0 : -1;
+}
+
+/* memDbcCursorNext() - Moves to the next record.  Returns 0 or -1 past
+ * the last one, the cursor is then on no record until a seek.
+ * cur - returned by memDbcCursorOpen()
+ */
+int memDbcCursorNext(MemDbcCursor_t *cur) {
+
+	return cursorStep(cur, 1);
+}
+
+/* memDbcCursorPrev() - Moves to the record before.  Returns 0 or -1 past
+ * the first one, the cursor is then on no record until a seek.
+ * cur - returned by memDbcCursorOpen()
+ */
+int memDbcCursorPrev(MemDbcCursor_t *cur) {
+
+	return cursorStep(cur, -1);
+}
+
+/* memDbcCursorKey() - Returns the key of the current record or NULL.
+ * It is good until the cursor is moved.
+ * cur - returned by memDbcCursorOpen()
+ */
+char *memDbcCursorKey(MemDbcCursor_t *cur) {
+
+	return (cur->pos >= 0) ? cur->keys[cur->pos] : NULL;
+}
+
+/* memDbcCursorValue() - Returns the data of the current record or NULL.
+ * Same as memDbcFind(), it is only kept from being freed inside
+ * memDbcReadBegin() and memDbcReadEnd().
+ * cur - returned by memDbcCursorOpen()
+ */
+void *memDbcCursorValue(MemDbcCursor_t *cur) {
+
+	return (cur->pos >= 0) ? cur->data[cur->pos] : NULL;
+}
+
+/* memDbcCursorClose() - Frees a cursor.
+ * cur - returned by memDbcCursorOpen()
+ */
+void memDbcCursorClose(MemDbcCursor_t *cur) {
+
+	if (cur == NULL)
+		return;
 
-	keyListSave(memDbc, fileName, callback);
+	free(cur->km.heap);
+	free(cur->km.cur);
+	free(cur->buf);
+	free(cur->last);
+	free(cur);
 }
 
 /* memDbcErro() - returns the MemDbCErrorNum value.
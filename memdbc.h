@@ -27,15 +27,19 @@
 #define _MEMDBC_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdatomic.h>
+#include <pthread.h>
 
 /* AtomicExchange is used to compare and set p and return 1 on success else 0
  * p pointer to location to test.
- * e pointer to expected value at p.
+ * e pointer to expected value at p, on failure it is set to the value found.
  * if p equal e then set p to n and return 1 else 0
- * All three arguments are pointers. */
+ * All three arguments are pointers.  It is a strong compare so a 0 return
+ * always means another thread changed p, and a successful store releases
+ * everything written before it, so it can publish a new node. */
 #define AtomicExchange(p, e, n) \
-    __atomic_compare_exchange(p, e, n, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)
+    __atomic_compare_exchange(p, e, n, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
 
 // These defines return the new value after operation.
 #define AtomicAdd(p, n)         __atomic_add_fetch(p, n, __ATOMIC_SEQ_CST)
@@ -92,9 +96,48 @@ typedef enum _memDbcErrors {
 	MALLOC_ERR,
 	CALLBACK_NULL,
 	REGEX_ERR,
-	UNKNOWN_TYPE
+	UNKNOWN_TYPE,
+	OPTION_ERR,
+	FILE_ERR,
+	FORMAT_ERR,
+	READONLY_ERR,
+	BUSY_ERR,
+	KEY_ERR,
+	MEMORY_ERR
 } MemDbcError_t;
 
+// The kind of tree used to store the records.
+typedef enum _memDbcEngine {
+	TRIE_ENGINE = 0,		// fixed fan out trie per key character, the default.
+	RADIX_ENGINE,			// path compressed trie, ASCII_DB only.
+	ART_ENGINE,				// adaptive radix tree, all DbTypes.
+	INT_ENGINE				// uint64_t keys in an adaptive radix tree, DIGITAL_DB only.
+} MemDbcEngine_t;
+
+// What is removed when a database with a maxMemory is over it.
+typedef enum _memDbcEvict {
+	EVICT_NONE = 0,			// nothing, adds fail with MEMORY_ERR.
+	EVICT_LRU,				// the record used least recently of a sample.
+	EVICT_LFU				// the record used least often of a sample.
+} MemDbcEvict_t;
+
+// How long memDbcAdd() and memDbcDelete() wait on the write ahead log.
+typedef enum _memDbcDurability {
+	WAL_NO_SYNC = 0,		// written by the log thread, left to the OS to sync.
+	WAL_ASYNC,				// synced by the log thread every WAL_SYNC_MS.
+	WAL_SYNC				// return once the record is synced, writers share syncs.
+} MemDbcDurability_t;
+
+// State passed to the memDbcSaveBackground() callback.
+typedef enum _memDbcSaveState {
+	SAVE_RUNNING,			// done records of about total have been written.
+	SAVE_DONE,				// the file is complete.
+	SAVE_FAILED
+} MemDbcSaveState_t;
+
+typedef void (*MemDbcSaveFn_t)(void *arg, MemDbcSaveState_t state, unsigned long done, unsigned long total);
+
+// What happened to a record, memDbcAddBatch() sets one per record.
 typedef enum _memDbcAction {
 	ACTION_ERR,
 	ACTION_INSERT,
@@ -102,28 +145,152 @@ typedef enum _memDbcAction {
 	ACTION_DELETED
 } MemDbcAction_t;
 
-typedef struct _ttkey_ {
-    char *key;
-    struct _ttkey_ *ptr;
-} Key_t;
+// A record and its length, returned by memDbcFindView().
+typedef struct _memDbcView {
+	void *data;			// NULL if the key was not found.
+	size_t len;
+} MemDbcView_t;
 
-typedef struct _memdbc_ {
-	DbTypes_t dbType;
-	Key_t *head;
+// Guess of the average value size used to size the pool from reserveKeys.
+#define MEMDBC_AVG_VALUE	64
+
+// Digits in the longest uint64_t, the width of INT_ENGINE keys by default.
+#define MEMDBC_INT_WIDTH	20
+
+// Most shards a database can be split into.
+#define MEMDBC_MAX_SHARDS	256
+
+// Trie nodes memDbcCompact() moves each time it holds a shard's locks,
+// writers to the shard wait for at most this many.
+#define MEMDBC_COMPACT_SLICE	256
+
+// Records an eviction looks at to pick the one to remove.
+#define MEMDBC_EVICT_SAMPLES	5
+// Most records an add evicts, a batch as many for each of its records.
+// The next adds go on if it is still over.
+#define MEMDBC_EVICT_MAX		16
+// EVICT_LFU counts are logarithmic, a new record starts at MEMDBC_LFU_INIT
+// and a count of n goes up about once every (n - MEMDBC_LFU_INIT) *
+// MEMDBC_LFU_FACTOR uses.  Counts go down by one each minute unused.
+#define MEMDBC_LFU_INIT			5
+#define MEMDBC_LFU_FACTOR		10
+// EVICT_LRU stamps are in ticks of this many milliseconds.  The 30 bit
+// stamp wraps after 2^30 ticks, about 12 days at 1, so a record unused
+// for longer than that may be taken for one used recently.
+#define MEMDBC_LRU_MS			1
+
+// Records a cursor reads each time it takes the index locks.
+#define MEMDBC_CURSOR_BATCH		64
+
+// HEX_DB keys up to this long are folded to lower case on the stack,
+// longer ones in a malloc()ed copy.
+#define MEMDBC_KEY_FOLD			128
+
+typedef struct _memDbcOpts {
+	unsigned long reserveKeys;	// Expected number of keys or 0, used to size the pool.
+	int hugePages;				// Back the pool with huge pages if set.
+	MemDbcEngine_t engine;		// Tree used to store the records.
+	int shards;					// Number of shards, 0 or 1 for a single tree.
+	int keyWidth;				// INT_ENGINE digits in a key, 0 for MEMDBC_INT_WIDTH.
+	int stride;					// HEX_DB and OCTAL_DB TRIE_ENGINE key digits per level, 0 or 1 for one.
+	// The key index and expiry times are malloc()ed outside the pool and
+	// are counted with it.
+	size_t maxMemory;			// Bytes of nodes, values and keys to keep to, 0 for no limit.
+	MemDbcEvict_t evict;		// What to do when an add goes over maxMemory.
+} MemDbcOpts_t;
+
+// One slice of the database.  Keys are spread over the shards by a hash
+// of the key, each shard has its own tree, key index, pool and locks so
+// writers to different shards never touch the same memory.
+typedef struct _memDbcShard {
+	void *index;		// B+ tree of the keys in sorted order.
 	unsigned long recCount;
 	void *tree;
+	void *pool;			// Trie nodes and values are allocated from here.
+	pthread_mutex_t indexLock;		// serializes changes to and walks of the key index.
+	pthread_rwlock_t treeLock;		// RADIX_ENGINE and ART_ENGINE trees, trie writers during memDbcCompact().
+	int compacting;		// memDbcCompact() is moving the shard's trie.
+	unsigned long owned;	// memDbcValueAlloc() records not yet added or freed.
+} __attribute__((aligned(64))) MemDbcShard_t;
+
+typedef struct _memdbc_ {
+	DbTypes_t dbType;
+	MemDbcEngine_t engine;
+	int numShards;
+	int keyWidth;		// INT_ENGINE keys are this many digits.
+	int stride;			// key digits per trie level, more than 1 is a WideTrieTree.
+	MemDbcShard_t *shards;
+	void *map;			// Read only mapped snapshot, no shards when set.
+	void *wal;			// Write ahead log or NULL.
+	void *bgSave;		// Running memDbcSaveBackground() or NULL.
+	void *compact;		// memDbcCompact() in progress or NULL.
+	void *ttl;			// Expiry times, made by the first memDbcAddTTL().
+	size_t shardMemory;	// maxMemory split over the shards, 0 for no limit.
+	MemDbcEvict_t evict;
+	uint64_t evictStart;	// CLOCK_MONOTONIC ms the access stamps count from.
 } MemDbc_t;
 
-extern MemDbcError_t memDbcErrorNum;
+// Bulk load in progress, see memDbcBuildOpen().
+typedef struct _memDbcBuild MemDbcBuild_t;
+
+// Walk of the records in key order, see memDbcCursorOpen().
+typedef struct _memDbcCursor MemDbcCursor_t;
+
+// Set per thread so concurrent callers do not see each other's errors.
+extern __thread MemDbcError_t memDbcErrorNum;
 
 MemDbc_t *memDbcInit(DbTypes_t dbType);
+MemDbc_t *memDbcInitOpts(DbTypes_t dbType, MemDbcOpts_t *opts);
+void memDbcFree(MemDbc_t *memDbc);
 int memDbcAdd(MemDbc_t *memDbc, char *key, void *data, int len);
+void *memDbcValueAlloc(MemDbc_t *memDbc, char *key, int len);
+void memDbcValueFree(MemDbc_t *memDbc, char *key, void *data);
+int memDbcAddOwned(MemDbc_t *memDbc, char *key, void *data);
+int memDbcAddBatch(MemDbc_t *memDbc, char **keys, void **values, int *lens, int n, MemDbcAction_t *status);
 unsigned long memDbcNumEntries(MemDbc_t *memDbc);
 void memDbcWalk(MemDbc_t *memDbc, char *(callback)(char *key, void *data));
 void *memDbcFind(MemDbc_t *memDbc, char *key);
+MemDbcView_t memDbcFindView(MemDbc_t *memDbc, char *key);
+int memDbcValueLen(void *data);
+int memDbcFindMany(MemDbc_t *memDbc, char **keys, int n, void **out);
+void memDbcReadBegin(MemDbc_t *memDbc);
+void memDbcReadEnd(MemDbc_t *memDbc);
 void memDbcFindAll(MemDbc_t *memDbc, char *regexStr, void (callback)(char *key, void *data));
 void memDbcSave(MemDbc_t *memDbc, char *fileName, char *(callback)(char *key, void *data));
+int memDbcSaveBinary(MemDbc_t *memDbc, char *fileName);
+MemDbc_t *memDbcLoad(char *fileName, MemDbcOpts_t *opts);
+MemDbcBuild_t *memDbcBuildOpen(DbTypes_t dbType, MemDbcOpts_t *opts);
+int memDbcBuildAdd(MemDbcBuild_t *build, char *key, void *data, int len);
+MemDbc_t *memDbcBuildClose(MemDbcBuild_t *build);
+MemDbc_t *memDbcLoadText(char *fileName, DbTypes_t dbType, MemDbcOpts_t *opts);
+int memDbcSaveMapped(MemDbc_t *memDbc, char *fileName);
+MemDbc_t *memDbcOpenMapped(char *fileName);
+int memDbcSaveBackground(MemDbc_t *memDbc, char *fileName, MemDbcSaveFn_t callback, void *arg);
+int memDbcSaveWait(MemDbc_t *memDbc);
+int memDbcWalOpen(MemDbc_t *memDbc, char *fileName, MemDbcDurability_t durability);
+int memDbcWalSync(MemDbc_t *memDbc);
+int memDbcCheckpoint(MemDbc_t *memDbc, char *fileName);
+int memDbcWalClose(MemDbc_t *memDbc);
 int memDbcDelete(MemDbc_t *memDbc, char *key);
+int memDbcCompact(MemDbc_t *memDbc, int maxNodes, int maxMicros, size_t *reclaimed);
+size_t memDbcMemoryUsed(MemDbc_t *memDbc);
+MemDbcCursor_t *memDbcCursorOpen(MemDbc_t *memDbc);
+int memDbcCursorSeek(MemDbcCursor_t *cur, char *key);
+int memDbcCursorSeekFirst(MemDbcCursor_t *cur);
+int memDbcCursorSeekLast(MemDbcCursor_t *cur);
+int memDbcCursorNext(MemDbcCursor_t *cur);
+int memDbcCursorPrev(MemDbcCursor_t *cur);
+char *memDbcCursorKey(MemDbcCursor_t *cur);
+void *memDbcCursorValue(MemDbcCursor_t *cur);
+void memDbcCursorClose(MemDbcCursor_t *cur);
+int memDbcAddInt(MemDbc_t *memDbc, uint64_t key, void *data, int len);
+void *memDbcFindInt(MemDbc_t *memDbc, uint64_t key);
+int memDbcDeleteInt(MemDbc_t *memDbc, uint64_t key);
+int memDbcAddTTL(MemDbc_t *memDbc, char *key, void *data, int len, unsigned long ttlMs);
+int memDbcExpire(MemDbc_t *memDbc, char *key, unsigned long ttlMs);
+int memDbcExpireTick(MemDbc_t *memDbc, int maxKeys);
+int memDbcExpireStart(MemDbc_t *memDbc);
+void memDbcExpireStop(MemDbc_t *memDbc);
 MemDbcError_t memDbcError();
 
 #endif
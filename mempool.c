@@ -0,0 +1,635 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include "memdbc.h"
+#include "mempool.h"
+#include "epoch.h"
+
+// Size classes used for values and anything not registered with mpAddClass().
+static size_t _mpDefaultClasses[] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096
+};
+
+// Objects larger than MP_MAX_SIZE are malloc'ed with this header in
+// front, so mpDestroy() can release the ones still in use.
+typedef struct _mpLarge {
+	struct _mpLarge *next;
+	struct _mpLarge *prev;
+} MpLarge_t;
+
+#define MP_ROUND(n, a)	(((n) + (a) - 1) & ~((size_t)(a) - 1))
+
+/*
+ * Function _mpBuildLookup is private to this file.
+ * Rebuilds the table that maps a size to the smallest class it fits in.
+ */
+static void _mpBuildLookup(MemPool_t *pool) {
+	int c = 0;
+	int i;
+
+	for (i = 0; i <= MP_MAX_SIZE / MP_ALIGN; i++) {
+		while (pool->classes[c].size < (size_t)i * MP_ALIGN)
+			c++;
+		pool->lookup[i] = c;
+	}
+}
+
+/*
+ * Function _mpMap is private to this file.
+ * Gets memory from the system, huge pages are tried first if asked for.
+ */
+static void *_mpMap(MemPool_t *pool, size_t size) {
+	void *p = MAP_FAILED;
+
+	if (pool->flags & MP_HUGE_PAGES) {
+#ifdef MAP_HUGETLB
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+		if (p == MAP_FAILED) {
+			// No huge pages reserved, ask for transparent huge pages.
+			p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+			if (p != MAP_FAILED)
+				madvise(p, size, MADV_HUGEPAGE);
+#endif
+		}
+	} else {
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+
+	return (p == MAP_FAILED) ? NULL : p;
+}
+
+/*
+ * Function _mpNewChunk is private to this file.
+ * Adds a chunk of at least size bytes and makes it the current chunk.
+ */
+static int _mpNewChunk(MemPool_t *pool, size_t size) {
+	MpChunk_t *chunk;
+
+	size = MP_ROUND(size, MP_CHUNK_SIZE);
+
+	chunk = (MpChunk_t *)_mpMap(pool, size);
+	if (chunk == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+
+	chunk->size = size;
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+	pool->bytesMapped += size;
+
+	pool->bump = (char *)chunk + MP_ROUND(sizeof(MpChunk_t), MP_ALIGN);
+	pool->end = (char *)chunk + size;
+
+	return 0;
+}
+
+/*
+ * Function _mpInFrom is private to this file.
+ * Returns 1 if p is in a chunk being evacuated, the pool lock is held.
+ */
+static int _mpInFrom(MemPool_t *pool, void *p) {
+	int lo = 0, hi = pool->numFrom - 1, mid;
+	char *c;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		c = (char *)pool->from[mid];
+		if ((char *)p < c)
+			hi = mid - 1;
+		else if ((char *)p >= c + pool->from[mid]->size)
+			lo = mid + 1;
+		else
+			return 1;
+	}
+
+	return 0;
+}
+
+static int _mpChunkCmp(const void *a, const void *b) {
+	char *x = *(char **)a;
+	char *y = *(char **)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Function mpInit creates a pool.
+ * reserve - bytes to map up front, 0 to grow a chunk at a time.
+ * flags - MP_HUGE_PAGES to back the pool with huge pages.
+ */
+MemPool_t *mpInit(size_t reserve, int flags) {
+	int i;
+
+	MemPool_t *pool = (MemPool_t *)calloc(1, sizeof(MemPool_t));
+	if (pool == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+
+	pool->flags = flags;
+	pool->numClasses = sizeof(_mpDefaultClasses) / sizeof(_mpDefaultClasses[0]);
+	for (i = 0; i < pool->numClasses; i++)
+		pool->classes[i].size = _mpDefaultClasses[i];
+
+	_mpBuildLookup(pool);
+	pthread_spin_init(&pool->lock, PTHREAD_PROCESS_PRIVATE);
+
+	if (reserve > 0 && _mpNewChunk(pool, reserve) != 0) {
+		pthread_spin_destroy(&pool->lock);
+		free(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/*
+ * Function mpAddClass adds a size class that fits size exactly.
+ * Used for the trie nodes so they do not round up to the next
+ * default class.  Returns the class index or -1.
+ */
+int mpAddClass(MemPool_t *pool, size_t size) {
+	int i;
+
+	size = MP_ROUND(size, MP_ALIGN);
+
+	if (size > MP_MAX_SIZE)
+		return -1;
+
+	pthread_spin_lock(&pool->lock);
+
+	for (i = 0; i < pool->numClasses; i++) {
+		if (pool->classes[i].size == size) {
+			pthread_spin_unlock(&pool->lock);
+			return i;
+		}
+		if (pool->classes[i].size > size)
+			break;
+	}
+
+	if (pool->numClasses == MP_MAX_CLASSES) {
+		pthread_spin_unlock(&pool->lock);
+		return -1;
+	}
+
+	memmove(&pool->classes[i + 1], &pool->classes[i], (pool->numClasses - i) * sizeof(MpClass_t));
+	pool->classes[i].size = size;
+	pool->classes[i].freeList = NULL;
+	pool->numClasses++;
+
+	_mpBuildLookup(pool);
+
+	pthread_spin_unlock(&pool->lock);
+
+	return i;
+}
+
+/*
+ * Function mpAlloc returns size bytes of zeroed memory.
+ * The pool lock is only held to pop the free list or bump the chunk,
+ * the memory is cleared after it is dropped.
+ */
+void *mpAlloc(MemPool_t *pool, size_t size) {
+	MpClass_t *cls;
+	void *p;
+
+	if (size > MP_MAX_SIZE) {
+		MpLarge_t *large = (MpLarge_t *)calloc(1, sizeof(MpLarge_t) + size);
+		if (large == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			return NULL;
+		}
+		pthread_spin_lock(&pool->lock);
+		large->next = (MpLarge_t *)pool->large;
+		large->prev = NULL;
+		if (large->next != NULL)
+			large->next->prev = large;
+		pool->large = large;
+		AtomicAdd(&pool->bytesUsed, size);
+		AtomicAdd(&pool->bytesLarge, size);
+		pthread_spin_unlock(&pool->lock);
+		return large + 1;
+	}
+
+	cls = &pool->classes[pool->lookup[(size + MP_ALIGN - 1) / MP_ALIGN]];
+
+	pthread_spin_lock(&pool->lock);
+
+	p = cls->freeList;
+	if (p != NULL) {
+		cls->freeList = *(void **)p;
+		AtomicAdd(&pool->bytesUsed, cls->size);
+		pthread_spin_unlock(&pool->lock);
+		memset(p, 0, cls->size);
+		return p;
+	}
+
+	// Fresh chunk memory from mmap() is already zero.
+	if (pool->bump == NULL || pool->bump + cls->size > pool->end) {
+		if (_mpNewChunk(pool, MP_CHUNK_SIZE) != 0) {
+			pthread_spin_unlock(&pool->lock);
+			return NULL;
+		}
+	}
+
+	p = pool->bump;
+	pool->bump += cls->size;
+	AtomicAdd(&pool->bytesUsed, cls->size);
+
+	pthread_spin_unlock(&pool->lock);
+
+	return p;
+}
+
+/*
+ * Function _mpRelease is private to this file.
+ * mpFree() of memory that is still counted in bytesUsed if counted is
+ * set, memory mpRetire() took off it is not.
+ */
+static void _mpRelease(MemPool_t *pool, void *p, size_t size, int counted) {
+	MpClass_t *cls;
+	int from;
+
+	if (p == NULL)
+		return;
+
+	if (size > MP_MAX_SIZE) {
+		MpLarge_t *large = (MpLarge_t *)p - 1;
+
+		pthread_spin_lock(&pool->lock);
+		if (large->prev != NULL)
+			large->prev->next = large->next;
+		else
+			pool->large = large->next;
+		if (large->next != NULL)
+			large->next->prev = large->prev;
+		if (counted)
+			AtomicSub(&pool->bytesUsed, size);
+		AtomicSub(&pool->bytesLarge, size);
+		pthread_spin_unlock(&pool->lock);
+		free(large);
+		return;
+	}
+
+	cls = &pool->classes[pool->lookup[(size + MP_ALIGN - 1) / MP_ALIGN]];
+
+	pthread_spin_lock(&pool->lock);
+	from = (pool->numFrom != 0 && _mpInFrom(pool, p));
+	if (counted) {
+		AtomicSub(&pool->bytesUsed, cls->size);
+		if (from)
+			pool->fromUsed -= cls->size;
+	}
+	// Memory being evacuated is not used again, it goes with its chunk.
+	if (from == 0) {
+		*(void **)p = cls->freeList;
+		cls->freeList = p;
+	}
+	pthread_spin_unlock(&pool->lock);
+}
+
+/*
+ * Function mpFree gives memory back to the pool, size must be the
+ * size given to mpAlloc().
+ */
+void mpFree(MemPool_t *pool, void *p, size_t size) {
+
+	_mpRelease(pool, p, size, 1);
+}
+
+/*
+ * Function mpDestroy releases the pool and everything allocated from it.
+ */
+void mpDestroy(MemPool_t *pool) {
+	MpChunk_t *chunk, *next;
+	MpLarge_t *large, *lnext;
+	int i, n;
+
+	if (pool == NULL)
+		return;
+
+	// Nothing retired from this pool may be freed after it is gone.
+	epForget(pool);
+
+	for (large = (MpLarge_t *)pool->large; large != NULL; large = lnext) {
+		lnext = large->next;
+		free(large);
+	}
+
+	for (chunk = pool->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		munmap(chunk, chunk->size);
+	}
+
+	// Chunks of an evacuation not yet given back.
+	n = (pool->numFrom != 0) ? pool->numFrom : pool->numRelease;
+	for (i = 0; i < n; i++)
+		munmap(pool->from[i], pool->from[i]->size);
+	free(pool->from);
+
+	pthread_spin_destroy(&pool->lock);
+	free(pool);
+}
+
+/*
+ * Function mpEvacuate starts emptying the pool.  Every chunk it has now
+ * is set aside and nothing more is allocated from them, new memory comes
+ * from new chunks.  The caller copies what is still in use out of them,
+ * see mpEvacuating(), then gives them back with mpEvacuateEnd().
+ * Returns 0 or -1 if out of memory.
+ */
+int mpEvacuate(MemPool_t *pool) {
+	MpChunk_t **from, *chunk;
+	int i, n, count;
+
+	if (pool->from != NULL)
+		return 0;		// already started.
+
+	// The list only grows, size the array and check it still fits.
+	for (;;) {
+		pthread_spin_lock(&pool->lock);
+		for (n = 0, chunk = pool->chunks; chunk != NULL; chunk = chunk->next)
+			n++;
+		pthread_spin_unlock(&pool->lock);
+
+		if (n == 0)
+			return 0;
+
+		from = (MpChunk_t **)malloc(n * sizeof(MpChunk_t *));
+		if (from == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			return -1;
+		}
+
+		pthread_spin_lock(&pool->lock);
+		for (count = 0, chunk = pool->chunks; chunk != NULL; chunk = chunk->next)
+			count++;
+		if (count == n)
+			break;
+		pthread_spin_unlock(&pool->lock);
+		free(from);
+	}
+
+	for (i = 0, chunk = pool->chunks; chunk != NULL; chunk = chunk->next)
+		from[i++] = chunk;
+	qsort(from, n, sizeof(MpChunk_t *), _mpChunkCmp);
+
+	pool->from = from;
+	pool->numFrom = n;
+	pool->fromMapped = pool->bytesMapped;
+	pool->fromUsed = pool->bytesUsed - pool->bytesLarge;
+	pool->chunks = NULL;
+	pool->bump = NULL;
+	pool->end = NULL;
+	for (i = 0; i < pool->numClasses; i++)
+		pool->classes[i].freeList = NULL;
+
+	pthread_spin_unlock(&pool->lock);
+
+	return 0;
+}
+
+/*
+ * Function mpEvacuating returns 1 if p is in a chunk set aside by
+ * mpEvacuate(), so it has to be copied before mpEvacuateEnd().
+ */
+int mpEvacuating(MemPool_t *pool, void *p) {
+	int r;
+
+	pthread_spin_lock(&pool->lock);
+	r = (pool->numFrom != 0 && _mpInFrom(pool, p));
+	pthread_spin_unlock(&pool->lock);
+
+	return r;
+}
+
+static int _mpFromMatch(void *ctx, void *p) {
+
+	return _mpInFrom((MemPool_t *)ctx, p);
+}
+
+/*
+ * Function mpEvacuateEnd gives the chunks set aside by mpEvacuate() back
+ * to the system, up to maxChunks of them a call or all of them if 0.
+ * Nothing in them may still be reachable, by a reader either.
+ * released - set to the bytes given back less what was mapped since
+ *            mpEvacuate(), nothing until that is made up.
+ * Returns 1 while there are chunks left, else 0.
+ */
+int mpEvacuateEnd(MemPool_t *pool, int maxChunks, size_t *released) {
+	MpChunk_t *chunk;
+	size_t bytes = 0, d;
+	int n = 0;
+
+	// Only this thread changes the from array, it is read without the lock.
+	if (pool->numFrom != 0) {
+		// Memory from the old chunks still waiting on readers must not
+		// be put on a free list once they are gone.
+		epForgetIf(pool, _mpFromMatch);
+
+		// What is still counted there was copied or is forgotten.
+		pthread_spin_lock(&pool->lock);
+		pool->fromDebt = pool->bytesMapped - pool->fromMapped;
+		AtomicSub(&pool->bytesUsed, pool->fromUsed);
+		pool->fromUsed = 0;
+		pool->numRelease = pool->numFrom;
+		pool->numFrom = 0;
+		pthread_spin_unlock(&pool->lock);
+	}
+
+	while (pool->numRelease > 0 && (maxChunks <= 0 || n < maxChunks)) {
+		chunk = pool->from[--pool->numRelease];
+		bytes += chunk->size;
+
+		pthread_spin_lock(&pool->lock);
+		pool->bytesMapped -= chunk->size;
+		pthread_spin_unlock(&pool->lock);
+
+		munmap(chunk, chunk->size);
+		n++;
+	}
+
+	if (pool->numRelease == 0) {
+		free(pool->from);
+		pool->from = NULL;
+	}
+
+	d = (bytes < pool->fromDebt) ? bytes : pool->fromDebt;
+	pool->fromDebt -= d;
+	if (released != NULL)
+		*released = bytes - d;
+
+	return pool->from != NULL;
+}
+
+/*
+ * Function mpValAlloc returns a zeroed buffer for a value of len bytes.
+ * One extra byte is left so string values are always NUL terminated.
+ */
+void *mpValAlloc(MemPool_t *pool, int len) {
+	MpValHdr_t *hdr = (MpValHdr_t *)mpAlloc(pool, sizeof(MpValHdr_t) + len + 1);
+
+	if (hdr == NULL)
+		return NULL;
+
+	hdr->len = len;
+
+	return hdr + 1;
+}
+
+/*
+ * Function mpValFree gives a value buffer back to the pool.
+ */
+void mpValFree(MemPool_t *pool, void *data) {
+	MpValHdr_t *hdr;
+
+	if (data == NULL)
+		return;
+
+	hdr = (MpValHdr_t *)data - 1;
+
+	if (AtomicGet(&hdr->state) & MP_VAL_INLINE) {
+		AtomicSet(&hdr->state, 0);
+		return;
+	}
+
+	mpFree(pool, hdr, sizeof(MpValHdr_t) + hdr->len + 1);
+}
+
+/*
+ * Function _mpRetireFree is private to this file.
+ * Called by the epoch reclaimer once retired memory is unreachable.
+ */
+static void _mpRetireFree(void *ctx, void *p, size_t size) {
+
+	_mpRelease((MemPool_t *)ctx, p, size, 0);
+}
+
+/*
+ * Function mpRetire frees p once no reader can still be using it.
+ * Used for memory a concurrent reader may have reached before it was
+ * unlinked.
+ */
+void mpRetire(MemPool_t *pool, void *p, size_t size) {
+	size_t n = size;
+
+	if (p == NULL)
+		return;
+
+	// No longer in use, whatever readers still hold.
+	pthread_spin_lock(&pool->lock);
+	if (size <= MP_MAX_SIZE)
+		n = pool->classes[pool->lookup[(size + MP_ALIGN - 1) / MP_ALIGN]].size;
+	AtomicSub(&pool->bytesUsed, n);
+	if (size <= MP_MAX_SIZE && pool->numFrom != 0 && _mpInFrom(pool, p))
+		pool->fromUsed -= n;
+	pthread_spin_unlock(&pool->lock);
+
+	epRetire(_mpRetireFree, pool, p, size);
+}
+
+/*
+ * Function mpValRetire is mpValFree() for a value that readers may still hold.
+ */
+void mpValRetire(MemPool_t *pool, void *data) {
+	MpValHdr_t *hdr;
+
+	if (data == NULL)
+		return;
+
+	hdr = (MpValHdr_t *)data - 1;
+
+	if (AtomicGet(&hdr->state) & MP_VAL_INLINE) {
+		MpValSlot_t *slot = (MpValSlot_t *)((char *)hdr - offsetof(MpValSlot_t, hdr));
+
+		AtomicSet(&slot->freedAt, epNow());
+		AtomicSet(&hdr->state, MP_VAL_VACATED);
+		return;
+	}
+
+	mpRetire(pool, hdr, sizeof(MpValHdr_t) + hdr->len + 1);
+}
+
+/*
+ * Function mpValInline copies a value of len bytes into slot if it is
+ * short enough and the slot is free.  Returns the value or NULL if it
+ * has to go in the pool.
+ */
+void *mpValInline(MpValSlot_t *slot, void *value, int len) {
+	unsigned int expect;
+	unsigned int state = MP_VAL_INLINE;
+
+	if (len >= MP_INLINE_SIZE)
+		return NULL;
+
+	// A fresh slot starts with stamp 0.
+	expect = AtomicGet(&slot->hdr.state);
+	if (expect & MP_VAL_INLINE)
+		return NULL;
+	if ((expect & MP_VAL_VACATED) && epPassed(AtomicGet(&slot->freedAt)) == 0)
+		return NULL;		// the old value may still be being read.
+
+	// Concurrent writers of a key race for the slot, the loser uses the pool.
+	if (AtomicExchange(&slot->hdr.state, &expect, &state) == 0)
+		return NULL;
+
+	slot->hdr.len = len;
+	memcpy(slot->bytes, value, len);
+	slot->bytes[len] = '\0';
+
+	return slot->bytes;
+}
+
+/*
+ * Function mpValMove returns a copy of a pool value that is in memory
+ * being evacuated, or data itself if it is not.  The old copy goes with
+ * its chunk.  Returns NULL if out of memory.
+ */
+void *mpValMove(MemPool_t *pool, void *data) {
+	void *copy;
+	int len;
+
+	if (data == NULL || mpValIsInline(data) || mpEvacuating(pool, (MpValHdr_t *)data - 1) == 0)
+		return data;
+
+	len = mpValLen(data);
+	copy = mpValAlloc(pool, len);
+	if (copy == NULL)
+		return NULL;
+
+	memcpy(copy, data, len + 1);
+
+	return copy;
+}
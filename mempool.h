@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#ifndef _MEMPOOL_H_
+#define _MEMPOOL_H_
+
+#include <sys/types.h>
+#include <pthread.h>
+#include "memdbc.h"
+
+// Flags for mpInit()
+#define MP_HUGE_PAGES	0x01
+
+// Memory is taken from the system in chunks of this size, 2MB is
+// also the size of a huge page on x86_64.
+#define MP_CHUNK_SIZE	(2 * 1024 * 1024)
+
+// Objects larger than this go straight to malloc().
+#define MP_MAX_SIZE		4096
+
+#define MP_ALIGN		16
+#define MP_MAX_CLASSES	32
+
+typedef struct _mpChunk {
+	struct _mpChunk *next;
+	size_t size;
+} MpChunk_t;
+
+typedef struct _mpClass {
+	size_t size;					// object size of this class.
+	void *freeList;					// objects given back by mpFree().
+} MpClass_t;
+
+typedef struct _memPool {
+	int flags;
+	int numClasses;
+	MpClass_t classes[MP_MAX_CLASSES];
+	unsigned char lookup[MP_MAX_SIZE / MP_ALIGN + 1];	// size to class index.
+	char *bump;						// next free byte in the current chunk.
+	char *end;						// end of the current chunk.
+	MpChunk_t *chunks;
+	void *large;					// list of objects larger than MP_MAX_SIZE.
+	size_t bytesMapped;
+	size_t bytesUsed;				// allocated and not yet freed or retired.
+	size_t bytesLarge;				// the part of bytesUsed that is not in chunks.
+	MpChunk_t **from;				// chunks being emptied by mpEvacuate(), by address.
+	int numFrom;
+	int numRelease;					// from chunks mpEvacuateEnd() has still to give back.
+	size_t fromMapped;				// bytesMapped when mpEvacuate() was called.
+	size_t fromDebt;				// mapped since then, taken off what is given back.
+	size_t fromUsed;				// the part of bytesUsed in the from chunks.
+	pthread_spinlock_t lock;		// pools are shared by concurrent writers.
+} MemPool_t;
+
+// Every value stored in a pool is preceded by this header, it is
+// what lets a value be freed without the caller knowing its size.
+typedef struct _mpValHdr {
+	unsigned int len;
+	unsigned int state;				// flags, and the access stamp above them.
+} MpValHdr_t;
+
+// Flags in MpValHdr_t state.
+#define MP_VAL_INLINE	0x01		// kept in a tree node's MpValSlot_t, not the pool.
+#define MP_VAL_VACATED	0x02		// slot emptied in epoch freedAt, readers may still see it.
+#define MP_VAL_FLAGS	0x03
+
+// The access stamp is the last use of the value, 0 until it is stamped.
+#define MP_VAL_STAMP_SHIFT	2
+#define MP_VAL_STAMP_MAX	(~0u >> MP_VAL_STAMP_SHIFT)
+
+// Passed as valueLen to the tree inserts when value came from mpValAlloc()
+// on the tree's pool, the tree keeps it instead of making a copy.
+#define MP_VAL_OWNED	(-1)
+
+// Values shorter than this are kept in the tree node instead of the pool.
+#define MP_INLINE_SIZE	24
+
+// Room in a tree node for one small value.  A slot has flags 0 when it
+// has never been used.  A value taken out of a slot may still be read
+// by readers, the slot is only used again once every reader of the
+// epoch it was emptied in has gone.  Nothing is written to the slot
+// after it is emptied, so freeing the node never races with it.
+typedef struct _mpValSlot {
+	unsigned long freedAt;
+	MpValHdr_t hdr;
+	char bytes[MP_INLINE_SIZE];
+} MpValSlot_t;
+
+MemPool_t *mpInit(size_t reserve, int flags);
+int mpAddClass(MemPool_t *pool, size_t size);
+void *mpAlloc(MemPool_t *pool, size_t size);
+void mpFree(MemPool_t *pool, void *p, size_t size);
+void mpDestroy(MemPool_t *pool);
+
+// Returns the bytes of objects allocated and not yet freed or retired.
+static inline size_t mpUsed(MemPool_t *pool) {
+	return AtomicGet(&pool->bytesUsed);
+}
+
+int mpEvacuate(MemPool_t *pool);
+int mpEvacuating(MemPool_t *pool, void *p);
+int mpEvacuateEnd(MemPool_t *pool, int maxChunks, size_t *released);
+
+void mpRetire(MemPool_t *pool, void *p, size_t size);
+
+void *mpValAlloc(MemPool_t *pool, int len);
+void mpValFree(MemPool_t *pool, void *data);
+void mpValRetire(MemPool_t *pool, void *data);
+void *mpValInline(MpValSlot_t *slot, void *value, int len);
+void *mpValMove(MemPool_t *pool, void *data);
+
+// Returns the length of a value returned by mpValAlloc().
+static inline int mpValLen(void *data) {
+	return ((MpValHdr_t *)data - 1)->len;
+}
+
+// Returns the access stamp of a value, see memDbcFind().
+static inline unsigned int mpValStamp(void *data) {
+	return AtomicGet(&((MpValHdr_t *)data - 1)->state) >> MP_VAL_STAMP_SHIFT;
+}
+
+// Sets the access stamp of a value if it is still old, leaving the flags
+// as they are.  Returns 0 if another thread changed it first.
+static inline int mpValSetStamp(void *data, unsigned int old, unsigned int stamp) {
+	unsigned int *state = &((MpValHdr_t *)data - 1)->state;
+	unsigned int expect = AtomicGet(state);
+	unsigned int desire;
+
+	if (expect >> MP_VAL_STAMP_SHIFT != old)
+		return 0;
+	desire = (expect & MP_VAL_FLAGS) | (stamp << MP_VAL_STAMP_SHIFT);
+	return AtomicExchange(state, &expect, &desire);
+}
+
+// Returns 1 if a value lives in a tree node's MpValSlot_t.  The slot goes
+// with the node, so a value in a node that is itself freed or retired
+// must not be freed or retired on its own.
+static inline int mpValIsInline(void *data) {
+	return (AtomicGet(&((MpValHdr_t *)data - 1)->state) & MP_VAL_INLINE) != 0;
+}
+
+#endif /* _MEMPOOL_H_ */
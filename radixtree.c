@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "radixtree.h"
+
+#define RTT_MAX_CHILD	95			// printable ASCII characters.
+#define RTT_MAX_LABEL	65535
+
+/*
+ * Function _rttChildSize is private to this file.
+ * The child pointers and their first bytes share one allocation.
+ */
+static inline size_t _rttChildSize(int maxChild) {
+	return maxChild * (sizeof(RadixTreeNode *) + 1);
+}
+
+/*
+ * Function _rttNewNode is private to this file.
+ */
+static RadixTreeNode *_rttNewNode(RadixTree *trie, char *label, int labelLen) {
+	RadixTreeNode *node = (RadixTreeNode *)mpAlloc(trie->pool, sizeof(RadixTreeNode));
+
+	if (node == NULL)
+		return NULL;
+
+	if (labelLen > 0) {
+		node->label = (char *)mpAlloc(trie->pool, labelLen);
+		if (node->label == NULL) {
+			mpFree(trie->pool, node, sizeof(RadixTreeNode));
+			return NULL;
+		}
+		memcpy(node->label, label, labelLen);
+	}
+	node->labelLen = labelLen;
+
+	return node;
+}
+
+/*
+ * Function _rttFreeNode is private to this file.
+ * Frees the node, its label and its child array but not the children.
+ */
+static void _rttFreeNode(RadixTree *trie, RadixTreeNode *node) {
+
+	if (node->label != NULL)
+		mpFree(trie->pool, node->label, node->labelLen);
+	if (node->child != NULL)
+		mpFree(trie->pool, node->child, _rttChildSize(node->maxChild));
+	mpFree(trie->pool, node, sizeof(RadixTreeNode));
+}
+
+/*
+ * Function _rttSetLabel is private to this file.
+ * Replaces the label of node with a copy of label.
+ */
+static int _rttSetLabel(RadixTree *trie, RadixTreeNode *node, char *label, int labelLen) {
+	char *p = NULL;
+
+	if (labelLen > 0) {
+		p = (char *)mpAlloc(trie->pool, labelLen);
+		if (p == NULL)
+			return -1;
+		memcpy(p, label, labelLen);
+	}
+
+	if (node->label != NULL)
+		mpFree(trie->pool, node->label, node->labelLen);
+
+	node->label = p;
+	node->labelLen = labelLen;
+
+	return 0;
+}
+
+/*
+ * Function _rttChildIdx is private to this file.
+ * Returns the index of the child whose label starts with ch or -1.
+ */
+static inline int _rttChildIdx(RadixTreeNode *node, char ch) {
+	unsigned char *f;
+
+	if (node->numChild == 0)
+		return -1;
+
+	f = (unsigned char *)memchr(node->first, (unsigned char)ch, node->numChild);
+
+	return (f == NULL) ? -1 : (int)(f - node->first);
+}
+
+/*
+ * Function _rttAddChild is private to this file.
+ * Adds child to node keeping the children sorted by first byte.
+ */
+static int _rttAddChild(RadixTree *trie, RadixTreeNode *node, RadixTreeNode *child) {
+	unsigned char ch = (unsigned char)child->label[0];
+	int i;
+
+	if (node->numChild == node->maxChild) {
+		int max = (node->maxChild == 0) ? 2 : node->maxChild * 2;
+		RadixTreeNode **c;
+		unsigned char *f;
+
+		if (max > RTT_MAX_CHILD)
+			max = RTT_MAX_CHILD;
+
+		c = (RadixTreeNode **)mpAlloc(trie->pool, _rttChildSize(max));
+		if (c == NULL)
+			return -1;
+		f = (unsigned char *)(c + max);
+
+		if (node->numChild > 0) {
+			memcpy(c, node->child, node->numChild * sizeof(RadixTreeNode *));
+			memcpy(f, node->first, node->numChild);
+			mpFree(trie->pool, node->child, _rttChildSize(node->maxChild));
+		}
+		node->child = c;
+		node->first = f;
+		node->maxChild = max;
+	}
+
+	for (i = node->numChild; i > 0 && node->first[i - 1] > ch; i--) {
+		node->first[i] = node->first[i - 1];
+		node->child[i] = node->child[i - 1];
+	}
+	node->first[i] = ch;
+	node->child[i] = child;
+	node->numChild++;
+
+	return 0;
+}
+
+/*
+ * Function _rttRemoveChild is private to this file.
+ */
+static void _rttRemoveChild(RadixTreeNode *node, int idx) {
+	int n = node->numChild - idx - 1;
+
+	memmove(&node->first[idx], &node->first[idx + 1], n);
+	memmove(&node->child[idx], &node->child[idx + 1], n * sizeof(RadixTreeNode *));
+	node->numChild--;
+}
+
+/*
+ * Function _rttMerge is private to this file.
+ * node has no data and a single child, fold node's label into the child
+ * and put the child in node's place under parent.  The child keeps its
+ * address so references to its data stay valid.
+ */
+static void _rttMerge(RadixTree *trie, RadixTreeNode *parent, int idx, RadixTreeNode *node) {
+	RadixTreeNode *child = node->child[0];
+	int len = node->labelLen + child->labelLen;
+	char *label;
+
+	if (len > RTT_MAX_LABEL)
+		return;
+
+	label = (char *)mpAlloc(trie->pool, len);
+	if (label == NULL)
+		return;			// Leave it unmerged, the tree is still correct.
+
+	memcpy(label, node->label, node->labelLen);
+	memcpy(label + node->labelLen, child->label, child->labelLen);
+	mpFree(trie->pool, child->label, child->labelLen);
+	child->label = label;
+	child->labelLen = len;
+
+	parent->child[idx] = child;
+	_rttFreeNode(trie, node);
+}
+
+RadixTree *rttInit(MemPool_t *pool) {
+
+	RadixTree *rttRoot = (RadixTree *) calloc(1, sizeof(RadixTree));
+	if (rttRoot == NULL)
+		return NULL;
+	rttRoot->pool = pool;
+
+	mpAddClass(pool, sizeof(RadixTreeNode));
+
+	rttRoot->root = _rttNewNode(rttRoot, NULL, 0);
+	if (rttRoot->root == NULL) {
+		free(rttRoot);
+		return NULL;
+	}
+
+	return rttRoot;
+}
+
+/*
+ * Function to find the node for a given key.
+ *
+ *   key = A ascii key
+ */
+RadixTreeNode *rttFindEnd(RadixTree *trie, char *key) {
+	RadixTreeNode *node = trie->root;
+	char *p = key;
+	int i;
+
+	while (*p != '\0') {
+		i = _rttChildIdx(node, *p);
+		if (i < 0)
+			return NULL;
+
+		node = node->child[i];
+
+		// Labels never hold a NUL so strncmp() stops at the end of key.
+		if (strncmp(p, node->label, node->labelLen) != 0)
+			return NULL;
+
+		p += node->labelLen;
+	}
+
+	if (node->inUse == 0)
+		return NULL;
+
+	return node;
+}
+
+/*
+ * Function rttInsert is used to insert data into the radix tree.
+ * dataRef - if not NULL, set to the address of the end node's data pointer.
+ * Returns 1 if the key is new, 2 if it was updated and 0 on error.
+ */
+int rttInsert(RadixTree *trie, char *key, void *value, int valueLen, void ***dataRef) {
+	RadixTreeNode *node = trie->root;
+	RadixTreeNode *c;
+	void *data, *old;
+	char *p;
+	int ret = 0;
+	int i, n;
+
+	/* Cannot insert NULL values */
+
+	if (value == TRIE_NULL) {
+		return ret;
+	}
+
+	// Only allow printable ASCII characters.
+	for (p = key; *p != '\0'; ++p) {
+		if (*p < 32 || *p > 126) {
+			pErr("ERROR: Not a printable character.\n");
+			return ret;
+		}
+	}
+	if (p - key > RTT_MAX_LABEL)
+		return ret;
+
+	p = key;
+
+	while (*p != '\0') {
+		i = _rttChildIdx(node, *p);
+
+		if (i < 0) {
+			// Nothing shares this prefix, the rest of the key is one node.
+			c = _rttNewNode(trie, p, strlen(p));
+			if (c == NULL)
+				return ret;
+			if (_rttAddChild(trie, node, c) != 0) {
+				_rttFreeNode(trie, c);
+				return ret;
+			}
+			node = c;
+			break;
+		}
+
+		c = node->child[i];
+
+		for (n = 1; n < c->labelLen && p[n] == c->label[n]; n++)
+			;
+
+		if (n < c->labelLen) {
+			// Key leaves the label part way, split the label.  The new
+			// node takes the common part and the old node keeps its
+			// address and data with the rest of the label.
+			RadixTreeNode *mid = _rttNewNode(trie, p, n);
+
+			if (mid == NULL)
+				return ret;
+			if (_rttAddChild(trie, mid, c) != 0 ||
+					_rttSetLabel(trie, c, c->label + n, c->labelLen - n) != 0) {
+				_rttFreeNode(trie, mid);
+				return ret;
+			}
+			// Re-point first byte, c's label changed.
+			mid->first[0] = (unsigned char)c->label[0];
+			node->child[i] = mid;
+			c = mid;
+		}
+
+		node = c;
+		p += n;
+	}
+
+	if (valueLen == MP_VAL_OWNED) {
+		data = value;		// already in the pool, taken as is.
+	} else {
+		data = mpValAlloc(trie->pool, valueLen);
+		if (data == NULL)
+			return 0;
+		memcpy((char *)data, (char *)value, valueLen);
+	}
+
+	// Swap the value in whole, readers holding only the index locks see
+	// the old or the new value, never NULL for a key that stays.
+	old = AtomicFetchSet(&node->data, data);
+	if (old != NULL) {
+		mpValRetire(trie->pool, old);
+		ret = 2;
+	} else {
+		ret = 1;
+	}
+	node->inUse = 1;
+	if (dataRef != NULL)
+		*dataRef = &node->data;
+
+	return ret;
+}
+
+/*
+ * Function rttDelete removes a key, nodes left without data or children
+ * are freed and single child chains are folded back together.
+ */
+int rttDelete(RadixTree *trie, char *key) {
+	RadixTreeNode *gp = NULL;
+	RadixTreeNode *parent = NULL;
+	RadixTreeNode *node = trie->root;
+	int gpIdx = -1, idx = -1;
+	char *p = key;
+	int i;
+
+	while (*p != '\0') {
+		i = _rttChildIdx(node, *p);
+		if (i < 0)
+			return -1;
+
+		if (strncmp(p, node->child[i]->label, node->child[i]->labelLen) != 0)
+			return -1;
+
+		gp = parent;
+		gpIdx = idx;
+		parent = node;
+		idx = i;
+		node = node->child[i];
+		p += node->labelLen;
+	}
+
+	if (node->inUse == 0 || node->data == NULL)
+		return -1;
+
+	mpValRetire(trie->pool, node->data);
+	node->data = NULL;
+	node->inUse = 0;
+
+	if (parent == NULL)
+		return 0;			// key was the empty string, root stays.
+
+	if (node->numChild == 0) {
+		_rttRemoveChild(parent, idx);
+		_rttFreeNode(trie, node);
+
+		// Parent may now be a dataless pass through node.
+		if (gp != NULL && parent->inUse == 0 && parent->numChild == 1)
+			_rttMerge(trie, gp, gpIdx, parent);
+	} else if (node->numChild == 1) {
+		_rttMerge(trie, parent, idx, node);
+	}
+
+	return 0;
+}
+
+void *rttLookup(RadixTree *trie, char *key) {
+	RadixTreeNode *node = rttFindEnd(trie, key);
+
+	if (node != NULL) {
+		return node->data;
+	} else {
+		return TRIE_NULL;
+	}
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#ifndef _RADIXTREE_H_
+#define _RADIXTREE_H_
+
+#include <sys/types.h>
+#include "memdbc.h"
+#include "mempool.h"
+
+#ifndef TRIE_NULL
+#define TRIE_NULL ((void *) 0)
+#endif
+
+// A path compressed (PATRICIA style) trie for ASCII keys.  A chain of
+// nodes with a single child is stored as one node holding the whole
+// substring in label.  Children are kept sorted by the first byte of
+// their label, first[] holds those bytes so a child is found with one
+// memchr() over a few bytes instead of a 95 pointer array.
+typedef struct _radixTreeNode {
+	void *data;
+	char *label;					// edge label leading to this node.
+	unsigned short labelLen;
+	unsigned short numChild;
+	unsigned short maxChild;
+	unsigned short inUse;
+	unsigned char *first;			// first label byte of each child.
+	struct _radixTreeNode **child;
+} RadixTreeNode;
+
+typedef struct _radixTree {
+	RadixTreeNode *root;			// root always has an empty label.
+	MemPool_t *pool;				// nodes, labels and values are allocated from here.
+} RadixTree;
+
+RadixTree *rttInit(MemPool_t *pool);
+RadixTreeNode *rttFindEnd(RadixTree *trie, char *key);
+int rttInsert(RadixTree *trie, char *key, void *value, int valueLen, void ***dataRef);
+int rttDelete(RadixTree *trie, char *key);
+void *rttLookup(RadixTree *trie, char *key);
+
+#endif /* _RADIXTREE_H_ */
@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <zlib.h>
+
+#include "snapshot.h"
+
+/*
+ * Function _snapWriteAll is private to this file.
+ * Writes len bytes, retrying short writes.
+ */
+static int _snapWriteAll(int fd, const char *p, size_t len) {
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			memDbcErrorNum = FILE_ERR;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Function _snapSyncDir is private to this file.
+ * Syncs the directory fileName is in, so a rename into it survives a crash.
+ */
+static int _snapSyncDir(const char *fileName) {
+	const char *slash = strrchr(fileName, '/');
+	char *dir;
+	int fd, r;
+
+	if (slash == NULL)
+		dir = strdup(".");
+	else if (slash == fileName)
+		dir = strdup("/");
+	else
+		dir = strndup(fileName, slash - fileName);
+	if (dir == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+	free(dir);
+	if (fd < 0) {
+		memDbcErrorNum = FILE_ERR;
+		return -1;
+	}
+
+	r = fsync(fd);
+	close(fd);
+	if (r != 0) {
+		memDbcErrorNum = FILE_ERR;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Function _snapFlush is private to this file.
+ */
+static int _snapFlush(SnapFile_t *snap) {
+
+	if (snap->used == 0)
+		return 0;
+
+	snap->crc = crc32(snap->crc, (const Bytef *)snap->buf, snap->used);
+	if (_snapWriteAll(snap->fd, snap->buf, snap->used) != 0)
+		return -1;
+	snap->used = 0;
+
+	return 0;
+}
+
+/*
+ * Function _snapPut is private to this file.
+ * Adds bytes to the write buffer, anything bigger than the buffer is
+ * written straight to the file.
+ */
+static int _snapPut(SnapFile_t *snap, const void *p, size_t len) {
+
+	if (snap->used + len > snap->bufSize) {
+		if (_snapFlush(snap) != 0)
+			return -1;
+		if (len > snap->bufSize) {
+			snap->crc = crc32(snap->crc, (const Bytef *)p, len);
+			return _snapWriteAll(snap->fd, p, len);
+		}
+	}
+
+	memcpy(snap->buf + snap->used, p, len);
+	snap->used += len;
+
+	return 0;
+}
+
+/*
+ * Function snapCreate starts a new snapshot file of dbType records.
+ * engine and keyWidth are kept in the header for snapOpen().
+ */
+SnapFile_t *snapCreate(char *fileName, DbTypes_t dbType, int engine, int keyWidth) {
+	SnapFile_t *snap = (SnapFile_t *)calloc(1, sizeof(SnapFile_t));
+
+	if (snap == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+	snap->fd = -1;
+
+	snap->fileName = strdup(fileName);
+	snap->tmpName = (char *)malloc(strlen(fileName) + 5);
+	snap->buf = (char *)malloc(SNAP_BUF_SIZE);
+	if (snap->fileName == NULL || snap->tmpName == NULL || snap->buf == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		snapFree(snap);
+		return NULL;
+	}
+	sprintf(snap->tmpName, "%s.tmp", fileName);
+	snap->bufSize = SNAP_BUF_SIZE;
+
+	snap->fd = open(snap->tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (snap->fd < 0) {
+		memDbcErrorNum = FILE_ERR;
+		snapFree(snap);
+		return NULL;
+	}
+
+	memcpy(snap->hdr.magic, SNAP_MAGIC, sizeof(snap->hdr.magic));
+	snap->hdr.version = SNAP_VERSION;
+	snap->hdr.dbType = dbType;
+	snap->hdr.engine = engine;
+	snap->hdr.keyWidth = keyWidth;
+
+	// The header is rewritten with the record count by snapClose().
+	if (_snapWriteAll(snap->fd, (char *)&snap->hdr, sizeof(SnapHdr_t)) != 0) {
+		snapAbort(snap);
+		return NULL;
+	}
+
+	return snap;
+}
+
+/*
+ * Function snapWrite adds a record to the snapshot, expires is 0 if it
+ * has no time to live.
+ */
+int snapWrite(SnapFile_t *snap, char *key, void *data, int len, uint64_t expires) {
+	uint32_t lens[2];
+	size_t keyLen = strlen(key);
+
+	lens[0] = keyLen | ((expires != 0) ? SNAP_EXPIRES : 0);
+	lens[1] = len;
+
+	if (_snapPut(snap, lens, sizeof(lens)) != 0 ||
+			(expires != 0 && _snapPut(snap, &expires, sizeof(expires)) != 0) ||
+			_snapPut(snap, key, keyLen) != 0 ||
+			_snapPut(snap, data, len) != 0)
+		return -1;
+
+	snap->hdr.recCount++;
+
+	return 0;
+}
+
+/*
+ * Function snapClose finishes the snapshot and moves it to its real name.
+ */
+int snapClose(SnapFile_t *snap) {
+	uint32_t trailer[2];
+	int r;
+
+	if (_snapFlush(snap) != 0)
+		goto err;
+
+	trailer[0] = SNAP_END;
+	trailer[1] = snap->crc;
+	if (_snapWriteAll(snap->fd, (char *)trailer, sizeof(trailer)) != 0)
+		goto err;
+
+	if (pwrite(snap->fd, &snap->hdr, sizeof(SnapHdr_t), 0) != sizeof(SnapHdr_t) ||
+			fsync(snap->fd) != 0) {
+		memDbcErrorNum = FILE_ERR;
+		goto err;
+	}
+
+	close(snap->fd);
+	snap->fd = -1;
+
+	if (rename(snap->tmpName, snap->fileName) != 0) {
+		memDbcErrorNum = FILE_ERR;
+		goto err;
+	}
+
+	r = _snapSyncDir(snap->fileName);
+	snapFree(snap);
+
+	return r;
+
+err:
+	snapAbort(snap);
+	return -1;
+}
+
+/*
+ * Function snapAbort throws away a snapshot that is being written.
+ */
+void snapAbort(SnapFile_t *snap) {
+
+	if (snap->fd >= 0) {
+		close(snap->fd);
+		snap->fd = -1;
+	}
+	unlink(snap->tmpName);
+	snapFree(snap);
+}
+
+/*
+ * Function _snapFill is private to this file.
+ * Makes sure need bytes past pos are in the read buffer.
+ */
+static int _snapFill(SnapFile_t *snap, size_t need) {
+	ssize_t n;
+
+	if (snap->used - snap->pos >= need)
+		return 0;
+
+	// Keep what is left at the front of the buffer.
+	memmove(snap->buf, snap->buf + snap->pos, snap->used - snap->pos);
+	snap->used -= snap->pos;
+	snap->pos = 0;
+
+	if (need > snap->bufSize) {
+		char *p = (char *)realloc(snap->buf, need);
+
+		if (p == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			return -1;
+		}
+		snap->buf = p;
+		snap->bufSize = need;
+	}
+
+	while (snap->used < need) {
+		n = read(snap->fd, snap->buf + snap->used, snap->bufSize - snap->used);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			// A short file is as bad as a bad one.
+			memDbcErrorNum = (n < 0) ? FILE_ERR : FORMAT_ERR;
+			return -1;
+		}
+		snap->used += n;
+	}
+
+	return 0;
+}
+
+/*
+ * Function snapOpen opens a snapshot for reading and checks its header.
+ */
+SnapFile_t *snapOpen(char *fileName) {
+	SnapFile_t *snap = (SnapFile_t *)calloc(1, sizeof(SnapFile_t));
+
+	if (snap == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+	snap->fd = -1;
+
+	snap->buf = (char *)malloc(SNAP_BUF_SIZE);
+	if (snap->buf == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		snapFree(snap);
+		return NULL;
+	}
+	snap->bufSize = SNAP_BUF_SIZE;
+
+	snap->fd = open(fileName, O_RDONLY);
+	if (snap->fd < 0) {
+		memDbcErrorNum = FILE_ERR;
+		snapFree(snap);
+		return NULL;
+	}
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(snap->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	if (_snapFill(snap, sizeof(SnapHdr_t)) != 0) {
+		snapFree(snap);
+		return NULL;
+	}
+	memcpy(&snap->hdr, snap->buf, sizeof(SnapHdr_t));
+	snap->pos = sizeof(SnapHdr_t);
+
+	if (memcmp(snap->hdr.magic, SNAP_MAGIC, sizeof(snap->hdr.magic)) != 0 ||
+			snap->hdr.version != SNAP_VERSION) {
+		memDbcErrorNum = FORMAT_ERR;
+		snapFree(snap);
+		return NULL;
+	}
+
+	return snap;
+}
+
+/*
+ * Function snapRead returns the next record.  key and data point into
+ * the snapshot's buffers and are good until the next call.  expires is
+ * set to 0 if the record has no time to live.
+ * Returns 1 for a record, 0 at the end of a good file and -1 on error.
+ */
+int snapRead(SnapFile_t *snap, char **key, void **data, int *len, uint64_t *expires) {
+	uint32_t lens[2];
+	size_t head, keyLen, n;
+
+	if (_snapFill(snap, sizeof(uint32_t)) != 0)
+		return -1;
+	memcpy(lens, snap->buf + snap->pos, sizeof(uint32_t));
+
+	if (lens[0] == SNAP_END) {
+		if (_snapFill(snap, sizeof(lens)) != 0)
+			return -1;
+		memcpy(lens, snap->buf + snap->pos, sizeof(lens));
+		if (lens[1] != snap->crc) {
+			memDbcErrorNum = FORMAT_ERR;
+			return -1;
+		}
+		return 0;
+	}
+
+	if (_snapFill(snap, sizeof(lens)) != 0)
+		return -1;
+	memcpy(lens, snap->buf + snap->pos, sizeof(lens));
+
+	keyLen = lens[0] & ~SNAP_EXPIRES;
+	head = sizeof(lens) + ((lens[0] & SNAP_EXPIRES) ? sizeof(uint64_t) : 0);
+	n = head + keyLen + lens[1];
+	if (_snapFill(snap, n) != 0)
+		return -1;
+
+	snap->crc = crc32(snap->crc, (const Bytef *)snap->buf + snap->pos, n);
+
+	if (keyLen + 1 > snap->keySize) {
+		char *p = (char *)realloc(snap->key, keyLen + 1);
+
+		if (p == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			return -1;
+		}
+		snap->key = p;
+		snap->keySize = keyLen + 1;
+	}
+	memcpy(snap->key, snap->buf + snap->pos + head, keyLen);
+	snap->key[keyLen] = '\0';
+
+	*expires = 0;
+	if (lens[0] & SNAP_EXPIRES)
+		memcpy(expires, snap->buf + snap->pos + sizeof(lens), sizeof(uint64_t));
+
+	*key = snap->key;
+	*data = snap->buf + snap->pos + head + keyLen;
+	*len = lens[1];
+
+	snap->pos += n;
+
+	return 1;
+}
+
+/*
+ * Function snapFree releases a snapshot opened by snapOpen().
+ */
+void snapFree(SnapFile_t *snap) {
+
+	if (snap == NULL)
+		return;
+
+	if (snap->fd >= 0)
+		close(snap->fd);
+	free(snap->fileName);
+	free(snap->tmpName);
+	free(snap->buf);
+	free(snap->key);
+	free(snap);
+}
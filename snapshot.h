@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+#include "memdbc.h"
+
+// Binary snapshot file layout, numbers are in host byte order:
+//
+//   SnapHdr_t
+//   records in key order, each:
+//       uint32_t keyLen, uint32_t valueLen, [uint64_t expires],
+//       key bytes, value bytes
+//   uint32_t SNAP_END, uint32_t crc32 of every record byte
+//
+// expires is only there if keyLen has SNAP_EXPIRES set, it is when the
+// record's time to live runs out in CLOCK_REALTIME milliseconds.
+//
+// recCount in the header is filled in when the file is closed.  The file
+// is written under a temporary name and renamed so a crash never leaves
+// a partial snapshot behind.
+#define SNAP_MAGIC		"MEMDBCS1"
+#define SNAP_VERSION	3
+#define SNAP_END		0xffffffffu
+#define SNAP_EXPIRES	0x80000000u
+
+// Size of the read and write buffers.
+#define SNAP_BUF_SIZE	(1024 * 1024)
+
+typedef struct _snapHdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t dbType;
+	uint64_t recCount;
+	uint32_t engine;		// MemDbcEngine_t the database used.
+	uint32_t keyWidth;		// INT_ENGINE key digits, else 0.
+} SnapHdr_t;
+
+typedef struct _snapFile {
+	int fd;
+	char *fileName;			// final name, writers only.
+	char *tmpName;			// name written to until snapClose().
+	char *buf;
+	size_t bufSize;
+	size_t used;			// bytes in buf.
+	size_t pos;				// read position in buf, readers only.
+	char *key;				// NUL terminated copy of the last key read.
+	size_t keySize;
+	uint32_t crc;
+	SnapHdr_t hdr;
+} SnapFile_t;
+
+SnapFile_t *snapCreate(char *fileName, DbTypes_t dbType, int engine, int keyWidth);
+int snapWrite(SnapFile_t *snap, char *key, void *data, int len, uint64_t expires);
+int snapClose(SnapFile_t *snap);
+void snapAbort(SnapFile_t *snap);
+
+SnapFile_t *snapOpen(char *fileName);
+int snapRead(SnapFile_t *snap, char **key, void **data, int *len, uint64_t *expires);
+void snapFree(SnapFile_t *snap);
+
+#endif /* _SNAPSHOT_H_ */
@@ -33,19 +33,118 @@
 #include "logutils.h"
 #include "strutils.h"
 #include "trietree.h"
+#include "keyidx.h"
 
 #define CHAR_BIT	8
 
+/*
+ * Function _trieHold is private to this file.
+ * A node's useCount is the number of keys under it plus the writers
+ * walking through it.  Adds one to it unless it is already 0, a node
+ * that reached 0 is being unlinked and can not be used again.
+ * Returns 0 if the node is dead.
+ */
+static inline int _trieHold(unsigned int *useCount) {
+	unsigned int n = AtomicGet(useCount);
+	unsigned int m;
+
+	do {
+		if (n == 0)
+			return 0;
+		m = n + 1;
+	} while (AtomicExchange(useCount, &n, &m) == 0);
+
+	return 1;
+}
+
+// Key characters of each child index, to give the compactions' moved()
+// the key of a node.  Hex keys come out in lower case, the case memdbc.c
+// folds them to before they reach the tree or the key index.
+static const char _asciiDigits[] = " !\"#$%&'()*+,-./0123456789:;<=>?@"
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~";
+static const char _hexDigits[] = "0123456789abcdef";
+static const char _decDigits[] = "0123456789";
+
+/*
+ * Function _trieCursorGrow is private to this file.
+ * Makes room in tc for levels levels and a key of keyLen characters.
+ * Returns 0 or -1 if out of memory.
+ */
+static int _trieCursorGrow(TrieCursor_t *tc, int levels, int keyLen) {
+	int size;
+
+	if (levels > tc->size) {
+		for (size = (tc->size > 0) ? tc->size : 64; size < levels; size *= 2)
+			;
+		int *idx = (int *) realloc(tc->idx, size * sizeof(int));
+		if (idx != NULL)
+			tc->idx = idx;
+		void **path = (void **) realloc(tc->path, size * sizeof(void *));
+		if (path != NULL)
+			tc->path = path;
+		if (idx == NULL || path == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			return -1;
+		}
+		tc->size = size;
+	}
+
+	if (keyLen >= tc->keySize) {
+		for (size = (tc->keySize > 0) ? tc->keySize : 256; size <= keyLen; size *= 2)
+			;
+		char *key = (char *) realloc(tc->key, size);
+		if (key == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			return -1;
+		}
+		tc->key = key;
+		tc->keySize = size;
+	}
+
+	return 0;
+}
+
+/*
+ * Function _trieKey is private to this file.
+ * Returns the key of the node depth levels down tc, one digit a level.
+ */
+static char *_trieKey(TrieCursor_t *tc, int depth, const char *digits) {
+	int i;
+
+	for (i = 0; i < depth; i++)
+		tc->key[i] = digits[tc->idx[i]];
+	tc->key[depth] = '\0';
+
+	return tc->key;
+}
+
+/*
+ * Function trieCursorFree releases what a compaction kept in tc and
+ * zeroes it.
+ */
+void trieCursorFree(TrieCursor_t *tc) {
+
+	free(tc->idx);
+	free(tc->path);
+	free(tc->key);
+	memset(tc, 0, sizeof(TrieCursor_t));
+}
+
 int _asciiTrieTreeInit = 0;
 
 static inline int _toAsciiIdx(char ch) __attribute__((always_inline));
 
-AsciiTrieTree *attInit() {
+AsciiTrieTree *attInit(MemPool_t *pool) {
 
 	AsciiTrieTree *attRoot = (AsciiTrieTree *) calloc(1, sizeof(AsciiTrieTree));
 	if (attRoot == NULL)
 		return NULL;
 	attRoot->root = NULL;
+	attRoot->pool = pool;
+
+	// Give the nodes, with and without a value slot, their own size classes.
+	mpAddClass(pool, sizeof(AsciiTrieTreeNode));
+	mpAddClass(pool, sizeof(AsciiTrieTreeNode) + sizeof(MpValSlot_t));
 
 	_asciiTrieTreeInit = 1;
 
@@ -54,13 +153,8 @@ AsciiTrieTree *attInit() {
 
 static inline int _toAsciiIdx(char ch) {
 
-	// Only allow printable ASCII characters.
-	if (ch > 31 && ch < 127)
-		return (int)ch - ' ';
-	else {
-		pErr("ERROR: Not a printable character.\n");
-		return 0;
-	}
+	// Keys are checked by keyCheck() before they get here.
+	return keyIdxMap[ASCII_DB][(unsigned char)ch];
 }
 
 /*
@@ -79,7 +173,7 @@ AsciiTrieTreeNode *attFindEnd(AsciiTrieTree *trie, char *key) {
 
 	// Search down the trie until the end of string is reached
 
-	node = trie->root;
+	node = AtomicGet(&trie->root);
 
 	for (p = key; *p != '\0'; ++p) {
 
@@ -88,70 +182,53 @@ AsciiTrieTreeNode *attFindEnd(AsciiTrieTree *trie, char *key) {
 			return NULL;
 		}
 
-		// Jump to the next node
-		node = node->next[_toAsciiIdx(*p)];
+		// Jump to the next node, slots are published by CAS in attInsert().
+		node = AtomicGet(&node->next[_toAsciiIdx(*p)]);
 	}
 
 	// This string is present if the value at the last node is not NULL
-	if (node == NULL || node->inUse == 0)
+	if (node == NULL || AtomicGet(&node->inUse) == 0)
 		return NULL;
 
 	return node;
 }
 
 /*
- * Function _attRollback is private to this file.
+ * Function _attRelease is private to this file.
+ * Drops the use counts of the first depth nodes of key.  A node whose
+ * count reaches 0 has no key left under it and no writer holding it, it
+ * is unlinked from its parent and retired.  The walk goes on through it,
+ * the nodes below that key still holds stay linked to it until they go.
  */
-static void _attRollback(AsciiTrieTree *trie, char *key) {
+static void _attRelease(AsciiTrieTree *trie, char *key, int depth) {
+	AsciiTrieTreeNode **rover = &trie->root;
 	AsciiTrieTreeNode *node;
-	AsciiTrieTreeNode **prev_ptr;
-	AsciiTrieTreeNode *next_node;
-	AsciiTrieTreeNode **next_prev_ptr;
 	char *p;
 
-	// Follow the chain along.  We know that we will never reach the
-	// end of the string because attInsert never got that far.  As a
-	// result, it is not necessary to check for the end of string
-	// delimiter (NUL)
-
-	node = trie->root;
-	prev_ptr = &trie->root;
-	p = key;
-
-	while (node != NULL) {
-
-		/* Find the next node now. We might free this node. */
-
-		next_prev_ptr = &node->next[_toAsciiIdx(*p)];
-		next_node = *next_prev_ptr;
-		++p;
-
-		// Decrease the use count and free the node if it
-		// reaches zero.
-
-		AtomicSub(&node->useCount, 1);
+	for (p = key; p - key < depth; ++p) {
+		node = AtomicGet(rover);
 
-		if (node->useCount == 0) {
-			free(node);
-
-			if (prev_ptr != NULL) {
-				*prev_ptr = NULL;
-			}
+		if (AtomicSub(&node->useCount, 1) == 0) {
+			AsciiTrieTreeNode *expect = node;
+			AsciiTrieTreeNode *none = NULL;
 
-			next_prev_ptr = NULL;
+			// An insert that found it dead may have unlinked it already.
+			AtomicExchange(rover, &expect, &none);
+			mpRetire(trie->pool, node, sizeof(AsciiTrieTreeNode) + (node->slot ? sizeof(MpValSlot_t) : 0));
 		}
 
-		/* Update pointers */
+		if (*p == '\0')
+			break;
 
-		node = next_node;
-		prev_ptr = next_prev_ptr;
+		rover = &node->next[_toAsciiIdx(*p)];
 	}
 }
 
 /*
  * Function attInsert is used to insert data into trie tree.
+ * dataRef - if not NULL, set to the address of the end node's data pointer.
  */
-int attInsert(AsciiTrieTree *trie, char *key, void *value, int valueLen) {
+int attInsert(AsciiTrieTree *trie, char *key, void *value, int valueLen, void ***dataRef) {
 	AsciiTrieTreeNode **rover;
 	AsciiTrieTreeNode *node;
 	char *p;
@@ -176,53 +253,95 @@ int attInsert(AsciiTrieTree *trie, char *key, void *value, int valueLen) {
 	p = key;
 
 	AsciiTrieTreeNode *tmp = NULL;
+	size_t tmpSize = 0;
+	size_t size;
 
 	for (;;) {
 
-		node = *rover;
+		node = AtomicGet(rover);
+
+		if (node != NULL && _trieHold(&node->useCount) == 0) {
+			// The last key under node is gone and it is being retired,
+			// unlink it and put a new node in its place.
+			AsciiTrieTreeNode *expect = node;
+			AsciiTrieTreeNode *none = NULL;
 
-		if (tmp == NULL) {
-            // tmp will be freed if it is unused at end of loop.
-            tmp = (AsciiTrieTreeNode *) calloc(1, sizeof(AsciiTrieTreeNode));
-            if (tmp != NULL)
-                tmp->inUse = 1;
-        }
+			AtomicExchange(rover, &expect, &none);
+			continue;
+		}
+
+		if (node == NULL) {
+			// The node a key ends in gets room for a short value.
+			size = sizeof(AsciiTrieTreeNode) + ((*p == '\0') ? sizeof(MpValSlot_t) : 0);
+			if (tmp != NULL && tmpSize != size) {
+				mpFree(trie->pool, tmp, tmpSize);
+				tmp = NULL;
+			}
+			if (tmp == NULL) {
+				// tmp will be freed if it is unused at end of loop.
+				tmp = (AsciiTrieTreeNode *) mpAlloc(trie->pool, size);
+				tmpSize = size;
+				if (tmp != NULL) {
+					tmp->inUse = 1;
+					tmp->useCount = 1;		// held by this writer once published.
+					tmp->slot = (size != sizeof(AsciiTrieTreeNode));
+				}
+			}
 
-        if (tmp == NULL) {
-            // Allocation failed.  Go back and undo
-            // what we have done so far.
-            _attRollback(trie, key);
+			if (tmp == NULL) {
+				// Allocation failed.  Go back and undo
+				// what we have done so far.
+				_attRelease(trie, key, p - key);
 
-            return ret;
-        }
+				return ret;
+			}
 
-		AsciiTrieTreeNode *expect = NULL;
+			AsciiTrieTreeNode *expect = NULL;
 
-        // Trying to avoid locks here.
-        if (AtomicExchange(&node, &expect, &tmp) == 1) {
-            *rover = tmp;
-            tmp = NULL;     // Set tmp so another will be allocated.
-        } else {
-            // Another thread beat us in adding node.
-            // Do not free tmp here.
-        }
+			// Publish tmp in the parent's slot.  If another writer got
+			// there first hold its node and keep tmp for the next level.
+			if (AtomicExchange(rover, &expect, &tmp) == 0)
+				continue;
 
-        // Increase the node useCount
-        AtomicAdd(&node->useCount, 1);
+			node = tmp;
+			tmp = NULL;     // Set tmp so another will be allocated.
+		}
 
 		// Reached the end of string?  If so, we're finished.
 		if (*p == '\0') {
-			if (node->data != NULL) {
-				// printf(" **** Freeing node data.\n");
-				free(node->data);
-				node->data = NULL;
+			void *data = NULL;
+
+			if (valueLen == MP_VAL_OWNED)
+				data = value;		// already in the pool, taken as is.
+			else if (node->slot)
+				data = mpValInline(node->val, value, valueLen);
+
+			if (data == NULL) {
+				data = mpValAlloc(trie->pool, valueLen);
+				if (data == NULL) {
+					_attRelease(trie, key, p - key + 1);
+					break;
+				}
+				memcpy((char *)data, (char *)value, valueLen);
+			}
+
+			// Swap the value in whole, a reader sees the old or the new
+			// value.  Only one writer of a new key sees NULL here.
+			void *old = AtomicFetchSet(&node->data, data);
+
+			if (old != NULL) {
+				mpValRetire(trie->pool, old);
 				ret = 2;
 			} else {
 				ret = 1;
 			}
-			node->data = (void *)calloc(1, valueLen + 1);
-			memcpy((char *)node->data, (char *)value, valueLen);
-			AtomicAdd(&node->inUse, 1);
+			AtomicSet(&node->inUse, 1);
+			if (dataRef != NULL)
+				*dataRef = &node->data;
+
+			// The nodes are counted once per key, an update lets go.
+			if (ret == 2)
+				_attRelease(trie, key, p - key + 1);
 			break;
 		}
 
@@ -232,13 +351,110 @@ int attInsert(AsciiTrieTree *trie, char *key, void *value, int valueLen) {
 	}
 
 	if (tmp != NULL)
-		free(tmp);
+		mpFree(trie->pool, tmp, tmpSize);
 
 	return ret;
 }
 
+/*
+ * Function attAppend is attInsert() for keys added in sorted order to a
+ * trie no other thread can see yet, it is used by the bulk loaders.
+ * path[i] is the node reached after i bytes of the last key added and
+ * depth is the number of bytes key shares with it, or -1 for the first
+ * key.  The walk starts at path[depth] instead of the root, so a run of
+ * keys with a long common prefix does not walk it again.  path must have
+ * room for strlen(key) + 1 nodes and is set for key.
+ */
+int attAppend(AsciiTrieTree *trie, AsciiTrieTreeNode **path, int depth, char *key, void *value, int valueLen, void ***dataRef) {
+	AsciiTrieTreeNode **rover;
+	AsciiTrieTreeNode *node;
+	size_t size;
+	char *p;
+	int i;
+
+	if (_asciiTrieTreeInit == 0) {
+		pErr("Must call attInit() first.\n");
+		return 0;
+	}
+
+	/* Cannot insert NULL values */
+
+	if (value == TRIE_NULL) {
+		return 0;
+	}
+
+	if (depth < 0 || trie->root == NULL) {
+		rover = &trie->root;
+		depth = 0;
+	} else {
+		// The shared nodes are counted without walking down to them.
+		for (i = 0; i < depth; i++)
+			path[i]->useCount++;
+		rover = (depth == 0) ? &trie->root : &path[depth - 1]->next[_toAsciiIdx(key[depth - 1])];
+	}
+
+	for (p = key + depth;; ++p) {
+
+		node = *rover;
+
+		if (node == NULL) {
+			// The node a key ends in gets room for a short value.
+			size = sizeof(AsciiTrieTreeNode) + ((*p == '\0') ? sizeof(MpValSlot_t) : 0);
+			node = (AsciiTrieTreeNode *) mpAlloc(trie->pool, size);
+			if (node == NULL) {
+				_attRelease(trie, key, p - key);
+				return 0;
+			}
+			node->inUse = 1;
+			node->slot = (*p == '\0');
+			*rover = node;
+		}
+
+		node->useCount++;
+		path[p - key] = node;
+
+		if (*p == '\0')
+			break;
+
+		rover = &node->next[_toAsciiIdx(*p)];
+	}
+
+	void *data = NULL;
+
+	if (valueLen == MP_VAL_OWNED)
+		data = value;		// already in the pool, taken as is.
+	else if (node->slot)
+		data = mpValInline(node->val, value, valueLen);
+
+	if (data == NULL) {
+		data = mpValAlloc(trie->pool, valueLen);
+		if (data == NULL) {
+			_attRelease(trie, key, p - key + 1);
+			return 0;
+		}
+		memcpy((char *)data, (char *)value, valueLen);
+	}
+
+	// A key given twice keeps the last value.
+	void *old = node->data;
+
+	node->data = data;
+	node->inUse = 1;
+	if (dataRef != NULL)
+		*dataRef = &node->data;
+
+	if (old != NULL) {
+		mpValRetire(trie->pool, old);
+		_attRelease(trie, key, p - key + 1);
+		return 2;
+	}
+
+	return 1;
+}
+
 int attDelete(AsciiTrieTree *trie, char *key) {
 	AsciiTrieTreeNode *node;
+	void *data;
 
 	if (_asciiTrieTreeInit == 0) {
 		pErr("Must call attInit() first.\n");
@@ -247,18 +463,18 @@ int attDelete(AsciiTrieTree *trie, char *key) {
 
 	node = attFindEnd(trie, key);
 
-	if (node != NULL) {
-		if (node->data != NULL) {
-			free(node->data);
-			node->data = NULL;
-		}
-		if (node->useCount > 0)
-			node->useCount--;
-		if (node->useCount == 0)
-			node->inUse = 0;
-	} else {
+	if (node == NULL)
 		return -1;		// record not found.
-	}
+
+	// Only the writer that takes the value out owns the delete.
+	data = AtomicFetchSet(&node->data, NULL);
+	if (data == NULL)
+		return -1;		// already deleted.
+
+	mpValRetire(trie->pool, data);
+
+	// The key's nodes, the ones left with no key under them are retired.
+	_attRelease(trie, key, strlen(key) + 1);
 
 	return 0;
 }
@@ -274,12 +490,78 @@ void *attLookup(AsciiTrieTree *trie, char *key) {
 	node = attFindEnd(trie, key);
 
 	if (node != NULL) {
-		return node->data;
+		return AtomicGet(&node->data);
 	} else {
 		return TRIE_NULL;
 	}
 }
 
+/*
+ * Function attLookupMany looks up n keys, out[i] is set to the data of
+ * keys[i] or NULL.  Up to TRIE_GROUP lookups walk down the trie together
+ * a level at a time and the slot each one reads next is prefetched, so
+ * their cache misses overlap instead of coming one after another.  A
+ * lookup that finishes hands its place to the next key.
+ * Returns the number of keys found.
+ */
+int attLookupMany(AsciiTrieTree *trie, char **keys, int n, void **out) {
+	AsciiTrieTreeNode *node[TRIE_GROUP];
+	AsciiTrieTreeNode *root;
+	char *p[TRIE_GROUP];
+	int which[TRIE_GROUP];
+	int live = 0;
+	int next = 0;
+	int found = 0;
+	int i;
+
+	if (_asciiTrieTreeInit == 0) {
+		pErr("Must call attInit() first.\n");
+		return 0;
+	}
+
+	root = AtomicGet(&trie->root);
+
+	while (live < TRIE_GROUP && next < n) {
+		node[live] = root;
+		p[live] = keys[next];
+		which[live++] = next++;
+	}
+
+	while (live > 0) {
+		for (i = 0; i < live;) {
+			AsciiTrieTreeNode *nd = node[i];
+
+			if (nd != NULL && *p[i] != '\0') {
+				nd = AtomicGet(&nd->next[_toAsciiIdx(*p[i])]);
+				node[i] = nd;
+				p[i]++;
+				if (nd != NULL)
+					__builtin_prefetch((*p[i] != '\0') ? (void *)&nd->next[_toAsciiIdx(*p[i])] : (void *)nd);
+				i++;
+				continue;
+			}
+
+			out[which[i]] = (nd != NULL && AtomicGet(&nd->inUse) != 0) ? AtomicGet(&nd->data) : TRIE_NULL;
+			if (out[which[i]] != TRIE_NULL)
+				found++;
+
+			if (next < n) {
+				node[i] = root;
+				p[i] = keys[next];
+				which[i++] = next++;
+			} else {
+				// Close the gap with the last lookup.
+				live--;
+				node[i] = node[live];
+				p[i] = p[live];
+				which[i] = which[live];
+			}
+		}
+	}
+
+	return found;
+}
+
 int attNumEntries(AsciiTrieTree *trie) {
 	// To find the number of entries, simply look at the use count
 	// of the root node.
@@ -296,16 +578,133 @@ int attNumEntries(AsciiTrieTree *trie) {
 	}
 }
 
-#define IDX(c)	((int)c - (int)'0')
+/*
+ * Function _attMove is private to this file.
+ * Copies the node in the slot at rover, and its value, to new memory if
+ * the pool is evacuating them.  depth is the node's level in tc.
+ * Returns the node as it is now or NULL if out of memory.
+ */
+static AsciiTrieTreeNode *_attMove(AsciiTrieTree *trie, AsciiTrieTreeNode **rover, TrieCursor_t *tc, int depth, TrieMovedFn_t moved, void *ctx) {
+	AsciiTrieTreeNode *node = *rover;
+	AsciiTrieTreeNode *copy;
+	size_t size = sizeof(AsciiTrieTreeNode) + (node->slot ? sizeof(MpValSlot_t) : 0);
+	void *data;
+
+	if (mpEvacuating(trie->pool, node)) {
+		copy = (AsciiTrieTreeNode *) mpAlloc(trie->pool, size);
+		if (copy == NULL)
+			return NULL;
+		memcpy(copy, node, size);
+
+		// A short value is kept in the node and moves with it.
+		data = copy->data;
+		if (data != NULL && (char *)data >= (char *)node && (char *)data < (char *)node + size)
+			copy->data = (char *)copy + ((char *)data - (char *)node);
+
+		// Readers still in the old node see it as it was.
+		AtomicSet(rover, copy);
+		if (copy->data != NULL)
+			moved(ctx, _trieKey(tc, depth, _asciiDigits), &node->data, &copy->data);
+		node = copy;
+	}
+
+	// The value goes right after its node.
+	data = mpValMove(trie->pool, node->data);
+	if (data == NULL && node->data != NULL)
+		return NULL;
+	if (data != node->data)
+		AtomicSet(&node->data, data);
+
+	return node;
+}
+
+/*
+ * Function attCompact copies the nodes the pool is evacuating, and their
+ * values, to new memory.  It visits up to budget nodes depth first from
+ * where tc was left, so the copies are laid out in the order lookups
+ * and walks go through them.  moved(ctx, key, old, ref) is called for
+ * each key whose data pointer moved.  Other writers must be kept out,
+ * readers need not be.  Returns 1 if there are nodes left, 0 when the
+ * trie is done or -1 if out of memory, a new call goes on from there.
+ */
+int attCompact(AsciiTrieTree *trie, TrieCursor_t *tc, int budget, TrieMovedFn_t moved, void *ctx) {
+	AsciiTrieTreeNode **rover = &trie->root;
+	AsciiTrieTreeNode *node;
+	int depth, i;
+
+	if (_asciiTrieTreeInit == 0) {
+		pErr("Must call attInit() first.\n");
+		return -1;
+	}
+
+	// Back down to where the last call stopped, the nodes above it
+	// are done.  If the node there is gone the walk goes on after it.
+	for (depth = 0; depth < tc->len && *rover != NULL; depth++) {
+		tc->path[depth] = *rover;
+		rover = &(*rover)->next[tc->idx[depth]];
+	}
+
+	for (;;) {
+		if (*rover != NULL) {
+			if (budget-- <= 0)
+				break;
+			if (_trieCursorGrow(tc, depth + 1, depth) != 0) {
+				tc->len = depth;
+				return -1;
+			}
+			node = _attMove(trie, rover, tc, depth, moved, ctx);
+			if (node == NULL) {
+				tc->len = depth;
+				return -1;
+			}
+			tc->path[depth] = node;
+
+			for (i = 0; i < 95 && node->next[i] == NULL; i++)
+				;
+			if (i < 95) {
+				tc->idx[depth++] = i;
+				rover = &node->next[i];
+				continue;
+			}
+		}
+
+		// On to the next child of the nearest level that has one.
+		for (;;) {
+			if (depth == 0) {
+				tc->len = 0;
+				return 0;
+			}
+			node = (AsciiTrieTreeNode *) tc->path[depth - 1];
+			for (i = tc->idx[depth - 1] + 1; i < 95 && node->next[i] == NULL; i++)
+				;
+			if (i < 95)
+				break;
+			depth--;
+		}
+		tc->idx[depth - 1] = i;
+		rover = &node->next[i];
+	}
+
+	tc->len = depth;
+
+	return 1;
+}
+
+#define IDX(c)	(keyIdxMap[DIGITAL_DB][(unsigned char)(c)])
 
 int _digitalTrieTreeInit = 0;
 
-DigitalTrieTree *dttInit() {
+DigitalTrieTree *dttInit(MemPool_t *pool) {
 
 	DigitalTrieTree *dttRoot = (DigitalTrieTree *) calloc(1, sizeof(DigitalTrieTree));
 	if (dttRoot == NULL)
 		return NULL;
 	dttRoot->root = NULL;
+	dttRoot->pool = pool;
+
+	// Give the nodes, with and without a value slot, their own size classes.
+	mpAddClass(pool, sizeof(DigitalTrieTreeNode));
+	mpAddClass(pool, sizeof(DigitalTrieTreeNode) + sizeof(MpValSlot_t));
 
 	_digitalTrieTreeInit = 1;
 
@@ -328,7 +727,7 @@ DigitalTrieTreeNode *dttFindEnd(DigitalTrieTree *trie, char *key) {
 
 	// Search down the trie until the end of string is reached
 
-	node = trie->root;
+	node = AtomicGet(&trie->root);
 
 	for (p = key; *p != '\0'; ++p) {
 
@@ -337,8 +736,8 @@ DigitalTrieTreeNode *dttFindEnd(DigitalTrieTree *trie, char *key) {
 			return NULL;
 		}
 
-		// Jump to the next node
-		node = node->next[IDX(*p)];
+		// Jump to the next node, slots are published by CAS in dttInsert().
+		node = AtomicGet(&node->next[IDX(*p)]);
 	}
 
 	if (node == NULL)
@@ -348,58 +747,41 @@ DigitalTrieTreeNode *dttFindEnd(DigitalTrieTree *trie, char *key) {
 }
 
 /*
- * Function _dttRollback is private to this file.
+ * Function _dttRelease is private to this file.
+ * Drops the use counts of the first depth nodes of key.  A node whose
+ * count reaches 0 has no key left under it and no writer holding it, it
+ * is unlinked from its parent and retired.  The walk goes on through it,
+ * the nodes below that key still holds stay linked to it until they go.
  */
-static void _dttRollback(DigitalTrieTree *trie, char *key) {
+static void _dttRelease(DigitalTrieTree *trie, char *key, int depth) {
+	DigitalTrieTreeNode **rover = &trie->root;
 	DigitalTrieTreeNode *node;
-	DigitalTrieTreeNode **prev_ptr;
-	DigitalTrieTreeNode *next_node;
-	DigitalTrieTreeNode **next_prev_ptr;
 	char *p;
 
-	// Follow the chain along.  We know that we will never reach the
-	// end of the string because dttInsert never got that far.  As a
-	// result, it is not necessary to check for the end of string
-	// delimiter (NUL)
-
-	node = trie->root;
-	prev_ptr = &trie->root;
-	p = key;
-
-	while (node != NULL) {
-
-		/* Find the next node now. We might free this node. */
-
-		next_prev_ptr = &node->next[IDX(*p)];
-		next_node = *next_prev_ptr;
-		++p;
-
-		// Decrease the use count and free the node if it
-		// reaches zero.
+	for (p = key; p - key < depth; ++p) {
+		node = AtomicGet(rover);
 
-		AtomicSub(&node->useCount, 1);
+		if (AtomicSub(&node->useCount, 1) == 0) {
+			DigitalTrieTreeNode *expect = node;
+			DigitalTrieTreeNode *none = NULL;
 
-		if (node->useCount == 0) {
-			free(node);
-
-			if (prev_ptr != NULL) {
-				*prev_ptr = NULL;
-			}
-
-			next_prev_ptr = NULL;
+			// An insert that found it dead may have unlinked it already.
+			AtomicExchange(rover, &expect, &none);
+			mpRetire(trie->pool, node, sizeof(DigitalTrieTreeNode) + (node->slot ? sizeof(MpValSlot_t) : 0));
 		}
 
-		/* Update pointers */
+		if (*p == '\0')
+			break;
 
-		node = next_node;
-		prev_ptr = next_prev_ptr;
+		rover = &node->next[IDX(*p)];
 	}
 }
 
 /*
  * Function dttInsert is used to insert data into trie tree.
+ * dataRef - if not NULL, set to the address of the end node's data pointer.
  */
-int dttInsert(DigitalTrieTree *trie, char *key, void *value, int valueLen) {
+int dttInsert(DigitalTrieTree *trie, char *key, void *value, int valueLen, void ***dataRef) {
 	DigitalTrieTreeNode **rover;
 	DigitalTrieTreeNode *node;
 	char *p;
@@ -424,53 +806,95 @@ int dttInsert(DigitalTrieTree *trie, char *key, void *value, int valueLen) {
 	p = key;
 
 	DigitalTrieTreeNode *tmp = NULL;
+	size_t tmpSize = 0;
+	size_t size;
 
 	for (;;) {
 
-		node = *rover;
+		node = AtomicGet(rover);
+
+		if (node != NULL && _trieHold(&node->useCount) == 0) {
+			// The last key under node is gone and it is being retired,
+			// unlink it and put a new node in its place.
+			DigitalTrieTreeNode *expect = node;
+			DigitalTrieTreeNode *none = NULL;
+
+			AtomicExchange(rover, &expect, &none);
+			continue;
+		}
 
-		if (tmp == NULL) {
-            // tmp will be freed if it is unused at end of loop.
-            tmp = (DigitalTrieTreeNode *) calloc(1, sizeof(DigitalTrieTreeNode));
-            if (tmp != NULL)
-                tmp->inUse = 1;
-        }
+		if (node == NULL) {
+			// The node a key ends in gets room for a short value.
+			size = sizeof(DigitalTrieTreeNode) + ((*p == '\0') ? sizeof(MpValSlot_t) : 0);
+			if (tmp != NULL && tmpSize != size) {
+				mpFree(trie->pool, tmp, tmpSize);
+				tmp = NULL;
+			}
+			if (tmp == NULL) {
+				// tmp will be freed if it is unused at end of loop.
+				tmp = (DigitalTrieTreeNode *) mpAlloc(trie->pool, size);
+				tmpSize = size;
+				if (tmp != NULL) {
+					tmp->inUse = 1;
+					tmp->useCount = 1;		// held by this writer once published.
+					tmp->slot = (size != sizeof(DigitalTrieTreeNode));
+				}
+			}
 
-        if (tmp == NULL) {
-            // Allocation failed.  Go back and undo
-            // what we have done so far.
-            _dttRollback(trie, key);
+			if (tmp == NULL) {
+				// Allocation failed.  Go back and undo
+				// what we have done so far.
+				_dttRelease(trie, key, p - key);
 
-            return ret;
-        }
+				return ret;
+			}
 
-        DigitalTrieTreeNode *expect = NULL;
+			DigitalTrieTreeNode *expect = NULL;
 
-        // Trying to avoid locks here.
-        if (AtomicExchange(&node, &expect, &tmp) == 1) {
-            *rover = tmp;
-            tmp = NULL;     // Set tmp so another will be allocated.
-        } else {
-            // Another thread beat us in adding node.
-            // Do not free tmp here.
-        }
+			// Publish tmp in the parent's slot.  If another writer got
+			// there first hold its node and keep tmp for the next level.
+			if (AtomicExchange(rover, &expect, &tmp) == 0)
+				continue;
 
-        // Increase the node useCount
-        AtomicAdd(&node->useCount, 1);
+			node = tmp;
+			tmp = NULL;     // Set tmp so another will be allocated.
+		}
 
 		// Reached the end of string?  If so, we're finished.
 		if (*p == '\0') {
-			if (node->data != NULL) {
-				printf(" **** Freeing node data.\n");
-				free(node->data);
-				node->data = NULL;
+			void *data = NULL;
+
+			if (valueLen == MP_VAL_OWNED)
+				data = value;		// already in the pool, taken as is.
+			else if (node->slot)
+				data = mpValInline(node->val, value, valueLen);
+
+			if (data == NULL) {
+				data = mpValAlloc(trie->pool, valueLen);
+				if (data == NULL) {
+					_dttRelease(trie, key, p - key + 1);
+					break;
+				}
+				memcpy((char *)data, (char *)value, valueLen);
+			}
+
+			// Swap the value in whole, a reader sees the old or the new
+			// value.  Only one writer of a new key sees NULL here.
+			void *old = AtomicFetchSet(&node->data, data);
+
+			if (old != NULL) {
+				mpValRetire(trie->pool, old);
 				ret = 2;
 			} else {
 				ret = 1;
 			}
-			node->data = (void *)calloc(1, valueLen + 1);
-			memcpy((char *)node->data, (char *)value, valueLen);
-			AtomicAdd(&node->inUse, 1);
+			AtomicSet(&node->inUse, 1);
+			if (dataRef != NULL)
+				*dataRef = &node->data;
+
+			// The nodes are counted once per key, an update lets go.
+			if (ret == 2)
+				_dttRelease(trie, key, p - key + 1);
 			break;
 		}
 
@@ -480,13 +904,110 @@ int dttInsert(DigitalTrieTree *trie, char *key, void *value, int valueLen) {
 	}
 
 	if (tmp != NULL)
-		free(tmp);
+		mpFree(trie->pool, tmp, tmpSize);
 
 	return ret;
 }
 
+/*
+ * Function dttAppend is dttInsert() for keys added in sorted order to a
+ * trie no other thread can see yet, it is used by the bulk loaders.
+ * path[i] is the node reached after i bytes of the last key added and
+ * depth is the number of bytes key shares with it, or -1 for the first
+ * key.  The walk starts at path[depth] instead of the root, so a run of
+ * keys with a long common prefix does not walk it again.  path must have
+ * room for strlen(key) + 1 nodes and is set for key.
+ */
+int dttAppend(DigitalTrieTree *trie, DigitalTrieTreeNode **path, int depth, char *key, void *value, int valueLen, void ***dataRef) {
+	DigitalTrieTreeNode **rover;
+	DigitalTrieTreeNode *node;
+	size_t size;
+	char *p;
+	int i;
+
+	if (_digitalTrieTreeInit == 0) {
+		pErr("Must call dttInit() first.\n");
+		return 0;
+	}
+
+	/* Cannot insert NULL values */
+
+	if (value == TRIE_NULL) {
+		return 0;
+	}
+
+	if (depth < 0 || trie->root == NULL) {
+		rover = &trie->root;
+		depth = 0;
+	} else {
+		// The shared nodes are counted without walking down to them.
+		for (i = 0; i < depth; i++)
+			path[i]->useCount++;
+		rover = (depth == 0) ? &trie->root : &path[depth - 1]->next[IDX(key[depth - 1])];
+	}
+
+	for (p = key + depth;; ++p) {
+
+		node = *rover;
+
+		if (node == NULL) {
+			// The node a key ends in gets room for a short value.
+			size = sizeof(DigitalTrieTreeNode) + ((*p == '\0') ? sizeof(MpValSlot_t) : 0);
+			node = (DigitalTrieTreeNode *) mpAlloc(trie->pool, size);
+			if (node == NULL) {
+				_dttRelease(trie, key, p - key);
+				return 0;
+			}
+			node->inUse = 1;
+			node->slot = (*p == '\0');
+			*rover = node;
+		}
+
+		node->useCount++;
+		path[p - key] = node;
+
+		if (*p == '\0')
+			break;
+
+		rover = &node->next[IDX(*p)];
+	}
+
+	void *data = NULL;
+
+	if (valueLen == MP_VAL_OWNED)
+		data = value;		// already in the pool, taken as is.
+	else if (node->slot)
+		data = mpValInline(node->val, value, valueLen);
+
+	if (data == NULL) {
+		data = mpValAlloc(trie->pool, valueLen);
+		if (data == NULL) {
+			_dttRelease(trie, key, p - key + 1);
+			return 0;
+		}
+		memcpy((char *)data, (char *)value, valueLen);
+	}
+
+	// A key given twice keeps the last value.
+	void *old = node->data;
+
+	node->data = data;
+	node->inUse = 1;
+	if (dataRef != NULL)
+		*dataRef = &node->data;
+
+	if (old != NULL) {
+		mpValRetire(trie->pool, old);
+		_dttRelease(trie, key, p - key + 1);
+		return 2;
+	}
+
+	return 1;
+}
+
 int dttDelete(DigitalTrieTree *trie, char *key) {
 	DigitalTrieTreeNode *node;
+	void *data;
 
 	if (_digitalTrieTreeInit == 0) {
 		pErr("Must call dttInit() first.\n");
@@ -495,18 +1016,18 @@ int dttDelete(DigitalTrieTree *trie, char *key) {
 
 	node = dttFindEnd(trie, key);
 
-	if (node != NULL) {
-		if (node->data != NULL) {
-			free(node->data);
-			node->data = NULL;
-		}
-		if (node->useCount > 0)
-			node->useCount--;
-		if (node->useCount == 0)
-			node->inUse = 0;
-	} else {
+	if (node == NULL)
 		return -1;		// record not found.
-	}
+
+	// Only the writer that takes the value out owns the delete.
+	data = AtomicFetchSet(&node->data, NULL);
+	if (data == NULL)
+		return -1;		// already deleted.
+
+	mpValRetire(trie->pool, data);
+
+	// The key's nodes, the ones left with no key under them are retired.
+	_dttRelease(trie, key, strlen(key) + 1);
 
 	return 0;
 }
@@ -522,38 +1043,221 @@ void *dttLookup(DigitalTrieTree *trie, char *key) {
 	node = dttFindEnd(trie, key);
 
 	if (node != NULL) {
-		return node->data;
+		return AtomicGet(&node->data);
 	} else {
 		return TRIE_NULL;
 	}
 }
 
-int dttNumEntries(DigitalTrieTree *trie) {
-	// To find the number of entries, simply look at the use count
-	// of the root node.
+/*
+ * Function dttLookupMany looks up n keys, out[i] is set to the data of
+ * keys[i] or NULL.  Up to TRIE_GROUP lookups walk down the trie together
+ * a level at a time and the slot each one reads next is prefetched, so
+ * their cache misses overlap instead of coming one after another.  A
+ * lookup that finishes hands its place to the next key.
+ * Returns the number of keys found.
+ */
+int dttLookupMany(DigitalTrieTree *trie, char **keys, int n, void **out) {
+	DigitalTrieTreeNode *node[TRIE_GROUP];
+	DigitalTrieTreeNode *root;
+	char *p[TRIE_GROUP];
+	int which[TRIE_GROUP];
+	int live = 0;
+	int next = 0;
+	int found = 0;
+	int i;
 
 	if (_digitalTrieTreeInit == 0) {
-		pErr("Must call ttInit() first.\n");
+		pErr("Must call dttInit() first.\n");
 		return 0;
 	}
 
-	if (trie->root == NULL) {
-		return 0;
-	} else {
+	root = AtomicGet(&trie->root);
+
+	while (live < TRIE_GROUP && next < n) {
+		node[live] = root;
+		p[live] = keys[next];
+		which[live++] = next++;
+	}
+
+	while (live > 0) {
+		for (i = 0; i < live;) {
+			DigitalTrieTreeNode *nd = node[i];
+
+			if (nd != NULL && *p[i] != '\0') {
+				nd = AtomicGet(&nd->next[IDX(*p[i])]);
+				node[i] = nd;
+				p[i]++;
+				if (nd != NULL)
+					__builtin_prefetch((*p[i] != '\0') ? (void *)&nd->next[IDX(*p[i])] : (void *)nd);
+				i++;
+				continue;
+			}
+
+			out[which[i]] = (nd != NULL && AtomicGet(&nd->inUse) != 0) ? AtomicGet(&nd->data) : TRIE_NULL;
+			if (out[which[i]] != TRIE_NULL)
+				found++;
+
+			if (next < n) {
+				node[i] = root;
+				p[i] = keys[next];
+				which[i++] = next++;
+			} else {
+				// Close the gap with the last lookup.
+				live--;
+				node[i] = node[live];
+				p[i] = p[live];
+				which[i] = which[live];
+			}
+		}
+	}
+
+	return found;
+}
+
+int dttNumEntries(DigitalTrieTree *trie) {
+	// To find the number of entries, simply look at the use count
+	// of the root node.
+
+	if (_digitalTrieTreeInit == 0) {
+		pErr("Must call ttInit() first.\n");
+		return 0;
+	}
+
+	if (trie->root == NULL) {
+		return 0;
+	} else {
 		return AtomicGet(&trie->root->useCount);
 	}
 }
 
+/*
+ * Function _dttMove is private to this file.
+ * Copies the node in the slot at rover, and its value, to new memory if
+ * the pool is evacuating them.  depth is the node's level in tc.
+ * Returns the node as it is now or NULL if out of memory.
+ */
+static DigitalTrieTreeNode *_dttMove(DigitalTrieTree *trie, DigitalTrieTreeNode **rover, TrieCursor_t *tc, int depth, TrieMovedFn_t moved, void *ctx) {
+	DigitalTrieTreeNode *node = *rover;
+	DigitalTrieTreeNode *copy;
+	size_t size = sizeof(DigitalTrieTreeNode) + (node->slot ? sizeof(MpValSlot_t) : 0);
+	void *data;
+
+	if (mpEvacuating(trie->pool, node)) {
+		copy = (DigitalTrieTreeNode *) mpAlloc(trie->pool, size);
+		if (copy == NULL)
+			return NULL;
+		memcpy(copy, node, size);
+
+		// A short value is kept in the node and moves with it.
+		data = copy->data;
+		if (data != NULL && (char *)data >= (char *)node && (char *)data < (char *)node + size)
+			copy->data = (char *)copy + ((char *)data - (char *)node);
+
+		// Readers still in the old node see it as it was.
+		AtomicSet(rover, copy);
+		if (copy->data != NULL)
+			moved(ctx, _trieKey(tc, depth, _decDigits), &node->data, &copy->data);
+		node = copy;
+	}
+
+	// The value goes right after its node.
+	data = mpValMove(trie->pool, node->data);
+	if (data == NULL && node->data != NULL)
+		return NULL;
+	if (data != node->data)
+		AtomicSet(&node->data, data);
+
+	return node;
+}
+
+/*
+ * Function dttCompact copies the nodes the pool is evacuating, and their
+ * values, to new memory.  It visits up to budget nodes depth first from
+ * where tc was left, so the copies are laid out in the order lookups
+ * and walks go through them.  moved(ctx, key, old, ref) is called for
+ * each key whose data pointer moved.  Other writers must be kept out,
+ * readers need not be.  Returns 1 if there are nodes left, 0 when the
+ * trie is done or -1 if out of memory, a new call goes on from there.
+ */
+int dttCompact(DigitalTrieTree *trie, TrieCursor_t *tc, int budget, TrieMovedFn_t moved, void *ctx) {
+	DigitalTrieTreeNode **rover = &trie->root;
+	DigitalTrieTreeNode *node;
+	int depth, i;
+
+	if (_digitalTrieTreeInit == 0) {
+		pErr("Must call dttInit() first.\n");
+		return -1;
+	}
+
+	// Back down to where the last call stopped, the nodes above it
+	// are done.  If the node there is gone the walk goes on after it.
+	for (depth = 0; depth < tc->len && *rover != NULL; depth++) {
+		tc->path[depth] = *rover;
+		rover = &(*rover)->next[tc->idx[depth]];
+	}
+
+	for (;;) {
+		if (*rover != NULL) {
+			if (budget-- <= 0)
+				break;
+			if (_trieCursorGrow(tc, depth + 1, depth) != 0) {
+				tc->len = depth;
+				return -1;
+			}
+			node = _dttMove(trie, rover, tc, depth, moved, ctx);
+			if (node == NULL) {
+				tc->len = depth;
+				return -1;
+			}
+			tc->path[depth] = node;
+
+			for (i = 0; i < 10 && node->next[i] == NULL; i++)
+				;
+			if (i < 10) {
+				tc->idx[depth++] = i;
+				rover = &node->next[i];
+				continue;
+			}
+		}
+
+		// On to the next child of the nearest level that has one.
+		for (;;) {
+			if (depth == 0) {
+				tc->len = 0;
+				return 0;
+			}
+			node = (DigitalTrieTreeNode *) tc->path[depth - 1];
+			for (i = tc->idx[depth - 1] + 1; i < 10 && node->next[i] == NULL; i++)
+				;
+			if (i < 10)
+				break;
+			depth--;
+		}
+		tc->idx[depth - 1] = i;
+		rover = &node->next[i];
+	}
+
+	tc->len = depth;
+
+	return 1;
+}
+
 int _hexTrieTreeInit = 0;
 
 static inline int _toHexIdx(char ch) __attribute__((always_inline));
 
-HexTrieTree *httInit() {
+HexTrieTree *httInit(MemPool_t *pool) {
 
 	HexTrieTree *httRoot = (HexTrieTree *) calloc(1, sizeof(HexTrieTree));
 	if (httRoot == NULL)
 		return NULL;
 	httRoot->root = NULL;
+	httRoot->pool = pool;
+
+	// Give the nodes, with and without a value slot, their own size classes.
+	mpAddClass(pool, sizeof(HexTrieTreeNode));
+	mpAddClass(pool, sizeof(HexTrieTreeNode) + sizeof(MpValSlot_t));
 
 	_hexTrieTreeInit = 1;
 
@@ -564,17 +1268,8 @@ HexTrieTree *httInit() {
  * Function _toHexIdx is private to this file.
  */
 static inline int _toHexIdx(char ch) {
-	// Only allow hex characters, both upper and lower case.
-	if (ch > 47 && ch < 58)
-		return ((int)ch - (int)'0');
-	else if ((int)ch > 64 && ch < 71)
-		return ((int)ch - (int)'A') + 10;
-	else if ((int)ch > 96 && ch < 103)
-		return ((int)ch - (int)'a') + 10;
-	else {
-		pErr("ERROR: Not a Hex character.\n");
-		return 0;
-	}
+	// Keys are checked by keyCheck() before they get here, case is ignored.
+	return keyIdxMap[HEX_DB][(unsigned char)ch];
 }
 
 /*
@@ -591,7 +1286,7 @@ HexTrieTreeNode *httFindEnd(HexTrieTree *trie, char *key) {
 
 	// Search down the trie until the end of string is reached
 
-	node = trie->root;
+	node = AtomicGet(&trie->root);
 
 	for (p = key; *p != '\0'; ++p) {
 
@@ -600,69 +1295,52 @@ HexTrieTreeNode *httFindEnd(HexTrieTree *trie, char *key) {
 			return NULL;
 		}
 
-		// Jump to the next node
-		node = node->next[_toHexIdx(*p)];
+		// Jump to the next node, slots are published by CAS in httInsert().
+		node = AtomicGet(&node->next[_toHexIdx(*p)]);
 	}
 
-	if (node == NULL || node->inUse == 0)
+	if (node == NULL || AtomicGet(&node->inUse) == 0)
 		return NULL;
 
 	return node;
 }
 
 /*
- * Function _httRollback is private to this file.
+ * Function _httRelease is private to this file.
+ * Drops the use counts of the first depth nodes of key.  A node whose
+ * count reaches 0 has no key left under it and no writer holding it, it
+ * is unlinked from its parent and retired.  The walk goes on through it,
+ * the nodes below that key still holds stay linked to it until they go.
  */
-static void _httRollback(HexTrieTree *trie, char *key) {
+static void _httRelease(HexTrieTree *trie, char *key, int depth) {
+	HexTrieTreeNode **rover = &trie->root;
 	HexTrieTreeNode *node;
-	HexTrieTreeNode **prev_ptr;
-	HexTrieTreeNode *next_node;
-	HexTrieTreeNode **next_prev_ptr;
 	char *p;
 
-	// Follow the chain along.  We know that we will never reach the
-	// end of the string because httInsert never got that far.  As a
-	// result, it is not necessary to check for the end of string
-	// delimiter (NUL)
-
-	node = trie->root;
-	prev_ptr = &trie->root;
-	p = key;
-
-	while (node != NULL) {
-
-		/* Find the next node now. We might free this node. */
-
-		next_prev_ptr = &node->next[_toHexIdx(*p)];
-		next_node = *next_prev_ptr;
-		++p;
-
-		// Decrease the use count and free the node if it
-		// reaches zero.
-
-		AtomicSub(&node->useCount, 1);
+	for (p = key; p - key < depth; ++p) {
+		node = AtomicGet(rover);
 
-		if (node->useCount == 0) {
-			free(node);
+		if (AtomicSub(&node->useCount, 1) == 0) {
+			HexTrieTreeNode *expect = node;
+			HexTrieTreeNode *none = NULL;
 
-			if (prev_ptr != NULL) {
-				*prev_ptr = NULL;
-			}
-
-			next_prev_ptr = NULL;
+			// An insert that found it dead may have unlinked it already.
+			AtomicExchange(rover, &expect, &none);
+			mpRetire(trie->pool, node, sizeof(HexTrieTreeNode) + (node->slot ? sizeof(MpValSlot_t) : 0));
 		}
 
-		/* Update pointers */
+		if (*p == '\0')
+			break;
 
-		node = next_node;
-		prev_ptr = next_prev_ptr;
+		rover = &node->next[_toHexIdx(*p)];
 	}
 }
 
 /*
  * Function httInsert is used to insert data into trie tree.
+ * dataRef - if not NULL, set to the address of the end node's data pointer.
  */
-int httInsert(HexTrieTree *trie, char *key, void *value, int valueLen) {
+int httInsert(HexTrieTree *trie, char *key, void *value, int valueLen, void ***dataRef) {
 	HexTrieTreeNode **rover;
 	HexTrieTreeNode *node;
 	char *p;
@@ -687,52 +1365,95 @@ int httInsert(HexTrieTree *trie, char *key, void *value, int valueLen) {
 	p = key;
 
 	HexTrieTreeNode *tmp = NULL;
+	size_t tmpSize = 0;
+	size_t size;
 
 	for (;;) {
 
-		node = *rover;
+		node = AtomicGet(rover);
+
+		if (node != NULL && _trieHold(&node->useCount) == 0) {
+			// The last key under node is gone and it is being retired,
+			// unlink it and put a new node in its place.
+			HexTrieTreeNode *expect = node;
+			HexTrieTreeNode *none = NULL;
+
+			AtomicExchange(rover, &expect, &none);
+			continue;
+		}
 
-		if (tmp == NULL) {
-            // tmp will be freed if it is unused at end of loop.
-            tmp = (HexTrieTreeNode *) calloc(1, sizeof(HexTrieTreeNode));
-            if (tmp != NULL)
-                tmp->inUse = 1;
-        }
+		if (node == NULL) {
+			// The node a key ends in gets room for a short value.
+			size = sizeof(HexTrieTreeNode) + ((*p == '\0') ? sizeof(MpValSlot_t) : 0);
+			if (tmp != NULL && tmpSize != size) {
+				mpFree(trie->pool, tmp, tmpSize);
+				tmp = NULL;
+			}
+			if (tmp == NULL) {
+				// tmp will be freed if it is unused at end of loop.
+				tmp = (HexTrieTreeNode *) mpAlloc(trie->pool, size);
+				tmpSize = size;
+				if (tmp != NULL) {
+					tmp->inUse = 1;
+					tmp->useCount = 1;		// held by this writer once published.
+					tmp->slot = (size != sizeof(HexTrieTreeNode));
+				}
+			}
 
-        if (tmp == NULL) {
-            // Allocation failed.  Go back and undo
-            // what we have done so far.
-            _httRollback(trie, key);
+			if (tmp == NULL) {
+				// Allocation failed.  Go back and undo
+				// what we have done so far.
+				_httRelease(trie, key, p - key);
 
-            return ret;
-        }
+				return ret;
+			}
 
-        HexTrieTreeNode *expect = NULL;
+			HexTrieTreeNode *expect = NULL;
 
-        // Trying to avoid locks here.
-        if (AtomicExchange(&node, &expect, &tmp) == 1) {
-            *rover = tmp;
-            tmp = NULL;     // Set tmp so another will be allocated.
-        } else {
-            // Another thread beat us in adding node.
-            // Do not free tmp here.
-        }
+			// Publish tmp in the parent's slot.  If another writer got
+			// there first hold its node and keep tmp for the next level.
+			if (AtomicExchange(rover, &expect, &tmp) == 0)
+				continue;
 
-        // Increase the node useCount
-        AtomicAdd(&node->useCount, 1);
+			node = tmp;
+			tmp = NULL;     // Set tmp so another will be allocated.
+		}
 
 		// Reached the end of string?  If so, we're finished.
 		if (*p == '\0') {
-			if (node->data != NULL) {
-				free(node->data);
-				node->data = NULL;
+			void *data = NULL;
+
+			if (valueLen == MP_VAL_OWNED)
+				data = value;		// already in the pool, taken as is.
+			else if (node->slot)
+				data = mpValInline(node->val, value, valueLen);
+
+			if (data == NULL) {
+				data = mpValAlloc(trie->pool, valueLen);
+				if (data == NULL) {
+					_httRelease(trie, key, p - key + 1);
+					break;
+				}
+				memcpy((char *)data, (char *)value, valueLen);
+			}
+
+			// Swap the value in whole, a reader sees the old or the new
+			// value.  Only one writer of a new key sees NULL here.
+			void *old = AtomicFetchSet(&node->data, data);
+
+			if (old != NULL) {
+				mpValRetire(trie->pool, old);
 				ret = 2;
 			} else {
 				ret = 1;
 			}
-			node->data = (void *)calloc(1, valueLen + 1);
-			memcpy((char *)node->data, (char *)value, valueLen);
-			AtomicAdd(&node->inUse, 1);
+			AtomicSet(&node->inUse, 1);
+			if (dataRef != NULL)
+				*dataRef = &node->data;
+
+			// The nodes are counted once per key, an update lets go.
+			if (ret == 2)
+				_httRelease(trie, key, p - key + 1);
 			break;
 		}
 
@@ -742,13 +1463,110 @@ int httInsert(HexTrieTree *trie, char *key, void *value, int valueLen) {
 	}
 
 	if (tmp != NULL)
-		free(tmp);
+		mpFree(trie->pool, tmp, tmpSize);
 
 	return ret;
 }
 
+/*
+ * Function httAppend is httInsert() for keys added in sorted order to a
+ * trie no other thread can see yet, it is used by the bulk loaders.
+ * path[i] is the node reached after i bytes of the last key added and
+ * depth is the number of bytes key shares with it, or -1 for the first
+ * key.  The walk starts at path[depth] instead of the root, so a run of
+ * keys with a long common prefix does not walk it again.  path must have
+ * room for strlen(key) + 1 nodes and is set for key.
+ */
+int httAppend(HexTrieTree *trie, HexTrieTreeNode **path, int depth, char *key, void *value, int valueLen, void ***dataRef) {
+	HexTrieTreeNode **rover;
+	HexTrieTreeNode *node;
+	size_t size;
+	char *p;
+	int i;
+
+	if (_hexTrieTreeInit == 0) {
+		pErr("Must call httInit() first.\n");
+		return 0;
+	}
+
+	/* Cannot insert NULL values */
+
+	if (value == TRIE_NULL) {
+		return 0;
+	}
+
+	if (depth < 0 || trie->root == NULL) {
+		rover = &trie->root;
+		depth = 0;
+	} else {
+		// The shared nodes are counted without walking down to them.
+		for (i = 0; i < depth; i++)
+			path[i]->useCount++;
+		rover = (depth == 0) ? &trie->root : &path[depth - 1]->next[_toHexIdx(key[depth - 1])];
+	}
+
+	for (p = key + depth;; ++p) {
+
+		node = *rover;
+
+		if (node == NULL) {
+			// The node a key ends in gets room for a short value.
+			size = sizeof(HexTrieTreeNode) + ((*p == '\0') ? sizeof(MpValSlot_t) : 0);
+			node = (HexTrieTreeNode *) mpAlloc(trie->pool, size);
+			if (node == NULL) {
+				_httRelease(trie, key, p - key);
+				return 0;
+			}
+			node->inUse = 1;
+			node->slot = (*p == '\0');
+			*rover = node;
+		}
+
+		node->useCount++;
+		path[p - key] = node;
+
+		if (*p == '\0')
+			break;
+
+		rover = &node->next[_toHexIdx(*p)];
+	}
+
+	void *data = NULL;
+
+	if (valueLen == MP_VAL_OWNED)
+		data = value;		// already in the pool, taken as is.
+	else if (node->slot)
+		data = mpValInline(node->val, value, valueLen);
+
+	if (data == NULL) {
+		data = mpValAlloc(trie->pool, valueLen);
+		if (data == NULL) {
+			_httRelease(trie, key, p - key + 1);
+			return 0;
+		}
+		memcpy((char *)data, (char *)value, valueLen);
+	}
+
+	// A key given twice keeps the last value.
+	void *old = node->data;
+
+	node->data = data;
+	node->inUse = 1;
+	if (dataRef != NULL)
+		*dataRef = &node->data;
+
+	if (old != NULL) {
+		mpValRetire(trie->pool, old);
+		_httRelease(trie, key, p - key + 1);
+		return 2;
+	}
+
+	return 1;
+}
+
 int httDelete(HexTrieTree *trie, char *key) {
 	HexTrieTreeNode *node;
+	void *data;
 
 	if (_hexTrieTreeInit == 0) {
 		pErr("Must call httInit() first.\n");
@@ -757,18 +1575,18 @@ int httDelete(HexTrieTree *trie, char *key) {
 
 	node = httFindEnd(trie, key);
 
-	if (node != NULL) {
-		if (node->data != NULL) {
-			free(node->data);
-			node->data = NULL;
-		}
-		if (node->useCount > 0)
-			node->useCount--;
-		if (node->useCount == 0)
-			node->inUse = 0;
-	} else {
+	if (node == NULL)
 		return -1;		// record not found.
-	}
+
+	// Only the writer that takes the value out owns the delete.
+	data = AtomicFetchSet(&node->data, NULL);
+	if (data == NULL)
+		return -1;		// already deleted.
+
+	mpValRetire(trie->pool, data);
+
+	// The key's nodes, the ones left with no key under them are retired.
+	_httRelease(trie, key, strlen(key) + 1);
 
 	return 0;
 }
@@ -784,12 +1602,78 @@ void *httLookup(HexTrieTree *trie, char *key) {
 	node = httFindEnd(trie, key);
 
 	if (node != NULL) {
-		return node->data;
+		return AtomicGet(&node->data);
 	} else {
 		return TRIE_NULL;
 	}
 }
 
+/*
+ * Function httLookupMany looks up n keys, out[i] is set to the data of
+ * keys[i] or NULL.  Up to TRIE_GROUP lookups walk down the trie together
+ * a level at a time and the slot each one reads next is prefetched, so
+ * their cache misses overlap instead of coming one after another.  A
+ * lookup that finishes hands its place to the next key.
+ * Returns the number of keys found.
+ */
+int httLookupMany(HexTrieTree *trie, char **keys, int n, void **out) {
+	HexTrieTreeNode *node[TRIE_GROUP];
+	HexTrieTreeNode *root;
+	char *p[TRIE_GROUP];
+	int which[TRIE_GROUP];
+	int live = 0;
+	int next = 0;
+	int found = 0;
+	int i;
+
+	if (_hexTrieTreeInit == 0) {
+		pErr("Must call httInit() first.\n");
+		return 0;
+	}
+
+	root = AtomicGet(&trie->root);
+
+	while (live < TRIE_GROUP && next < n) {
+		node[live] = root;
+		p[live] = keys[next];
+		which[live++] = next++;
+	}
+
+	while (live > 0) {
+		for (i = 0; i < live;) {
+			HexTrieTreeNode *nd = node[i];
+
+			if (nd != NULL && *p[i] != '\0') {
+				nd = AtomicGet(&nd->next[_toHexIdx(*p[i])]);
+				node[i] = nd;
+				p[i]++;
+				if (nd != NULL)
+					__builtin_prefetch((*p[i] != '\0') ? (void *)&nd->next[_toHexIdx(*p[i])] : (void *)nd);
+				i++;
+				continue;
+			}
+
+			out[which[i]] = (nd != NULL && AtomicGet(&nd->inUse) != 0) ? AtomicGet(&nd->data) : TRIE_NULL;
+			if (out[which[i]] != TRIE_NULL)
+				found++;
+
+			if (next < n) {
+				node[i] = root;
+				p[i] = keys[next];
+				which[i++] = next++;
+			} else {
+				// Close the gap with the last lookup.
+				live--;
+				node[i] = node[live];
+				p[i] = p[live];
+				which[i] = which[live];
+			}
+		}
+	}
+
+	return found;
+}
+
 int httNumEntries(HexTrieTree *trie) {
 	// To find the number of entries, simply look at the use count
 	// of the root node.
@@ -806,16 +1690,133 @@ int httNumEntries(HexTrieTree *trie) {
 	}
 }
 
+/*
+ * Function _httMove is private to this file.
+ * Copies the node in the slot at rover, and its value, to new memory if
+ * the pool is evacuating them.  depth is the node's level in tc.
+ * Returns the node as it is now or NULL if out of memory.
+ */
+static HexTrieTreeNode *_httMove(HexTrieTree *trie, HexTrieTreeNode **rover, TrieCursor_t *tc, int depth, TrieMovedFn_t moved, void *ctx) {
+	HexTrieTreeNode *node = *rover;
+	HexTrieTreeNode *copy;
+	size_t size = sizeof(HexTrieTreeNode) + (node->slot ? sizeof(MpValSlot_t) : 0);
+	void *data;
+
+	if (mpEvacuating(trie->pool, node)) {
+		copy = (HexTrieTreeNode *) mpAlloc(trie->pool, size);
+		if (copy == NULL)
+			return NULL;
+		memcpy(copy, node, size);
+
+		// A short value is kept in the node and moves with it.
+		data = copy->data;
+		if (data != NULL && (char *)data >= (char *)node && (char *)data < (char *)node + size)
+			copy->data = (char *)copy + ((char *)data - (char *)node);
+
+		// Readers still in the old node see it as it was.
+		AtomicSet(rover, copy);
+		if (copy->data != NULL)
+			moved(ctx, _trieKey(tc, depth, _hexDigits), &node->data, &copy->data);
+		node = copy;
+	}
+
+	// The value goes right after its node.
+	data = mpValMove(trie->pool, node->data);
+	if (data == NULL && node->data != NULL)
+		return NULL;
+	if (data != node->data)
+		AtomicSet(&node->data, data);
+
+	return node;
+}
+
+/*
+ * Function httCompact copies the nodes the pool is evacuating, and their
+ * values, to new memory.  It visits up to budget nodes depth first from
+ * where tc was left, so the copies are laid out in the order lookups
+ * and walks go through them.  moved(ctx, key, old, ref) is called for
+ * each key whose data pointer moved.  Other writers must be kept out,
+ * readers need not be.  Returns 1 if there are nodes left, 0 when the
+ * trie is done or -1 if out of memory, a new call goes on from there.
+ */
+int httCompact(HexTrieTree *trie, TrieCursor_t *tc, int budget, TrieMovedFn_t moved, void *ctx) {
+	HexTrieTreeNode **rover = &trie->root;
+	HexTrieTreeNode *node;
+	int depth, i;
+
+	if (_hexTrieTreeInit == 0) {
+		pErr("Must call httInit() first.\n");
+		return -1;
+	}
+
+	// Back down to where the last call stopped, the nodes above it
+	// are done.  If the node there is gone the walk goes on after it.
+	for (depth = 0; depth < tc->len && *rover != NULL; depth++) {
+		tc->path[depth] = *rover;
+		rover = &(*rover)->next[tc->idx[depth]];
+	}
+
+	for (;;) {
+		if (*rover != NULL) {
+			if (budget-- <= 0)
+				break;
+			if (_trieCursorGrow(tc, depth + 1, depth) != 0) {
+				tc->len = depth;
+				return -1;
+			}
+			node = _httMove(trie, rover, tc, depth, moved, ctx);
+			if (node == NULL) {
+				tc->len = depth;
+				return -1;
+			}
+			tc->path[depth] = node;
+
+			for (i = 0; i < 16 && node->next[i] == NULL; i++)
+				;
+			if (i < 16) {
+				tc->idx[depth++] = i;
+				rover = &node->next[i];
+				continue;
+			}
+		}
+
+		// On to the next child of the nearest level that has one.
+		for (;;) {
+			if (depth == 0) {
+				tc->len = 0;
+				return 0;
+			}
+			node = (HexTrieTreeNode *) tc->path[depth - 1];
+			for (i = tc->idx[depth - 1] + 1; i < 16 && node->next[i] == NULL; i++)
+				;
+			if (i < 16)
+				break;
+			depth--;
+		}
+		tc->idx[depth - 1] = i;
+		rover = &node->next[i];
+	}
+
+	tc->len = depth;
+
+	return 1;
+}
+
 int _octalTrieTreeInit = 0;
 
 static inline int _toOctalIdx(char ch) __attribute__((always_inline));
 
-OctalTrieTree *ottInit() {
+OctalTrieTree *ottInit(MemPool_t *pool) {
 
 	OctalTrieTree *ottRoot = (OctalTrieTree *) calloc(1, sizeof(OctalTrieTree));
 	if (ottRoot == NULL)
 		return NULL;
 	ottRoot->root = NULL;
+	ottRoot->pool = pool;
+
+	// Give the nodes, with and without a value slot, their own size classes.
+	mpAddClass(pool, sizeof(OctalTrieTreeNode));
+	mpAddClass(pool, sizeof(OctalTrieTreeNode) + sizeof(MpValSlot_t));
 
 	_octalTrieTreeInit = 1;
 
@@ -826,13 +1827,8 @@ OctalTrieTree *ottInit() {
  * Function _toOctalIdx is private to this file.
  */
 static inline int _toOctalIdx(char ch) {
-	// Only allow octal characters, both upper and lower case.
-	if (ch > 47 && ch < 56) {
-		return ((int)ch - (int)'0');
-	} else {
-		pErr("ERROR: Not a Octal character. (%c)(%d)\n", ch, ch);
-		return 0;
-	}
+	// Keys are checked by keyCheck() before they get here.
+	return keyIdxMap[OCTAL_DB][(unsigned char)ch];
 }
 
 /*
@@ -849,7 +1845,7 @@ OctalTrieTreeNode *ottFindEnd(OctalTrieTree *trie, char *key) {
 
 	// Search down the trie until the end of string is reached
 
-	node = trie->root;
+	node = AtomicGet(&trie->root);
 	for (p = key; *p != '\0'; ++p) {
 
 		if (node == NULL) {
@@ -857,69 +1853,52 @@ OctalTrieTreeNode *ottFindEnd(OctalTrieTree *trie, char *key) {
 			return NULL;
 		}
 
-		// Jump to the next node
-		node = node->next[_toOctalIdx(*p)];
+		// Jump to the next node, slots are published by CAS in ottInsert().
+		node = AtomicGet(&node->next[_toOctalIdx(*p)]);
 	}
 
-	if (node == NULL || node->inUse == 0)
+	if (node == NULL || AtomicGet(&node->inUse) == 0)
 		return NULL;
 
 	return node;
 }
 
 /*
- * Function _ottRollback is private to this file.
+ * Function _ottRelease is private to this file.
+ * Drops the use counts of the first depth nodes of key.  A node whose
+ * count reaches 0 has no key left under it and no writer holding it, it
+ * is unlinked from its parent and retired.  The walk goes on through it,
+ * the nodes below that key still holds stay linked to it until they go.
  */
-static void _ottRollback(OctalTrieTree *trie, char *key) {
+static void _ottRelease(OctalTrieTree *trie, char *key, int depth) {
+	OctalTrieTreeNode **rover = &trie->root;
 	OctalTrieTreeNode *node;
-	OctalTrieTreeNode **prev_ptr;
-	OctalTrieTreeNode *next_node;
-	OctalTrieTreeNode **next_prev_ptr;
-	char *p = NULL;
-
-	// Follow the chain along.  We know that we will never reach the
-	// end of the string because ottInsert never got that far.  As a
-	// result, it is not necessary to check for the end of string
-	// delimiter (NUL)
-
-	node = trie->root;
-	prev_ptr = &trie->root;
-	p = key;
-
-	while (node != NULL) {
-
-		/* Find the next node now. We might free this node. */
-
-		next_prev_ptr = &node->next[_toOctalIdx(*p)];
-		next_node = *next_prev_ptr;
-		++p;
-
-		// Decrease the use count and free the node if it
-		// reaches zero.
-
-		AtomicSub(&node->useCount, 1);
+	char *p;
 
-		if (node->useCount == 0) {
-			free(node);
+	for (p = key; p - key < depth; ++p) {
+		node = AtomicGet(rover);
 
-			if (prev_ptr != NULL) {
-				*prev_ptr = NULL;
-			}
+		if (AtomicSub(&node->useCount, 1) == 0) {
+			OctalTrieTreeNode *expect = node;
+			OctalTrieTreeNode *none = NULL;
 
-			next_prev_ptr = NULL;
+			// An insert that found it dead may have unlinked it already.
+			AtomicExchange(rover, &expect, &none);
+			mpRetire(trie->pool, node, sizeof(OctalTrieTreeNode) + (node->slot ? sizeof(MpValSlot_t) : 0));
 		}
 
-		/* Update pointers */
+		if (*p == '\0')
+			break;
 
-		node = next_node;
-		prev_ptr = next_prev_ptr;
+		rover = &node->next[_toOctalIdx(*p)];
 	}
 }
 
 /*
  * Function ottInsert is used to insert data into trie tree.
+ * dataRef - if not NULL, set to the address of the end node's data pointer.
  */
-int ottInsert(OctalTrieTree *trie, char *key, void *value, int valueLen) {
+int ottInsert(OctalTrieTree *trie, char *key, void *value, int valueLen, void ***dataRef) {
 	OctalTrieTreeNode **rover;
 	OctalTrieTreeNode *node;
 	char *p = key;
@@ -942,52 +1921,95 @@ int ottInsert(OctalTrieTree *trie, char *key, void *value, int valueLen) {
 	rover = &trie->root;
 
 	OctalTrieTreeNode *tmp = NULL;
+	size_t tmpSize = 0;
+	size_t size;
 
 	for (;;) {
 
-		node = *rover;
+		node = AtomicGet(rover);
+
+		if (node != NULL && _trieHold(&node->useCount) == 0) {
+			// The last key under node is gone and it is being retired,
+			// unlink it and put a new node in its place.
+			OctalTrieTreeNode *expect = node;
+			OctalTrieTreeNode *none = NULL;
+
+			AtomicExchange(rover, &expect, &none);
+			continue;
+		}
 
-		if (tmp == NULL) {
-            // tmp will be freed if it is unused at end of loop.
-            tmp = (OctalTrieTreeNode *) calloc(1, sizeof(OctalTrieTreeNode));
-            if (tmp != NULL)
-                tmp->inUse = 1;
-        }
+		if (node == NULL) {
+			// The node a key ends in gets room for a short value.
+			size = sizeof(OctalTrieTreeNode) + ((*p == '\0') ? sizeof(MpValSlot_t) : 0);
+			if (tmp != NULL && tmpSize != size) {
+				mpFree(trie->pool, tmp, tmpSize);
+				tmp = NULL;
+			}
+			if (tmp == NULL) {
+				// tmp will be freed if it is unused at end of loop.
+				tmp = (OctalTrieTreeNode *) mpAlloc(trie->pool, size);
+				tmpSize = size;
+				if (tmp != NULL) {
+					tmp->inUse = 1;
+					tmp->useCount = 1;		// held by this writer once published.
+					tmp->slot = (size != sizeof(OctalTrieTreeNode));
+				}
+			}
 
-        if (tmp == NULL) {
-            // Allocation failed.  Go back and undo
-            // what we have done so far.
-            _ottRollback(trie, key);
+			if (tmp == NULL) {
+				// Allocation failed.  Go back and undo
+				// what we have done so far.
+				_ottRelease(trie, key, p - key);
 
-            return ret;
-        }
+				return ret;
+			}
 
-        OctalTrieTreeNode *expect = NULL;
+			OctalTrieTreeNode *expect = NULL;
 
-        // Trying to avoid locks here.
-        if (AtomicExchange(&node, &expect, &tmp) == 1) {
-            *rover = tmp;
-            tmp = NULL;     // Set tmp so another will be allocated.
-        } else {
-            // Another thread beat us in adding node.
-            // Do not free tmp here.
-        }
+			// Publish tmp in the parent's slot.  If another writer got
+			// there first hold its node and keep tmp for the next level.
+			if (AtomicExchange(rover, &expect, &tmp) == 0)
+				continue;
 
-        // Increase the node useCount
-        AtomicAdd(&node->useCount, 1);
+			node = tmp;
+			tmp = NULL;     // Set tmp so another will be allocated.
+		}
 
 		// Reached the end of string?  If so, we're finished.
 		if (*p == '\0') {
-			if (node->data != NULL) {
-				free(node->data);
-				node->data = NULL;
+			void *data = NULL;
+
+			if (valueLen == MP_VAL_OWNED)
+				data = value;		// already in the pool, taken as is.
+			else if (node->slot)
+				data = mpValInline(node->val, value, valueLen);
+
+			if (data == NULL) {
+				data = mpValAlloc(trie->pool, valueLen);
+				if (data == NULL) {
+					_ottRelease(trie, key, p - key + 1);
+					break;
+				}
+				memcpy((char *)data, (char *)value, valueLen);
+			}
+
+			// Swap the value in whole, a reader sees the old or the new
+			// value.  Only one writer of a new key sees NULL here.
+			void *old = AtomicFetchSet(&node->data, data);
+
+			if (old != NULL) {
+				mpValRetire(trie->pool, old);
 				ret = 2;
 			} else {
 				ret = 1;
 			}
-			node->data = (void *)calloc(1, valueLen + 1);
-			memcpy((char *)node->data, (char *)value, valueLen);
-			AtomicAdd(&node->inUse, 1);
+			AtomicSet(&node->inUse, 1);
+			if (dataRef != NULL)
+				*dataRef = &node->data;
+
+			// The nodes are counted once per key, an update lets go.
+			if (ret == 2)
+				_ottRelease(trie, key, p - key + 1);
 			break;
 		}
 
@@ -997,54 +2019,217 @@ int ottInsert(OctalTrieTree *trie, char *key, void *value, int valueLen) {
 	}
 
 	if (tmp != NULL)
-		free(tmp);
+		mpFree(trie->pool, tmp, tmpSize);
 
 	return ret;
 }
 
-int ottDelete(OctalTrieTree *trie, char *key) {
+/*
+ * Function ottAppend is ottInsert() for keys added in sorted order to a
+ * trie no other thread can see yet, it is used by the bulk loaders.
+ * path[i] is the node reached after i bytes of the last key added and
+ * depth is the number of bytes key shares with it, or -1 for the first
+ * key.  The walk starts at path[depth] instead of the root, so a run of
+ * keys with a long common prefix does not walk it again.  path must have
+ * room for strlen(key) + 1 nodes and is set for key.
+ */
+int ottAppend(OctalTrieTree *trie, OctalTrieTreeNode **path, int depth, char *key, void *value, int valueLen, void ***dataRef) {
+	OctalTrieTreeNode **rover;
 	OctalTrieTreeNode *node;
+	size_t size;
+	char *p;
+	int i;
 
 	if (_octalTrieTreeInit == 0) {
 		pErr("Must call ottInit() first.\n");
-		return -1;
+		return 0;
 	}
 
-	node = ottFindEnd(trie, key);
+	/* Cannot insert NULL values */
 
-	if (node != NULL) {
-		if (node->data != NULL) {
-			free(node->data);
-			node->data = NULL;
-		}
-		if (node->useCount > 0)
-			node->useCount--;
-		if (node->useCount == 0)
-			node->inUse = 0;
-	} else {
-		return -1;		// record not found.
+	if (value == TRIE_NULL) {
+		return 0;
 	}
 
-	return 0;
-}
-
-void *ottLookup(OctalTrieTree *trie, char *key) {
-	OctalTrieTreeNode *node;
-
-	if (_octalTrieTreeInit == 0) {
-		pErr("Must call ottInit() first.\n");
-		return NULL;
+	if (depth < 0 || trie->root == NULL) {
+		rover = &trie->root;
+		depth = 0;
+	} else {
+		// The shared nodes are counted without walking down to them.
+		for (i = 0; i < depth; i++)
+			path[i]->useCount++;
+		rover = (depth == 0) ? &trie->root : &path[depth - 1]->next[_toOctalIdx(key[depth - 1])];
 	}
 
-	node = ottFindEnd(trie, key);
+	for (p = key + depth;; ++p) {
 
-	if (node != NULL) {
-		return node->data;
+		node = *rover;
+
+		if (node == NULL) {
+			// The node a key ends in gets room for a short value.
+			size = sizeof(OctalTrieTreeNode) + ((*p == '\0') ? sizeof(MpValSlot_t) : 0);
+			node = (OctalTrieTreeNode *) mpAlloc(trie->pool, size);
+			if (node == NULL) {
+				_ottRelease(trie, key, p - key);
+				return 0;
+			}
+			node->inUse = 1;
+			node->slot = (*p == '\0');
+			*rover = node;
+		}
+
+		node->useCount++;
+		path[p - key] = node;
+
+		if (*p == '\0')
+			break;
+
+		rover = &node->next[_toOctalIdx(*p)];
+	}
+
+	void *data = NULL;
+
+	if (valueLen == MP_VAL_OWNED)
+		data = value;		// already in the pool, taken as is.
+	else if (node->slot)
+		data = mpValInline(node->val, value, valueLen);
+
+	if (data == NULL) {
+		data = mpValAlloc(trie->pool, valueLen);
+		if (data == NULL) {
+			_ottRelease(trie, key, p - key + 1);
+			return 0;
+		}
+		memcpy((char *)data, (char *)value, valueLen);
+	}
+
+	// A key given twice keeps the last value.
+	void *old = node->data;
+
+	node->data = data;
+	node->inUse = 1;
+	if (dataRef != NULL)
+		*dataRef = &node->data;
+
+	if (old != NULL) {
+		mpValRetire(trie->pool, old);
+		_ottRelease(trie, key, p - key + 1);
+		return 2;
+	}
+
+	return 1;
+}
+
+int ottDelete(OctalTrieTree *trie, char *key) {
+	OctalTrieTreeNode *node;
+	void *data;
+
+	if (_octalTrieTreeInit == 0) {
+		pErr("Must call ottInit() first.\n");
+		return -1;
+	}
+
+	node = ottFindEnd(trie, key);
+
+	if (node == NULL)
+		return -1;		// record not found.
+
+	// Only the writer that takes the value out owns the delete.
+	data = AtomicFetchSet(&node->data, NULL);
+	if (data == NULL)
+		return -1;		// already deleted.
+
+	mpValRetire(trie->pool, data);
+
+	// The key's nodes, the ones left with no key under them are retired.
+	_ottRelease(trie, key, strlen(key) + 1);
+
+	return 0;
+}
+
+void *ottLookup(OctalTrieTree *trie, char *key) {
+	OctalTrieTreeNode *node;
+
+	if (_octalTrieTreeInit == 0) {
+		pErr("Must call ottInit() first.\n");
+		return NULL;
+	}
+
+	node = ottFindEnd(trie, key);
+
+	if (node != NULL) {
+		return AtomicGet(&node->data);
 	} else {
 		return TRIE_NULL;
 	}
 }
 
+/*
+ * Function ottLookupMany looks up n keys, out[i] is set to the data of
+ * keys[i] or NULL.  Up to TRIE_GROUP lookups walk down the trie together
+ * a level at a time and the slot each one reads next is prefetched, so
+ * their cache misses overlap instead of coming one after another.  A
+ * lookup that finishes hands its place to the next key.
+ * Returns the number of keys found.
+ */
+int ottLookupMany(OctalTrieTree *trie, char **keys, int n, void **out) {
+	OctalTrieTreeNode *node[TRIE_GROUP];
+	OctalTrieTreeNode *root;
+	char *p[TRIE_GROUP];
+	int which[TRIE_GROUP];
+	int live = 0;
+	int next = 0;
+	int found = 0;
+	int i;
+
+	if (_octalTrieTreeInit == 0) {
+		pErr("Must call ottInit() first.\n");
+		return 0;
+	}
+
+	root = AtomicGet(&trie->root);
+
+	while (live < TRIE_GROUP && next < n) {
+		node[live] = root;
+		p[live] = keys[next];
+		which[live++] = next++;
+	}
+
+	while (live > 0) {
+		for (i = 0; i < live;) {
+			OctalTrieTreeNode *nd = node[i];
+
+			if (nd != NULL && *p[i] != '\0') {
+				nd = AtomicGet(&nd->next[_toOctalIdx(*p[i])]);
+				node[i] = nd;
+				p[i]++;
+				if (nd != NULL)
+					__builtin_prefetch((*p[i] != '\0') ? (void *)&nd->next[_toOctalIdx(*p[i])] : (void *)nd);
+				i++;
+				continue;
+			}
+
+			out[which[i]] = (nd != NULL && AtomicGet(&nd->inUse) != 0) ? AtomicGet(&nd->data) : TRIE_NULL;
+			if (out[which[i]] != TRIE_NULL)
+				found++;
+
+			if (next < n) {
+				node[i] = root;
+				p[i] = keys[next];
+				which[i++] = next++;
+			} else {
+				// Close the gap with the last lookup.
+				live--;
+				node[i] = node[live];
+				p[i] = p[live];
+				which[i] = which[live];
+			}
+		}
+	}
+
+	return found;
+}
+
 int ottNumEntries(OctalTrieTree *trie) {
 	// To find the number of entries, simply look at the use count
 	// of the root node.
@@ -1060,3 +2245,1023 @@ int ottNumEntries(OctalTrieTree *trie) {
 		return AtomicGet(&trie->root->useCount);
 	}
 }
+
+/*
+ * Function _ottMove is private to this file.
+ * Copies the node in the slot at rover, and its value, to new memory if
+ * the pool is evacuating them.  depth is the node's level in tc.
+ * Returns the node as it is now or NULL if out of memory.
+ */
+static OctalTrieTreeNode *_ottMove(OctalTrieTree *trie, OctalTrieTreeNode **rover, TrieCursor_t *tc, int depth, TrieMovedFn_t moved, void *ctx) {
+	OctalTrieTreeNode *node = *rover;
+	OctalTrieTreeNode *copy;
+	size_t size = sizeof(OctalTrieTreeNode) + (node->slot ? sizeof(MpValSlot_t) : 0);
+	void *data;
+
+	if (mpEvacuating(trie->pool, node)) {
+		copy = (OctalTrieTreeNode *) mpAlloc(trie->pool, size);
+		if (copy == NULL)
+			return NULL;
+		memcpy(copy, node, size);
+
+		// A short value is kept in the node and moves with it.
+		data = copy->data;
+		if (data != NULL && (char *)data >= (char *)node && (char *)data < (char *)node + size)
+			copy->data = (char *)copy + ((char *)data - (char *)node);
+
+		// Readers still in the old node see it as it was.
+		AtomicSet(rover, copy);
+		if (copy->data != NULL)
+			moved(ctx, _trieKey(tc, depth, _decDigits), &node->data, &copy->data);
+		node = copy;
+	}
+
+	// The value goes right after its node.
+	data = mpValMove(trie->pool, node->data);
+	if (data == NULL && node->data != NULL)
+		return NULL;
+	if (data != node->data)
+		AtomicSet(&node->data, data);
+
+	return node;
+}
+
+/*
+ * Function ottCompact copies the nodes the pool is evacuating, and their
+ * values, to new memory.  It visits up to budget nodes depth first from
+ * where tc was left, so the copies are laid out in the order lookups
+ * and walks go through them.  moved(ctx, key, old, ref) is called for
+ * each key whose data pointer moved.  Other writers must be kept out,
+ * readers need not be.  Returns 1 if there are nodes left, 0 when the
+ * trie is done or -1 if out of memory, a new call goes on from there.
+ */
+int ottCompact(OctalTrieTree *trie, TrieCursor_t *tc, int budget, TrieMovedFn_t moved, void *ctx) {
+	OctalTrieTreeNode **rover = &trie->root;
+	OctalTrieTreeNode *node;
+	int depth, i;
+
+	if (_octalTrieTreeInit == 0) {
+		pErr("Must call ottInit() first.\n");
+		return -1;
+	}
+
+	// Back down to where the last call stopped, the nodes above it
+	// are done.  If the node there is gone the walk goes on after it.
+	for (depth = 0; depth < tc->len && *rover != NULL; depth++) {
+		tc->path[depth] = *rover;
+		rover = &(*rover)->next[tc->idx[depth]];
+	}
+
+	for (;;) {
+		if (*rover != NULL) {
+			if (budget-- <= 0)
+				break;
+			if (_trieCursorGrow(tc, depth + 1, depth) != 0) {
+				tc->len = depth;
+				return -1;
+			}
+			node = _ottMove(trie, rover, tc, depth, moved, ctx);
+			if (node == NULL) {
+				tc->len = depth;
+				return -1;
+			}
+			tc->path[depth] = node;
+
+			for (i = 0; i < 8 && node->next[i] == NULL; i++)
+				;
+			if (i < 8) {
+				tc->idx[depth++] = i;
+				rover = &node->next[i];
+				continue;
+			}
+		}
+
+		// On to the next child of the nearest level that has one.
+		for (;;) {
+			if (depth == 0) {
+				tc->len = 0;
+				return 0;
+			}
+			node = (OctalTrieTreeNode *) tc->path[depth - 1];
+			for (i = tc->idx[depth - 1] + 1; i < 8 && node->next[i] == NULL; i++)
+				;
+			if (i < 8)
+				break;
+			depth--;
+		}
+		tc->idx[depth - 1] = i;
+		rover = &node->next[i];
+	}
+
+	tc->len = depth;
+
+	return 1;
+}
+
+int _wideTrieTreeInit = 0;
+
+#define WTT_IS_LEAF(x)		(((uintptr_t)(x) & 1))
+#define WTT_SET_LEAF(x)		((WideTrieTreeNode *)((uintptr_t)(x) | 1))
+#define WTT_LEAF_RAW(x)		((WideTrieTreeLeaf *)((uintptr_t)(x) & ~(uintptr_t)1))
+
+/*
+ * Function _wttLayout is private to this file.
+ * Sets the child layout of a trie with stride digits per level.  Returns
+ * -1 if dbType can not be split that way.
+ */
+static int _wttLayout(WideTrieTree *trie, DbTypes_t dbType, int stride) {
+	int i, n, off;
+
+	if (dbType == HEX_DB)
+		trie->radix = 16;
+	else if (dbType == OCTAL_DB)
+		trie->radix = 8;
+	else
+		return -1;
+
+	if (stride < 1 || stride > TRIE_MAX_STRIDE)
+		return -1;
+
+	trie->dbType = dbType;
+	trie->stride = stride;
+
+	// Full runs first, in key order, then the shorter runs longest first.
+	for (i = 0, n = 1; i < stride; i++)
+		n *= trie->radix;
+	trie->base[stride] = 0;
+	off = n;
+	for (i = stride - 1; i > 0; i--) {
+		n /= trie->radix;
+		trie->base[i] = off;
+		off += n;
+	}
+	trie->fanOut = off;
+	trie->nodeSize = sizeof(WideTrieTreeNode) + off * sizeof(WideTrieTreeNode *);
+
+	if (trie->nodeSize > MP_MAX_SIZE)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Function wttNodeSize returns the size of a node of a trie with stride
+ * digits per level, or 0 if dbType can not be split that way.
+ */
+size_t wttNodeSize(DbTypes_t dbType, int stride) {
+	WideTrieTree t;
+
+	if (_wttLayout(&t, dbType, stride) != 0)
+		return 0;
+
+	return t.nodeSize;
+}
+
+WideTrieTree *wttInit(MemPool_t *pool, DbTypes_t dbType, int stride) {
+
+	WideTrieTree *wttRoot = (WideTrieTree *) calloc(1, sizeof(WideTrieTree));
+	if (wttRoot == NULL)
+		return NULL;
+	if (_wttLayout(wttRoot, dbType, stride) != 0) {
+		free(wttRoot);
+		return NULL;
+	}
+	wttRoot->pool = pool;
+
+	// Nodes and leaves get their own size classes.
+	mpAddClass(pool, wttRoot->nodeSize);
+	mpAddClass(pool, sizeof(WideTrieTreeLeaf));
+
+	// The root is always there, the empty key ends in it.
+	wttRoot->root = (WideTrieTreeNode *) mpAlloc(pool, wttRoot->nodeSize);
+	if (wttRoot->root == NULL) {
+		free(wttRoot);
+		return NULL;
+	}
+
+	_wideTrieTreeInit = 1;
+
+	return wttRoot;
+}
+
+/*
+ * Function _wttIdx is private to this file.
+ * Returns the child for the next run of digits of p and sets *used to
+ * the number of digits in it.  Hex digits are folded to one case as
+ * they are combined.
+ */
+static inline int _wttIdx(WideTrieTree *trie, const char *p, int *used) {
+	// Keys are checked by keyCheck() before they get here.
+	const unsigned char *map = keyIdxMap[trie->dbType];
+	int idx = 0;
+	int i;
+
+	for (i = 0; i < trie->stride && p[i] != '\0'; i++)
+		idx = idx * trie->radix + map[(unsigned char)p[i]];
+
+	*used = i;
+
+	return trie->base[i] + idx;
+}
+
+/*
+ * Function to find the leaf of a key, NULL if the key was never added.
+ */
+WideTrieTreeLeaf *wttFindEnd(WideTrieTree *trie, char *key) {
+	WideTrieTreeNode *node;
+	char *p;
+	int used;
+
+	if (_wideTrieTreeInit == 0) {
+		pErr("Must call wttInit() first.\n");
+		return NULL;
+	}
+
+	// The root only moves in wttCompact().
+	node = AtomicGet(&trie->root);
+
+	for (p = key; *p != '\0';) {
+		// Slots are published by CAS in wttInsert().
+		node = AtomicGet(&node->next[_wttIdx(trie, p, &used)]);
+		p += used;
+
+		if (node == NULL)
+			return NULL;
+		if (WTT_IS_LEAF(node))
+			return (*p == '\0') ? WTT_LEAF_RAW(node) : NULL;
+	}
+
+	return AtomicGet(&node->leaf);
+}
+
+/*
+ * Function _wttLeafGone is private to this file.
+ * Unlinks leaf, the leaf of the first len digits of key, when its
+ * useCount has reached 0 and retires it.  Nobody can hold or move a
+ * leaf at 0, it is where the walk finds it or in a node that is gone.
+ */
+static void _wttLeafGone(WideTrieTree *trie, WideTrieTreeLeaf *leaf, char *key, int len) {
+	const unsigned char *map = keyIdxMap[trie->dbType];
+	WideTrieTreeNode *node = AtomicGet(&trie->root);
+	WideTrieTreeNode **slot;
+	WideTrieTreeNode *child;
+	WideTrieTreeNode *none = NULL;
+	WideTrieTreeLeaf *expect = leaf;
+	WideTrieTreeLeaf *noLeaf = NULL;
+	int pos = 0;
+	int i, n, idx;
+
+	for (;;) {
+		if (pos == len) {
+			AtomicExchange(&node->leaf, &expect, &noLeaf);
+			break;
+		}
+
+		n = (len - pos < trie->stride) ? len - pos : trie->stride;
+		for (i = 0, idx = 0; i < n; i++)
+			idx = idx * trie->radix + map[(unsigned char)key[pos + i]];
+		slot = &node->next[trie->base[n] + idx];
+		pos += n;
+
+		child = AtomicGet(slot);
+		if (child == NULL)
+			break;
+		if (WTT_IS_LEAF(child)) {
+			if (child == WTT_SET_LEAF(leaf))
+				AtomicExchange(slot, &child, &none);
+			break;
+		}
+		node = child;
+	}
+
+	mpRetire(trie->pool, leaf, sizeof(WideTrieTreeLeaf));
+}
+
+/*
+ * Function _wttLeafDrop is private to this file.
+ * Takes one off the useCount of leaf, the leaf of the first len digits
+ * of key.  The writer that takes it to 0 frees it.
+ */
+static inline void _wttLeafDrop(WideTrieTree *trie, WideTrieTreeLeaf *leaf, char *key, int len) {
+
+	if (AtomicSub(&leaf->useCount, 1) == 0)
+		_wttLeafGone(trie, leaf, key, len);
+}
+
+/*
+ * Function _wttPutBack is private to this file.
+ * Puts the leaf of node, which reached a useCount of 0, back in the slot
+ * at rover, the first len digits of key.  A leaf whose key has gone too
+ * is left out, the slot is emptied.
+ */
+static void _wttPutBack(WideTrieTree *trie, WideTrieTreeNode **rover, WideTrieTreeNode *node, char *key, int len) {
+	WideTrieTreeLeaf *leaf = AtomicGet(&node->leaf);
+	WideTrieTreeNode *expect = node;
+	WideTrieTreeNode *back;
+
+	if (leaf != NULL && _trieHold(&leaf->useCount) == 0)
+		leaf = NULL;
+
+	back = (leaf != NULL) ? WTT_SET_LEAF(leaf) : NULL;
+	AtomicExchange(rover, &expect, &back);
+
+	if (leaf != NULL)
+		_wttLeafDrop(trie, leaf, key, len);
+}
+
+/*
+ * Function _wttDrop is private to this file.
+ * Takes one off the useCount of node, found in the slot at rover, the
+ * first len digits of key.  A node's count is the keys under its slots
+ * and the writers holding it, the key of its own leaf is counted above
+ * it.  At 0 the slot gets the node's leaf back and the node is retired,
+ * the leaves in its slots went with the deletes of their keys.  The root
+ * is never retired.
+ */
+static void _wttDrop(WideTrieTree *trie, WideTrieTreeNode **rover, WideTrieTreeNode *node, char *key, int len) {
+
+	if (AtomicSub(&node->useCount, 1) != 0 || node == trie->root)
+		return;
+
+	// An insert that found it dead may have put the leaf back already.
+	_wttPutBack(trie, rover, node, key, len);
+
+	mpRetire(trie->pool, node, trie->nodeSize);
+}
+
+/*
+ * Function _wttRelease is private to this file.
+ * Drops the use counts of depth levels of key, depth is in levels not
+ * digits and rover is the slot of the first one, reached after pos
+ * digits.  The deepest goes first, so a node is retired after the nodes
+ * under it have given their leaves back to its slots.
+ */
+static void _wttRelease(WideTrieTree *trie, WideTrieTreeNode **rover, char *key, int pos, int depth) {
+	WideTrieTreeNode *node = AtomicGet(rover);
+	int idx, used;
+
+	if (depth > 1 && key[pos] != '\0') {
+		idx = _wttIdx(trie, key + pos, &used);
+		_wttRelease(trie, &node->next[idx], key, pos + used, depth - 1);
+	}
+
+	_wttDrop(trie, rover, node, key, pos);
+}
+
+/*
+ * Function _wttLevels is private to this file.
+ * Returns the number of levels a key counts, the nodes above the slot
+ * it ends in.  The empty key ends in the root and counts it.
+ */
+static inline int _wttLevels(WideTrieTree *trie, char *key) {
+	int n = (strlen(key) + trie->stride - 1) / trie->stride;
+
+	return (n > 0) ? n : 1;
+}
+
+/*
+ * Function _wttNewLeaf is private to this file.
+ * Returns a leaf held by the writer that made it, NULL if out of memory.
+ */
+static inline WideTrieTreeLeaf *_wttNewLeaf(WideTrieTree *trie) {
+	WideTrieTreeLeaf *leaf = (WideTrieTreeLeaf *) mpAlloc(trie->pool, sizeof(WideTrieTreeLeaf));
+
+	if (leaf != NULL)
+		leaf->useCount = 1;
+
+	return leaf;
+}
+
+/*
+ * Function _wttStore is private to this file.
+ * Puts value in leaf.  Returns 1 if the key is new, 2 if it was updated
+ * and 0 on error.
+ */
+static int _wttStore(WideTrieTree *trie, WideTrieTreeLeaf *leaf, void *value, int valueLen, void ***dataRef) {
+	void *data = NULL;
+
+	if (valueLen == MP_VAL_OWNED)
+		data = value;		// already in the pool, taken as is.
+	else
+		data = mpValInline(&leaf->val, value, valueLen);
+
+	if (data == NULL) {
+		data = mpValAlloc(trie->pool, valueLen);
+		if (data == NULL)
+			return 0;
+		memcpy((char *)data, (char *)value, valueLen);
+	}
+
+	// Swap the value in whole, a reader sees the old or the new
+	// value.  Only one writer of a new key sees NULL here.
+	void *old = AtomicFetchSet(&leaf->data, data);
+
+	if (dataRef != NULL)
+		*dataRef = &leaf->data;
+
+	if (old != NULL) {
+		mpValRetire(trie->pool, old);
+		return 2;
+	}
+
+	return 1;
+}
+
+/*
+ * Function wttInsert is used to insert data into trie tree.
+ * dataRef - if not NULL, set to the address of the leaf's data pointer.
+ */
+int wttInsert(WideTrieTree *trie, char *key, void *value, int valueLen, void ***dataRef) {
+	WideTrieTreeNode **rover;
+	WideTrieTreeNode *node;
+	WideTrieTreeNode *child;
+	WideTrieTreeNode *tmpNode = NULL;
+	WideTrieTreeLeaf *tmpLeaf = NULL;
+	WideTrieTreeLeaf *leaf = NULL;
+	char *p = key;
+	int level = 1;
+	int own = 0;
+	int used;
+	int ret = 0;
+
+	if (_wideTrieTreeInit == 0) {
+		pErr("Must call wttInit() first.\n");
+		return ret;
+	}
+
+	/* Cannot insert NULL values */
+
+	if (value == TRIE_NULL) {
+		return ret;
+	}
+
+	// The root is never retired, it can be held without a check.
+	rover = &trie->root;
+	node = trie->root;
+	AtomicAdd(&node->useCount, 1);
+
+	for (;;) {
+		if (*p == '\0') {
+			// The key ends in this node, give it a leaf.
+			own = 1;
+			leaf = AtomicGet(&node->leaf);
+			for (;;) {
+				if (leaf == NULL) {
+					if (tmpLeaf == NULL && (tmpLeaf = _wttNewLeaf(trie)) == NULL)
+						break;
+					if (AtomicExchange(&node->leaf, &leaf, &tmpLeaf) == 1) {
+						leaf = tmpLeaf;
+						tmpLeaf = NULL;
+						break;
+					}
+				} else if (_trieHold(&leaf->useCount) != 0) {
+					break;
+				} else {
+					// Its key is gone and it is being freed, take it out.
+					WideTrieTreeLeaf *none = NULL;
+
+					if (AtomicExchange(&node->leaf, &leaf, &none) == 1)
+						leaf = NULL;
+				}
+			}
+			break;
+		}
+
+		rover = &node->next[_wttIdx(trie, p, &used)];
+		p += used;
+
+		child = AtomicGet(rover);
+
+		for (;;) {
+			WideTrieTreeNode *expect = child;
+
+			if (*p == '\0' && child == NULL) {
+				// Last digits, the key ends in a leaf in the slot.
+				if (tmpLeaf == NULL && (tmpLeaf = _wttNewLeaf(trie)) == NULL)
+					break;
+				WideTrieTreeNode *tagged = WTT_SET_LEAF(tmpLeaf);
+
+				if (AtomicExchange(rover, &expect, &tagged) == 1) {
+					leaf = tmpLeaf;
+					tmpLeaf = NULL;
+					break;
+				}
+			} else if (*p == '\0' && WTT_IS_LEAF(child)) {
+				if (_trieHold(&WTT_LEAF_RAW(child)->useCount) != 0) {
+					leaf = WTT_LEAF_RAW(child);
+					break;
+				}
+
+				// Its key is gone and it is being freed, take it out.
+				WideTrieTreeNode *none = NULL;
+
+				AtomicExchange(rover, &expect, &none);
+				expect = AtomicGet(rover);
+			} else if (child == NULL || WTT_IS_LEAF(child)) {
+				// The key goes on, a node takes the slot and keeps the
+				// leaf that was there unless its key is gone.
+				WideTrieTreeLeaf *keep = (child != NULL) ? WTT_LEAF_RAW(child) : NULL;
+				int moved;
+
+				if (tmpNode == NULL)
+					tmpNode = (WideTrieTreeNode *) mpAlloc(trie->pool, trie->nodeSize);
+				if (tmpNode == NULL)
+					break;
+				if (keep != NULL && _trieHold(&keep->useCount) == 0)
+					keep = NULL;
+				tmpNode->leaf = keep;
+				tmpNode->useCount = 1;		// held by this writer once published.
+
+				moved = AtomicExchange(rover, &expect, &tmpNode);
+				if (keep != NULL)
+					_wttLeafDrop(trie, keep, key, p - key);
+				if (moved == 1) {
+					child = tmpNode;
+					tmpNode = NULL;
+					break;
+				}
+			} else if (_trieHold(&child->useCount) != 0) {
+				break;
+			} else {
+				// The last key under child is gone and it is being
+				// retired, put its leaf back in the slot.
+				_wttPutBack(trie, rover, child, key, p - key);
+				expect = AtomicGet(rover);
+			}
+
+			// Another writer changed the slot, look again.
+			child = expect;
+		}
+
+		if (leaf != NULL || child == NULL || WTT_IS_LEAF(child))
+			break;
+
+		// Advance to the next node in the chain
+		node = child;
+		level++;
+	}
+
+	if (leaf != NULL) {
+		ret = _wttStore(trie, leaf, value, valueLen, dataRef);
+
+		// The hold on a new key's leaf is the count of the key.
+		if (ret != 1)
+			_wttLeafDrop(trie, leaf, key, p - key);
+	}
+
+	if (ret == 1 && own) {
+		// The key is counted above the node whose leaf it is in.
+		if (node != trie->root)
+			_wttDrop(trie, rover, node, key, p - key);
+	} else if (ret != 1) {
+		// Updated, or allocation failed.  Undo what we have done so far.
+		_wttRelease(trie, &trie->root, key, 0, level);
+	}
+
+	if (tmpNode != NULL)
+		mpFree(trie->pool, tmpNode, trie->nodeSize);
+	if (tmpLeaf != NULL)
+		mpFree(trie->pool, tmpLeaf, sizeof(WideTrieTreeLeaf));
+
+	return ret;
+}
+
+/*
+ * Function wttAppend is wttInsert() for keys added in sorted order to a
+ * trie no other thread can see yet, see httAppend().  depth is still the
+ * number of digits key shares with the last key, path[i] is the node
+ * reached after i runs of digits.
+ */
+int wttAppend(WideTrieTree *trie, WideTrieTreeNode **path, int depth, char *key, void *value, int valueLen, void ***dataRef) {
+	WideTrieTreeNode **rover;
+	WideTrieTreeNode *node;
+	WideTrieTreeNode *child;
+	WideTrieTreeLeaf *leaf;
+	char *p;
+	int level = 0;
+	int held = 0;
+	int used;
+	int ret;
+	int i;
+
+	if (_wideTrieTreeInit == 0) {
+		pErr("Must call wttInit() first.\n");
+		return 0;
+	}
+
+	/* Cannot insert NULL values */
+
+	if (value == TRIE_NULL) {
+		return 0;
+	}
+
+	node = trie->root;
+
+	if (depth > 0) {
+		// The levels of whole runs both keys share are counted without
+		// walking down to them, the walk starts in the last one.  The
+		// last key went through it, it is a node.
+		level = depth / trie->stride;
+		if (level > 0) {
+			for (i = 0; i < level - 1; i++)
+				path[i]->useCount++;
+			node = path[level - 1];
+			level--;
+			held = level;
+		}
+	}
+
+	for (p = key + level * trie->stride;; p += used) {
+
+		path[level++] = node;
+
+		if (*p == '\0') {
+			// The key is counted above the node whose leaf it is in,
+			// the empty key in the root.
+			if (node == trie->root) {
+				node->useCount++;
+				held++;
+			}
+			leaf = node->leaf;
+			if (leaf == NULL) {
+				leaf = (WideTrieTreeLeaf *) mpAlloc(trie->pool, sizeof(WideTrieTreeLeaf));
+				if (leaf == NULL)
+					break;
+				node->leaf = leaf;
+			}
+			break;
+		}
+
+		node->useCount++;
+		held++;
+
+		rover = &node->next[_wttIdx(trie, p, &used)];
+		child = *rover;
+
+		if (p[used] == '\0' && (child == NULL || WTT_IS_LEAF(child))) {
+			leaf = (child != NULL) ? WTT_LEAF_RAW(child) : (WideTrieTreeLeaf *) mpAlloc(trie->pool, sizeof(WideTrieTreeLeaf));
+			if (leaf != NULL)
+				*rover = WTT_SET_LEAF(leaf);
+			break;
+		}
+
+		if (child == NULL || WTT_IS_LEAF(child)) {
+			node = (WideTrieTreeNode *) mpAlloc(trie->pool, trie->nodeSize);
+			if (node == NULL) {
+				leaf = NULL;
+				break;
+			}
+			node->leaf = (child != NULL) ? WTT_LEAF_RAW(child) : NULL;
+			*rover = node;
+		} else {
+			node = child;
+		}
+	}
+
+	// A key given twice is counted once.
+	ret = (leaf != NULL) ? _wttStore(trie, leaf, value, valueLen, dataRef) : 0;
+	if (ret == 1)
+		leaf->useCount = 1;
+	else
+		_wttRelease(trie, &trie->root, key, 0, held);
+
+	return ret;
+}
+
+int wttDelete(WideTrieTree *trie, char *key) {
+	WideTrieTreeLeaf *leaf;
+	void *data;
+
+	if (_wideTrieTreeInit == 0) {
+		pErr("Must call wttInit() first.\n");
+		return -1;
+	}
+
+	leaf = wttFindEnd(trie, key);
+
+	if (leaf == NULL)
+		return -1;		// record not found.
+
+	// Only the writer that takes the value out owns the delete.
+	data = AtomicFetchSet(&leaf->data, NULL);
+	if (data == NULL)
+		return -1;		// already deleted.
+
+	mpValRetire(trie->pool, data);
+
+	// The key's leaf and nodes, the ones nobody holds any more are freed.
+	_wttLeafDrop(trie, leaf, key, strlen(key));
+	_wttRelease(trie, &trie->root, key, 0, _wttLevels(trie, key));
+
+	return 0;
+}
+
+void *wttLookup(WideTrieTree *trie, char *key) {
+	WideTrieTreeLeaf *leaf;
+
+	if (_wideTrieTreeInit == 0) {
+		pErr("Must call wttInit() first.\n");
+		return NULL;
+	}
+
+	leaf = wttFindEnd(trie, key);
+
+	if (leaf != NULL) {
+		return AtomicGet(&leaf->data);
+	} else {
+		return TRIE_NULL;
+	}
+}
+
+/*
+ * Function wttLookupMany is httLookupMany() for a wide trie.
+ * Returns the number of keys found.
+ */
+int wttLookupMany(WideTrieTree *trie, char **keys, int n, void **out) {
+	WideTrieTreeNode *node[TRIE_GROUP];
+	WideTrieTreeNode *root;
+	WideTrieTreeLeaf *leaf;
+	char *p[TRIE_GROUP];
+	int which[TRIE_GROUP];
+	int live = 0;
+	int next = 0;
+	int found = 0;
+	int used;
+	int i;
+
+	if (_wideTrieTreeInit == 0) {
+		pErr("Must call wttInit() first.\n");
+		return 0;
+	}
+
+	root = AtomicGet(&trie->root);
+
+	while (live < TRIE_GROUP && next < n) {
+		node[live] = root;
+		p[live] = keys[next];
+		which[live++] = next++;
+	}
+
+	while (live > 0) {
+		for (i = 0; i < live;) {
+			WideTrieTreeNode *nd = node[i];
+
+			if (*p[i] != '\0') {
+				nd = AtomicGet(&nd->next[_wttIdx(trie, p[i], &used)]);
+				p[i] += used;
+				if (nd != NULL && !WTT_IS_LEAF(nd)) {
+					node[i] = nd;
+					__builtin_prefetch((*p[i] != '\0') ? (void *)&nd->next[_wttIdx(trie, p[i], &used)] : (void *)nd);
+					i++;
+					continue;
+				}
+				leaf = (nd != NULL && *p[i] == '\0') ? WTT_LEAF_RAW(nd) : NULL;
+			} else {
+				leaf = AtomicGet(&nd->leaf);
+			}
+
+			out[which[i]] = (leaf != NULL) ? AtomicGet(&leaf->data) : TRIE_NULL;
+			if (out[which[i]] != TRIE_NULL)
+				found++;
+
+			if (next < n) {
+				node[i] = root;
+				p[i] = keys[next];
+				which[i++] = next++;
+			} else {
+				// Close the gap with the last lookup.
+				live--;
+				node[i] = node[live];
+				p[i] = p[live];
+				which[i] = which[live];
+			}
+		}
+	}
+
+	return found;
+}
+
+int wttNumEntries(WideTrieTree *trie) {
+	// To find the number of entries, simply look at the use count
+	// of the root node.
+
+	if (_wideTrieTreeInit == 0) {
+		pErr("Must call wttInit() first.\n");
+		return 0;
+	}
+
+	return AtomicGet(&trie->root->useCount);
+}
+
+/*
+ * Function _wttKey is private to this file.
+ * Returns the key of the node depth levels down tc, with the digits of
+ * its child last on the end unless last is -1.
+ */
+static char *_wttKey(WideTrieTree *trie, TrieCursor_t *tc, int depth, int last) {
+	char *p = tc->key;
+	int i, j, n, v, idx;
+
+	for (i = 0; i <= depth; i++) {
+		idx = (i < depth) ? tc->idx[i] : last;
+		if (idx < 0)
+			break;
+
+		// Full runs are first in next[], then the shorter ones.
+		for (n = trie->stride; n > 1 && idx >= trie->base[n - 1]; n--)
+			;
+		for (j = n - 1, v = idx - trie->base[n]; j >= 0; j--, v /= trie->radix)
+			p[j] = _hexDigits[v % trie->radix];
+		p += n;
+	}
+	*p = '\0';
+
+	return tc->key;
+}
+
+/*
+ * Function _wttMoveLeaf is private to this file.
+ * Copies leaf and a short value in it to new memory, the caller puts
+ * the copy where the leaf was.  Returns NULL if out of memory.
+ */
+static WideTrieTreeLeaf *_wttMoveLeaf(WideTrieTree *trie, WideTrieTreeLeaf *leaf) {
+	WideTrieTreeLeaf *copy;
+	void *data;
+
+	copy = (WideTrieTreeLeaf *) mpAlloc(trie->pool, sizeof(WideTrieTreeLeaf));
+	if (copy == NULL)
+		return NULL;
+	memcpy(copy, leaf, sizeof(WideTrieTreeLeaf));
+
+	data = copy->data;
+	if (data != NULL && (char *)data >= (char *)leaf && (char *)data < (char *)(leaf + 1))
+		copy->data = (char *)copy + ((char *)data - (char *)leaf);
+
+	return copy;
+}
+
+/*
+ * Function _wttMoveValue is private to this file.
+ * Moves the value of leaf if the pool is evacuating it.  Returns 0 or
+ * -1 if out of memory.
+ */
+static int _wttMoveValue(WideTrieTree *trie, WideTrieTreeLeaf *leaf) {
+	void *data = mpValMove(trie->pool, leaf->data);
+
+	if (data == NULL && leaf->data != NULL)
+		return -1;
+	if (data != leaf->data)
+		AtomicSet(&leaf->data, data);
+
+	return 0;
+}
+
+/*
+ * Function _wttMoveSlot is private to this file.
+ * Moves the leaf in slot, the child last of the node depth levels down
+ * tc, if the pool is evacuating it.  Returns 0 or -1 if out of memory.
+ */
+static int _wttMoveSlot(WideTrieTree *trie, WideTrieTreeNode **slot, TrieCursor_t *tc, int depth, int last, TrieMovedFn_t moved, void *ctx) {
+	WideTrieTreeLeaf *leaf = WTT_LEAF_RAW(*slot);
+	WideTrieTreeLeaf *copy;
+
+	if (mpEvacuating(trie->pool, leaf)) {
+		copy = _wttMoveLeaf(trie, leaf);
+		if (copy == NULL)
+			return -1;
+		AtomicSet(slot, WTT_SET_LEAF(copy));
+		if (copy->data != NULL)
+			moved(ctx, _wttKey(trie, tc, depth, last), &leaf->data, &copy->data);
+		leaf = copy;
+	}
+
+	return _wttMoveValue(trie, leaf);
+}
+
+/*
+ * Function _wttMove is private to this file.
+ * Copies the node in the slot at rover, and its leaves and values, to
+ * new memory if the pool is evacuating them.  depth is the node's level
+ * in tc.  Returns the node as it is now or NULL if out of memory.
+ */
+static WideTrieTreeNode *_wttMove(WideTrieTree *trie, WideTrieTreeNode **rover, TrieCursor_t *tc, int depth, TrieMovedFn_t moved, void *ctx) {
+	WideTrieTreeNode *node = *rover;
+	WideTrieTreeNode *copy;
+	WideTrieTreeLeaf *leaf, *lcopy;
+	int i;
+
+	if (mpEvacuating(trie->pool, node)) {
+		copy = (WideTrieTreeNode *) mpAlloc(trie->pool, trie->nodeSize);
+		if (copy == NULL)
+			return NULL;
+		memcpy(copy, node, trie->nodeSize);
+
+		// Readers still in the old node see it as it was.
+		AtomicSet(rover, copy);
+		node = copy;
+	}
+
+	// The leaves go right after their node, its own leaf first.
+	leaf = node->leaf;
+	if (leaf != NULL) {
+		if (mpEvacuating(trie->pool, leaf)) {
+			lcopy = _wttMoveLeaf(trie, leaf);
+			if (lcopy == NULL)
+				return NULL;
+			AtomicSet(&node->leaf, lcopy);
+			if (lcopy->data != NULL)
+				moved(ctx, _wttKey(trie, tc, depth, -1), &leaf->data, &lcopy->data);
+			leaf = lcopy;
+		}
+		if (_wttMoveValue(trie, leaf) != 0)
+			return NULL;
+	}
+
+	for (i = 0; i < trie->fanOut; i++) {
+		if (node->next[i] != NULL && WTT_IS_LEAF(node->next[i])) {
+			if (_wttMoveSlot(trie, &node->next[i], tc, depth, i, moved, ctx) != 0)
+				return NULL;
+		}
+	}
+
+	return node;
+}
+
+/*
+ * Function wttCompact is attCompact() for a WideTrieTree, the leaves
+ * of a node are moved with it.
+ */
+int wttCompact(WideTrieTree *trie, TrieCursor_t *tc, int budget, TrieMovedFn_t moved, void *ctx) {
+	WideTrieTreeNode **rover = &trie->root;
+	WideTrieTreeNode *node, *child;
+	int depth, i;
+
+	if (_wideTrieTreeInit == 0) {
+		pErr("Must call wttInit() first.\n");
+		return -1;
+	}
+
+	for (depth = 0; depth < tc->len && *rover != NULL && WTT_IS_LEAF(*rover) == 0; depth++) {
+		tc->path[depth] = *rover;
+		rover = &(*rover)->next[tc->idx[depth]];
+	}
+
+	for (;;) {
+		node = *rover;
+		if (node != NULL && WTT_IS_LEAF(node)) {
+			// A node that went after the walk passed its parent left
+			// its leaf in the slot.
+			if (_wttMoveSlot(trie, rover, tc, depth - 1, tc->idx[depth - 1], moved, ctx) != 0) {
+				tc->len = depth;
+				return -1;
+			}
+		} else if (node != NULL) {
+			if (budget-- <= 0)
+				break;
+			if (_trieCursorGrow(tc, depth + 1, (depth + 1) * trie->stride) != 0) {
+				tc->len = depth;
+				return -1;
+			}
+			node = _wttMove(trie, rover, tc, depth, moved, ctx);
+			if (node == NULL) {
+				tc->len = depth;
+				return -1;
+			}
+			tc->path[depth] = node;
+
+			for (i = 0; i < trie->fanOut; i++) {
+				child = node->next[i];
+				if (child != NULL && WTT_IS_LEAF(child) == 0)
+					break;
+			}
+			if (i < trie->fanOut) {
+				tc->idx[depth++] = i;
+				rover = &node->next[i];
+				continue;
+			}
+		}
+
+		// On to the next child node of the nearest level that has one.
+		for (;;) {
+			if (depth == 0) {
+				tc->len = 0;
+				return 0;
+			}
+			node = (WideTrieTreeNode *) tc->path[depth - 1];
+			for (i = tc->idx[depth - 1] + 1; i < trie->fanOut; i++) {
+				child = node->next[i];
+				if (child != NULL && WTT_IS_LEAF(child) == 0)
+					break;
+			}
+			if (i < trie->fanOut)
+				break;
+			depth--;
+		}
+		tc->idx[depth - 1] = i;
+		rover = &node->next[i];
+	}
+
+	tc->len = depth;
+
+	return 1;
+}
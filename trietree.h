@@ -28,6 +28,32 @@
 
 #include <sys/types.h>
 #include "memdbc.h"
+#include "mempool.h"
+
+// Lookups LookupMany() keeps going at once, enough to cover the memory
+// latency with a few misses in flight.
+#define TRIE_GROUP	16
+
+// Most key digits a WideTrieTree level can take, a 256 way hex node is
+// the biggest that fits a pool size class.
+#define TRIE_MAX_STRIDE	2
+
+// Where a compaction of a trie is up to, the child taken at each level
+// from the root to the next node to visit.  Zeroed to start at the root,
+// freed with trieCursorFree().
+typedef struct _trieCursor {
+	int *idx;
+	void **path;		// node at each level, only good during one call.
+	int len;			// levels in idx.
+	int size;			// room in idx and path.
+	char *key;			// key handed to TrieMovedFn_t.
+	int keySize;
+} TrieCursor_t;
+
+// Called by the compactions for a key whose data pointer moved from old to ref.
+typedef void (*TrieMovedFn_t)(void *ctx, char *key, void **old, void **ref);
+
+void trieCursorFree(TrieCursor_t *tc);
 
 #ifndef TRIE_NULL
 #define TRIE_NULL ((void *) 0)
@@ -39,19 +65,25 @@ typedef struct _asciiTrieTreeNode {
 	void *data;
 	unsigned int useCount;
 	unsigned short inUse;
+	unsigned short slot;		// 1 if val[] is there.
 	struct _asciiTrieTreeNode *next[95];
+	MpValSlot_t val[];		// short values, only nodes made as the end of a key.
 } AsciiTrieTreeNode;
 
 typedef struct _asciiTrieTree {
 	AsciiTrieTreeNode *root;
+	MemPool_t *pool;		// nodes and values are allocated from here.
 } AsciiTrieTree;
 
-AsciiTrieTree *attInit();
+AsciiTrieTree *attInit(MemPool_t *pool);
 AsciiTrieTreeNode *attFindEnd(AsciiTrieTree *trie, char *key);
-int attInsert(AsciiTrieTree *trie, char *key, void *value, int valueLen);
+int attInsert(AsciiTrieTree *trie, char *key, void *value, int valueLen, void ***dataRef);
+int attAppend(AsciiTrieTree *trie, AsciiTrieTreeNode **path, int depth, char *key, void *value, int valueLen, void ***dataRef);
 int attDelete(AsciiTrieTree *trie, char *key);
 void *attLookup(AsciiTrieTree *trie, char *key);
+int attLookupMany(AsciiTrieTree *trie, char **keys, int n, void **out);
 int attNumEntries(AsciiTrieTree *trie);
+int attCompact(AsciiTrieTree *trie, TrieCursor_t *tc, int budget, TrieMovedFn_t moved, void *ctx);
 
 // The *next array on a 64bit system is 80 bytes in size,
 // cause on 64bit systems pointers are 8 bytes long.
@@ -59,19 +91,25 @@ typedef struct _digitalTrieTreeNode {
 	void *data;
 	unsigned int useCount;
 	unsigned short inUse;
+	unsigned short slot;		// 1 if val[] is there.
 	struct _digitalTrieTreeNode *next[10];
+	MpValSlot_t val[];		// short values, only nodes made as the end of a key.
 } DigitalTrieTreeNode;
 
 typedef struct _digitalTrieTree {
 	DigitalTrieTreeNode *root;
+	MemPool_t *pool;		// nodes and values are allocated from here.
 } DigitalTrieTree;
 
-DigitalTrieTree *dttInit();
+DigitalTrieTree *dttInit(MemPool_t *pool);
 DigitalTrieTreeNode *dttFindEnd(DigitalTrieTree *trie, char *key);
-int dttInsert(DigitalTrieTree *trie, char *key, void *value, int valueLen);
+int dttInsert(DigitalTrieTree *trie, char *key, void *value, int valueLen, void ***dataRef);
+int dttAppend(DigitalTrieTree *trie, DigitalTrieTreeNode **path, int depth, char *key, void *value, int valueLen, void ***dataRef);
 int dttDelete(DigitalTrieTree *trie, char *key);
 void *dttLookup(DigitalTrieTree *trie, char *key);
+int dttLookupMany(DigitalTrieTree *trie, char **keys, int n, void **out);
 int dttNumEntries(DigitalTrieTree *trie);
+int dttCompact(DigitalTrieTree *trie, TrieCursor_t *tc, int budget, TrieMovedFn_t moved, void *ctx);
 
 // The *next array on a 64bit system is 128 bytes in size,
 // cause on 64bit systems pointers are 8 bytes long.
@@ -79,19 +117,25 @@ typedef struct _hexTrieTreeNode {
 	void *data;
 	unsigned int useCount;
 	unsigned short inUse;
+	unsigned short slot;		// 1 if val[] is there.
 	struct _hexTrieTreeNode *next[16];
+	MpValSlot_t val[];		// short values, only nodes made as the end of a key.
 } HexTrieTreeNode;
 
 typedef struct _hexTrieTree {
 	HexTrieTreeNode *root;
+	MemPool_t *pool;		// nodes and values are allocated from here.
 } HexTrieTree;
 
-HexTrieTree *httInit();
+HexTrieTree *httInit(MemPool_t *pool);
 HexTrieTreeNode *httFindEnd(HexTrieTree *trie, char *key);
-int httInsert(HexTrieTree *trie, char *key, void *value, int valueLen);
+int httInsert(HexTrieTree *trie, char *key, void *value, int valueLen, void ***dataRef);
+int httAppend(HexTrieTree *trie, HexTrieTreeNode **path, int depth, char *key, void *value, int valueLen, void ***dataRef);
 int httDelete(HexTrieTree *trie, char *key);
 void *httLookup(HexTrieTree *trie, char *key);
+int httLookupMany(HexTrieTree *trie, char **keys, int n, void **out);
 int httNumEntries(HexTrieTree *trie);
+int httCompact(HexTrieTree *trie, TrieCursor_t *tc, int budget, TrieMovedFn_t moved, void *ctx);
 
 // The *next array on a 64bit system is 64 bytes in size,
 // cause on 64bit systems pointers are 8 bytes long.
@@ -99,20 +143,72 @@ typedef struct _octalTrieTreeNode {
 	void *data;
 	unsigned int useCount;
 	unsigned short inUse;
+	unsigned short slot;		// 1 if val[] is there.
 	struct _octalTrieTreeNode *next[8];
+	MpValSlot_t val[];		// short values, only nodes made as the end of a key.
 } OctalTrieTreeNode;
 
 typedef struct _octalTrieTree {
 	OctalTrieTreeNode *root;
+	MemPool_t *pool;		// nodes and values are allocated from here.
 } OctalTrieTree;
 
-OctalTrieTree *ottInit();
+OctalTrieTree *ottInit(MemPool_t *pool);
 OctalTrieTreeNode *ottFindEnd(OctalTrieTree *trie, char *key);
-int ottInsert(OctalTrieTree *trie, char *key, void *value, int valueLen);
+int ottInsert(OctalTrieTree *trie, char *key, void *value, int valueLen, void ***dataRef);
+int ottAppend(OctalTrieTree *trie, OctalTrieTreeNode **path, int depth, char *key, void *value, int valueLen, void ***dataRef);
 int ottDelete(OctalTrieTree *trie, char *key);
 void *ottLookup(OctalTrieTree *trie, char *key);
+int ottLookupMany(OctalTrieTree *trie, char **keys, int n, void **out);
 int ottNumEntries(OctalTrieTree *trie);
+int ottCompact(OctalTrieTree *trie, TrieCursor_t *tc, int budget, TrieMovedFn_t moved, void *ctx);
+
+// Trie of HEX_DB or OCTAL_DB keys that takes stride digits per level,
+// two hex digits make a 256 way node.  next[] holds a child for each
+// run of stride digits and after them one for each shorter run, those
+// are the last digits of a key whose length is not a multiple of the
+// stride.  The number of children is fixed by wttInit().
+// A key ends in a small leaf, not a node, so the wide nodes are only
+// made for the levels keys go through.  A child slot holds a node or a
+// leaf tagged with the low bit.  When a longer key goes through a leaf
+// a node is put in its slot that keeps the leaf, and the leaf goes back
+// in the slot when the node is retired.  A leaf is counted like a node,
+// 1 for its key and 1 for each writer holding it, and is freed when its
+// count reaches 0.
+typedef struct _wideTrieTreeLeaf {
+	void *data;
+	unsigned int useCount;
+	MpValSlot_t val;		// short values are kept here.
+} WideTrieTreeLeaf;
 
+typedef struct _wideTrieTreeNode {
+	WideTrieTreeLeaf *leaf;		// key that ends at this node or NULL.
+	unsigned int useCount;
+	unsigned int pad;
+	struct _wideTrieTreeNode *next[];
+} WideTrieTreeNode;
+
+typedef struct _wideTrieTree {
+	WideTrieTreeNode *root;
+	MemPool_t *pool;		// nodes and values are allocated from here.
+	DbTypes_t dbType;
+	int stride;				// key digits per level.
+	int radix;				// children of one digit.
+	int fanOut;				// entries in next[].
+	int base[TRIE_MAX_STRIDE + 1];	// first child of a run of i digits.
+	size_t nodeSize;
+} WideTrieTree;
+
+size_t wttNodeSize(DbTypes_t dbType, int stride);
+WideTrieTree *wttInit(MemPool_t *pool, DbTypes_t dbType, int stride);
+WideTrieTreeLeaf *wttFindEnd(WideTrieTree *trie, char *key);
+int wttInsert(WideTrieTree *trie, char *key, void *value, int valueLen, void ***dataRef);
+int wttAppend(WideTrieTree *trie, WideTrieTreeNode **path, int depth, char *key, void *value, int valueLen, void ***dataRef);
+int wttDelete(WideTrieTree *trie, char *key);
+void *wttLookup(WideTrieTree *trie, char *key);
+int wttLookupMany(WideTrieTree *trie, char **keys, int n, void **out);
+int wttNumEntries(WideTrieTree *trie);
+int wttCompact(WideTrieTree *trie, TrieCursor_t *tc, int budget, TrieMovedFn_t moved, void *ctx);
 
 
 #endif /* _TRIETREE_H_ */
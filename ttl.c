@@ -0,0 +1,579 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "ttl.h"
+
+/*
+ * Function _ttlMs is private to this file.
+ * Returns CLOCK_MONOTONIC in milliseconds.
+ */
+static uint64_t _ttlMs() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Function _ttlFind is private to this file.
+ * Returns the link that points at the entry of key, or at the NULL
+ * ending its chain if there is none.  tableLock or lock is held.
+ */
+static TtlEntry_t **_ttlFind(Ttl_t *ttl, TtlStripe_t *s, char *key, unsigned int hash) {
+	TtlEntry_t **link;
+
+	if (s->numBuckets == 0)
+		return NULL;
+
+	link = &s->buckets[(hash / TTL_STRIPES) & (s->numBuckets - 1)];
+	for (; *link != NULL; link = &(*link)->next) {
+		if ((*link)->hash != hash)
+			continue;
+		if ((ttl->foldCase ? strcasecmp((*link)->key, key) : strcmp((*link)->key, key)) == 0)
+			break;
+	}
+
+	return link;
+}
+
+/*
+ * Function _ttlGrow is private to this file.
+ * Doubles the buckets of a stripe, tableLock is held.
+ */
+static int _ttlGrow(TtlStripe_t *s) {
+	size_t n = (s->numBuckets == 0) ? 16 : s->numBuckets * 2;
+	TtlEntry_t **buckets, *e, *next;
+	size_t i, b;
+
+	buckets = (TtlEntry_t **)calloc(n, sizeof(TtlEntry_t *));
+	if (buckets == NULL)
+		return -1;
+
+	for (i = 0; i < s->numBuckets; i++) {
+		for (e = s->buckets[i]; e != NULL; e = next) {
+			next = e->next;
+			b = (e->hash / TTL_STRIPES) & (n - 1);
+			e->next = buckets[b];
+			buckets[b] = e;
+		}
+	}
+
+	free(s->buckets);
+	AtomicAdd(&s->bytes, (n - s->numBuckets) * sizeof(TtlEntry_t *));
+	s->buckets = buckets;
+	s->numBuckets = n;
+
+	return 0;
+}
+
+/*
+ * Function _ttlPlace is private to this file.
+ * Puts an entry in the wheel slot for its expiry time.  The level is the
+ * lowest one whose run of slots takes in both now and the expiry time.
+ * One a whole turn of the top level or more away goes in the top level
+ * slot that comes round last and is placed again when it does.
+ */
+static void _ttlPlace(TtlStripe_t *s, TtlEntry_t *e) {
+	uint64_t x = (e->expires < s->now) ? s->now : e->expires;
+	TtlEntry_t **head;
+	int k, shift;
+
+	for (k = 0; k < TTL_LEVELS - 1; k++) {
+		shift = TTL_BITS * (k + 1);
+		if ((x >> shift) == (s->now >> shift))
+			break;
+	}
+
+	e->level = k;
+	shift = TTL_BITS * k;
+	if ((x >> shift) - (s->now >> shift) >= TTL_SLOTS)
+		e->slot = ((s->now >> shift) - 1) & TTL_MASK;
+	else
+		e->slot = (x >> shift) & TTL_MASK;
+
+	head = &s->slots[e->level][e->slot];
+	e->slotNext = *head;
+	if (*head != NULL)
+		(*head)->slotPrev = &e->slotNext;
+	*head = e;
+	e->slotPrev = head;
+	s->occupied[e->level] |= 1ULL << e->slot;
+}
+
+/*
+ * Function _ttlUnlink is private to this file.
+ * Takes an entry out of its wheel slot.
+ */
+static void _ttlUnlink(TtlStripe_t *s, TtlEntry_t *e) {
+
+	*e->slotPrev = e->slotNext;
+	if (e->slotNext != NULL)
+		e->slotNext->slotPrev = e->slotPrev;
+	if (s->slots[e->level][e->slot] == NULL)
+		s->occupied[e->level] &= ~(1ULL << e->slot);
+}
+
+/*
+ * Function _ttlRemove is private to this file.
+ * Takes an entry out of the wheel and the table, the caller frees it.
+ */
+static void _ttlRemove(Ttl_t *ttl, TtlStripe_t *s, TtlEntry_t *e) {
+	TtlEntry_t **link;
+
+	_ttlUnlink(s, e);
+
+	pthread_spin_lock(&s->tableLock);
+	link = _ttlFind(ttl, s, e->key, e->hash);
+	*link = e->next;
+	s->count--;
+	AtomicSub(&s->bytes, sizeof(TtlEntry_t) + strlen(e->key) + 1);
+	pthread_spin_unlock(&s->tableLock);
+}
+
+/*
+ * Function _ttlCascade is private to this file.
+ * At a tick that starts slots of the higher levels, puts their entries
+ * back in the levels below, the highest level first.
+ */
+static void _ttlCascade(TtlStripe_t *s, uint64_t t) {
+	TtlEntry_t *list, *e;
+	int top, k, slot;
+
+	for (top = 0; top < TTL_LEVELS - 1; top++) {
+		if ((t & ((1ULL << (TTL_BITS * (top + 1))) - 1)) != 0)
+			break;
+	}
+
+	for (k = top; k > 0; k--) {
+		slot = (t >> (TTL_BITS * k)) & TTL_MASK;
+		list = s->slots[k][slot];
+		s->slots[k][slot] = NULL;
+		s->occupied[k] &= ~(1ULL << slot);
+
+		while (list != NULL) {
+			e = list;
+			list = e->slotNext;
+			_ttlPlace(s, e);
+		}
+	}
+}
+
+/*
+ * Function _ttlNext is private to this file.
+ * Returns the first tick after t with a slot that is not empty, level 0
+ * slots and the starts of higher level ones.  Without any it is the
+ * start of the next run of the top level.
+ */
+static uint64_t _ttlNext(TtlStripe_t *s, uint64_t t) {
+	uint64_t bits;
+	int k, shift, idx;
+
+	for (k = 0; k < TTL_LEVELS; k++) {
+		shift = TTL_BITS * k;
+		idx = (t >> shift) & TTL_MASK;
+		bits = (idx == TTL_MASK) ? 0 : s->occupied[k] & (~0ULL << (idx + 1));
+		if (bits != 0)
+			return ((t >> (shift + TTL_BITS)) << (shift + TTL_BITS)) + ((uint64_t)__builtin_ctzll(bits) << shift);
+	}
+
+	return ((t >> (TTL_BITS * TTL_LEVELS)) + 1) << (TTL_BITS * TTL_LEVELS);
+}
+
+/*
+ * Function _ttlAdvanceStripe is private to this file.
+ * Expires up to max keys of a stripe due by tick target, lock is held.
+ * Returns the number expired, if it is max the stripe may have more.
+ */
+static int _ttlAdvanceStripe(Ttl_t *ttl, TtlStripe_t *s, uint64_t target, int max, TtlExpireFn_t fn, void *ctx) {
+	TtlEntry_t *e;
+	uint64_t t, next;
+	int n = 0;
+
+	while (s->now <= target) {
+		t = s->now;
+
+		// An empty wheel can be at any time.
+		if (s->count == 0) {
+			s->now = target + 1;
+			break;
+		}
+
+		// Done again if a call stops in this tick, the slots are empty then.
+		if ((t & TTL_MASK) == 0)
+			_ttlCascade(s, t);
+
+		while ((e = s->slots[0][t & TTL_MASK]) != NULL) {
+			if (n >= max)
+				return n;
+			_ttlRemove(ttl, s, e);
+			fn(ctx, e->key);
+			free(e);
+			n++;
+		}
+
+		next = _ttlNext(s, t);
+		s->now = (next > target) ? target + 1 : next;
+	}
+
+	return n;
+}
+
+/*
+ * Function _ttlThread is private to this file.
+ * Expires keys every TTL_SWEEP_MS until ttlStop().
+ */
+static void *_ttlThread(void *arg) {
+	Ttl_t *ttl = (Ttl_t *)arg;
+	struct timespec ts;
+
+	pthread_mutex_lock(&ttl->lock);
+
+	while (ttl->stop == 0) {
+		pthread_mutex_unlock(&ttl->lock);
+		ttlAdvance(ttl, 0, ttl->fn, ttl->ctx);
+		pthread_mutex_lock(&ttl->lock);
+
+		if (ttl->stop != 0)
+			break;
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += TTL_SWEEP_MS * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&ttl->cond, &ttl->lock, &ts);
+	}
+
+	pthread_mutex_unlock(&ttl->lock);
+
+	return NULL;
+}
+
+/*
+ * Function ttlInit returns an empty set of expiry times for keys of
+ * dbType, HEX_DB keys match in either case.
+ */
+Ttl_t *ttlInit(DbTypes_t dbType) {
+	Ttl_t *ttl;
+	int i;
+
+	// Stripes are cache line aligned so their locks do not share lines.
+	if (posix_memalign((void **)&ttl, 64, sizeof(Ttl_t)) != 0) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+	memset(ttl, 0, sizeof(Ttl_t));
+
+	ttl->start = _ttlMs();
+	ttl->foldCase = (dbType == HEX_DB);
+	pthread_mutex_init(&ttl->lock, NULL);
+	pthread_cond_init(&ttl->cond, NULL);
+
+	for (i = 0; i < TTL_STRIPES; i++) {
+		pthread_mutex_init(&ttl->stripes[i].lock, NULL);
+		pthread_spin_init(&ttl->stripes[i].tableLock, PTHREAD_PROCESS_PRIVATE);
+	}
+
+	return ttl;
+}
+
+/*
+ * Function ttlFree stops the sweep thread and frees every entry.
+ */
+void ttlFree(Ttl_t *ttl) {
+	TtlStripe_t *s;
+	TtlEntry_t *e, *next;
+	size_t b;
+	int i;
+
+	if (ttl == NULL)
+		return;
+
+	ttlStop(ttl);
+
+	for (i = 0; i < TTL_STRIPES; i++) {
+		s = &ttl->stripes[i];
+		for (b = 0; b < s->numBuckets; b++) {
+			for (e = s->buckets[b]; e != NULL; e = next) {
+				next = e->next;
+				free(e);
+			}
+		}
+		free(s->buckets);
+		pthread_mutex_destroy(&s->lock);
+		pthread_spin_destroy(&s->tableLock);
+	}
+
+	pthread_mutex_destroy(&ttl->lock);
+	pthread_cond_destroy(&ttl->cond);
+	free(ttl);
+}
+
+/*
+ * Function ttlBytes returns the bytes of entries and tables allocated.
+ */
+size_t ttlBytes(Ttl_t *ttl) {
+	size_t n = 0;
+	int i;
+
+	for (i = 0; i < TTL_STRIPES; i++)
+		n += AtomicGet(&ttl->stripes[i].bytes);
+
+	return n;
+}
+
+/*
+ * Function ttlNow returns the current tick.
+ */
+uint64_t ttlNow(Ttl_t *ttl) {
+
+	return _ttlMs() - ttl->start;
+}
+
+/*
+ * Function ttlWallNow returns CLOCK_REALTIME in milliseconds.  Ticks mean
+ * nothing to another process, expiry times are logged and saved in this.
+ */
+uint64_t ttlWallNow(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Function ttlToWall returns tick as a ttlWallNow() time.
+ */
+uint64_t ttlToWall(Ttl_t *ttl, uint64_t tick) {
+
+	return ttlWallNow() + tick - ttlNow(ttl);
+}
+
+/*
+ * Function ttlFromWall returns the tick of a ttlWallNow() time, or the
+ * current tick if it has passed.
+ */
+uint64_t ttlFromWall(Ttl_t *ttl, uint64_t wall) {
+	uint64_t now = ttlWallNow();
+
+	return ttlNow(ttl) + ((wall > now) ? wall - now : 0);
+}
+
+/*
+ * Function ttlStripe returns the stripe of a key's hash, its lock is
+ * held over ttlSet() and ttlClear().
+ */
+TtlStripe_t *ttlStripe(Ttl_t *ttl, unsigned int hash) {
+
+	return &ttl->stripes[hash % TTL_STRIPES];
+}
+
+/*
+ * Function ttlSet sets the tick a key expires at, the key is copied.
+ * Returns 0 or -1 if out of memory.
+ */
+int ttlSet(Ttl_t *ttl, char *key, unsigned int hash, uint64_t expires) {
+	TtlStripe_t *s = ttlStripe(ttl, hash);
+	TtlEntry_t **link, *e;
+	size_t len;
+
+	link = _ttlFind(ttl, s, key, hash);
+	if (link != NULL && *link != NULL) {
+		e = *link;
+		_ttlUnlink(s, e);
+		pthread_spin_lock(&s->tableLock);
+		e->expires = expires;
+		pthread_spin_unlock(&s->tableLock);
+		_ttlPlace(s, e);
+		return 0;
+	}
+
+	len = strlen(key);
+	e = (TtlEntry_t *)malloc(sizeof(TtlEntry_t) + len + 1);
+	if (e == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+	memcpy(e->key, key, len + 1);
+	e->hash = hash;
+	e->expires = expires;
+
+	pthread_spin_lock(&s->tableLock);
+	if (s->count >= s->numBuckets && _ttlGrow(s) < 0 && s->numBuckets == 0) {
+		pthread_spin_unlock(&s->tableLock);
+		free(e);
+		memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+	link = &s->buckets[(hash / TTL_STRIPES) & (s->numBuckets - 1)];
+	e->next = *link;
+	*link = e;
+	s->count++;
+	AtomicAdd(&s->bytes, sizeof(TtlEntry_t) + len + 1);
+	pthread_spin_unlock(&s->tableLock);
+
+	_ttlPlace(s, e);
+
+	return 0;
+}
+
+/*
+ * Function ttlClear removes a key's expiry time.
+ * Returns 1 if it had one, else 0.
+ */
+int ttlClear(Ttl_t *ttl, char *key, unsigned int hash) {
+	TtlStripe_t *s = ttlStripe(ttl, hash);
+	TtlEntry_t **link, *e;
+
+	link = _ttlFind(ttl, s, key, hash);
+	if (link == NULL || *link == NULL)
+		return 0;
+
+	e = *link;
+	_ttlRemove(ttl, s, e);
+	free(e);
+
+	return 1;
+}
+
+/*
+ * Function ttlGet sets expires to the tick a key expires at, the stripe
+ * lock need not be held.  Returns 1 if it has one, else 0.
+ */
+int ttlGet(Ttl_t *ttl, char *key, unsigned int hash, uint64_t *expires) {
+	TtlStripe_t *s = ttlStripe(ttl, hash);
+	TtlEntry_t **link;
+	int r = 0;
+
+	pthread_spin_lock(&s->tableLock);
+	link = _ttlFind(ttl, s, key, hash);
+	if (link != NULL && *link != NULL) {
+		*expires = (*link)->expires;
+		r = 1;
+	}
+	pthread_spin_unlock(&s->tableLock);
+
+	return r;
+}
+
+/*
+ * Function ttlHold takes every table lock, so a process forked while they
+ * are held sees whole tables.  Both processes call ttlRelease() after.
+ */
+void ttlHold(Ttl_t *ttl) {
+	int i;
+
+	for (i = 0; i < TTL_STRIPES; i++)
+		pthread_spin_lock(&ttl->stripes[i].tableLock);
+}
+
+/*
+ * Function ttlRelease lets go of the locks taken by ttlHold().
+ */
+void ttlRelease(Ttl_t *ttl) {
+	int i;
+
+	for (i = TTL_STRIPES - 1; i >= 0; i--)
+		pthread_spin_unlock(&ttl->stripes[i].tableLock);
+}
+
+/*
+ * Function ttlAdvance calls fn for up to max keys whose time has come,
+ * or all of them if max is 0, and forgets them.  A stripe lock is let
+ * go every TTL_BATCH keys.  Returns the number expired.
+ */
+int ttlAdvance(Ttl_t *ttl, int max, TtlExpireFn_t fn, void *ctx) {
+	uint64_t target = ttlNow(ttl);
+	unsigned int first = AtomicFetchAdd(&ttl->next, 1);
+	TtlStripe_t *s;
+	int i, n = 0, r, batch;
+
+	// Each call starts at another stripe so a small max reaches them all.
+	for (i = 0; i < TTL_STRIPES; i++) {
+		s = &ttl->stripes[(first + i) % TTL_STRIPES];
+		do {
+			batch = TTL_BATCH;
+			if (max > 0 && max - n < batch)
+				batch = max - n;
+
+			pthread_mutex_lock(&s->lock);
+			r = _ttlAdvanceStripe(ttl, s, target, batch, fn, ctx);
+			pthread_mutex_unlock(&s->lock);
+
+			n += r;
+			if (max > 0 && n >= max)
+				return n;
+		} while (r == batch);
+	}
+
+	return n;
+}
+
+/*
+ * Function ttlStart starts a thread that calls ttlAdvance() with fn
+ * every TTL_SWEEP_MS.  Returns 0 or -1.
+ */
+int ttlStart(Ttl_t *ttl, TtlExpireFn_t fn, void *ctx) {
+
+	if (ttl->running)
+		return 0;
+
+	ttl->fn = fn;
+	ttl->ctx = ctx;
+	ttl->stop = 0;
+	if (pthread_create(&ttl->thread, NULL, _ttlThread, ttl) != 0) {
+		memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+	ttl->running = 1;
+
+	return 0;
+}
+
+/*
+ * Function ttlStop stops the thread started by ttlStart().
+ */
+void ttlStop(Ttl_t *ttl) {
+
+	if (ttl->running == 0)
+		return;
+
+	pthread_mutex_lock(&ttl->lock);
+	ttl->stop = 1;
+	pthread_cond_signal(&ttl->cond);
+	pthread_mutex_unlock(&ttl->lock);
+
+	pthread_join(ttl->thread, NULL);
+	ttl->running = 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+#ifndef _TTL_H_
+#define _TTL_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "memdbc.h"
+
+// Record expiry.  Each key with a time to live has an entry in a hash
+// table, for memDbcFind(), and in a hierarchical timing wheel, so the
+// keys whose time has come are found without looking at the others.
+// Times are in ticks of a millisecond since ttlInit().
+//
+// The wheel has TTL_LEVELS levels of TTL_SLOTS slots, level k slot i
+// holds the entries due in the i'th run of 64^k ticks of the current
+// 64^(k+1).  As time reaches a slot of a higher level its entries are
+// put back in the lower levels, an entry moves at most TTL_LEVELS times.
+// A bit per slot that is not empty lets ttlAdvance() skip idle ticks.
+// Keys are spread over TTL_STRIPES stripes, each with its own lock,
+// table and wheel.
+#define TTL_BITS		6
+#define TTL_SLOTS		(1 << TTL_BITS)
+#define TTL_MASK		(TTL_SLOTS - 1)
+#define TTL_LEVELS		6			// 2^36 ms, about two years.
+#define TTL_STRIPES		64
+
+// How often the thread started by ttlStart() removes expired keys.
+#define TTL_SWEEP_MS	10
+// Keys a stripe expires before its lock is let go, so writers get in.
+#define TTL_BATCH		256
+
+typedef struct _ttlEntry {
+	struct _ttlEntry *next;			// hash chain.
+	struct _ttlEntry *slotNext;		// wheel slot list.
+	struct _ttlEntry **slotPrev;	// what points at this entry.
+	uint64_t expires;				// tick the key is removed at.
+	unsigned int hash;
+	unsigned char level;
+	unsigned char slot;
+	char key[];
+} TtlEntry_t;
+
+// lock is held by the caller over a change to a key and its entry, and
+// by ttlAdvance() while it expires keys.  The table is also guarded by
+// tableLock, only held inside this file, so ttlGet() never waits for a
+// record to be changed.
+typedef struct _ttlStripe {
+	pthread_mutex_t lock;
+	pthread_spinlock_t tableLock;
+	TtlEntry_t **buckets;
+	size_t numBuckets;
+	size_t count;
+	size_t bytes;					// entries and buckets allocated.
+	uint64_t now;					// next tick to look at.
+	uint64_t occupied[TTL_LEVELS];	// a bit per slot with entries.
+	TtlEntry_t *slots[TTL_LEVELS][TTL_SLOTS];
+} __attribute__((aligned(64))) TtlStripe_t;
+
+// Called for each expired key with its stripe locked.
+typedef void (*TtlExpireFn_t)(void *ctx, char *key);
+
+typedef struct _ttl {
+	uint64_t start;					// CLOCK_MONOTONIC ms at tick 0.
+	int foldCase;					// HEX_DB keys are the same in either case.
+	unsigned int next;				// stripe ttlAdvance() starts at.
+	TtlExpireFn_t fn;				// for the sweep thread.
+	void *ctx;
+	pthread_t thread;
+	int running;
+	int stop;
+	pthread_mutex_t lock;			// guards stop.
+	pthread_cond_t cond;
+	TtlStripe_t stripes[TTL_STRIPES];
+} Ttl_t;
+
+Ttl_t *ttlInit(DbTypes_t dbType);
+void ttlFree(Ttl_t *ttl);
+size_t ttlBytes(Ttl_t *ttl);
+uint64_t ttlNow(Ttl_t *ttl);
+uint64_t ttlWallNow(void);
+uint64_t ttlToWall(Ttl_t *ttl, uint64_t tick);
+uint64_t ttlFromWall(Ttl_t *ttl, uint64_t wall);
+TtlStripe_t *ttlStripe(Ttl_t *ttl, unsigned int hash);
+int ttlSet(Ttl_t *ttl, char *key, unsigned int hash, uint64_t expires);
+int ttlClear(Ttl_t *ttl, char *key, unsigned int hash);
+int ttlGet(Ttl_t *ttl, char *key, unsigned int hash, uint64_t *expires);
+void ttlHold(Ttl_t *ttl);
+void ttlRelease(Ttl_t *ttl);
+int ttlAdvance(Ttl_t *ttl, int max, TtlExpireFn_t fn, void *ctx);
+int ttlStart(Ttl_t *ttl, TtlExpireFn_t fn, void *ctx);
+void ttlStop(Ttl_t *ttl);
+
+#endif /* _TTL_H_ */
@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "wal.h"
+
+/*
+ * Function _walWriteAll is private to this file.
+ * Writes len bytes, retrying short writes.
+ */
+static int _walWriteAll(int fd, const char *p, size_t len) {
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Function _walSyncDir is private to this file.
+ * Syncs the directory fileName is in, so a rename into it survives a crash.
+ */
+static int _walSyncDir(const char *fileName) {
+	const char *slash = strrchr(fileName, '/');
+	char *dir;
+	int fd, r;
+
+	if (slash == NULL)
+		dir = strdup(".");
+	else if (slash == fileName)
+		dir = strdup("/");
+	else
+		dir = strndup(fileName, slash - fileName);
+	if (dir == NULL)
+		return -1;
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+	free(dir);
+	if (fd < 0)
+		return -1;
+
+	r = fsync(fd);
+	close(fd);
+
+	return r;
+}
+
+/*
+ * Function _walReplay is private to this file.
+ * Calls apply for every good record and returns the offset just past
+ * the last one, or -1 if the file is not a log of dbType.
+ */
+static off_t _walReplay(FILE *in, off_t size, DbTypes_t dbType, WalApplyFn_t apply, void *ctx) {
+	off_t good = sizeof(WalHdr_t);
+	WalHdr_t hdr;
+	WalRec_t rec;
+	char *buf = NULL;
+	size_t bufSize = 0, n;
+	uint32_t crc;
+
+	if (fread(&hdr, sizeof(WalHdr_t), 1, in) != 1 ||
+			memcmp(hdr.magic, WAL_MAGIC, sizeof(hdr.magic)) != 0 ||
+			hdr.version != WAL_VERSION || hdr.dbType != dbType) {
+		memDbcErrorNum = FORMAT_ERR;
+		return -1;
+	}
+
+	while (fread(&rec, sizeof(WalRec_t), 1, in) == 1) {
+		// Lengths of a torn record can be anything.
+		if (good + sizeof(WalRec_t) + rec.keyLen + rec.valueLen > (uint64_t)size)
+			break;
+
+		n = (size_t)rec.keyLen + rec.valueLen + 1;
+		if (n > bufSize) {
+			char *p = (char *)realloc(buf, n);
+
+			if (p == NULL) {
+				memDbcErrorNum = MALLOC_ERR;
+				good = -1;
+				break;
+			}
+			buf = p;
+			bufSize = n;
+		}
+
+		// The key is kept apart from the value so it can be NUL terminated.
+		if (fread(buf, 1, rec.keyLen, in) != rec.keyLen ||
+				fread(buf + rec.keyLen + 1, 1, rec.valueLen, in) != rec.valueLen)
+			break;
+
+		crc = crc32(0, (const Bytef *)&rec.op, sizeof(WalRec_t) - sizeof(rec.crc));
+		crc = crc32(crc, (const Bytef *)buf, rec.keyLen);
+		crc = crc32(crc, (const Bytef *)buf + rec.keyLen + 1, rec.valueLen);
+		if (crc != rec.crc || rec.op < WAL_ADD || rec.op > WAL_EXPIRE)
+			break;
+		buf[rec.keyLen] = '\0';
+
+		if (apply(ctx, rec.op, buf, buf + rec.keyLen + 1, rec.valueLen, rec.expires) < 0) {
+			good = -1;
+			break;
+		}
+
+		good += sizeof(WalRec_t) + rec.keyLen + rec.valueLen;
+	}
+
+	free(buf);
+
+	return good;
+}
+
+/*
+ * Function _walThread is private to this file.
+ * Writes out what writers have logged, one batch at a time.
+ */
+static void *_walThread(void *arg) {
+	Wal_t *wal = (Wal_t *)arg;
+	struct timespec ts;
+	uint64_t end;
+	size_t n;
+	char *p;
+	int rc;
+
+	pthread_mutex_lock(&wal->lock);
+
+	for (;;) {
+		while ((wal->used == 0 || wal->hold) && wal->stop == 0)
+			pthread_cond_wait(&wal->flushCond, &wal->lock);
+		if (wal->used == 0)
+			break;		// stopped with nothing left.
+
+		// Let more records gather unless a writer is waiting on the fsync.
+		if (wal->durability != WAL_SYNC && wal->stop == 0 && wal->used < wal->bufSize / 2) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += WAL_SYNC_MS * 1000000L;
+			if (ts.tv_nsec >= 1000000000L) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&wal->flushCond, &wal->lock, &ts);
+			if (wal->hold)
+				continue;
+		}
+
+		// Swap buffers so writers can go on logging during the write.
+		p = wal->out;
+		wal->out = wal->buf;
+		wal->buf = p;
+		n = wal->outSize;
+		wal->outSize = wal->bufSize;
+		wal->bufSize = n;
+
+		n = wal->used;
+		wal->used = 0;
+		end = wal->written;
+		pthread_cond_broadcast(&wal->doneCond);		// there is room again.
+
+		pthread_mutex_unlock(&wal->lock);
+
+		rc = _walWriteAll(wal->fd, wal->out, n);
+		if (rc == 0 && wal->durability != WAL_NO_SYNC)
+			rc = fdatasync(wal->fd);
+
+		pthread_mutex_lock(&wal->lock);
+		if (rc != 0)
+			wal->error = 1;
+		else
+			wal->durable = end;
+		pthread_cond_broadcast(&wal->doneCond);
+	}
+
+	pthread_mutex_unlock(&wal->lock);
+
+	return NULL;
+}
+
+/*
+ * Function walOpen opens or creates a log.  Records already in it are
+ * handed to apply, then the log thread is started.
+ */
+Wal_t *walOpen(char *fileName, DbTypes_t dbType, MemDbcDurability_t durability, WalApplyFn_t apply, void *ctx) {
+	Wal_t *wal;
+	WalHdr_t hdr;
+	struct stat st;
+	off_t good = 0;
+	FILE *in;
+	int i;
+
+	wal = (Wal_t *)calloc(1, sizeof(Wal_t));
+	if (wal == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return NULL;
+	}
+	wal->fd = -1;
+	wal->durability = durability;
+
+	wal->fileName = strdup(fileName);
+	wal->buf = (char *)malloc(WAL_BUF_SIZE);
+	wal->out = (char *)malloc(WAL_BUF_SIZE);
+	if (wal->fileName == NULL || wal->buf == NULL || wal->out == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		goto err;
+	}
+	wal->bufSize = WAL_BUF_SIZE;
+	wal->outSize = WAL_BUF_SIZE;
+
+	in = fopen(fileName, "r");
+	if (in != NULL && fstat(fileno(in), &st) == 0 && st.st_size > 0) {
+		good = _walReplay(in, st.st_size, dbType, apply, ctx);
+	}
+	if (in != NULL)
+		fclose(in);
+	if (good < 0)
+		goto err;
+
+	// Read as well, walTruncate() copies the end of the log.
+	wal->fd = open(fileName, O_RDWR | O_CREAT, 0644);
+	if (wal->fd < 0) {
+		memDbcErrorNum = FILE_ERR;
+		goto err;
+	}
+
+	if (good == 0) {
+		memset(&hdr, 0, sizeof(WalHdr_t));
+		memcpy(hdr.magic, WAL_MAGIC, sizeof(hdr.magic));
+		hdr.version = WAL_VERSION;
+		hdr.dbType = dbType;
+		good = sizeof(WalHdr_t);
+		if (ftruncate(wal->fd, 0) != 0 || _walWriteAll(wal->fd, (char *)&hdr, sizeof(WalHdr_t)) != 0) {
+			memDbcErrorNum = FILE_ERR;
+			goto err;
+		}
+	} else if (ftruncate(wal->fd, good) != 0 || lseek(wal->fd, good, SEEK_SET) != good) {
+		// Drop a record torn by a crash so new ones follow the last good one.
+		memDbcErrorNum = FILE_ERR;
+		goto err;
+	}
+	if (fsync(wal->fd) != 0) {
+		memDbcErrorNum = FILE_ERR;
+		goto err;
+	}
+	wal->written = good;
+	wal->durable = good;
+	wal->base = sizeof(WalHdr_t);
+
+	pthread_mutex_init(&wal->lock, NULL);
+	pthread_cond_init(&wal->flushCond, NULL);
+	pthread_cond_init(&wal->doneCond, NULL);
+	for (i = 0; i < WAL_STRIPES; i++)
+		pthread_mutex_init(&wal->stripes[i], NULL);
+
+	if (pthread_create(&wal->thread, NULL, _walThread, wal) != 0) {
+		memDbcErrorNum = MALLOC_ERR;
+		goto err;
+	}
+
+	return wal;
+
+err:
+	if (wal->fd >= 0)
+		close(wal->fd);
+	free(wal->fileName);
+	free(wal->buf);
+	free(wal->out);
+	free(wal);
+	return NULL;
+}
+
+/*
+ * Function walLog appends a record and returns the offset just past it
+ * to hand to walWait(), or 0 if the log has failed.
+ */
+uint64_t walLog(Wal_t *wal, int op, char *key, void *data, int len, uint64_t expires) {
+	WalRec_t rec;
+	size_t need;
+	uint64_t lsn;
+	char *p;
+
+	rec.op = op;
+	rec.keyLen = strlen(key);
+	rec.valueLen = (op == WAL_ADD) ? len : 0;
+	rec.expires = (op != WAL_DELETE) ? expires : 0;
+	rec.crc = crc32(0, (const Bytef *)&rec.op, sizeof(WalRec_t) - sizeof(rec.crc));
+	rec.crc = crc32(rec.crc, (const Bytef *)key, rec.keyLen);
+	if (rec.valueLen > 0)
+		rec.crc = crc32(rec.crc, (const Bytef *)data, rec.valueLen);
+
+	need = sizeof(WalRec_t) + rec.keyLen + rec.valueLen;
+
+	pthread_mutex_lock(&wal->lock);
+
+	// Wait for the log thread to take the buffer when it is full.
+	while (wal->used > 0 && wal->used + need > wal->bufSize && wal->error == 0) {
+		pthread_cond_signal(&wal->flushCond);
+		pthread_cond_wait(&wal->doneCond, &wal->lock);
+	}
+
+	if (wal->error == 0 && need > wal->bufSize) {
+		p = (char *)realloc(wal->buf, need);
+		if (p == NULL) {
+			memDbcErrorNum = MALLOC_ERR;
+			pthread_mutex_unlock(&wal->lock);
+			return 0;
+		}
+		wal->buf = p;
+		wal->bufSize = need;
+	}
+
+	if (wal->error != 0) {
+		memDbcErrorNum = FILE_ERR;
+		pthread_mutex_unlock(&wal->lock);
+		return 0;
+	}
+
+	p = wal->buf + wal->used;
+	memcpy(p, &rec, sizeof(WalRec_t));
+	memcpy(p + sizeof(WalRec_t), key, rec.keyLen);
+	if (rec.valueLen > 0)
+		memcpy(p + sizeof(WalRec_t) + rec.keyLen, data, rec.valueLen);
+
+	// The log thread only needs waking for the first record of a batch.
+	if (wal->used == 0 || wal->durability == WAL_SYNC || wal->used + need > wal->bufSize / 2)
+		pthread_cond_signal(&wal->flushCond);
+
+	wal->used += need;
+	wal->written += need;
+	lsn = wal->written;
+
+	pthread_mutex_unlock(&wal->lock);
+
+	return lsn;
+}
+
+/*
+ * Function walWait waits for the record ending at lsn to be on disk
+ * if the log is WAL_SYNC.  Returns 0 or -1 if the log has failed.
+ */
+int walWait(Wal_t *wal, uint64_t lsn) {
+	int r = 0;
+
+	if (wal->durability != WAL_SYNC)
+		return 0;
+
+	pthread_mutex_lock(&wal->lock);
+	while (wal->durable < lsn && wal->error == 0)
+		pthread_cond_wait(&wal->doneCond, &wal->lock);
+	if (wal->durable < lsn) {
+		memDbcErrorNum = FILE_ERR;
+		r = -1;
+	}
+	pthread_mutex_unlock(&wal->lock);
+
+	return r;
+}
+
+/*
+ * Function walSync waits until everything logged so far is on disk,
+ * whatever the durability of the log.
+ */
+int walSync(Wal_t *wal) {
+	uint64_t lsn;
+	int r = 0;
+
+	pthread_mutex_lock(&wal->lock);
+	lsn = wal->written;
+	pthread_cond_signal(&wal->flushCond);
+	while (wal->durable < lsn && wal->error == 0)
+		pthread_cond_wait(&wal->doneCond, &wal->lock);
+	if (wal->durable < lsn)
+		r = -1;
+	pthread_mutex_unlock(&wal->lock);
+
+	// WAL_NO_SYNC batches are written but not synced.
+	if (r == 0 && fdatasync(wal->fd) != 0)
+		r = -1;
+	if (r != 0)
+		memDbcErrorNum = FILE_ERR;
+
+	return r;
+}
+
+/*
+ * Function walLsn returns the lsn after the last record logged.
+ */
+uint64_t walLsn(Wal_t *wal) {
+	uint64_t lsn;
+
+	pthread_mutex_lock(&wal->lock);
+	lsn = wal->written;
+	pthread_mutex_unlock(&wal->lock);
+
+	return lsn;
+}
+
+/*
+ * Function walTruncate throws away the records before lsn, which must be
+ * one walLsn() returned.  The records after it are copied to a new file
+ * that replaces the log, writers wait for the log lock while they are.
+ */
+int walTruncate(Wal_t *wal, uint64_t lsn) {
+	char *tmpName;
+	WalHdr_t hdr;
+	off_t from, to;
+	ssize_t n;
+	int fd = -1, r = -1;
+
+	tmpName = (char *)malloc(strlen(wal->fileName) + 5);
+	if (tmpName == NULL) {
+		memDbcErrorNum = MALLOC_ERR;
+		return -1;
+	}
+	sprintf(tmpName, "%s.tmp", wal->fileName);
+
+	// Wait for lsn to be in the file, then hold the log thread and wait
+	// for the batch it is writing.  Records still in buf go to the new
+	// file once the thread is let go.
+	pthread_mutex_lock(&wal->lock);
+	while (wal->durable < lsn && wal->error == 0) {
+		pthread_cond_signal(&wal->flushCond);
+		pthread_cond_wait(&wal->doneCond, &wal->lock);
+	}
+	wal->hold = 1;
+	while (wal->durable + wal->used < wal->written && wal->error == 0)
+		pthread_cond_wait(&wal->doneCond, &wal->lock);
+	if (wal->error != 0 || lsn < wal->base || lsn > wal->durable)
+		goto out;
+
+	// The log thread waits for the lock, so its out buffer is free to
+	// copy through.
+	from = sizeof(WalHdr_t) + (lsn - wal->base);
+	to = sizeof(WalHdr_t) + (wal->durable - wal->base);
+
+	fd = open(tmpName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || pread(wal->fd, &hdr, sizeof(WalHdr_t), 0) != sizeof(WalHdr_t) ||
+			_walWriteAll(fd, (char *)&hdr, sizeof(WalHdr_t)) != 0)
+		goto out;
+
+	while (from < to) {
+		n = pread(wal->fd, wal->out, ((size_t)(to - from) < wal->outSize) ? (size_t)(to - from) : wal->outSize, from);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0 || _walWriteAll(fd, wal->out, n) != 0)
+			goto out;
+		from += n;
+	}
+
+	if (fsync(fd) != 0 || rename(tmpName, wal->fileName) != 0)
+		goto out;
+
+	// The new file is the log from here on, even if the directory sync fails.
+	close(wal->fd);
+	wal->fd = fd;
+	fd = -1;
+	wal->base = lsn;
+	r = _walSyncDir(wal->fileName);
+
+out:
+	if (fd >= 0) {
+		close(fd);
+		unlink(tmpName);
+	}
+	if (r != 0)
+		memDbcErrorNum = FILE_ERR;
+	wal->hold = 0;
+	pthread_cond_signal(&wal->flushCond);
+	pthread_mutex_unlock(&wal->lock);
+	free(tmpName);
+
+	return r;
+}
+
+/*
+ * Function walClose writes out and syncs what is left, stops the log
+ * thread and frees the log.  Returns 0 or -1 if anything was lost.
+ */
+int walClose(Wal_t *wal) {
+	int r;
+	int i;
+
+	pthread_mutex_lock(&wal->lock);
+	wal->stop = 1;
+	pthread_cond_signal(&wal->flushCond);
+	pthread_mutex_unlock(&wal->lock);
+
+	pthread_join(wal->thread, NULL);
+
+	r = (wal->error == 0 && fsync(wal->fd) == 0) ? 0 : -1;
+	if (r != 0)
+		memDbcErrorNum = FILE_ERR;
+
+	close(wal->fd);
+	free(wal->fileName);
+	pthread_mutex_destroy(&wal->lock);
+	pthread_cond_destroy(&wal->flushCond);
+	pthread_cond_destroy(&wal->doneCond);
+	for (i = 0; i < WAL_STRIPES; i++)
+		pthread_mutex_destroy(&wal->stripes[i]);
+	free(wal->buf);
+	free(wal->out);
+	free(wal);
+
+	return r;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2023 Richard Kelly Wiles (rkwiles@twc.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Kelly Wiles
+ */
+
+
+#ifndef _WAL_H_
+#define _WAL_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "memdbc.h"
+
+// Write ahead log.  Every add and delete is appended to a buffer, a
+// background thread writes the buffer out and fsyncs it, so writers that
+// arrive while an fsync is running share the next one (group commit).
+// Numbers are in host byte order.
+//
+//   WalHdr_t
+//   records, each:
+//       WalRec_t, key bytes, value bytes
+//
+// expires is when the record's time to live runs out in CLOCK_REALTIME
+// milliseconds, see ttlWallNow(), or 0 for none.  A WAL_EXPIRE record
+// sets or clears it for a key already there and has no value.
+//
+// A record's lsn is the log offset just past it.  Offsets count from the
+// log as first opened, they keep growing when walTruncate() drops the
+// front of the file.
+//
+// The crc of a record covers everything in it after the crc.  Replay
+// stops at the first short or damaged record and the log is cut there,
+// it is what a crash in the middle of a write leaves behind.
+#define WAL_MAGIC		"MEMDBCW1"
+#define WAL_VERSION		2
+
+#define WAL_ADD			1
+#define WAL_DELETE		2
+#define WAL_EXPIRE		3
+
+// Records are buffered up to this size before writers wait for the log thread.
+#define WAL_BUF_SIZE	(4 * 1024 * 1024)
+// How long the log thread gathers records before writing for WAL_ASYNC and WAL_NO_SYNC.
+#define WAL_SYNC_MS		10
+// Writes of keys in the same stripe are logged in the order they are made.
+#define WAL_STRIPES		64
+
+typedef struct _walHdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t dbType;
+} WalHdr_t;
+
+typedef struct _walRec {
+	uint32_t crc;
+	uint32_t op;
+	uint32_t keyLen;
+	uint32_t valueLen;
+	uint64_t expires;
+} WalRec_t;
+
+// Called for each record found by walOpen(), returns -1 to stop.
+typedef int (*WalApplyFn_t)(void *ctx, int op, char *key, void *data, int len, uint64_t expires);
+
+typedef struct _wal {
+	int fd;
+	char *fileName;
+	MemDbcDurability_t durability;
+	pthread_mutex_t lock;
+	pthread_cond_t flushCond;		// wakes the log thread.
+	pthread_cond_t doneCond;		// wakes writers when a batch is written.
+	char *buf;						// records not yet given to the log thread.
+	size_t bufSize;
+	size_t used;
+	char *out;						// batch being written by the log thread.
+	size_t outSize;
+	uint64_t written;				// lsn after the last record logged.
+	uint64_t durable;				// lsn up to which the log is on disk.
+	uint64_t base;					// lsn of the first record in the file.
+	int stop;
+	int hold;						// walTruncate() is swapping the file.
+	int error;
+	pthread_t thread;
+	pthread_mutex_t stripes[WAL_STRIPES];
+} Wal_t;
+
+Wal_t *walOpen(char *fileName, DbTypes_t dbType, MemDbcDurability_t durability, WalApplyFn_t apply, void *ctx);
+uint64_t walLog(Wal_t *wal, int op, char *key, void *data, int len, uint64_t expires);
+int walWait(Wal_t *wal, uint64_t lsn);
+int walSync(Wal_t *wal);
+uint64_t walLsn(Wal_t *wal);
+int walTruncate(Wal_t *wal, uint64_t lsn);
+int walClose(Wal_t *wal);
+
+#endif /* _WAL_H_ */